@@ -23,15 +23,23 @@ include $(CLEAR_VARS)
 
 NFC_PROTOCOL := nci
 
+# Build against the simulated controller in src/sim instead of libnfc-nci.
+NFCD_SIMULATOR ?= false
+
 LOCAL_SRC_FILES := \
     src/nfcd.cpp \
     src/NfcService.cpp \
+    src/NfcEventQueue.cpp \
     src/NfcIpcSocket.cpp \
+    src/NfcMessageDecoder.cpp \
+    src/NfcMessageEncoder.cpp \
     src/IpcSocketListener.cpp \
     src/NfcUtil.cpp \
     src/MessageHandler.cpp \
     src/SessionId.cpp \
     src/P2pLinkManager.cpp \
+    src/PresenceCheckScheduler.cpp \
+    src/WorkerPool.cpp \
     src/snep/SnepServer.cpp \
     src/snep/SnepClient.cpp \
     src/snep/SnepMessage.cpp \
@@ -43,6 +51,7 @@ NCI_SRC_FILES := \
     src/nci/NfcManager.cpp \
     src/nci/LlcpSocket.cpp \
     src/nci/LlcpServiceSocket.cpp \
+    src/nci/LlcpConnectionlessSocket.cpp \
     src/nci/P2pDevice.cpp \
     src/nci/NfcTagManager.cpp \
     src/nci/Mutex.cpp \
@@ -59,14 +68,28 @@ NCI_SRC_FILES := \
 INTERFACE_SRC_FILES := \
     src/interface/DeviceHost.cpp \
     src/interface/NdefMessage.cpp \
+    src/interface/NdefMessageView.cpp \
     src/interface/NdefRecord.cpp
 
+SIM_SRC_FILES := \
+    src/sim/SimController.cpp \
+    src/sim/SimNfa.cpp \
+    src/sim/SimScript.cpp
+
 ifeq ($(NFC_PROTOCOL),nci)
 LOCAL_SRC_FILES += $(NCI_SRC_FILES)
+ifeq ($(NFCD_SIMULATOR),true)
+LOCAL_SRC_FILES += $(SIM_SRC_FILES)
+endif
 endif
 
 LOCAL_SRC_FILES += $(INTERFACE_SRC_FILES)
 
+ifeq ($(NFCD_SIMULATOR),true)
+# Must come first so src/sim/NfcAdaptation.h shadows the libnfc-nci one.
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/src/sim
+endif
+
 LOCAL_C_INCLUDES += \
     $(LOCAL_PATH)/src \
     external/stlport/stlport \
@@ -103,13 +126,13 @@ LOCAL_SHARED_LIBRARIES += \
     libutils \
     liblog \
     libstlport \
-    libcrypto \
-    libbinder
+    libcrypto
 
 ifeq ($(NFC_PROTOCOL),nci)
-LOCAL_SHARED_LIBRARIES += \
-    libnfc-nci \
-    libexpat
+ifneq ($(NFCD_SIMULATOR),true)
+LOCAL_SHARED_LIBRARIES += libnfc-nci
+endif
+LOCAL_SHARED_LIBRARIES += libexpat
 endif
 
 LOCAL_MODULE := nfcd
@@ -117,7 +140,9 @@ LOCAL_MODULE_TAGS := optional
 
 LOCAL_CFLAGS := -DDEBUG -DPLATFORM_ANDROID -DSTDC_HEADERS=1 -DHAVE_SYS_TYPES_H=1 -DHAVE_SYS_STAT_H=1 -DHAVE_STDLIB_H=1 -DHAVE_STRING_H=1 -DHAVE_MEMORY_H=1 -DHAVE_STRINGS_H=1 -DHAVE_INTTYPES_H=1 -DHAVE_STDINT_H=1 -DHAVE_UNISTD_H=1 -DHAVE_DLFCN_H=1 -DSILENT=1 -DNO_SIGNALS=1 -DNO_EXECUTE_PERMISSION=1 -D_GNU_SOURCE -D_REENTRANT -DUSE_MMAP -DUSE_MUNMAP -D_FILE_OFFSET_BITS=64 -DNO_UNALIGNED_ACCESS
 
-ifeq ($(TARGET_DEVICE),flame)
+ifeq ($(NFCD_SIMULATOR),true)
+LOCAL_CFLAGS += -DNFCD_SIMULATOR
+else ifeq ($(TARGET_DEVICE),flame)
 LOCAL_CFLAGS += -DNFCC_PN547 -DNFC_NXP_NOT_OPEN_INCLUDED
 
 LOCAL_C_INCLUDES += \
@@ -131,4 +156,119 @@ endif
 
 include $(BUILD_EXECUTABLE)
 
+ifeq ($(NFCD_SIMULATOR),true)
+NFCD_SRC_FILES := $(LOCAL_SRC_FILES)
+NFCD_C_INCLUDES := $(LOCAL_C_INCLUDES)
+NFCD_SHARED_LIBRARIES := $(LOCAL_SHARED_LIBRARIES)
+NFCD_CFLAGS := $(LOCAL_CFLAGS)
+
+# The host links the same libraries statically and uses its own C++ library.
+NFCD_HOST_C_INCLUDES := $(filter-out external/stlport/stlport bionic,$(NFCD_C_INCLUDES))
+NFCD_HOST_STATIC_LIBRARIES := libcutils libutils liblog libexpat
+NFCD_HOST_LDLIBS := -lpthread -lrt
+
+NFCD_BENCH_SRC_FILES := \
+    $(filter-out src/nfcd.cpp,$(NFCD_SRC_FILES)) \
+    src/bench/GeckoClient.cpp \
+    src/bench/NfcBench.cpp
+
+# Build nfcd on the simulated controller for the host
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(NFCD_SRC_FILES)
+LOCAL_C_INCLUDES := $(NFCD_HOST_C_INCLUDES)
+LOCAL_STATIC_LIBRARIES := $(NFCD_HOST_STATIC_LIBRARIES)
+LOCAL_LDLIBS := $(NFCD_HOST_LDLIBS)
+LOCAL_CFLAGS := $(NFCD_CFLAGS)
+
+LOCAL_MODULE := nfcd
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Build nfcd-bench, nfcd with a fake Gecko client on the simulated controller
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(NFCD_BENCH_SRC_FILES)
+LOCAL_C_INCLUDES := \
+    $(NFCD_C_INCLUDES) \
+    $(LOCAL_PATH)/src/bench
+
+LOCAL_SHARED_LIBRARIES := $(NFCD_SHARED_LIBRARIES)
+LOCAL_CFLAGS := $(NFCD_CFLAGS)
+
+LOCAL_MODULE := nfcd-bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(NFCD_BENCH_SRC_FILES)
+LOCAL_C_INCLUDES := \
+    $(NFCD_HOST_C_INCLUDES) \
+    $(LOCAL_PATH)/src/bench
+
+LOCAL_STATIC_LIBRARIES := $(NFCD_HOST_STATIC_LIBRARIES)
+LOCAL_LDLIBS := $(NFCD_HOST_LDLIBS)
+LOCAL_CFLAGS := $(NFCD_CFLAGS)
+
+LOCAL_MODULE := nfcd-bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+endif
+
+# Build snep-bench, SNEP over loopback LLCP sockets. It only needs the SNEP
+# code, so it is built for the target and the host without the simulator.
+SNEP_BENCH_SRC_FILES := \
+    src/WorkerPool.cpp \
+    src/snep/SnepServer.cpp \
+    src/snep/SnepClient.cpp \
+    src/snep/SnepMessage.cpp \
+    src/snep/SnepMessenger.cpp \
+    src/interface/NdefMessage.cpp \
+    src/interface/NdefMessageView.cpp \
+    src/interface/NdefRecord.cpp \
+    src/nci/Mutex.cpp \
+    src/nci/CondVar.cpp \
+    src/bench/LoopbackLlcpSocket.cpp \
+    src/bench/SnepBench.cpp
+
+SNEP_BENCH_C_INCLUDES := \
+    $(LOCAL_PATH)/src \
+    $(LOCAL_PATH)/src/interface \
+    $(LOCAL_PATH)/src/nci \
+    $(LOCAL_PATH)/src/snep \
+    $(LOCAL_PATH)/src/bench
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(SNEP_BENCH_SRC_FILES)
+LOCAL_C_INCLUDES := \
+    $(SNEP_BENCH_C_INCLUDES) \
+    external/stlport/stlport \
+    bionic
+LOCAL_SHARED_LIBRARIES := libcutils liblog libstlport
+LOCAL_CFLAGS := -DDEBUG
+
+LOCAL_MODULE := snep-bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(SNEP_BENCH_SRC_FILES)
+LOCAL_C_INCLUDES := $(SNEP_BENCH_C_INCLUDES)
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_CFLAGS := -DDEBUG
+
+LOCAL_MODULE := snep-bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
 #endif #} TARGET_PROVIDES_NFCD
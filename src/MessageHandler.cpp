@@ -15,114 +15,117 @@
  */
 
 #include "MessageHandler.h"
-#include <arpa/inet.h> // for htonl
 #include "NfcService.h"
 #include "NfcIpcSocket.h"
+#include "NfcMessageDecoder.h"
+#include "NfcMessageEncoder.h"
 #include "NfcUtil.h"
 #include "NdefMessage.h"
 #include "NdefRecord.h"
 #include "SessionId.h"
 #include "NfcDebug.h"
+#include "LlcpMetrics.h"
 
 #define MAJOR_VERSION (1)
-#define MINOR_VERSION (22)
+#define MINOR_VERSION (24)
 
-using android::Parcel;
-
-void MessageHandler::NotifyInitialized(Parcel& aParcel)
+void MessageHandler::NotifyInitialized(NfcMessageEncoder& aMsg)
 {
-  aParcel.writeInt32(0); // status
-  aParcel.writeInt32(MAJOR_VERSION);
-  aParcel.writeInt32(MINOR_VERSION);
-  SendResponse(aParcel);
+  aMsg.WriteInt32(0); // status
+  aMsg.WriteInt32(MAJOR_VERSION);
+  aMsg.WriteInt32(MINOR_VERSION);
+  SendResponse(aMsg);
 }
 
-void MessageHandler::NotifyTechDiscovered(Parcel& aParcel, void* aData)
+void MessageHandler::NotifyTechDiscovered(NfcMessageEncoder& aMsg, void* aData)
 {
   TechDiscoveredEvent* event = reinterpret_cast<TechDiscoveredEvent*>(aData);
 
-  aParcel.writeInt32(event->sessionId);
-  aParcel.writeInt32(event->isP2P);
-  aParcel.writeInt32(event->techCount);
-  void* dest = aParcel.writeInplace(event->techCount);
-  memcpy(dest, event->techList, event->techCount);
-  aParcel.writeInt32(event->tagIdCount);
-  void* idPtr = aParcel.writeInplace(event->tagIdCount);
-  memcpy(idPtr, event->tagId, event->tagIdCount);
-  aParcel.writeInt32(event->ndefMsgCount);
-  SendNdefMsg(aParcel, event->ndefMsg);
-  SendNdefInfo(aParcel, event->ndefInfo);
-  SendResponse(aParcel);
+  aMsg.WriteInt32(event->sessionId);
+  aMsg.WriteInt32(event->isP2P);
+  aMsg.WriteInt32(event->techCount);
+  aMsg.WriteBlob(event->techList, event->techCount);
+  aMsg.WriteInt32(event->tagIdCount);
+  aMsg.WriteBlob(event->tagId, event->tagIdCount);
+  aMsg.WriteInt32(event->ndefMsgCount);
+  SendNdefMsg(aMsg, event->ndefMsg);
+  SendNdefInfo(aMsg, event->ndefInfo);
+  SendResponse(aMsg);
 }
 
-void MessageHandler::NotifyTechLost(Parcel& aParcel, void* aData)
+void MessageHandler::NotifyTechLost(NfcMessageEncoder& aMsg, void* aData)
 {
-  aParcel.writeInt32(reinterpret_cast<int>(aData));
-  SendResponse(aParcel);
+  aMsg.WriteInt32(reinterpret_cast<int>(aData));
+  SendResponse(aMsg);
 }
 
-void MessageHandler::NotifyTransactionEvent(Parcel& aParcel, void* aData)
+void MessageHandler::NotifyTransactionEvent(NfcMessageEncoder& aMsg, void* aData)
 {
   TransactionEvent* event = reinterpret_cast<TransactionEvent*>(aData);
 
-  aParcel.writeInt32(NfcUtil::ConvertOriginType(event->originType));
-  aParcel.writeInt32(event->originIndex);
-
-  aParcel.writeInt32(event->aidLen);
-  void* aid = aParcel.writeInplace(event->aidLen);
-  memcpy(aid, event->aid, event->aidLen);
+  aMsg.WriteInt32(NfcUtil::ConvertOriginType(event->originType));
+  aMsg.WriteInt32(event->originIndex);
 
-  aParcel.writeInt32(event->payloadLen);
-  void* payload = aParcel.writeInplace(event->payloadLen);
-  memcpy(payload, event->payload, event->payloadLen);
+  uint32_t aidLen = event->aid.size();
+  aMsg.WriteInt32(aidLen);
+  if (aidLen) {
+    aMsg.WriteBlob(&event->aid[0], aidLen);
+  }
 
-  SendResponse(aParcel);
+  uint32_t payloadLen = event->payload.size();
+  aMsg.WriteInt32(payloadLen);
+  if (payloadLen) {
+    aMsg.WriteBlob(&event->payload[0], payloadLen);
+  }
 
-  delete event;
+  SendResponse(aMsg);
 }
 
-void MessageHandler::NotifyNdefReceived(Parcel& aParcel, void* aData)
+void MessageHandler::NotifyNdefReceived(NfcMessageEncoder& aMsg, void* aData)
 {
   NdefReceivedEvent* event = reinterpret_cast<NdefReceivedEvent*>(aData);
 
-  aParcel.writeInt32(event->sessionId);
-  aParcel.writeInt32(event->ndefMsgCount);
-  SendNdefMsg(aParcel, event->ndefMsg);
-  SendResponse(aParcel);
+  aMsg.WriteInt32(event->sessionId);
+  aMsg.WriteInt32(event->ndefMsgCount);
+  SendNdefMsg(aMsg, event->ndefMsg);
+  SendResponse(aMsg);
 }
 
 void MessageHandler::ProcessRequest(const uint8_t* aData, size_t aDataLen)
 {
-  Parcel parcel;
-  int32_t sizeLe, size, request;
-  uint32_t status;
+  NfcMessageDecoder msg(aData, aDataLen);
+  int32_t request;
 
   NFCD_DEBUG("enter data=%p, dataLen=%d", aData, aDataLen);
-  parcel.setData((uint8_t*)aData, aDataLen);
-  status = parcel.readInt32(&request);
-  if (status != 0) {
+  if (!msg.ReadInt32(&request)) {
     NFCD_ERROR("Invalid request block");
     return;
   }
 
   switch (request) {
     case NFC_REQUEST_CHANGE_RF_STATE:
-      HandleChangeRFStateRequest(parcel);
+      HandleChangeRFStateRequest(msg);
       break;
     case NFC_REQUEST_READ_NDEF:
-      HandleReadNdefRequest(parcel);
+      HandleReadNdefRequest(msg);
       break;
     case NFC_REQUEST_WRITE_NDEF:
-      HandleWriteNdefRequest(parcel);
+      HandleWriteNdefRequest(msg);
       break;
     case NFC_REQUEST_MAKE_NDEF_READ_ONLY:
-      HandleMakeNdefReadonlyRequest(parcel);
+      HandleMakeNdefReadonlyRequest(msg);
       break;
     case NFC_REQUEST_FORMAT:
-      HandleNdefFormatRequest(parcel);
+      HandleNdefFormatRequest(msg);
       break;
     case NFC_REQUEST_TRANSCEIVE:
-      HandleTagTransceiveRequest(parcel);
+      HandleTagTransceiveRequest(msg);
+      break;
+    case NFC_REQUEST_TRANSCEIVE_BATCH:
+      HandleTagTransceiveBatchRequest(msg);
+      break;
+    case NFC_REQUEST_LLCP_METRICS:
+      HandleLlcpMetricsRequest(msg);
       break;
     default:
       NFCD_ERROR("Unhandled Request=%d", request);
@@ -133,25 +136,32 @@ void MessageHandler::ProcessRequest(const uint8_t* aData, size_t aDataLen)
 void MessageHandler::ProcessResponse(NfcResponseType aResponse, NfcErrorCode aError, void* aData)
 {
   NFCD_DEBUG("enter response=%d, error=%d", aResponse, aError);
-  Parcel parcel;
-  parcel.writeInt32(0); // Parcel Size.
-  parcel.writeInt32(aResponse);
-  parcel.writeInt32(aError);
+  // Outgoing messages are only built on the NfcService thread.
+  NfcMessageEncoder& msg = mEncoder;
+  msg.Begin();
+  msg.WriteInt32(aResponse);
+  msg.WriteInt32(aError);
 
   switch (aResponse) {
     case NFC_RESPONSE_CHANGE_RF_STATE:
-      HandleChangeRFStateResponse(parcel, aData);
+      HandleChangeRFStateResponse(msg, aData);
       break;
     case NFC_RESPONSE_READ_NDEF:
-      HandleReadNdefResponse(parcel, aData);
+      HandleReadNdefResponse(msg, aData);
       break;
     case NFC_RESPONSE_WRITE_NDEF: // Fall through.
     case NFC_RESPONSE_MAKE_READ_ONLY:
     case NFC_RESPONSE_FORMAT:
-      HandleResponse(parcel);
+      HandleResponse(msg);
       break;
     case NFC_RESPONSE_TAG_TRANSCEIVE:
-      HandleTagTransceiveResponse(parcel, aData);
+      HandleTagTransceiveResponse(msg, aData);
+      break;
+    case NFC_RESPONSE_TAG_TRANSCEIVE_BATCH:
+      HandleTagTransceiveBatchResponse(msg, aData);
+      break;
+    case NFC_RESPONSE_LLCP_METRICS:
+      HandleLlcpMetricsResponse(msg, aData);
       break;
     default:
       NFCD_ERROR("Not implement");
@@ -162,25 +172,25 @@ void MessageHandler::ProcessResponse(NfcResponseType aResponse, NfcErrorCode aEr
 void MessageHandler::ProcessNotification(NfcNotificationType aNotification, void* aData)
 {
   NFCD_DEBUG("processNotificaton notification=%d", aNotification);
-  Parcel parcel;
-  parcel.writeInt32(0); // Parcel Size.
-  parcel.writeInt32(aNotification | 0x80000000);
+  NfcMessageEncoder& msg = mEncoder;
+  msg.Begin();
+  msg.WriteInt32(aNotification | 0x80000000);
 
   switch (aNotification) {
     case NFC_NOTIFICATION_INITIALIZED :
-      NotifyInitialized(parcel);
+      NotifyInitialized(msg);
       break;
     case NFC_NOTIFICATION_TECH_DISCOVERED:
-      NotifyTechDiscovered(parcel, aData);
+      NotifyTechDiscovered(msg, aData);
       break;
     case NFC_NOTIFICATION_TECH_LOST:
-      NotifyTechLost(parcel, aData);
+      NotifyTechLost(msg, aData);
       break;
     case NFC_NOTIFICATION_TRANSACTION_EVENT:
-      NotifyTransactionEvent(parcel, aData);
+      NotifyTransactionEvent(msg, aData);
       break;
     case NFC_NOTIFICATION_NDEF_RECEIVED:
-      NotifyNdefReceived(parcel, aData);
+      NotifyNdefReceived(msg, aData);
       break;
     default:
       NFCD_ERROR("Not implement");
@@ -193,17 +203,16 @@ void MessageHandler::SetOutgoingSocket(NfcIpcSocket* aSocket)
   mSocket = aSocket;
 }
 
-void MessageHandler::SendResponse(Parcel& aParcel)
+void MessageHandler::SendResponse(NfcMessageEncoder& aMsg)
 {
-  aParcel.setDataPosition(0);
-  uint32_t sizeBE = htonl(aParcel.dataSize() - sizeof(int));
-  aParcel.writeInt32(sizeBE);
-  mSocket->WriteToOutgoingQueue(const_cast<uint8_t*>(aParcel.data()), aParcel.dataSize());
+  int count = 0;
+  struct iovec* iov = aMsg.Finish(&count);
+  mSocket->WriteToOutgoingQueue(iov, count);
 }
 
-bool MessageHandler::HandleChangeRFStateRequest(Parcel& aParcel)
+bool MessageHandler::HandleChangeRFStateRequest(NfcMessageDecoder& aMsg)
 {
-  int rfState = aParcel.readInt32();
+  int rfState = aMsg.ReadInt32();
   bool value;
   switch (rfState) {
     case NFC_RF_STATE_IDLE: // Fall through.
@@ -218,49 +227,49 @@ bool MessageHandler::HandleChangeRFStateRequest(Parcel& aParcel)
   }
 }
 
-bool MessageHandler::HandleReadNdefRequest(Parcel& aParcel)
+bool MessageHandler::HandleReadNdefRequest(NfcMessageDecoder& aMsg)
 {
-  int sessionId = aParcel.readInt32();
+  int sessionId = aMsg.ReadInt32();
   //TODO check SessionId
   return mService->HandleReadNdefRequest();
 }
 
-bool MessageHandler::HandleWriteNdefRequest(Parcel& aParcel)
+bool MessageHandler::HandleWriteNdefRequest(NfcMessageDecoder& aMsg)
 {
   NdefMessagePdu ndefMessagePdu;
-  NdefMessage* ndefMessage = new NdefMessage();
+  NdefMessage ndefMessage;
 
-  int sessionId = aParcel.readInt32();
+  int sessionId = aMsg.ReadInt32();
   //TODO check SessionId
-  bool isP2P = aParcel.readInt32() != 0;
+  bool isP2P = aMsg.ReadInt32() != 0;
 
-  uint32_t numRecords = aParcel.readInt32();
+  uint32_t numRecords = aMsg.ReadInt32();
   ndefMessagePdu.numRecords = numRecords;
   ndefMessagePdu.records = new NdefRecordPdu[numRecords];
 
   for (uint32_t i = 0; i < numRecords; i++) {
-    ndefMessagePdu.records[i].tnf = aParcel.readInt32();
+    ndefMessagePdu.records[i].tnf = aMsg.ReadInt32();
 
-    uint32_t typeLength = aParcel.readInt32();
+    uint32_t typeLength = aMsg.ReadInt32();
     ndefMessagePdu.records[i].typeLength = typeLength;
     ndefMessagePdu.records[i].type = new uint8_t[typeLength];
-    const void* data = aParcel.readInplace(typeLength);
+    const void* data = aMsg.ReadInplace(typeLength);
     memcpy(ndefMessagePdu.records[i].type, data, typeLength);
 
-    uint32_t idLength = aParcel.readInt32();
+    uint32_t idLength = aMsg.ReadInt32();
     ndefMessagePdu.records[i].idLength = idLength;
     ndefMessagePdu.records[i].id = new uint8_t[idLength];
-    data = aParcel.readInplace(idLength);
+    data = aMsg.ReadInplace(idLength);
     memcpy(ndefMessagePdu.records[i].id, data, idLength);
 
-    uint32_t payloadLength = aParcel.readInt32();
+    uint32_t payloadLength = aMsg.ReadInt32();
     ndefMessagePdu.records[i].payloadLength = payloadLength;
     ndefMessagePdu.records[i].payload = new uint8_t[payloadLength];
-    data = aParcel.readInplace(payloadLength);
+    data = aMsg.ReadInplace(payloadLength);
     memcpy(ndefMessagePdu.records[i].payload, data, payloadLength);
   }
 
-  NfcUtil::ConvertNdefPduToNdefMessage(ndefMessagePdu, ndefMessage);
+  NfcUtil::ConvertNdefPduToNdefMessage(ndefMessagePdu, &ndefMessage);
 
   for (uint32_t i = 0; i < numRecords; i++) {
     delete[] ndefMessagePdu.records[i].type;
@@ -269,122 +278,191 @@ bool MessageHandler::HandleWriteNdefRequest(Parcel& aParcel)
   }
   delete[] ndefMessagePdu.records;
 
-  return mService->HandleWriteNdefRequest(ndefMessage, isP2P);
+  return mService->HandleWriteNdefRequest(&ndefMessage, isP2P);
 }
 
-bool MessageHandler::HandleMakeNdefReadonlyRequest(Parcel& aParcel)
+bool MessageHandler::HandleMakeNdefReadonlyRequest(NfcMessageDecoder& aMsg)
 {
-  mService->HandleMakeNdefReadonlyRequest();
-  return true;
+  return mService->HandleMakeNdefReadonlyRequest();
 }
 
-bool MessageHandler::HandleNdefFormatRequest(Parcel& aParcel)
+bool MessageHandler::HandleNdefFormatRequest(NfcMessageDecoder& aMsg)
 {
-  mService->HandleNdefFormatRequest();
-  return true;
+  return mService->HandleNdefFormatRequest();
 }
 
-bool MessageHandler::HandleTagTransceiveRequest(Parcel& aParcel)
+bool MessageHandler::HandleTagTransceiveRequest(NfcMessageDecoder& aMsg)
 {
-  int sessionId = aParcel.readInt32();
-  int tech = aParcel.readInt32();
-  int bufLen = aParcel.readInt32();
+  int sessionId = aMsg.ReadInt32();
+  int tech = aMsg.ReadInt32();
+  int bufLen = aMsg.ReadInt32();
 
-  const void* buf = aParcel.readInplace(bufLen);
-  mService->HandleTagTransceiveRequest(tech, static_cast<const uint8_t*>(buf), bufLen);
-  return true;
+  const void* buf = aMsg.ReadInplace(bufLen);
+  return mService->HandleTagTransceiveRequest(tech, static_cast<const uint8_t*>(buf), bufLen);
+}
+
+bool MessageHandler::HandleTagTransceiveBatchRequest(NfcMessageDecoder& aMsg)
+{
+  int sessionId = aMsg.ReadInt32();
+  int tech = aMsg.ReadInt32();
+  uint32_t flags = aMsg.ReadInt32();
+  uint32_t count = aMsg.ReadInt32();
+
+  // Every frame takes at least its length field.
+  if (count > aMsg.DataAvail() / sizeof(int32_t)) {
+    NFCD_ERROR("invalid frame count=%u", count);
+    return false;
+  }
+
+  // Frames are referenced in place and copied once into the event.
+  std::vector<const uint8_t*> frames(count);
+  std::vector<uint32_t> lengths(count);
+  for (uint32_t i = 0; i < count; i++) {
+    lengths[i] = aMsg.ReadInt32();
+    frames[i] = static_cast<const uint8_t*>(aMsg.ReadInplace(lengths[i]));
+    if (!frames[i] && lengths[i]) {
+      NFCD_ERROR("truncated frame %u", i);
+      return false;
+    }
+  }
+
+  return mService->HandleTagTransceiveBatchRequest(tech, flags, frames, lengths);
+}
+
+bool MessageHandler::HandleLlcpMetricsRequest(NfcMessageDecoder& aMsg)
+{
+  return mService->HandleLlcpMetricsRequest();
 }
 
-bool MessageHandler::HandleChangeRFStateResponse(Parcel& aParcel, void* aData)
+bool MessageHandler::HandleChangeRFStateResponse(NfcMessageEncoder& aMsg, void* aData)
 {
-  aParcel.writeInt32(*reinterpret_cast<int*>(aData));
-  SendResponse(aParcel);
+  aMsg.WriteInt32(*reinterpret_cast<int*>(aData));
+  SendResponse(aMsg);
   return true;
 }
 
-bool MessageHandler::HandleReadNdefResponse(Parcel& aParcel, void* aData)
+bool MessageHandler::HandleReadNdefResponse(NfcMessageEncoder& aMsg, void* aData)
 {
   NdefMessage* ndef = reinterpret_cast<NdefMessage*>(aData);
 
-  aParcel.writeInt32(SessionId::GetCurrentId());
+  aMsg.WriteInt32(SessionId::GetCurrentId());
 
-  SendNdefMsg(aParcel, ndef);
-  SendResponse(aParcel);
+  SendNdefMsg(aMsg, ndef);
+  SendResponse(aMsg);
 
   return true;
 }
 
-bool MessageHandler::HandleTagTransceiveResponse(Parcel& aParcel, void* aData)
+bool MessageHandler::HandleTagTransceiveResponse(NfcMessageEncoder& aMsg, void* aData)
 {
   std::vector<uint8_t>* response = reinterpret_cast<std::vector<uint8_t>*>(aData);
   uint32_t length = response->size();
 
-  aParcel.writeInt32(SessionId::GetCurrentId());
-  aParcel.writeInt32(length);
+  aMsg.WriteInt32(SessionId::GetCurrentId());
+  aMsg.WriteInt32(length);
 
-  uint8_t* buf = static_cast<uint8_t*>(aParcel.writeInplace(length));
-  std::copy(response->begin(), response->end(), buf);
+  if (length) {
+    aMsg.WriteBlob(&response->front(), length);
+  }
 
-  SendResponse(aParcel);
+  SendResponse(aMsg);
 
   return true;
 }
 
-bool MessageHandler::HandleResponse(Parcel& aParcel)
+bool MessageHandler::HandleTagTransceiveBatchResponse(NfcMessageEncoder& aMsg, void* aData)
 {
-  aParcel.writeInt32(SessionId::GetCurrentId());
-  SendResponse(aParcel);
+  TransceiveBatchEvent* event = reinterpret_cast<TransceiveBatchEvent*>(aData);
+  const uint8_t* response = event->responses;
+
+  aMsg.WriteInt32(SessionId::GetCurrentId());
+  aMsg.WriteInt32(event->count);
+
+  for (uint32_t i = 0; i < event->count; i++) {
+    uint32_t length = event->lengths[i];
+    aMsg.WriteInt32(length);
+    aMsg.WriteBlob(response, length);
+    response += length;
+  }
+
+  SendResponse(aMsg);
+
   return true;
 }
 
-bool MessageHandler::SendNdefMsg(Parcel& aParcel, NdefMessage* aNdef)
+bool MessageHandler::HandleLlcpMetricsResponse(NfcMessageEncoder& aMsg, void* aData)
+{
+  LlcpLinkMetrics* link = reinterpret_cast<LlcpLinkMetrics*>(aData);
+
+  aMsg.WriteInt32(link->isActive);
+  aMsg.WriteInt32(link->durationMs);
+  aMsg.WriteInt32(link->remoteLinkMiu);
+  SendLlcpMetrics(aMsg, link->total);
+
+  uint32_t count = link->connections.size();
+  aMsg.WriteInt32(count);
+  for (uint32_t i = 0; i < count; i++) {
+    aMsg.WriteInt32(link->connections[i].handle);
+    SendLlcpMetrics(aMsg, link->connections[i].metrics);
+  }
+
+  SendResponse(aMsg);
+
+  return true;
+}
+
+bool MessageHandler::HandleResponse(NfcMessageEncoder& aMsg)
+{
+  aMsg.WriteInt32(SessionId::GetCurrentId());
+  SendResponse(aMsg);
+  return true;
+}
+
+bool MessageHandler::SendNdefMsg(NfcMessageEncoder& aMsg, NdefMessage* aNdef)
 {
   if (!aNdef)
     return false;
 
   int numRecords = aNdef->mRecords.size();
   NFCD_DEBUG("numRecords=%d", numRecords);
-  aParcel.writeInt32(numRecords);
+  aMsg.WriteInt32(numRecords);
 
   for (int i = 0; i < numRecords; i++) {
     NdefRecord &record = aNdef->mRecords[i];
 
     NFCD_DEBUG("tnf=%u", record.mTnf);
-    aParcel.writeInt32(record.mTnf);
+    aMsg.WriteInt32(record.mTnf);
 
     uint32_t typeLength = record.mType.size();
     NFCD_DEBUG("typeLength=%u", typeLength);
-    aParcel.writeInt32(typeLength);
-    void* dest = aParcel.writeInplace(typeLength);
-    if (dest == NULL) {
-      NFCD_ERROR("writeInplace returns NULL");
-      return false;
+    aMsg.WriteInt32(typeLength);
+    if (typeLength) {
+      aMsg.WriteBlob(&record.mType.front(), typeLength);
     }
-    memcpy(dest, &record.mType.front(), typeLength);
 
     uint32_t idLength = record.mId.size();
     NFCD_DEBUG("idLength=%d", idLength);
-    aParcel.writeInt32(idLength);
-    dest = aParcel.writeInplace(idLength);
-    memcpy(dest, &record.mId.front(), idLength);
+    aMsg.WriteInt32(idLength);
+    if (idLength) {
+      aMsg.WriteBlob(&record.mId.front(), idLength);
+    }
 
     uint32_t payloadLength = record.mPayload.size();
     NFCD_DEBUG("payloadLength=%u", payloadLength);
-    aParcel.writeInt32(payloadLength);
-    dest = aParcel.writeInplace(payloadLength);
-    memcpy(dest, &record.mPayload.front(), payloadLength);
-    for (uint32_t j = 0; j < payloadLength; j++) {
-      NFCD_DEBUG("mPayload %d = %u", j, record.mPayload[j]);
+    aMsg.WriteInt32(payloadLength);
+    // Sent in place if large.
+    if (payloadLength) {
+      aMsg.WriteBlob(&record.mPayload.front(), payloadLength);
     }
   }
 
   return true;
 }
 
-bool MessageHandler::SendNdefInfo(Parcel& aParcel, NdefInfo* aInfo)
+bool MessageHandler::SendNdefInfo(NfcMessageEncoder& aMsg, NdefInfo* aInfo)
 {
   // if contain ndef information
-  aParcel.writeInt32(aInfo ? true : false);
+  aMsg.WriteInt32(aInfo ? true : false);
 
   if (!aInfo) {
     return false;
@@ -392,16 +470,31 @@ bool MessageHandler::SendNdefInfo(Parcel& aParcel, NdefInfo* aInfo)
 
   // ndef tyoe
   NfcNdefType type = (NfcUtil::ConvertNdefType(aInfo->ndefType));
-  aParcel.writeInt32(static_cast<int>(type));
+  aMsg.WriteInt32(static_cast<int>(type));
 
   // max support length
-  aParcel.writeInt32(aInfo->maxSupportedLength);
+  aMsg.WriteInt32(aInfo->maxSupportedLength);
 
   // is ready only
-  aParcel.writeInt32(aInfo->isReadOnly);
+  aMsg.WriteInt32(aInfo->isReadOnly);
 
   // ndef formatable
-  aParcel.writeInt32(aInfo->isFormatable);
+  aMsg.WriteInt32(aInfo->isFormatable);
 
   return true;
 }
+
+void MessageHandler::SendLlcpMetrics(NfcMessageEncoder& aMsg, const LlcpMetrics& aMetrics)
+{
+  aMsg.WriteInt32(aMetrics.pdusSent);
+  aMsg.WriteInt32(aMetrics.bytesSent);
+  aMsg.WriteInt32(aMetrics.pdusReceived);
+  aMsg.WriteInt32(aMetrics.bytesReceived);
+  aMsg.WriteInt32(aMetrics.congestionWaits);
+  aMsg.WriteInt32(aMetrics.congestionMs);
+  aMsg.WriteInt32(aMetrics.receiveWaits);
+  aMsg.WriteInt32(aMetrics.receiveWaitMs);
+  aMsg.WriteInt32(aMetrics.connects);
+  aMsg.WriteInt32(aMetrics.connectMs);
+  aMsg.WriteInt32(aMetrics.maxConnectMs);
+}
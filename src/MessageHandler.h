@@ -20,12 +20,14 @@
 #include <stdio.h>
 #include "NfcGonkMessage.h"
 #include "TagTechnology.h"
-#include <binder/Parcel.h>
+#include "NfcMessageEncoder.h"
 
 class NfcIpcSocket;
+class NfcMessageDecoder;
 class NfcService;
 class NdefMessage;
 class NdefInfo;
+struct LlcpMetrics;
 
 class MessageHandler {
 public:
@@ -38,31 +40,38 @@ public:
   void SetOutgoingSocket(NfcIpcSocket* aSocket);
 
 private:
-  void NotifyInitialized(android::Parcel& aParcel);
-  void NotifyTechDiscovered(android::Parcel& aParcel, void* aData);
-  void NotifyTechLost(android::Parcel& aParcel, void* aData);
-  void NotifyTransactionEvent(android::Parcel& aParcel, void* aData);
-  void NotifyNdefReceived(android::Parcel& aParcel, void* aData);
+  void NotifyInitialized(NfcMessageEncoder& aMsg);
+  void NotifyTechDiscovered(NfcMessageEncoder& aMsg, void* aData);
+  void NotifyTechLost(NfcMessageEncoder& aMsg, void* aData);
+  void NotifyTransactionEvent(NfcMessageEncoder& aMsg, void* aData);
+  void NotifyNdefReceived(NfcMessageEncoder& aMsg, void* aData);
 
-  bool HandleChangeRFStateRequest(android::Parcel& aParcel);
-  bool HandleReadNdefRequest(android::Parcel& aParcel);
-  bool HandleWriteNdefRequest(android::Parcel& aParcel);
-  bool HandleMakeNdefReadonlyRequest(android::Parcel& aParcel);
-  bool HandleNdefFormatRequest(android::Parcel& aParcel);
-  bool HandleTagTransceiveRequest(android::Parcel& aParcel);
+  bool HandleChangeRFStateRequest(NfcMessageDecoder& aMsg);
+  bool HandleReadNdefRequest(NfcMessageDecoder& aMsg);
+  bool HandleWriteNdefRequest(NfcMessageDecoder& aMsg);
+  bool HandleMakeNdefReadonlyRequest(NfcMessageDecoder& aMsg);
+  bool HandleNdefFormatRequest(NfcMessageDecoder& aMsg);
+  bool HandleTagTransceiveRequest(NfcMessageDecoder& aMsg);
+  bool HandleTagTransceiveBatchRequest(NfcMessageDecoder& aMsg);
+  bool HandleLlcpMetricsRequest(NfcMessageDecoder& aMsg);
 
-  bool HandleChangeRFStateResponse(android::Parcel& aParcel, void* aData);
-  bool HandleReadNdefResponse(android::Parcel& aParcel, void* aData);
-  bool HandleTagTransceiveResponse(android::Parcel& aParcel, void* aData);
-  bool HandleResponse(android::Parcel& aParcel);
+  bool HandleChangeRFStateResponse(NfcMessageEncoder& aMsg, void* aData);
+  bool HandleReadNdefResponse(NfcMessageEncoder& aMsg, void* aData);
+  bool HandleTagTransceiveResponse(NfcMessageEncoder& aMsg, void* aData);
+  bool HandleTagTransceiveBatchResponse(NfcMessageEncoder& aMsg, void* aData);
+  bool HandleLlcpMetricsResponse(NfcMessageEncoder& aMsg, void* aData);
+  bool HandleResponse(NfcMessageEncoder& aMsg);
 
-  void SendResponse(android::Parcel& aParcel);
+  void SendResponse(NfcMessageEncoder& aMsg);
 
-  bool SendNdefMsg(android::Parcel& aParcel, NdefMessage* aNdef);
-  bool SendNdefInfo(android::Parcel& aParcel, NdefInfo* aInfo);
+  bool SendNdefMsg(NfcMessageEncoder& aMsg, NdefMessage* aNdef);
+  bool SendNdefInfo(NfcMessageEncoder& aMsg, NdefInfo* aInfo);
+  void SendLlcpMetrics(NfcMessageEncoder& aMsg, const LlcpMetrics& aMetrics);
 
   NfcIpcSocket* mSocket;
   NfcService* mService;
+  // Reused for every outgoing message.
+  NfcMessageEncoder mEncoder;
 };
 
 struct TechDiscoveredEvent {
@@ -77,6 +86,13 @@ struct TechDiscoveredEvent {
   NdefInfo* ndefInfo;
 };
 
+struct TransceiveBatchEvent {
+  uint32_t count;
+  // Length of each response, responses are stored one after the other.
+  const uint32_t* lengths;
+  const uint8_t* responses;
+};
+
 struct NdefReceivedEvent {
   int sessionId;
   uint32_t ndefMsgCount;
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NfcEventQueue.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <cutils/atomic.h>
+
+#include "NfcDebug.h"
+
+/**
+ * Each slot carries a sequence number:
+ *   seq == pos               slot is free for the producer claiming pos.
+ *   seq == pos + 1           slot at pos is published, consumer may take it.
+ *   seq == pos + sCapacity   slot was released, free for the next lap.
+ * Positions are free running and compared with wrap-around arithmetic.
+ */
+
+static inline int32_t Distance(int32_t aSeq, uint32_t aPos)
+{
+  return static_cast<int32_t>(static_cast<uint32_t>(aSeq) - aPos);
+}
+
+static int64_t ElapsedUs(const struct timespec& aFrom)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (static_cast<int64_t>(now.tv_sec) - aFrom.tv_sec) * 1000000LL +
+         (now.tv_nsec - aFrom.tv_nsec) / 1000;
+}
+
+NfcEvent::NfcEvent()
+ : tag(NULL)
+ , flags(0)
+ , hasNdef(false)
+ , mType(MSG_UNDEFINED)
+ , mSequence(0)
+ , mPosition(0)
+{
+  mEnqueueTime.tv_sec = 0;
+  mEnqueueTime.tv_nsec = 0;
+}
+
+NfcEventQueue::NfcEventQueue()
+ : mEnqueuePos(0)
+ , mDepth(0)
+ , mFullWaits(0)
+ , mDrops(0)
+ , mDequeuePos(0)
+ , mMaxDepth(0)
+ , mDispatched(0)
+ , mLastLatencyUs(0)
+ , mMaxLatencyUs(0)
+ , mTotalLatencyUs(0)
+{
+  for (uint32_t i = 0; i < sCapacity; i++) {
+    mSlots[i].mSequence = i;
+    mSlots[i].buffer.reserve(sSlotBufferSize);
+  }
+
+  if (sem_init(&mSem, 0, 0) == -1) {
+    NFCD_ERROR("Semaphore creation failed");
+    abort();
+  }
+}
+
+NfcEventQueue::~NfcEventQueue()
+{
+  sem_destroy(&mSem);
+}
+
+NfcEvent* NfcEventQueue::Acquire(NfcEventType aType)
+{
+  struct timespec fullSince;
+  bool full = false;
+
+  while (true) {
+    uint32_t pos = static_cast<uint32_t>(android_atomic_acquire_load(&mEnqueuePos));
+    NfcEvent* slot = &mSlots[pos & sMask];
+    int32_t diff = Distance(android_atomic_acquire_load(&slot->mSequence), pos);
+
+    if (diff == 0) {
+      if (android_atomic_acquire_cas(static_cast<int32_t>(pos),
+                                     static_cast<int32_t>(pos + 1),
+                                     &mEnqueuePos) == 0) {
+        slot->mPosition = pos;
+        slot->mType = aType;
+        slot->tag = NULL;
+        slot->hasNdef = false;
+        return slot;
+      }
+    } else if (diff < 0) {
+      // The consumer still owns the slot from the previous lap.
+      if (!full) {
+        full = true;
+        clock_gettime(CLOCK_MONOTONIC, &fullSince);
+        android_atomic_inc(&mFullWaits);
+      } else if (ElapsedUs(fullSince) > sFullWaitLimitUs) {
+        android_atomic_inc(&mDrops);
+        NFCD_ERROR("queue full, dropping event type=%d", aType);
+        return NULL;
+      }
+      sched_yield();
+    }
+    // Otherwise another producer claimed |pos| first; retry.
+  }
+}
+
+void NfcEventQueue::Publish(NfcEvent* aEvent)
+{
+  clock_gettime(CLOCK_MONOTONIC, &aEvent->mEnqueueTime);
+  android_atomic_inc(&mDepth);
+  android_atomic_release_store(static_cast<int32_t>(aEvent->mPosition + 1),
+                               &aEvent->mSequence);
+  sem_post(&mSem);
+}
+
+NfcEvent* NfcEventQueue::Dequeue()
+{
+  while (true) {
+    NfcEvent* slot = &mSlots[mDequeuePos & sMask];
+    if (Distance(android_atomic_acquire_load(&slot->mSequence), mDequeuePos + 1) == 0) {
+      mDequeuePos++;
+
+      int32_t depth = android_atomic_acquire_load(&mDepth);
+      if (depth > mMaxDepth) {
+        mMaxDepth = depth;
+      }
+
+      mLastLatencyUs = ElapsedUs(slot->mEnqueueTime);
+      if (mLastLatencyUs > mMaxLatencyUs) {
+        mMaxLatencyUs = mLastLatencyUs;
+      }
+      mTotalLatencyUs += mLastLatencyUs;
+      mDispatched++;
+      return slot;
+    }
+
+    // Either empty or the head slot is claimed but not yet published.
+    // Every Publish() posts once, so wake-ups are never lost.
+    if (sem_wait(&mSem) && errno != EINTR) {
+      NFCD_ERROR("Failed to wait for semaphore");
+      abort();
+    }
+  }
+}
+
+void NfcEventQueue::Release(NfcEvent* aEvent)
+{
+  // Payload storage is left as is so its capacity is reused.
+  aEvent->mType = MSG_UNDEFINED;
+  android_atomic_dec(&mDepth);
+  android_atomic_release_store(static_cast<int32_t>(aEvent->mPosition + sCapacity),
+                               &aEvent->mSequence);
+}
+
+int32_t NfcEventQueue::GetDepth()
+{
+  return android_atomic_acquire_load(&mDepth);
+}
+
+void NfcEventQueue::DumpStats()
+{
+  NFCD_DEBUG("dispatched=%llu depth=%d maxDepth=%d fullWaits=%d drops=%d "
+             "latency avg=%lldus max=%lldus",
+             static_cast<unsigned long long>(mDispatched), GetDepth(), mMaxDepth,
+             android_atomic_acquire_load(&mFullWaits),
+             android_atomic_acquire_load(&mDrops),
+             static_cast<long long>(mDispatched ?
+                                    mTotalLatencyUs / static_cast<int64_t>(mDispatched) : 0),
+             static_cast<long long>(mMaxLatencyUs));
+}
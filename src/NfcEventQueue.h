@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_NfcEventQueue_h
+#define mozilla_nfcd_NfcEventQueue_h
+
+#include <semaphore.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+#include "DeviceHost.h"
+#include "NdefMessage.h"
+
+class INfcTag;
+class IP2pDevice;
+
+typedef enum {
+  MSG_UNDEFINED = 0,
+  MSG_LLCP_LINK_ACTIVATION,
+  MSG_LLCP_LINK_DEACTIVATION,
+  MSG_TAG_DISCOVERED,
+  MSG_TAG_LOST,
+  MSG_SE_FIELD_ACTIVATED,
+  MSG_SE_FIELD_DEACTIVATED,
+  MSG_SE_NOTIFY_TRANSACTION_EVENT,
+  MSG_READ_NDEF,
+  MSG_WRITE_NDEF,
+  MSG_SOCKET_CONNECTED,
+  MSG_MAKE_NDEF_READONLY,
+  MSG_LOW_POWER,
+  MSG_ENABLE,
+  MSG_RECEIVE_NDEF_EVENT,
+  MSG_NDEF_FORMAT,
+  MSG_TAG_TRANSCEIVE,
+  MSG_TAG_TRANSCEIVE_BATCH,
+  MSG_P2P_PUSH_COMPLETE,
+  MSG_LLCP_METRICS
+} NfcEventType;
+
+/**
+ * An event slot of NfcEventQueue. Slots are preallocated by the queue
+ * and reused, so an event must not be kept after it is released.
+ *
+ * The payload is typed; which member is valid depends on the event type.
+ * Variable-sized payloads are copied into storage owned by the slot, which
+ * keeps its capacity across reuse so steady-state traffic does not hit the
+ * heap.
+ */
+class NfcEvent {
+public:
+  NfcEvent();
+
+  NfcEventType GetType() { return mType; }
+
+  union {
+    INfcTag* tag;           // MSG_TAG_DISCOVERED.
+    IP2pDevice* p2pDevice;  // MSG_LLCP_LINK_ACTIVATION/DEACTIVATION.
+    int sessionId;          // MSG_TAG_LOST.
+    int tech;               // MSG_TAG_TRANSCEIVE(_BATCH).
+    bool isP2P;             // MSG_WRITE_NDEF.
+    bool enable;            // MSG_LOW_POWER, MSG_ENABLE.
+    bool success;           // MSG_P2P_PUSH_COMPLETE.
+  };
+
+  // MSG_TAG_TRANSCEIVE command. MSG_TAG_TRANSCEIVE_BATCH commands, one
+  // after the other.
+  std::vector<uint8_t> buffer;
+
+  // MSG_TAG_TRANSCEIVE_BATCH. Length of each command in buffer and
+  // NfcTransceiveBatchFlag.
+  std::vector<uint32_t> frameLengths;
+  uint32_t flags;
+
+  // MSG_WRITE_NDEF, MSG_RECEIVE_NDEF_EVENT. Only valid if hasNdef is true.
+  bool hasNdef;
+  NdefMessage ndef;
+
+  // MSG_SE_NOTIFY_TRANSACTION_EVENT.
+  TransactionEvent transaction;
+
+private:
+  friend class NfcEventQueue;
+
+  NfcEventType mType;
+  // Ticket of the slot, see NfcEventQueue for the protocol.
+  volatile int32_t mSequence;
+  // Position in the queue claimed by the producer.
+  uint32_t mPosition;
+  // Time the event was published.
+  struct timespec mEnqueueTime;
+};
+
+/**
+ * Bounded multi-producer/single-consumer ring of preallocated NfcEvents.
+ *
+ * Producers (NFA callback threads, IPC thread, P2P threads) claim a slot
+ * with a CAS on the enqueue position, fill the slot in place and publish
+ * it. The single consumer (NfcService event loop) dispatches events in
+ * order and releases the slot afterwards. No lock is taken on either side;
+ * a semaphore is only used to park the consumer when the ring is empty.
+ */
+class NfcEventQueue {
+public:
+  NfcEventQueue();
+  ~NfcEventQueue();
+
+  /**
+   * Claim a free slot. Spins (yielding) while the ring is full, for at
+   * most sFullWaitLimitUs; the event is then dropped and counted.
+   *
+   * @param  aType Type of the event.
+   * @return       Slot to fill; must be passed to Publish(). NULL if the
+   *               ring stayed full.
+   */
+  NfcEvent* Acquire(NfcEventType aType);
+
+  /**
+   * Make a filled slot visible to the consumer and wake it up.
+   *
+   * @param  aEvent Slot returned by Acquire().
+   * @return        None.
+   */
+  void Publish(NfcEvent* aEvent);
+
+  /**
+   * Wait until the next event in order is published. Consumer only.
+   *
+   * @return Next event; must be passed to Release() after dispatch.
+   */
+  NfcEvent* Dequeue();
+
+  /**
+   * Return a dispatched slot to the producers. Consumer only.
+   *
+   * @param  aEvent Slot returned by Dequeue().
+   * @return        None.
+   */
+  void Release(NfcEvent* aEvent);
+
+  /**
+   * Number of published events not yet released.
+   */
+  int32_t GetDepth();
+
+  /**
+   * Latency between Publish() and Dequeue() of the last event, in us.
+   */
+  int64_t GetLastLatencyUs() { return mLastLatencyUs; }
+
+  /**
+   * Log queue depth and enqueue-to-dispatch latency counters.
+   *
+   * @return None.
+   */
+  void DumpStats();
+
+private:
+  static const uint32_t sCapacity = 64;
+  static const uint32_t sMask = sCapacity - 1;
+  // Initial capacity of the byte storage of each slot, large enough for a
+  // short APDU so the common transceive does not reallocate.
+  static const uint32_t sSlotBufferSize = 261;
+  // How long a producer waits for a free slot before dropping its event.
+  static const int64_t sFullWaitLimitUs = 100 * 1000;
+
+  NfcEvent mSlots[sCapacity];
+  sem_t mSem;
+
+  // Shared by producers.
+  volatile int32_t mEnqueuePos;
+  volatile int32_t mDepth;
+  volatile int32_t mFullWaits;
+  volatile int32_t mDrops;
+
+  // Only accessed by the consumer.
+  uint32_t mDequeuePos;
+  int32_t mMaxDepth;
+  uint64_t mDispatched;
+  int64_t mLastLatencyUs;
+  int64_t mMaxLatencyUs;
+  int64_t mTotalLatencyUs;
+};
+
+#endif // mozilla_nfcd_NfcEventQueue_h
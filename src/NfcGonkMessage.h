@@ -263,8 +263,53 @@ typedef enum {
    * response is tag response data.
    */
   NFC_REQUEST_TRANSCEIVE,
+
+  /**
+   * NFC_REQUEST_TRANSCEIVE_BATCH
+   *
+   * Send several raw frames to the tag back-to-back.
+   *
+   * data is [sessionId][technology][flags][number of frames]
+   *         followed by [frame length][frame] for each frame. flags is a
+   *         combination of NfcTransceiveBatchFlag.
+   *
+   * response is [sessionId][number of responses] followed by
+   *         [response length][response] for each frame that was sent.
+   */
+  NFC_REQUEST_TRANSCEIVE_BATCH,
+
+  /**
+   * NFC_REQUEST_LLCP_METRICS
+   *
+   * Get the traffic counters of the current LLCP link, or of the last one
+   * if no link is up.
+   *
+   * data is NULL.
+   *
+   * response is [link is active][link duration in ms][remote link MIU]
+   *         [link counters][number of open connections] followed by
+   *         [connection handle][connection counters] for each open
+   *         connection. Link counters include closed connections.
+   *
+   *         Counters are [I-PDUs sent][bytes sent][I-PDUs received]
+   *         [bytes received][congestion waits][ms blocked on congestion]
+   *         [receive waits][ms blocked in receive][connects]
+   *         [total connect ms][max connect ms].
+   */
+  NFC_REQUEST_LLCP_METRICS,
 } NfcRequestType;
 
+/**
+ * Flags of NFC_REQUEST_TRANSCEIVE_BATCH.
+ */
+typedef enum {
+  /**
+   * Stop after a response whose ISO 7816-4 status word is not 0x9000.
+   * That response is still returned.
+   */
+  NFC_TRANSCEIVE_BATCH_STOP_ON_STATUS_ERROR = 1 << 0,
+} NfcTransceiveBatchFlag;
+
 typedef enum {
   NFC_RESPONSE_CHANGE_RF_STATE,
 
@@ -276,7 +321,11 @@ typedef enum {
 
   NFC_RESPONSE_FORMAT,
 
-  NFC_RESPONSE_TAG_TRANSCEIVE
+  NFC_RESPONSE_TAG_TRANSCEIVE,
+
+  NFC_RESPONSE_TAG_TRANSCEIVE_BATCH,
+
+  NFC_RESPONSE_LLCP_METRICS
 } NfcResponseType;
 
 typedef struct {
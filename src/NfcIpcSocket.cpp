@@ -18,15 +18,18 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <poll.h>
+#include <stddef.h>
 #include <pwd.h>
 #include <netinet/in.h>
 #include <sys/un.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <linux/prctl.h>
 #include <cutils/sockets.h>
 #include <cutils/record_stream.h>
 #include <unistd.h>
+#include <limits.h>
 #include <queue>
 #include <string>
 
@@ -37,8 +40,12 @@
 
 #define NFCD_SOCKET_NAME "nfcd"
 #define MAX_COMMAND_BYTES (8 * 1024)
+// Longest time the service thread waits for Gecko to drain the socket.
+#define WRITE_TIMEOUT_MS 1000
 
-using android::Parcel;
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 /**
  * NfcIpcSocket
@@ -56,6 +63,7 @@ NfcIpcSocket::NfcIpcSocket()
   : mMsgHandler(NULL)
   , mListener(NULL)
   , mNfcdRw(-1)
+  , mWriteFailed(false)
 {
 }
 
@@ -100,13 +108,13 @@ int NfcIpcSocket::GetConnectedSocket(const char* aSocketName, bool aSeqPacket)
     return -1;
   }
 
+  struct sockaddr_un addr;
   size_t siz = len + NBOUNDS;
-  if (siz > UNIX_PATH_MAX) {
+  if (siz > sizeof(addr.sun_path)) {
     NFCD_ERROR("Socket address too long\n");
     return -1;
   }
 
-  struct sockaddr_un addr;
   addr.sun_family = AF_UNIX;
   addr.sun_path[0] = '\0'; /* abstract socket namespace */
   memcpy(addr.sun_path + 1, aSocketName, len + 1);
@@ -183,6 +191,7 @@ void NfcIpcSocket::Loop(const char* aSocketName, bool aSeqPacket)
 
     NFCD_DEBUG("Socket connected");
     connected = true;
+    mWriteFailed = false;
 
     RecordStream* rs = record_stream_new(mNfcdRw, MAX_COMMAND_BYTES);
 
@@ -221,29 +230,69 @@ void NfcIpcSocket::Loop(const char* aSocketName, bool aSeqPacket)
 // Write NFC data to Gecko
 // Outgoing queue contain the data should be send to gecko
 // TODO check thread, this should run on the NfcService thread.
-void NfcIpcSocket::WriteToOutgoingQueue(uint8_t* aData, size_t aDataLen)
+void NfcIpcSocket::WriteToOutgoingQueue(struct iovec* aIov, int aIovCount)
 {
-  NFCD_DEBUG("enter, data=%p, dataLen=%d", aData, aDataLen);
+  NFCD_DEBUG("enter, iov=%p, iovCount=%d", aIov, aIovCount);
+
+  if (aIov == NULL || aIovCount <= 0) {
+    return;
+  }
 
-  if (aData == NULL || aDataLen == 0) {
+  if (mWriteFailed) {
+    NFCD_ERROR("connection dropped, message discarded");
     return;
   }
 
-  size_t writeOffset = 0;
-  int written = 0;
+  // Skip entries written completely, and advance into a partially written
+  // one, until every entry is written.
+  while (aIovCount > 0) {
+    if (aIov->iov_len == 0) {
+      aIov++;
+      aIovCount--;
+      continue;
+    }
 
-  NFCD_DEBUG("Writing %d bytes to gecko ", aDataLen);
-  while (writeOffset < aDataLen) {
+    ssize_t written;
     do {
-      written = write (mNfcdRw, aData + writeOffset, aDataLen - writeOffset);
+      written = writev(mNfcdRw, aIov, aIovCount > IOV_MAX ? IOV_MAX : aIovCount);
     } while (written < 0 && errno == EINTR);
 
-    if (written >= 0) {
-      writeOffset += written;
-    } else {
+    if (written < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // The socket is non-blocking, wait until it drains.
+        struct pollfd fds;
+        fds.fd = mNfcdRw;
+        fds.events = POLLOUT;
+        fds.revents = 0;
+        int ready;
+        do {
+          ready = poll(&fds, 1, WRITE_TIMEOUT_MS);
+        } while (ready < 0 && errno == EINTR);
+        if (ready > 0) {
+          continue;
+        }
+
+        // Gecko stopped reading. Shutting the socket down wakes up the
+        // listener, which closes it and waits for a new connection.
+        NFCD_ERROR("Response: write timed out, dropping connection");
+        mWriteFailed = true;
+        shutdown(mNfcdRw, SHUT_RDWR);
+        break;
+      }
       NFCD_ERROR("Response: unexpected error on write errno:%d", errno);
       break;
     }
+
+    while (written > 0 && aIovCount > 0) {
+      size_t length = written < (ssize_t)aIov->iov_len ? written : aIov->iov_len;
+      aIov->iov_base = static_cast<uint8_t*>(aIov->iov_base) + length;
+      aIov->iov_len -= length;
+      written -= length;
+      if (aIov->iov_len == 0) {
+        aIov++;
+        aIovCount--;
+      }
+    }
   }
 }
 
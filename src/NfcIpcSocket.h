@@ -19,7 +19,7 @@
 
 #include <pthread.h>
 #include <time.h>
-#include <binder/Parcel.h>
+#include <sys/uio.h>
 
 class MessageHandler;
 class IpcSocketListener;
@@ -37,7 +37,16 @@ public:
 
   void SetSocketListener(IpcSocketListener* alistener);
 
-  void WriteToOutgoingQueue(uint8_t* aData, size_t aDataLen);
+  /**
+   * Write a message to Gecko with a single writev() if possible. If Gecko
+   * does not drain the socket within a bounded time the connection is
+   * dropped, so a stalled client cannot block the caller's thread.
+   *
+   * @param  aIov      Message segments, advanced while they are written.
+   * @param  aIovCount Number of segments.
+   * @return           None.
+   */
+  void WriteToOutgoingQueue(struct iovec* aIov, int aIovCount);
   void WriteToIncomingQueue(uint8_t* aData, size_t aDataLen);
 
 private:
@@ -49,6 +58,8 @@ private:
   MessageHandler* mMsgHandler;
   IpcSocketListener* mListener;
   int mNfcdRw;
+  // Set when a write timed out, cleared on the next connection.
+  volatile bool mWriteFailed;
 
   void InitSocket();
   int GetListenSocket();
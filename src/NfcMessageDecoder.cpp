@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NfcMessageDecoder.h"
+
+#include <string.h>
+
+NfcMessageDecoder::NfcMessageDecoder(const uint8_t* aData, size_t aLength)
+ : mData(aData)
+ , mLength(aData ? aLength : 0)
+ , mPos(0)
+{
+}
+
+bool NfcMessageDecoder::ReadInt32(int32_t* aValue)
+{
+  if (DataAvail() < sizeof(int32_t)) {
+    return false;
+  }
+
+  // Fields are in host byte order and may be unaligned in the buffer.
+  memcpy(aValue, mData + mPos, sizeof(int32_t));
+  mPos += sizeof(int32_t);
+  return true;
+}
+
+int32_t NfcMessageDecoder::ReadInt32()
+{
+  int32_t value = 0;
+  ReadInt32(&value);
+  return value;
+}
+
+const void* NfcMessageDecoder::ReadInplace(uint32_t aLength)
+{
+  size_t padded = (static_cast<size_t>(aLength) + 3) & ~static_cast<size_t>(3);
+  if (padded < aLength || padded > DataAvail()) {
+    return NULL;
+  }
+
+  const uint8_t* data = mData + mPos;
+  mPos += padded;
+  return data;
+}
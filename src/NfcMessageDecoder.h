@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_NfcMessageDecoder_h
+#define mozilla_nfcd_NfcMessageDecoder_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decodes the body of an incoming message in the parcel format described
+ * in NfcGonkMessage.h: 32-bit fields and blobs padded to 4 bytes. The
+ * counterpart of NfcMessageEncoder.
+ *
+ * Data is read in place and not copied, so it must stay valid while the
+ * decoder is used.
+ */
+class NfcMessageDecoder {
+public:
+  NfcMessageDecoder(const uint8_t* aData, size_t aLength);
+
+  /**
+   * Read a 32-bit field.
+   *
+   * @param  aValue Output value.
+   * @return        False if the message is too short.
+   */
+  bool ReadInt32(int32_t* aValue);
+
+  /**
+   * Read a 32-bit field.
+   *
+   * @return Value read, 0 if the message is too short.
+   */
+  int32_t ReadInt32();
+
+  /**
+   * Read a blob of aLength bytes and skip its padding.
+   *
+   * @param  aLength Number of bytes.
+   * @return         Blob in the message, NULL if the message is too short.
+   */
+  const void* ReadInplace(uint32_t aLength);
+
+  /**
+   * Number of bytes left to read.
+   */
+  size_t DataAvail() const { return mLength - mPos; }
+
+private:
+  const uint8_t* mData;
+  size_t mLength;
+  size_t mPos;
+};
+
+#endif // mozilla_nfcd_NfcMessageDecoder_h
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NfcMessageEncoder.h"
+
+#include <arpa/inet.h> // for htonl
+#include <string.h>
+
+// Most messages fit without growing the buffer.
+static const uint32_t INITIAL_BUFFER_SIZE = 1024;
+
+NfcMessageEncoder::NfcMessageEncoder()
+ : mSize(0)
+{
+  mBuffer.reserve(INITIAL_BUFFER_SIZE);
+}
+
+void NfcMessageEncoder::Begin()
+{
+  mBuffer.clear();
+  mSegments.clear();
+  mSize = 0;
+  WriteInt32(0); // Parcel Size.
+}
+
+void NfcMessageEncoder::WriteInt32(int32_t aValue)
+{
+  Append(&aValue, sizeof(aValue));
+}
+
+void NfcMessageEncoder::WriteBlob(const void* aData, uint32_t aLength)
+{
+  static const uint8_t padding[3] = {0, 0, 0};
+  uint32_t padLength = (4 - (aLength & 3)) & 3;
+
+  if (aLength >= sZeroCopyThreshold) {
+    Segment segment;
+    segment.data = static_cast<const uint8_t*>(aData);
+    segment.offset = 0;
+    segment.length = aLength;
+    mSegments.push_back(segment);
+    mSize += aLength;
+  } else if (aLength) {
+    Append(aData, aLength);
+  }
+
+  if (padLength) {
+    Append(padding, padLength);
+  }
+}
+
+void NfcMessageEncoder::Append(const void* aData, uint32_t aLength)
+{
+  uint32_t offset = mBuffer.size();
+  const uint8_t* data = static_cast<const uint8_t*>(aData);
+  mBuffer.insert(mBuffer.end(), data, data + aLength);
+
+  // Extend the last segment if it is also in the buffer.
+  if (!mSegments.empty() && !mSegments.back().data) {
+    mSegments.back().length += aLength;
+  } else {
+    Segment segment;
+    segment.data = NULL;
+    segment.offset = offset;
+    segment.length = aLength;
+    mSegments.push_back(segment);
+  }
+  mSize += aLength;
+}
+
+struct iovec* NfcMessageEncoder::Finish(int* aCount)
+{
+  uint32_t sizeBE = htonl(mSize - sizeof(int32_t));
+  memcpy(&mBuffer[0], &sizeBE, sizeof(sizeBE));
+
+  // mBuffer does not move anymore, resolve the offsets.
+  mIov.resize(mSegments.size());
+  for (size_t i = 0; i < mSegments.size(); i++) {
+    const Segment& segment = mSegments[i];
+    const uint8_t* base = segment.data ? segment.data : &mBuffer[segment.offset];
+    mIov[i].iov_base = const_cast<uint8_t*>(base);
+    mIov[i].iov_len = segment.length;
+  }
+
+  *aCount = mIov.size();
+  return &mIov[0];
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_NfcMessageEncoder_h
+#define mozilla_nfcd_NfcMessageEncoder_h
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <vector>
+
+/**
+ * Encodes outgoing messages in the parcel format described in
+ * NfcGonkMessage.h: a big-endian size followed by 32-bit fields and blobs
+ * padded to 4 bytes.
+ *
+ * Fields are written into a buffer kept across messages. Large blobs are
+ * not copied; they are referenced in place and sent with the rest of the
+ * message by a single writev(), so they must stay valid until the message
+ * is sent.
+ */
+class NfcMessageEncoder {
+public:
+  NfcMessageEncoder();
+
+  /**
+   * Start a new message. Reserves room for the size field.
+   *
+   * @return None.
+   */
+  void Begin();
+
+  void WriteInt32(int32_t aValue);
+
+  /**
+   * Write raw bytes, padded to 4 bytes.
+   *
+   * @param  aData   Bytes to write, referenced until the message is sent if
+   *                 aLength is at least sZeroCopyThreshold.
+   * @param  aLength Number of bytes.
+   * @return         None.
+   */
+  void WriteBlob(const void* aData, uint32_t aLength);
+
+  /**
+   * Patch the size field and describe the message for writev().
+   *
+   * @param  aCount Output number of entries of the returned array.
+   * @return        Array of aCount iovecs, valid until the next Begin(). The
+   *                caller may modify it.
+   */
+  struct iovec* Finish(int* aCount);
+
+  /**
+   * Total length of the message, size field included.
+   */
+  uint32_t GetSize() const { return mSize; }
+
+private:
+  // Blobs of at least this length are sent in place.
+  static const uint32_t sZeroCopyThreshold = 256;
+
+  struct Segment {
+    // NULL if the segment is stored in mBuffer at offset.
+    const uint8_t* data;
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  void Append(const void* aData, uint32_t aLength);
+
+  std::vector<uint8_t> mBuffer;
+  std::vector<Segment> mSegments;
+  std::vector<struct iovec> mIov;
+  uint32_t mSize;
+};
+
+#endif // mozilla_nfcd_NfcMessageEncoder_h
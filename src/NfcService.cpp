@@ -15,7 +15,6 @@
  */
 
 #include <pthread.h>
-#include <semaphore.h>
 #include <stdlib.h>
 #include <memory>
 
@@ -25,63 +24,20 @@
 #include "IP2pDevice.h"
 #include "DeviceHost.h"
 #include "NfcService.h"
+#include "NfcManager.h"
 #include "NfcUtil.h"
 #include "NfcDebug.h"
 #include "P2pLinkManager.h"
+#include "PresenceCheckScheduler.h"
 #include "SessionId.h"
 
-using namespace android;
-
-typedef enum {
-  MSG_UNDEFINED = 0,
-  MSG_LLCP_LINK_ACTIVATION,
-  MSG_LLCP_LINK_DEACTIVATION,
-  MSG_TAG_DISCOVERED,
-  MSG_TAG_LOST,
-  MSG_SE_FIELD_ACTIVATED,
-  MSG_SE_FIELD_DEACTIVATED,
-  MSG_SE_NOTIFY_TRANSACTION_EVENT,
-  MSG_READ_NDEF,
-  MSG_WRITE_NDEF,
-  MSG_SOCKET_CONNECTED,
-  MSG_MAKE_NDEF_READONLY,
-  MSG_LOW_POWER,
-  MSG_ENABLE,
-  MSG_RECEIVE_NDEF_EVENT,
-  MSG_NDEF_FORMAT,
-  MSG_TAG_TRANSCEIVE
-} NfcEventType;
-
 typedef enum {
   STATE_NFC_OFF = 0,
   STATE_NFC_ON_LOW_POWER,
   STATE_NFC_ON,
 } NfcState;
 
-class NfcEvent {
-public:
-  NfcEvent(NfcEventType aType)
-   : mType(aType)
-  {}
-
-  NfcEventType GetType() { return mType; }
-
-  int arg1;
-  int arg2;
-  void* obj;
-
-private:
-  NfcEventType mType;
-};
-
-class PollingThreadParam {
-public:
-  INfcTag* pINfcTag;
-  int sessionId;
-};
-
 static pthread_t thread_id;
-static sem_t thread_sem;
 
 NfcService* NfcService::sInstance = NULL;
 NfcManager* NfcService::sNfcManager = NULL;
@@ -91,11 +47,13 @@ NfcService::NfcService()
  , mIsTagPresent(false)
 {
   mP2pLinkManager = new P2pLinkManager(this);
+  mPresenceCheck = new PresenceCheckScheduler();
 }
 
 NfcService::~NfcService()
 {
   delete mP2pLinkManager;
+  delete mPresenceCheck;
 }
 
 static void* ServiceThreadFunc(void* aArg)
@@ -107,13 +65,13 @@ static void* ServiceThreadFunc(void* aArg)
 
 void NfcService::Initialize(NfcManager* aNfcManager, MessageHandler* aMsgHandler)
 {
-  if (sem_init(&thread_sem, 0, 0) == -1) {
-    NFCD_ERROR("init_nfc_service Semaphore creation failed");
+  if (pthread_create(&thread_id, NULL, ServiceThreadFunc, this) != 0) {
+    NFCD_ERROR("init_nfc_service pthread_create failed");
     abort();
   }
 
-  if (pthread_create(&thread_id, NULL, ServiceThreadFunc, this) != 0) {
-    NFCD_ERROR("init_nfc_service pthread_create failed");
+  if (!mPresenceCheck->Initialize()) {
+    NFCD_ERROR("init_nfc_service presence check scheduler failed");
     abort();
   }
 
@@ -124,70 +82,86 @@ void NfcService::Initialize(NfcManager* aNfcManager, MessageHandler* aMsgHandler
 void NfcService::NotifyLlcpLinkActivated(IP2pDevice* aDevice)
 {
   NFCD_DEBUG("enter");
-  NfcEvent* event = new NfcEvent(MSG_LLCP_LINK_ACTIVATION);
-  event->obj = reinterpret_cast<void*>(aDevice);
-  NfcService::Instance()->mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = NfcService::Instance()->mQueue.Acquire(MSG_LLCP_LINK_ACTIVATION);
+  if (!event) {
+    return;
+  }
+  event->p2pDevice = aDevice;
+  NfcService::Instance()->mQueue.Publish(event);
 }
 
 void NfcService::NotifyLlcpLinkDeactivated(IP2pDevice* aDevice)
 {
   NFCD_DEBUG("enter");
-  NfcEvent* event = new NfcEvent(MSG_LLCP_LINK_DEACTIVATION);
-  event->obj = reinterpret_cast<void*>(aDevice);
-  NfcService::Instance()->mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = NfcService::Instance()->mQueue.Acquire(MSG_LLCP_LINK_DEACTIVATION);
+  if (!event) {
+    return;
+  }
+  event->p2pDevice = aDevice;
+  NfcService::Instance()->mQueue.Publish(event);
 }
 
 void NfcService::NotifyTagDiscovered(INfcTag* aTag)
 {
   NFCD_DEBUG("enter");
-  NfcEvent* event = new NfcEvent(MSG_TAG_DISCOVERED);
-  event->obj = reinterpret_cast<void*>(aTag);
-  NfcService::Instance()->mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = NfcService::Instance()->mQueue.Acquire(MSG_TAG_DISCOVERED);
+  if (!event) {
+    return;
+  }
+  event->tag = aTag;
+  NfcService::Instance()->mQueue.Publish(event);
 }
 
 void NfcService::NotifyTagLost(int aSessionId)
 {
   NFCD_DEBUG("enter");
-  NfcEvent* event = new NfcEvent(MSG_TAG_LOST);
-  event->obj = reinterpret_cast<void*>(aSessionId);
-  NfcService::Instance()->mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = NfcService::Instance()->mQueue.Acquire(MSG_TAG_LOST);
+  if (!event) {
+    return;
+  }
+  event->sessionId = aSessionId;
+  NfcService::Instance()->mQueue.Publish(event);
 }
 
 void NfcService::NotifySEFieldActivated()
 {
   NFCD_DEBUG("enter");
-  NfcEvent* event = new NfcEvent(MSG_SE_FIELD_ACTIVATED);
-  NfcService::Instance()->mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = NfcService::Instance()->mQueue.Acquire(MSG_SE_FIELD_ACTIVATED);
+  if (!event) {
+    return;
+  }
+  NfcService::Instance()->mQueue.Publish(event);
 }
 
 void NfcService::NotifySEFieldDeactivated()
 {
   NFCD_DEBUG("enter");
-  NfcEvent* event = new NfcEvent(MSG_SE_FIELD_DEACTIVATED);
-  NfcService::Instance()->mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = NfcService::Instance()->mQueue.Acquire(MSG_SE_FIELD_DEACTIVATED);
+  if (!event) {
+    return;
+  }
+  NfcService::Instance()->mQueue.Publish(event);
 }
 
 void NfcService::NotifySETransactionEvent(TransactionEvent* aEvent)
 {
   NFCD_DEBUG("enter");
-  NfcEvent* event = new NfcEvent(MSG_SE_NOTIFY_TRANSACTION_EVENT);
-  event->obj = reinterpret_cast<void*>(aEvent);
-  NfcService::Instance()->mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = NfcService::Instance()->mQueue.Acquire(MSG_SE_NOTIFY_TRANSACTION_EVENT);
+  if (!event) {
+    return;
+  }
+  event->transaction.originType = aEvent->originType;
+  event->transaction.originIndex = aEvent->originIndex;
+  event->transaction.aid = aEvent->aid;
+  event->transaction.payload = aEvent->payload;
+  NfcService::Instance()->mQueue.Publish(event);
 }
 
 void NfcService::HandleLlcpLinkDeactivation(NfcEvent* aEvent)
 {
   NFCD_DEBUG("enter");
 
-  void* pDevice = aEvent->obj;
-  IP2pDevice* pIP2pDevice = reinterpret_cast<IP2pDevice*>(pDevice);
+  IP2pDevice* pIP2pDevice = aEvent->p2pDevice;
 
   if (pIP2pDevice->GetMode() == NfcDepEndpoint::MODE_P2P_TARGET) {
     pIP2pDevice->Disconnect();
@@ -202,8 +176,7 @@ void NfcService::HandleLlcpLinkDeactivation(NfcEvent* aEvent)
 void NfcService::HandleLlcpLinkActivation(NfcEvent* aEvent)
 {
   NFCD_DEBUG("enter");
-  void* pDevice = aEvent->obj;
-  IP2pDevice* pIP2pDevice = reinterpret_cast<IP2pDevice*>(pDevice);
+  IP2pDevice* pIP2pDevice = aEvent->p2pDevice;
 
   if (pIP2pDevice->GetMode() == NfcDepEndpoint::MODE_P2P_TARGET ||
       pIP2pDevice->GetMode() == NfcDepEndpoint::MODE_P2P_INITIATOR) {
@@ -235,46 +208,22 @@ void NfcService::HandleLlcpLinkActivation(NfcEvent* aEvent)
 
   mP2pLinkManager->OnLlcpActivated();
 
-  TechDiscoveredEvent* data = new TechDiscoveredEvent();
+  TechDiscoveredEvent data;
 
   mP2pLinkManager->SetSessionId(SessionId::GenerateNewId());
-  data->sessionId = mP2pLinkManager->GetSessionId();
-  data->isP2P = true;
-  data->techCount = 0;
-  data->techList = NULL;
-  data->tagIdCount = 0;
-  data->tagId = NULL;
-  data->ndefMsgCount = 0;
-  data->ndefMsg = NULL;
-  data->ndefInfo = NULL;
-  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_TECH_DISCOVERED, data);
-  delete data;
+  data.sessionId = mP2pLinkManager->GetSessionId();
+  data.isP2P = true;
+  data.techCount = 0;
+  data.techList = NULL;
+  data.tagIdCount = 0;
+  data.tagId = NULL;
+  data.ndefMsgCount = 0;
+  data.ndefMsg = NULL;
+  data.ndefInfo = NULL;
+  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_TECH_DISCOVERED, &data);
   NFCD_DEBUG("exit");
 }
 
-static void *PollingThreadFunc(void *aArg)
-{
-  PollingThreadParam* param = reinterpret_cast<PollingThreadParam*>(aArg);
-  INfcTag* pINfcTag = param->pINfcTag;
-  int sessionId = param->sessionId;
-
-  NfcService::Instance()->TagDetected();
-
-  while (pINfcTag->PresenceCheck()) {
-    sleep(1);
-  }
-
-  NfcService::Instance()->TagRemoved();
-
-  pINfcTag->Disconnect();
-
-  NfcService::Instance()->NotifyTagLost(sessionId);
-
-  delete param;
-
-  return NULL;
-}
-
 void NfcService::HandleTagDiscovered(NfcEvent* aEvent)
 {
   // Do not support multiple tag discover.
@@ -282,7 +231,7 @@ void NfcService::HandleTagDiscovered(NfcEvent* aEvent)
     return;
   }
 
-  INfcTag* pINfcTag = reinterpret_cast<INfcTag*>(aEvent->obj);
+  INfcTag* pINfcTag = aEvent->tag;
 
   // To get complete tag information, need to call read ndef first.
   // In readNdef function, it will add NDEF related info in NfcTagManager.
@@ -293,111 +242,105 @@ void NfcService::HandleTagDiscovered(NfcEvent* aEvent)
   std::vector<TagTechnology>& techList = pINfcTag->GetTechList();
   int techCount = techList.size();
 
-  uint8_t* gonkTechList = new uint8_t[techCount];
-  std::copy(techList.begin(), techList.end(), gonkTechList);
-
-  TechDiscoveredEvent* data = new TechDiscoveredEvent();
-  data->sessionId = SessionId::GenerateNewId();
-  data->isP2P = false;
-  data->techCount = techCount;
-  data->techList = gonkTechList;
-  data->tagIdCount = pINfcTag->GetUid().size();
-  uint8_t* tagId = new uint8_t[data->tagIdCount];
-  memcpy(tagId, &pINfcTag->GetUid()[0], data->tagIdCount);
-  data->tagId = tagId;
-  data->ndefMsgCount = pNdefMessage.get() ? 1 : 0;
-  data->ndefMsg = pNdefMessage.get();
-  data->ndefInfo = pNdefInfo.get();
-  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_TECH_DISCOVERED, data);
-
-  PollingThreadParam* param = new PollingThreadParam();
-  param->sessionId = data->sessionId;
-  param->pINfcTag = pINfcTag;
+  // mTechListBuf keeps its capacity, no allocation after the first tag.
+  mTechListBuf.assign(techList.begin(), techList.end());
+  std::vector<uint8_t>& uid = pINfcTag->GetUid();
 
-  delete tagId;
-  delete gonkTechList;
-  delete data;
+  TechDiscoveredEvent data;
+  data.sessionId = SessionId::GenerateNewId();
+  data.isP2P = false;
+  data.techCount = techCount;
+  data.techList = techCount ? &mTechListBuf[0] : NULL;
+  data.tagIdCount = uid.size();
+  data.tagId = uid.empty() ? NULL : &uid[0];
+  data.ndefMsgCount = pNdefMessage.get() ? 1 : 0;
+  data.ndefMsg = pNdefMessage.get();
+  data.ndefInfo = pNdefInfo.get();
+  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_TECH_DISCOVERED, &data);
 
-  pthread_t tid;
-  pthread_create(&tid, NULL, PollingThreadFunc, param);
+  TagDetected();
+  mPresenceCheck->Start(pINfcTag, data.sessionId);
 }
 
 void NfcService::HandleTagLost(NfcEvent* aEvent)
 {
-  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_TECH_LOST, aEvent->obj);
+  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_TECH_LOST,
+                                   reinterpret_cast<void*>(aEvent->sessionId));
 }
 
 void NfcService::HandleTransactionEvent(NfcEvent* aEvent)
 {
-  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_TRANSACTION_EVENT, aEvent->obj);
+  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_TRANSACTION_EVENT, &aEvent->transaction);
 }
 
 void* NfcService::EventLoop()
 {
   NFCD_DEBUG("NFCService started");
   while(true) {
-    if(sem_wait(&thread_sem)) {
-      NFCD_ERROR("Failed to wait for semaphore");
-      abort();
+    NfcEvent* event = mQueue.Dequeue();
+    NfcEventType eventType = event->GetType();
+
+    NFCD_DEBUG("NFCService msg=%d latency=%lldus depth=%d",
+               eventType, static_cast<long long>(mQueue.GetLastLatencyUs()),
+               mQueue.GetDepth());
+    switch(eventType) {
+      case MSG_LLCP_LINK_ACTIVATION:
+        HandleLlcpLinkActivation(event);
+        break;
+      case MSG_LLCP_LINK_DEACTIVATION:
+        HandleLlcpLinkDeactivation(event);
+        break;
+      case MSG_TAG_DISCOVERED:
+        HandleTagDiscovered(event);
+        break;
+      case MSG_TAG_LOST:
+        HandleTagLost(event);
+        break;
+      case MSG_SE_NOTIFY_TRANSACTION_EVENT:
+        HandleTransactionEvent(event);
+        break;
+      case MSG_READ_NDEF:
+        HandleReadNdefResponse(event);
+        break;
+      case MSG_WRITE_NDEF:
+        HandleWriteNdefResponse(event);
+        break;
+      case MSG_SOCKET_CONNECTED:
+        mMsgHandler->ProcessNotification(NFC_NOTIFICATION_INITIALIZED , NULL);
+        break;
+      case MSG_MAKE_NDEF_READONLY:
+        HandleMakeNdefReadonlyResponse(event);
+        break;
+      case MSG_LOW_POWER:
+        HandleEnterLowPowerResponse(event);
+        break;
+      case MSG_ENABLE:
+        HandleEnableResponse(event);
+        break;
+      case MSG_RECEIVE_NDEF_EVENT:
+        HandleReceiveNdefEvent(event);
+        break;
+      case MSG_NDEF_FORMAT:
+        HandleNdefFormatResponse(event);
+        break;
+      case MSG_TAG_TRANSCEIVE:
+        HandleTagTransceiveResponse(event);
+        break;
+      case MSG_TAG_TRANSCEIVE_BATCH:
+        HandleTagTransceiveBatchResponse(event);
+        break;
+      case MSG_P2P_PUSH_COMPLETE:
+        HandleP2pPushComplete(event);
+        break;
+      case MSG_LLCP_METRICS:
+        HandleLlcpMetricsResponse(event);
+        break;
+      default:
+        NFCD_ERROR("NFCService bad message");
+        abort();
     }
 
-    while (!mQueue.empty()) {
-      NfcEvent* event = *mQueue.begin();
-      mQueue.erase(mQueue.begin());
-      NfcEventType eventType = event->GetType();
-
-      NFCD_DEBUG("NFCService msg=%d", eventType);
-      switch(eventType) {
-        case MSG_LLCP_LINK_ACTIVATION:
-          HandleLlcpLinkActivation(event);
-          break;
-        case MSG_LLCP_LINK_DEACTIVATION:
-          HandleLlcpLinkDeactivation(event);
-          break;
-        case MSG_TAG_DISCOVERED:
-          HandleTagDiscovered(event);
-          break;
-        case MSG_TAG_LOST:
-          HandleTagLost(event);
-          break;
-        case MSG_SE_NOTIFY_TRANSACTION_EVENT:
-          HandleTransactionEvent(event);
-          break;
-        case MSG_READ_NDEF:
-          HandleReadNdefResponse(event);
-          break;
-        case MSG_WRITE_NDEF:
-          HandleWriteNdefResponse(event);
-          break;
-        case MSG_SOCKET_CONNECTED:
-          mMsgHandler->ProcessNotification(NFC_NOTIFICATION_INITIALIZED , NULL);
-          break;
-        case MSG_MAKE_NDEF_READONLY:
-          HandleMakeNdefReadonlyResponse(event);
-          break;
-        case MSG_LOW_POWER:
-          HandleEnterLowPowerResponse(event);
-          break;
-        case MSG_ENABLE:
-          HandleEnableResponse(event);
-          break;
-        case MSG_RECEIVE_NDEF_EVENT:
-          HandleReceiveNdefEvent(event);
-          break;
-        case MSG_NDEF_FORMAT:
-          HandleNdefFormatResponse(event);
-          break;
-        case MSG_TAG_TRANSCEIVE:
-          HandleTagTransceiveResponse(event);
-          break;
-        default:
-          NFCD_ERROR("NFCService bad message");
-          abort();
-      }
-
-      //TODO delete event->data?
-      delete event;
-    }
+    mQueue.Release(event);
   }
 }
 
@@ -424,9 +367,11 @@ bool NfcService::HandleDisconnect()
 
 bool NfcService::HandleReadNdefRequest()
 {
-  NfcEvent *event = new NfcEvent(MSG_READ_NDEF);
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_READ_NDEF);
+  if (!event) {
+    return false;
+  }
+  mQueue.Publish(event);
   return true;
 }
 
@@ -446,30 +391,34 @@ void NfcService::HandleReadNdefResponse(NfcEvent* aEvent)
     return;
   }
 
+  mPresenceCheck->NotifyActivity();
   mMsgHandler->ProcessResponse(resType, NFC_SUCCESS, pNdefMessage.get());
 }
 
 void NfcService::HandleReceiveNdefEvent(NfcEvent* aEvent)
 {
-  NdefMessage* ndef = reinterpret_cast<NdefMessage*>(aEvent->obj);
-
-  NdefReceivedEvent* data = new NdefReceivedEvent();
-  data->sessionId = SessionId::GetCurrentId();
-  data->ndefMsgCount = ndef ? 1 : 0;
-  data->ndefMsg = ndef;
-  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_NDEF_RECEIVED, data);
+  NdefMessage* ndef = aEvent->hasNdef ? &aEvent->ndef : NULL;
 
-  delete data;
-  delete ndef;
+  NdefReceivedEvent data;
+  data.sessionId = SessionId::GetCurrentId();
+  data.ndefMsgCount = ndef ? 1 : 0;
+  data.ndefMsg = ndef;
+  mMsgHandler->ProcessNotification(NFC_NOTIFICATION_NDEF_RECEIVED, &data);
 }
 
 bool NfcService::HandleWriteNdefRequest(NdefMessage* aNdef, bool aIsP2P)
 {
-  NfcEvent *event = new NfcEvent(MSG_WRITE_NDEF);
-  event->arg1 = aIsP2P;
-  event->obj = aNdef;
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_WRITE_NDEF);
+  if (!event) {
+    return false;
+  }
+  event->isP2P = aIsP2P;
+  event->hasNdef = !!aNdef;
+  if (aNdef) {
+    // Take over the records, the slot's previous records go back to the caller.
+    event->ndef.mRecords.swap(aNdef->mRecords);
+  }
+  mQueue.Publish(event);
   return true;
 }
 
@@ -478,22 +427,25 @@ void NfcService::HandleWriteNdefResponse(NfcEvent* aEvent)
   NfcResponseType resType = NFC_RESPONSE_WRITE_NDEF;
   NfcErrorCode code = NFC_SUCCESS;
 
-  std::auto_ptr<NdefMessage> pNdef(reinterpret_cast<NdefMessage*>(aEvent->obj));
-  if (!pNdef.get()) {
+  if (!aEvent->hasNdef) {
     mMsgHandler->ProcessResponse(resType, NFC_ERROR_INVALID_PARAM, NULL);
     return;
   }
 
-  bool isP2P = aEvent->arg1;
+  NdefMessage* pNdef = &aEvent->ndef;
+  bool isP2P = aEvent->isP2P;
   if (isP2P && mP2pLinkManager->IsLlcpActive()) {
-    mP2pLinkManager->Push(*pNdef.get());
+    // Sent by the push thread, which responds once the peer has it.
+    mP2pLinkManager->Push(*pNdef);
+    return;
   } else if (!isP2P && IsTagPresent()) {
     INfcTag* pINfcTag = reinterpret_cast<INfcTag*>
                         (sNfcManager->QueryInterface(INTERFACE_TAG_MANAGER));
 
     code = !!pINfcTag ?
-           (pINfcTag->WriteNdef(*pNdef.get()) ? NFC_SUCCESS : NFC_ERROR_IO) :
+           (pINfcTag->WriteNdef(*pNdef) ? NFC_SUCCESS : NFC_ERROR_IO) :
            NFC_ERROR_NOT_SUPPORTED;
+    mPresenceCheck->NotifyActivity();
   } else {
     code = NFC_ERROR_IO;
   }
@@ -501,18 +453,39 @@ void NfcService::HandleWriteNdefResponse(NfcEvent* aEvent)
   mMsgHandler->ProcessResponse(resType, code, NULL);
 }
 
+void NfcService::HandleP2pPushComplete(NfcEvent* aEvent)
+{
+  mMsgHandler->ProcessResponse(NFC_RESPONSE_WRITE_NDEF,
+                               aEvent->success ? NFC_SUCCESS : NFC_ERROR_IO,
+                               NULL);
+}
+
+void NfcService::OnP2pPushComplete(bool aSuccess)
+{
+  NfcEvent* event = mQueue.Acquire(MSG_P2P_PUSH_COMPLETE);
+  if (!event) {
+    return;
+  }
+  event->success = aSuccess;
+  mQueue.Publish(event);
+}
+
 void NfcService::OnConnected()
 {
-  NfcEvent *event = new NfcEvent(MSG_SOCKET_CONNECTED);
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_SOCKET_CONNECTED);
+  if (!event) {
+    return;
+  }
+  mQueue.Publish(event);
 }
 
 bool NfcService::HandleMakeNdefReadonlyRequest()
 {
-  NfcEvent *event = new NfcEvent(MSG_MAKE_NDEF_READONLY);
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_MAKE_NDEF_READONLY);
+  if (!event) {
+    return false;
+  }
+  mQueue.Publish(event);
   return true;
 }
 
@@ -525,26 +498,29 @@ void NfcService::HandleMakeNdefReadonlyResponse(NfcEvent* aEvent)
                       (pINfcTag->MakeReadOnly() ? NFC_SUCCESS : NFC_ERROR_IO) :
                       NFC_ERROR_NOT_SUPPORTED;
 
+  mPresenceCheck->NotifyActivity();
   mMsgHandler->ProcessResponse(NFC_RESPONSE_MAKE_READ_ONLY, code, NULL);
 }
 
 bool NfcService::HandleNdefFormatRequest()
 {
-  NfcEvent *event = new NfcEvent(MSG_NDEF_FORMAT);
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_NDEF_FORMAT);
+  if (!event) {
+    return false;
+  }
+  mQueue.Publish(event);
   return true;
 }
 
 bool NfcService::HandleTagTransceiveRequest(int aTech, const uint8_t* aBuf, uint32_t aBufLen)
 {
-  std::vector<uint8_t>* cmd = new std::vector<uint8_t>(aBuf, aBuf + aBufLen);
-
-  NfcEvent *event = new NfcEvent(MSG_TAG_TRANSCEIVE);
-  event->arg1 = aTech;
-  event->obj = reinterpret_cast<void*>(cmd);
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_TAG_TRANSCEIVE);
+  if (!event) {
+    return false;
+  }
+  event->tech = aTech;
+  event->buffer.assign(aBuf, aBuf + aBufLen);
+  mQueue.Publish(event);
   return true;
 }
 
@@ -553,24 +529,118 @@ void NfcService::HandleTagTransceiveResponse(NfcEvent* aEvent)
   INfcTag* pINfcTag = reinterpret_cast<INfcTag*>
                       (sNfcManager->QueryInterface(INTERFACE_TAG_MANAGER));
 
-  int tech = aEvent->arg1;
-  std::vector<uint8_t>* command = reinterpret_cast<std::vector<uint8_t>*>(aEvent->obj);
-  std::vector<uint8_t> response;
+  int tech = aEvent->tech;
+  std::vector<uint8_t>& command = aEvent->buffer;
+  // Reuse the response buffer across transceives.
+  std::vector<uint8_t>& response = mTransceiveResponse;
+  response.clear();
 
   NfcErrorCode code = pINfcTag->Connect(static_cast<TagTechnology>(tech)) ?
                       NFC_SUCCESS : NFC_ERROR_IO;
 
   if (NFC_SUCCESS == code) {
-    code = !!pINfcTag ? (pINfcTag->Transceive(*command, response) ?
+    code = !!pINfcTag ? (pINfcTag->Transceive(command, response) ?
            NFC_SUCCESS : NFC_ERROR_IO) : NFC_ERROR_NOT_SUPPORTED;
   }
 
-  delete command;
-
+  mPresenceCheck->NotifyActivity();
   mMsgHandler->ProcessResponse(NFC_RESPONSE_TAG_TRANSCEIVE, code,
                                reinterpret_cast<void*>(&response));
 }
 
+bool NfcService::HandleTagTransceiveBatchRequest(int aTech,
+                                                 uint32_t aFlags,
+                                                 const std::vector<const uint8_t*>& aFrames,
+                                                 const std::vector<uint32_t>& aLengths)
+{
+  NfcEvent* event = mQueue.Acquire(MSG_TAG_TRANSCEIVE_BATCH);
+  if (!event) {
+    return false;
+  }
+  event->tech = aTech;
+  event->flags = aFlags;
+  event->frameLengths = aLengths;
+  event->buffer.clear();
+  for (size_t i = 0; i < aFrames.size(); i++) {
+    event->buffer.insert(event->buffer.end(), aFrames[i], aFrames[i] + aLengths[i]);
+  }
+  mQueue.Publish(event);
+  return true;
+}
+
+static bool IsStatusWordOk(const uint8_t* aResponse, uint32_t aLength)
+{
+  return aLength >= 2 &&
+         aResponse[aLength - 2] == 0x90 &&
+         aResponse[aLength - 1] == 0x00;
+}
+
+void NfcService::HandleTagTransceiveBatchResponse(NfcEvent* aEvent)
+{
+  INfcTag* pINfcTag = reinterpret_cast<INfcTag*>
+                      (sNfcManager->QueryInterface(INTERFACE_TAG_MANAGER));
+
+  bool stopOnStatusError = aEvent->flags & NFC_TRANSCEIVE_BATCH_STOP_ON_STATUS_ERROR;
+  std::vector<uint32_t>& lengths = aEvent->frameLengths;
+  const uint8_t* frame = aEvent->buffer.empty() ? NULL : &aEvent->buffer[0];
+  // Responses are appended one after the other to the reused buffer.
+  std::vector<uint8_t>& responses = mTransceiveResponse;
+  std::vector<uint32_t>& responseLengths = mTransceiveResponseLengths;
+  responses.clear();
+  responseLengths.clear();
+
+  NfcErrorCode code = !pINfcTag ? NFC_ERROR_NOT_SUPPORTED :
+                      pINfcTag->Connect(static_cast<TagTechnology>(aEvent->tech)) ?
+                      NFC_SUCCESS : NFC_ERROR_IO;
+
+  for (size_t i = 0; NFC_SUCCESS == code && i < lengths.size(); i++) {
+    mTransceiveCommand.assign(frame, frame + lengths[i]);
+    frame += lengths[i];
+
+    size_t offset = responses.size();
+    if (!pINfcTag->Transceive(mTransceiveCommand, responses)) {
+      code = NFC_ERROR_IO;
+      break;
+    }
+
+    uint32_t length = responses.size() - offset;
+    responseLengths.push_back(length);
+
+    if (stopOnStatusError &&
+        !IsStatusWordOk(length ? &responses[offset] : NULL, length)) {
+      NFCD_DEBUG("stop batch at frame %zu", i);
+      break;
+    }
+  }
+
+  TransceiveBatchEvent event;
+  event.count = responseLengths.size();
+  event.lengths = responseLengths.empty() ? NULL : &responseLengths[0];
+  event.responses = responses.empty() ? NULL : &responses[0];
+
+  mPresenceCheck->NotifyActivity();
+  mMsgHandler->ProcessResponse(NFC_RESPONSE_TAG_TRANSCEIVE_BATCH, code,
+                               reinterpret_cast<void*>(&event));
+}
+
+bool NfcService::HandleLlcpMetricsRequest()
+{
+  NfcEvent* event = mQueue.Acquire(MSG_LLCP_METRICS);
+  if (!event) {
+    return false;
+  }
+  mQueue.Publish(event);
+  return true;
+}
+
+void NfcService::HandleLlcpMetricsResponse(NfcEvent* aEvent)
+{
+  // Reuse the connection list across queries.
+  sNfcManager->GetLlcpMetrics(mLlcpMetrics);
+  mMsgHandler->ProcessResponse(NFC_RESPONSE_LLCP_METRICS, NFC_SUCCESS,
+                               reinterpret_cast<void*>(&mLlcpMetrics));
+}
+
 void NfcService::HandleNdefFormatResponse(NfcEvent* aEvent)
 {
   INfcTag* pINfcTag = reinterpret_cast<INfcTag*>
@@ -580,21 +650,24 @@ void NfcService::HandleNdefFormatResponse(NfcEvent* aEvent)
                       (pINfcTag->FormatNdef() ? NFC_SUCCESS : NFC_ERROR_IO) :
                       NFC_ERROR_NOT_SUPPORTED;
 
+  mPresenceCheck->NotifyActivity();
   mMsgHandler->ProcessResponse(NFC_RESPONSE_FORMAT, code, NULL);
 }
 
 bool NfcService::HandleEnterLowPowerRequest(bool aEnter)
 {
-  NfcEvent *event = new NfcEvent(MSG_LOW_POWER);
-  event->arg1 = aEnter;
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_LOW_POWER);
+  if (!event) {
+    return false;
+  }
+  event->enable = aEnter;
+  mQueue.Publish(event);
   return true;
 }
 
 void NfcService::HandleEnterLowPowerResponse(NfcEvent* aEvent)
 {
-  bool low = aEvent->arg1;
+  bool low = aEvent->enable;
 
   NfcErrorCode code = SetLowPowerMode(low);
 
@@ -604,10 +677,12 @@ void NfcService::HandleEnterLowPowerResponse(NfcEvent* aEvent)
 
 bool NfcService::HandleEnableRequest(bool aEnable)
 {
-  NfcEvent *event = new NfcEvent(MSG_ENABLE);
-  event->arg1 = aEnable;
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_ENABLE);
+  if (!event) {
+    return false;
+  }
+  event->enable = aEnable;
+  mQueue.Publish(event);
   return true;
 }
 
@@ -620,7 +695,7 @@ void NfcService::HandleEnableResponse(NfcEvent* aEvent)
 {
   NfcErrorCode code = NFC_SUCCESS;
 
-  bool enable = aEvent->arg1;
+  bool enable = aEvent->enable;
   if (enable) {
     // Disable low power mode if already in low power mode
     if (mState == STATE_NFC_ON_LOW_POWER) {
@@ -696,6 +771,7 @@ NfcErrorCode NfcService::DisableNfc()
   }
 
   mState = STATE_NFC_OFF;
+  mQueue.DumpStats();
 
   return NFC_SUCCESS;
 }
@@ -728,10 +804,14 @@ NfcErrorCode NfcService::SetLowPowerMode(bool aLow)
 
 void NfcService::OnP2pReceivedNdef(NdefMessage* aNdef)
 {
-  NfcEvent *event = new NfcEvent(MSG_RECEIVE_NDEF_EVENT);
-
-  event->obj = aNdef ? new NdefMessage(aNdef) : NULL;
-
-  mQueue.push_back(event);
-  sem_post(&thread_sem);
+  NfcEvent* event = mQueue.Acquire(MSG_RECEIVE_NDEF_EVENT);
+  if (!event) {
+    return;
+  }
+  event->hasNdef = !!aNdef;
+  if (aNdef) {
+    // Element-wise assignment reuses the record storage already in the slot.
+    event->ndef.mRecords = aNdef->mRecords;
+  }
+  mQueue.Publish(event);
 }
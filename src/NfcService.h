@@ -17,18 +17,19 @@
 #ifndef mozilla_nfcd_NfcService_h
 #define mozilla_nfcd_NfcService_h
 
-#include "utils/List.h"
 #include "IpcSocketListener.h"
-#include "NfcManager.h"
+#include "NfcEventQueue.h"
 #include "NfcGonkMessage.h"
+#include "LlcpMetrics.h"
 
 class NdefMessage;
 class MessageHandler;
-class NfcEvent;
 class INfcManager;
+class NfcManager;
 class INfcTag;
 class IP2pDevice;
 class P2pLinkManager;
+class PresenceCheckScheduler;
 
 class NfcService : public IpcSocketListener {
 public:
@@ -66,14 +67,23 @@ public:
   void HandleNdefFormatResponse(NfcEvent* aEvent);
   bool HandleTagTransceiveRequest(int aTech, const uint8_t* aBuf, uint32_t aBufLen);
   void HandleTagTransceiveResponse(NfcEvent* aEvent);
+  bool HandleTagTransceiveBatchRequest(int aTech,
+                                       uint32_t aFlags,
+                                       const std::vector<const uint8_t*>& aFrames,
+                                       const std::vector<uint32_t>& aLengths);
+  void HandleTagTransceiveBatchResponse(NfcEvent* aEvent);
+  bool HandleLlcpMetricsRequest();
+  void HandleLlcpMetricsResponse(NfcEvent* aEvent);
   bool HandleEnterLowPowerRequest(bool aEnter);
   void HandleEnterLowPowerResponse(NfcEvent* aEvent);
   bool HandleEnableRequest(bool aEnable);
   void HandleEnableResponse(NfcEvent* aEvent);
   void HandleReceiveNdefEvent(NfcEvent* aEvent);
+  void HandleP2pPushComplete(NfcEvent* aEvent);
 
   void OnConnected();
   void OnP2pReceivedNdef(NdefMessage* aNdef);
+  void OnP2pPushComplete(bool aSuccess);
   NfcErrorCode EnableNfc();
   NfcErrorCode DisableNfc();
   NfcErrorCode SetLowPowerMode(bool aLow);
@@ -89,9 +99,16 @@ private:
   bool mIsTagPresent;
   static NfcService* sInstance;
   static NfcManager* sNfcManager;
-  android::List<NfcEvent*> mQueue;
+  NfcEventQueue mQueue;
+  // Scratch buffers reused by the event loop.
+  std::vector<uint8_t> mTechListBuf;
+  std::vector<uint8_t> mTransceiveResponse;
+  std::vector<uint8_t> mTransceiveCommand;
+  std::vector<uint32_t> mTransceiveResponseLengths;
+  LlcpLinkMetrics mLlcpMetrics;
   MessageHandler* mMsgHandler;
   P2pLinkManager* mP2pLinkManager;
+  PresenceCheckScheduler* mPresenceCheck;
 };
 
 #endif // mozilla_nfcd_NfcService_h
@@ -18,13 +18,17 @@
 
 void NfcUtil::ConvertNdefPduToNdefMessage(NdefMessagePdu& aNdefPdu,
                                           NdefMessage* aNdefMessage) {
+  std::vector<NdefRecord>& records = aNdefMessage->mRecords;
+  records.reserve(records.size() + aNdefPdu.numRecords);
   for (uint32_t i = 0; i < aNdefPdu.numRecords; i++) {
     NdefRecordPdu& record = aNdefPdu.records[i];
-    aNdefMessage->mRecords.push_back(NdefRecord(
-      record.tnf,
-      record.typeLength, record.type,
-      record.idLength, record.id,
-      record.payloadLength, record.payload));
+    std::vector<uint8_t> type(record.type, record.type + record.typeLength);
+    std::vector<uint8_t> id(record.id, record.id + record.idLength);
+    std::vector<uint8_t> payload(record.payload,
+                                 record.payload + record.payloadLength);
+    // Append an empty record and move the fields in, so they are copied once.
+    records.push_back(NdefRecord());
+    records.back().Adopt(record.tnf, type, id, payload);
   }
 }
 
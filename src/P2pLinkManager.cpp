@@ -16,6 +16,9 @@
 
 #include "P2pLinkManager.h"
 
+#include <stdlib.h>
+#include <cutils/properties.h>
+
 #include "NdefMessage.h"
 #include "SnepMessage.h"
 #include "SnepServer.h"
@@ -30,6 +33,8 @@ static const uint8_t RTD_HANDOVER_SELECT[2] = {0x48, 0x73};   // "Hs"
 static const uint8_t RTD_HANDOVER_CARRIER[2] = {0x48, 0x63};  // "Hc"
 static const uint8_t RTD_HANDOVER_SIZE = 2;
 
+#define PRECONNECT_PROPERTY "nfcd.p2p.preconnect"
+
 enum HandoverType {
   NOT_HANDOVER = -1,
   HANDOVER_REQUEST,
@@ -96,6 +101,11 @@ void HandoverCallback::OnMessageReceived(NdefMessage* aNdef)
 P2pLinkManager::P2pLinkManager(NfcService* aService)
  : mLinkState(LINK_STATE_DOWN)
  , mSessionId(-1)
+ , mLinkGeneration(0)
+ , mClientGeneration(0)
+ , mPreconnectPending(false)
+ , mPushThreadExit(false)
+ , mPreconnect(false)
  , mSnepClient(NULL)
  , mHandoverClient(NULL)
 {
@@ -107,10 +117,36 @@ P2pLinkManager::P2pLinkManager(NfcService* aService)
 
   mNfcService = aService;
   sP2pLinkManager = this;
+
+  char value[PROPERTY_VALUE_MAX];
+  if (property_get(PRECONNECT_PROPERTY, value, NULL) > 0) {
+    mPreconnect = atoi(value) != 0;
+  }
+
+  pthread_mutex_init(&mPushMutex, NULL);
+  pthread_cond_init(&mPushCond, NULL);
+  if (pthread_create(&mPushThread, NULL, PushThreadFunc, this) != 0) {
+    NFCD_ERROR("pthread_create failed");
+    abort();
+  }
 }
 
 P2pLinkManager::~P2pLinkManager()
 {
+  CancelPushes();
+  pthread_mutex_lock(&mPushMutex);
+  mPushThreadExit = true;
+  pthread_cond_signal(&mPushCond);
+  pthread_mutex_unlock(&mPushMutex);
+  pthread_join(mPushThread, NULL);
+
+  while (!mPushQueue.empty()) {
+    delete mPushQueue.front().ndef;
+    mPushQueue.pop_front();
+  }
+  pthread_cond_destroy(&mPushCond);
+  pthread_mutex_destroy(&mPushMutex);
+
   DisconnectClients();
 
   delete mSnepCallback;
@@ -133,17 +169,109 @@ void P2pLinkManager::EnableDisable(bool aEnable)
     mSnepServer->Stop();
     mHandoverServer->Stop();
 
-    DisconnectClients();
+    CancelPushes();
   }
 }
 
-// TODO : P2P push will block in llcp socket send/receive.
-//        Maybe we should create a thread to do it ?
 void P2pLinkManager::Push(NdefMessage& aNdef)
+{
+  PendingPush push;
+  push.ndef = new NdefMessage();
+  push.ndef->mRecords.swap(aNdef.mRecords);
+
+  pthread_mutex_lock(&mPushMutex);
+  push.linkGeneration = mLinkGeneration;
+  mPushQueue.push_back(push);
+  pthread_cond_signal(&mPushCond);
+  pthread_mutex_unlock(&mPushMutex);
+}
+
+void P2pLinkManager::CancelPushes()
+{
+  // The push thread fails the queued pushes and drops the clients. A push
+  // in progress is unblocked by the stack closing its connection.
+  pthread_mutex_lock(&mPushMutex);
+  mLinkGeneration++;
+  mPreconnectPending = false;
+  pthread_cond_signal(&mPushCond);
+  pthread_mutex_unlock(&mPushMutex);
+}
+
+void* P2pLinkManager::PushThreadFunc(void* aArg)
+{
+  pthread_setname_np(pthread_self(), "P2P push thread");
+  return reinterpret_cast<P2pLinkManager*>(aArg)->PushLoop();
+}
+
+void* P2pLinkManager::PushLoop()
+{
+  while (true) {
+    pthread_mutex_lock(&mPushMutex);
+    while (!mPushThreadExit && mPushQueue.empty() && !mPreconnectPending &&
+           mClientGeneration == mLinkGeneration) {
+      pthread_cond_wait(&mPushCond, &mPushMutex);
+    }
+    if (mPushThreadExit) {
+      pthread_mutex_unlock(&mPushMutex);
+      break;
+    }
+
+    const uint32_t linkGeneration = mLinkGeneration;
+    const bool preconnect = mPreconnectPending;
+    mPreconnectPending = false;
+    PendingPush push = { NULL, 0 };
+    if (!mPushQueue.empty()) {
+      push = mPushQueue.front();
+      mPushQueue.pop_front();
+    }
+    pthread_mutex_unlock(&mPushMutex);
+
+    // Clients connected on a link that is gone can't be used anymore.
+    if (mClientGeneration != linkGeneration) {
+      DisconnectClients();
+      mClientGeneration = linkGeneration;
+    }
+
+    if (preconnect) {
+      NFCD_DEBUG("pre-connect clients");
+      GetSnepClient();
+      GetHandoverClient();
+    }
+
+    if (!push.ndef) {
+      continue;
+    }
+
+    bool success = false;
+    if (push.linkGeneration == linkGeneration) {
+      success = DoPush(*push.ndef);
+      if (!success) {
+        // Don't keep a connection the peer may have dropped, the next push
+        // connects again.
+        DisconnectClients();
+      }
+
+      pthread_mutex_lock(&mPushMutex);
+      if (push.linkGeneration != mLinkGeneration) {
+        NFCD_DEBUG("link lost during push");
+        success = false;
+      }
+      pthread_mutex_unlock(&mPushMutex);
+    } else {
+      NFCD_DEBUG("push cancelled");
+    }
+
+    delete push.ndef;
+    mNfcService->OnP2pPushComplete(success);
+  }
+  return NULL;
+}
+
+bool P2pLinkManager::DoPush(NdefMessage& aNdef)
 {
   if (aNdef.mRecords.size() == 0) {
     NFCD_ERROR("no NDEF record");
-    return;
+    return false;
   }
 
   // In current design nfcd only provide one "push" API to send a NDEF message through P2P link.
@@ -171,6 +299,7 @@ void P2pLinkManager::Push(NdefMessage& aNdef)
       if (selectMsg) {
         NotifyNdefReceived(selectMsg);
         delete selectMsg;
+        return true;
       }
     } else {
       NFCD_ERROR("handover client not connected");
@@ -181,7 +310,7 @@ void P2pLinkManager::Push(NdefMessage& aNdef)
   } else if (HANDOVER_SELECT == handoverType) {
     if (mHandoverServer) {
       NFCD_DEBUG("send Handover Select by handover server");
-      mHandoverServer->Put(aNdef);
+      return mHandoverServer->Put(aNdef);
     } else {
       NFCD_ERROR("handover server not created");
     }
@@ -190,23 +319,31 @@ void P2pLinkManager::Push(NdefMessage& aNdef)
     SnepClient* pClient = GetSnepClient();
     if (pClient) {
       NFCD_DEBUG("send NDEF by SNEP client");
-      pClient->Put(aNdef);
+      return pClient->Put(aNdef);
     } else {
       NFCD_ERROR("snep client not connected");
     }
   }
+  return false;
 }
 
 void P2pLinkManager::OnLlcpActivated()
 {
   mLinkState = LINK_STATE_UP;
+
+  if (mPreconnect) {
+    pthread_mutex_lock(&mPushMutex);
+    mPreconnectPending = true;
+    pthread_cond_signal(&mPushCond);
+    pthread_mutex_unlock(&mPushMutex);
+  }
 }
 
 void P2pLinkManager::OnLlcpDeactivated()
 {
   mLinkState = LINK_STATE_DOWN;
 
-  DisconnectClients();
+  CancelPushes();
 }
 
 SnepClient* P2pLinkManager::GetSnepClient()
@@ -17,6 +17,10 @@
 #ifndef mozilla_nfcd_P2pLinkManager_h
 #define mozilla_nfcd_P2pLinkManager_h
 
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+
 #include "ISnepCallback.h"
 #include "IHandoverCallback.h"
 
@@ -55,7 +59,24 @@ public:
 
   void NotifyNdefReceived(NdefMessage* aNdef);
   void EnableDisable(bool aEnable);
+
+  /**
+   * Queue an NDEF message to be sent to the peer, and return without
+   * waiting for the peer. The result is reported through
+   * NfcService::OnP2pPushComplete(). Pushes still queued or in progress
+   * when the link goes down fail.
+   *
+   * @param  aNdef Message to send, its records are taken over.
+   * @return       None.
+   */
   void Push(NdefMessage& aNdef);
+  /**
+   * Mark the link up. In pre-connect mode, the SNEP and handover clients
+   * are connected in the background right away, so the first push does
+   * not wait for the LLCP connection.
+   *
+   * @return None.
+   */
   void OnLlcpActivated();
   void OnLlcpDeactivated();
   bool IsLlcpActive();
@@ -67,6 +88,18 @@ private:
   static const int LINK_STATE_DOWN = 1;
   static const int LINK_STATE_UP = 2;
 
+  struct PendingPush {
+    NdefMessage* ndef;
+    // Link the push was requested on.
+    uint32_t linkGeneration;
+  };
+
+  static void* PushThreadFunc(void* aArg);
+  void* PushLoop();
+  bool DoPush(NdefMessage& aNdef);
+  void CancelPushes();
+
+  // Clients are only used by the push thread.
   SnepClient* GetSnepClient();
   HandoverClient* GetHandoverClient();
   void DisconnectClients();
@@ -74,6 +107,23 @@ private:
   int mLinkState;
   int mSessionId;
 
+  pthread_t mPushThread;
+  // Fields below are protected by mPushMutex.
+  pthread_mutex_t mPushMutex;
+  pthread_cond_t mPushCond;
+  std::deque<PendingPush> mPushQueue;
+  // Bumped every time the link goes down, so pushes for an older link
+  // are dropped.
+  uint32_t mLinkGeneration;
+  // Link the clients are connected on, only used by the push thread.
+  uint32_t mClientGeneration;
+  // Connect the clients before the first push, see OnLlcpActivated().
+  bool mPreconnectPending;
+  bool mPushThreadExit;
+
+  // Read from the "nfcd.p2p.preconnect" property.
+  bool mPreconnect;
+
   NfcService* mNfcService;
 
   SnepCallback* mSnepCallback;
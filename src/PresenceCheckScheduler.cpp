@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PresenceCheckScheduler.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <cutils/properties.h>
+
+#include "INfcTag.h"
+#include "NfcService.h"
+#include "NfcDebug.h"
+
+#define PRESENCE_CHECK_PROPERTY_PREFIX "nfcd.presence_check."
+#define PRESENCE_CHECK_MAX_PROPERTY PRESENCE_CHECK_PROPERTY_PREFIX "max"
+#define PRESENCE_CHECK_MISSES_PROPERTY PRESENCE_CHECK_PROPERTY_PREFIX "misses"
+
+static const uint32_t DEFAULT_MAX_INTERVAL_MS = 500;
+static const uint32_t MIN_INTERVAL_MS = 50;
+// A single miss is often RF noise, two in a row at the floor interval
+// reliably mean the tag was pulled away.
+static const uint32_t DEFAULT_MAX_MISSES = 2;
+
+static uint32_t ReadIntervalProperty(const char* aKey, uint32_t aDefault)
+{
+  char value[PROPERTY_VALUE_MAX];
+
+  if (property_get(aKey, value, NULL) > 0) {
+    int ms = atoi(value);
+    if (ms > 0) {
+      return ms;
+    }
+  }
+  return aDefault;
+}
+
+static const struct {
+  TagTechnology tech;
+  const char* name;
+  uint32_t defaultMs;
+} sDefaultIntervals[] = {
+  { NFC_A,             "nfc_a",             125 },
+  { NFC_B,             "nfc_b",             125 },
+  { NFC_F,             "nfc_f",             250 },
+  { NFC_V,             "nfc_v",             250 },
+  { NFC_ISO_DEP,       "iso_dep",           125 },
+  { MIFARE_CLASSIC,    "mifare_classic",    125 },
+  { MIFARE_ULTRALIGHT, "mifare_ultralight", 125 },
+  { NFC_BARCODE,       "nfc_barcode",       250 },
+  { UNKNOWN,           "default",           250 },
+};
+
+PresenceCheckScheduler::PresenceCheckScheduler()
+ : mTimerFd(-1)
+ , mMaxIntervalMs(DEFAULT_MAX_INTERVAL_MS)
+ , mMaxMisses(DEFAULT_MAX_MISSES)
+ , mTag(NULL)
+ , mSessionId(-1)
+ , mBaseIntervalMs(0)
+ , mIntervalMs(0)
+ , mActivity(false)
+ , mMisses(0)
+ , mGeneration(0)
+{
+  pthread_mutex_init(&mMutex, NULL);
+
+  for (size_t i = 0; i < sizeof(sDefaultIntervals) / sizeof(sDefaultIntervals[0]); i++) {
+    mIntervals[sDefaultIntervals[i].tech] = sDefaultIntervals[i].defaultMs;
+  }
+}
+
+PresenceCheckScheduler::~PresenceCheckScheduler()
+{
+  if (mTimerFd >= 0) {
+    close(mTimerFd);
+  }
+  pthread_mutex_destroy(&mMutex);
+}
+
+bool PresenceCheckScheduler::Initialize()
+{
+  for (size_t i = 0; i < sizeof(sDefaultIntervals) / sizeof(sDefaultIntervals[0]); i++) {
+    char key[PROPERTY_KEY_MAX];
+    TagTechnology tech = sDefaultIntervals[i].tech;
+
+    snprintf(key, sizeof(key), PRESENCE_CHECK_PROPERTY_PREFIX "%s",
+             sDefaultIntervals[i].name);
+    mIntervals[tech] = ReadIntervalProperty(key, mIntervals[tech]);
+  }
+  mMaxIntervalMs = ReadIntervalProperty(PRESENCE_CHECK_MAX_PROPERTY, mMaxIntervalMs);
+  mMaxMisses = ReadIntervalProperty(PRESENCE_CHECK_MISSES_PROPERTY, mMaxMisses);
+
+  mTimerFd = timerfd_create(CLOCK_MONOTONIC, 0);
+  if (mTimerFd < 0) {
+    NFCD_ERROR("timerfd_create failed, errno=%d", errno);
+    return false;
+  }
+
+  if (pthread_create(&mThread, NULL, ThreadFunc, this) != 0) {
+    NFCD_ERROR("pthread_create failed");
+    close(mTimerFd);
+    mTimerFd = -1;
+    return false;
+  }
+
+  return true;
+}
+
+void PresenceCheckScheduler::Start(INfcTag* aTag, int aSessionId)
+{
+  uint32_t interval = SelectInterval(aTag);
+
+  pthread_mutex_lock(&mMutex);
+  mTag = aTag;
+  mSessionId = aSessionId;
+  mBaseIntervalMs = interval;
+  mIntervalMs = interval;
+  mActivity = false;
+  mMisses = 0;
+  mGeneration++;
+  pthread_mutex_unlock(&mMutex);
+
+  NFCD_DEBUG("session=%d interval=%ums", aSessionId, interval);
+  Arm(interval);
+}
+
+void PresenceCheckScheduler::NotifyActivity()
+{
+  pthread_mutex_lock(&mMutex);
+  if (!mTag) {
+    pthread_mutex_unlock(&mMutex);
+    return;
+  }
+  mActivity = true;
+  uint32_t interval = NextIntervalLocked();
+  pthread_mutex_unlock(&mMutex);
+
+  // Bring the pending check forward. If a check is running, the loop
+  // re-arms the timer afterwards and this expiry is superseded.
+  Arm(interval);
+}
+
+uint32_t PresenceCheckScheduler::NextIntervalLocked()
+{
+  if (mActivity) {
+    mIntervalMs = mBaseIntervalMs / 2;
+  } else {
+    mIntervalMs += mIntervalMs / 2;
+  }
+
+  if (mIntervalMs < MIN_INTERVAL_MS) {
+    mIntervalMs = MIN_INTERVAL_MS;
+  }
+  uint32_t maxInterval = mMaxIntervalMs > mBaseIntervalMs ? mMaxIntervalMs : mBaseIntervalMs;
+  if (mIntervalMs > maxInterval) {
+    mIntervalMs = maxInterval;
+  }
+  return mIntervalMs;
+}
+
+uint32_t PresenceCheckScheduler::GetInterval(TagTechnology aTech)
+{
+  if (aTech < NFC_A || aTech > UNKNOWN) {
+    aTech = UNKNOWN;
+  }
+  return mIntervals[aTech];
+}
+
+uint32_t PresenceCheckScheduler::SelectInterval(INfcTag* aTag)
+{
+  // A tag may expose several technologies, use the tightest interval.
+  std::vector<TagTechnology>& techList = aTag->GetTechList();
+  uint32_t interval = 0;
+
+  for (size_t i = 0; i < techList.size(); i++) {
+    uint32_t techInterval = GetInterval(techList[i]);
+    if (!interval || techInterval < interval) {
+      interval = techInterval;
+    }
+  }
+
+  return interval ? interval : GetInterval(UNKNOWN);
+}
+
+void PresenceCheckScheduler::Arm(uint32_t aIntervalMs)
+{
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = aIntervalMs / 1000;
+  spec.it_value.tv_nsec = (aIntervalMs % 1000) * 1000000;
+
+  if (timerfd_settime(mTimerFd, 0, &spec, NULL) < 0) {
+    NFCD_ERROR("timerfd_settime failed, errno=%d", errno);
+  }
+}
+
+void* PresenceCheckScheduler::ThreadFunc(void* aArg)
+{
+  pthread_setname_np(pthread_self(), "NFC presence check");
+  PresenceCheckScheduler* scheduler = reinterpret_cast<PresenceCheckScheduler*>(aArg);
+  return scheduler->Loop();
+}
+
+void* PresenceCheckScheduler::Loop()
+{
+  struct pollfd fds;
+  fds.fd = mTimerFd;
+  fds.events = POLLIN;
+
+  while (true) {
+    fds.revents = 0;
+    if (poll(&fds, 1, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      NFCD_ERROR("poll failed, errno=%d", errno);
+      abort();
+    }
+
+    uint64_t expirations;
+    if (read(mTimerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+      continue;
+    }
+
+    pthread_mutex_lock(&mMutex);
+    INfcTag* tag = mTag;
+    int sessionId = mSessionId;
+    uint32_t generation = mGeneration;
+    // Activity reported from now on happens after this check.
+    mActivity = false;
+    pthread_mutex_unlock(&mMutex);
+
+    if (!tag) {
+      continue;
+    }
+
+    // Blocks until the controller reports the result.
+    PresenceCheckResult result = tag->PresenceCheck();
+
+    uint32_t interval = 0;
+    bool present = false;
+    pthread_mutex_lock(&mMutex);
+    bool current = generation == mGeneration;
+    if (current) {
+      if (result == PRESENCE_CHECK_PRESENT) {
+        mMisses = 0;
+        interval = NextIntervalLocked();
+        mActivity = false;
+        present = true;
+      } else if (result == PRESENCE_CHECK_MISSED && ++mMisses < mMaxMisses) {
+        // The tag is probably leaving, confirm as fast as possible and
+        // restart the back-off from the floor.
+        mIntervalMs = MIN_INTERVAL_MS;
+        interval = MIN_INTERVAL_MS;
+        present = true;
+      } else {
+        mTag = NULL;
+      }
+    }
+    pthread_mutex_unlock(&mMutex);
+
+    if (!current) {
+      // A new tag was discovered meanwhile and re-armed the timer.
+      continue;
+    }
+
+    if (present) {
+      Arm(interval);
+      continue;
+    }
+
+    NFCD_DEBUG("tag lost, session=%d", sessionId);
+    NfcService::Instance()->TagRemoved();
+    tag->Disconnect();
+    NfcService::NotifyTagLost(sessionId);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_PresenceCheckScheduler_h
+#define mozilla_nfcd_PresenceCheckScheduler_h
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "TagTechnology.h"
+
+class INfcTag;
+
+/**
+ * Drives presence checks of the connected tag from a single long-lived
+ * thread woken by a timerfd. When the tag is gone it is disconnected and
+ * MSG_TAG_LOST is posted through the NfcService event queue.
+ *
+ * The interval is adaptive. Each technology has a base interval, which can
+ * be overridden with the "nfcd.presence_check.<tech>" properties (ms).
+ * Checks of an idle tag back off up to "nfcd.presence_check.max", and any
+ * I/O with the tag tightens the next check to half the base interval,
+ * since the user is likely to remove the tag right after using it.
+ *
+ * A failed check makes the tag suspect: checks then run at the floor
+ * interval until one succeeds, or until "nfcd.presence_check.misses"
+ * consecutive checks failed and the tag is reported lost.
+ */
+class PresenceCheckScheduler {
+public:
+  PresenceCheckScheduler();
+  ~PresenceCheckScheduler();
+
+  /**
+   * Create the timer and start the scheduler thread.
+   *
+   * @return True if ok.
+   */
+  bool Initialize();
+
+  /**
+   * Start checking a newly discovered tag. Replaces the tag being checked,
+   * if any.
+   *
+   * @param  aTag       Tag to check.
+   * @param  aSessionId Session id reported in the tag lost notification.
+   * @return            None.
+   */
+  void Start(INfcTag* aTag, int aSessionId);
+
+  /**
+   * Notify that the application did I/O with the tag, e.g. a transceive.
+   *
+   * @return None.
+   */
+  void NotifyActivity();
+
+  /**
+   * Get the base presence-check interval used for a tag technology.
+   *
+   * @param  aTech Tag technology.
+   * @return       Interval in milliseconds.
+   */
+  uint32_t GetInterval(TagTechnology aTech);
+
+private:
+  static void* ThreadFunc(void* aArg);
+  void* Loop();
+
+  void Arm(uint32_t aIntervalMs);
+  uint32_t SelectInterval(INfcTag* aTag);
+  uint32_t NextIntervalLocked();
+
+  int mTimerFd;
+  pthread_t mThread;
+
+  // Indexed by TagTechnology, UNKNOWN holds the default.
+  uint32_t mIntervals[UNKNOWN + 1];
+  // Upper bound of the back-off of idle tags.
+  uint32_t mMaxIntervalMs;
+  // Consecutive failed checks after which the tag is lost.
+  uint32_t mMaxMisses;
+
+  // Fields below are protected by mMutex.
+  pthread_mutex_t mMutex;
+  INfcTag* mTag;
+  int mSessionId;
+  uint32_t mBaseIntervalMs;
+  uint32_t mIntervalMs;
+  bool mActivity;
+  // Consecutive failed checks of the current tag.
+  uint32_t mMisses;
+  // Bumped on every Start() so a check in flight for a previous tag is
+  // ignored.
+  uint32_t mGeneration;
+};
+
+#endif // mozilla_nfcd_PresenceCheckScheduler_h
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WorkerPool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <cutils/properties.h>
+
+#include "NfcDebug.h"
+
+#define WORKER_POOL_SIZE_PROPERTY "nfcd.p2p.workers"
+
+// One link for each of the SNEP and handover services.
+static const int DEFAULT_WORKERS = 2;
+static const int MIN_WORKERS = 1;
+
+WorkerPool& WorkerPool::GetInstance()
+{
+  static WorkerPool sInstance;
+  return sInstance;
+}
+
+WorkerPool::WorkerPool()
+ : mMaxWorkers(DEFAULT_WORKERS)
+ , mWorkers(0)
+ , mIdleWorkers(0)
+{
+  pthread_mutex_init(&mMutex, NULL);
+  pthread_cond_init(&mCond, NULL);
+
+  char value[PROPERTY_VALUE_MAX];
+  if (property_get(WORKER_POOL_SIZE_PROPERTY, value, NULL) > 0) {
+    int workers = atoi(value);
+    mMaxWorkers = workers < MIN_WORKERS ? MIN_WORKERS : workers;
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  // Workers are detached and never exit, the pool lives as long as nfcd.
+}
+
+bool WorkerPool::Post(Task aTask, void* aArg)
+{
+  Work work;
+  work.task = aTask;
+  work.arg = aArg;
+
+  pthread_mutex_lock(&mMutex);
+  mQueue.push_back(work);
+
+  if (mIdleWorkers >= static_cast<int>(mQueue.size())) {
+    pthread_cond_signal(&mCond);
+  } else if (mWorkers < mMaxWorkers) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t tid;
+    if (pthread_create(&tid, &attr, ThreadFunc, this) != 0) {
+      NFCD_ERROR("pthread_create failed");
+      mQueue.pop_back();
+      pthread_attr_destroy(&attr);
+      pthread_mutex_unlock(&mMutex);
+      return false;
+    }
+    pthread_attr_destroy(&attr);
+    mWorkers++;
+  } else {
+    NFCD_DEBUG("all %d workers busy, %u tasks waiting",
+               mWorkers, static_cast<uint32_t>(mQueue.size()));
+  }
+
+  pthread_mutex_unlock(&mMutex);
+  return true;
+}
+
+void* WorkerPool::ThreadFunc(void* aArg)
+{
+  reinterpret_cast<WorkerPool*>(aArg)->Loop();
+  return NULL;
+}
+
+void WorkerPool::Loop()
+{
+  pthread_mutex_lock(&mMutex);
+  while (true) {
+    while (mQueue.empty()) {
+      mIdleWorkers++;
+      pthread_cond_wait(&mCond, &mMutex);
+      mIdleWorkers--;
+    }
+
+    Work work = mQueue.front();
+    mQueue.pop_front();
+    pthread_mutex_unlock(&mMutex);
+
+    work.task(work.arg);
+
+    pthread_mutex_lock(&mMutex);
+  }
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_WorkerPool_h
+#define mozilla_nfcd_WorkerPool_h
+
+#include <pthread.h>
+#include <deque>
+
+/**
+ * Threads shared by the P2P services for serving accepted LLCP connections.
+ * The accept loops have threads of their own, so they never hold a worker.
+ *
+ * Workers are created on demand up to a limit read from the
+ * "nfcd.p2p.workers" property, and stay around for the next link once
+ * their task returns. When every worker is busy and the limit is reached,
+ * tasks wait in FIFO order.
+ */
+class WorkerPool {
+public:
+  typedef void* (*Task)(void* aArg);
+
+  static WorkerPool& GetInstance();
+
+  /**
+   * Run a task on a worker.
+   *
+   * @param  aTask Function to run, may block.
+   * @param  aArg  Argument of aTask.
+   * @return       True if the task is queued.
+   */
+  bool Post(Task aTask, void* aArg);
+
+private:
+  WorkerPool();
+  ~WorkerPool();
+
+  static void* ThreadFunc(void* aArg);
+  void Loop();
+
+  struct Work {
+    Task task;
+    void* arg;
+  };
+
+  pthread_mutex_t mMutex;
+  pthread_cond_t mCond;
+  std::deque<Work> mQueue;
+  int mMaxWorkers;
+  int mWorkers;
+  int mIdleWorkers;
+};
+
+#endif // mozilla_nfcd_WorkerPool_h
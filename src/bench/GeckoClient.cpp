@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GeckoClient.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "NfcGonkMessage.h"
+
+// Notifications have the top bit of the type set.
+#define NOTIFICATION_FLAG 0x80000000
+// Largest message accepted, nfcd never sends more than an NDEF message.
+#define MAX_MESSAGE_BYTES (16 * 1024 * 1024)
+
+GeckoClient::GeckoClient()
+ : mListenFd(-1)
+ , mFd(-1)
+{
+}
+
+GeckoClient::~GeckoClient()
+{
+  if (mFd >= 0) {
+    close(mFd);
+  }
+  if (mListenFd >= 0) {
+    close(mListenFd);
+  }
+}
+
+uint64_t GeckoClient::NowUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool GeckoClient::Listen(const char* aSocketName)
+{
+  size_t len = strlen(aSocketName);
+  struct sockaddr_un addr;
+  // Abstract name between a leading and a trailing '\0', as nfcd builds it.
+  if (len + 2 > sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket name too long\n");
+    return false;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path + 1, aSocketName, len);
+  socklen_t addrLen = offsetof(struct sockaddr_un, sun_path) + len + 2;
+
+  mListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (mListenFd < 0) {
+    fprintf(stderr, "socket: %s\n", strerror(errno));
+    return false;
+  }
+  if (bind(mListenFd, reinterpret_cast<struct sockaddr*>(&addr), addrLen) < 0 ||
+      listen(mListenFd, 1) < 0) {
+    fprintf(stderr, "bind %s: %s\n", aSocketName, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool GeckoClient::Accept()
+{
+  do {
+    mFd = accept(mListenFd, NULL, NULL);
+  } while (mFd < 0 && errno == EINTR);
+
+  if (mFd < 0) {
+    fprintf(stderr, "accept: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool GeckoClient::SendRequest(int32_t aType, const std::vector<int32_t>& aFields)
+{
+  uint32_t size = (aFields.size() + 1) * sizeof(int32_t);
+  std::vector<uint8_t> buf(sizeof(uint32_t) + size);
+
+  // Size is big-endian, fields are in host order.
+  buf[0] = size >> 24;
+  buf[1] = size >> 16;
+  buf[2] = size >> 8;
+  buf[3] = size;
+  memcpy(&buf[4], &aType, sizeof(aType));
+  if (!aFields.empty()) {
+    memcpy(&buf[8], &aFields[0], aFields.size() * sizeof(int32_t));
+  }
+
+  size_t offset = 0;
+  while (offset < buf.size()) {
+    ssize_t written = write(mFd, &buf[offset], buf.size() - offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "write: %s\n", strerror(errno));
+      return false;
+    }
+    offset += written;
+  }
+  return true;
+}
+
+bool GeckoClient::ReadFully(uint8_t* aBuf, size_t aLength, int aTimeoutMs)
+{
+  size_t offset = 0;
+  while (offset < aLength) {
+    struct pollfd fds;
+    fds.fd = mFd;
+    fds.events = POLLIN;
+    fds.revents = 0;
+
+    int ret = poll(&fds, 1, aTimeoutMs);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return false;
+    }
+
+    ssize_t len = read(mFd, aBuf + offset, aLength - offset);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      return false;
+    }
+    offset += len;
+  }
+  return true;
+}
+
+bool GeckoClient::Receive(Message& aMessage, int aTimeoutMs)
+{
+  uint8_t header[4];
+  if (!ReadFully(header, sizeof(header), aTimeoutMs)) {
+    return false;
+  }
+
+  uint32_t size = (header[0] << 24) | (header[1] << 16) |
+                  (header[2] << 8) | header[3];
+  if (size < sizeof(int32_t) || size > MAX_MESSAGE_BYTES) {
+    fprintf(stderr, "bad message size %u\n", size);
+    return false;
+  }
+
+  std::vector<uint8_t> buf(size);
+  if (!ReadFully(&buf[0], size, aTimeoutMs)) {
+    return false;
+  }
+  aMessage.time = NowUs();
+
+  uint32_t type;
+  memcpy(&type, &buf[0], sizeof(type));
+  size_t offset = sizeof(type);
+
+  aMessage.isNotification = type & NOTIFICATION_FLAG;
+  aMessage.type = type & ~NOTIFICATION_FLAG;
+  aMessage.error = NFC_SUCCESS;
+  if (!aMessage.isNotification && size >= offset + sizeof(int32_t)) {
+    memcpy(&aMessage.error, &buf[offset], sizeof(int32_t));
+    offset += sizeof(int32_t);
+  }
+  aMessage.body.assign(buf.begin() + offset, buf.end());
+  return true;
+}
+
+bool GeckoClient::WaitNotification(int32_t aType, Message& aMessage, int aTimeoutMs)
+{
+  while (Receive(aMessage, aTimeoutMs)) {
+    if (aMessage.isNotification && aMessage.type == aType) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GeckoClient::WaitResponse(int32_t aType, Message& aMessage, int aTimeoutMs)
+{
+  while (Receive(aMessage, aTimeoutMs)) {
+    if (!aMessage.isNotification && aMessage.type == aType) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_GeckoClient_h
+#define mozilla_nfcd_GeckoClient_h
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Plays the Gecko side of the nfcd IPC socket: listens on an abstract
+ * socket that nfcd connects to (nfcd -a <name>), sends requests and reads
+ * responses and notifications in the format of NfcGonkMessage.h.
+ */
+class GeckoClient {
+public:
+  struct Message {
+    bool isNotification;
+    // NfcResponseType or NfcNotificationType.
+    int32_t type;
+    // Error code of a response.
+    int32_t error;
+    // Fields following the type, or following the error of a response.
+    std::vector<uint8_t> body;
+    // Monotonic time the last byte was read, in microseconds.
+    uint64_t time;
+  };
+
+  GeckoClient();
+  ~GeckoClient();
+
+  /**
+   * Create the listening socket.
+   *
+   * @param  aSocketName Abstract socket name.
+   * @return             False on error.
+   */
+  bool Listen(const char* aSocketName);
+
+  /**
+   * Wait for nfcd to connect.
+   *
+   * @return False on error.
+   */
+  bool Accept();
+
+  /**
+   * Send a request made of 32-bit fields.
+   *
+   * @param  aType   NfcRequestType.
+   * @param  aFields Fields following the type.
+   * @return         False on error.
+   */
+  bool SendRequest(int32_t aType, const std::vector<int32_t>& aFields);
+
+  /**
+   * Read the next message.
+   *
+   * @param  aMessage   Output message.
+   * @param  aTimeoutMs Give up after this long, -1 to wait forever.
+   * @return            False on error, timeout or disconnection.
+   */
+  bool Receive(Message& aMessage, int aTimeoutMs);
+
+  /**
+   * Read messages until a notification of the given type.
+   *
+   * @param  aType      NfcNotificationType.
+   * @param  aMessage   Output message.
+   * @param  aTimeoutMs Timeout for each message, -1 to wait forever.
+   * @return            False on error, timeout or disconnection.
+   */
+  bool WaitNotification(int32_t aType, Message& aMessage, int aTimeoutMs);
+
+  /**
+   * Read messages until a response of the given type.
+   *
+   * @param  aType      NfcResponseType.
+   * @param  aMessage   Output message.
+   * @param  aTimeoutMs Timeout for each message, -1 to wait forever.
+   * @return            False on error, timeout or disconnection.
+   */
+  bool WaitResponse(int32_t aType, Message& aMessage, int aTimeoutMs);
+
+  static uint64_t NowUs();
+
+private:
+  bool ReadFully(uint8_t* aBuf, size_t aLength, int aTimeoutMs);
+
+  int mListenFd;
+  int mFd;
+};
+
+#endif // mozilla_nfcd_GeckoClient_h
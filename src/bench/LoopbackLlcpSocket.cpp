@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LoopbackLlcpSocket.h"
+
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+#include "NfcDebug.h"
+
+// First SAP handed to client sockets, as LLCP does for unnamed services.
+#define FIRST_CLIENT_SAP 0x20
+
+/**
+ * State shared by the two sides of a connection. Side i receives from
+ * rx[i] and is woken through wake[i].
+ */
+struct LoopbackLink {
+  struct Pdu {
+    // Monotonic time the PDU becomes readable, in milliseconds.
+    uint64_t ready;
+    std::vector<uint8_t> data;
+  };
+
+  Mutex mutex;
+  CondVar wake[2];
+  std::deque<Pdu> rx[2];
+  int miu[2];
+  int rw[2];
+  bool closed[2];
+  // Sides still referencing the link.
+  int refs;
+};
+
+static Mutex sServersMutex;
+static std::vector<LoopbackLlcpServerSocket*> sServers;
+static int sNextClientSap = FIRST_CLIENT_SAP;
+
+static uint64_t NowMs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * LoopbackLlcpSocket
+ */
+LoopbackLlcpSocket::LoopbackLlcpSocket(int aMiu, int aRw, uint32_t aLatencyMs)
+ : mLink(NULL)
+ , mSide(0)
+ , mSap(0)
+ , mMiu(aMiu)
+ , mRw(aRw < 1 ? 1 : aRw)
+ , mLatencyMs(aLatencyMs)
+{
+  ResetStats();
+}
+
+LoopbackLlcpSocket::~LoopbackLlcpSocket()
+{
+  Close();
+  if (!mLink) {
+    return;
+  }
+
+  bool last;
+  {
+    AutoMutex lock(mLink->mutex);
+    last = --mLink->refs == 0;
+  }
+  if (last) {
+    delete mLink;
+  }
+}
+
+void LoopbackLlcpSocket::ResetStats()
+{
+  mSentPdus = 0;
+  mSentBytes = 0;
+  mReceivedPdus = 0;
+  mReceivedBytes = 0;
+}
+
+void LoopbackLlcpSocket::Attach(LoopbackLink* aLink, int aSide)
+{
+  mLink = aLink;
+  mSide = aSide;
+  aLink->miu[aSide] = mMiu;
+  aLink->rw[aSide] = mRw;
+  aLink->closed[aSide] = false;
+  aLink->refs++;
+}
+
+bool LoopbackLlcpSocket::Connect(LoopbackLlcpServerSocket* aServer)
+{
+  if (mLink) {
+    NFCD_ERROR("already connected");
+    return false;
+  }
+  if (!aServer) {
+    NFCD_ERROR("no such service");
+    return false;
+  }
+
+  {
+    AutoMutex lock(sServersMutex);
+    mSap = sNextClientSap++;
+  }
+  return aServer->Connect(this);
+}
+
+bool LoopbackLlcpSocket::ConnectToSap(int aSap)
+{
+  return Connect(LoopbackLlcpServerSocket::Find(aSap, NULL));
+}
+
+bool LoopbackLlcpSocket::ConnectToService(const char* aSN)
+{
+  return aSN && Connect(LoopbackLlcpServerSocket::Find(-1, aSN));
+}
+
+void LoopbackLlcpSocket::Close()
+{
+  if (!mLink) {
+    return;
+  }
+
+  AutoMutex lock(mLink->mutex);
+  mLink->closed[mSide] = true;
+  mLink->wake[0].NotifyOne();
+  mLink->wake[1].NotifyOne();
+}
+
+bool LoopbackLlcpSocket::Send(const uint8_t* aData, size_t aLength)
+{
+  if (!mLink) {
+    return false;
+  }
+
+  const int remote = 1 - mSide;
+  AutoMutex lock(mLink->mutex);
+
+  if (aLength > (size_t)mLink->miu[remote]) {
+    NFCD_ERROR("SDU of %u bytes exceeds remote MIU %d",
+               static_cast<uint32_t>(aLength), mLink->miu[remote]);
+    return false;
+  }
+
+  // Wait for the peer to acknowledge, i.e. receive, earlier PDUs.
+  while (!mLink->closed[0] && !mLink->closed[1] &&
+         mLink->rx[remote].size() >= (size_t)mLink->rw[remote]) {
+    mLink->wake[mSide].Wait(mLink->mutex);
+  }
+  if (mLink->closed[0] || mLink->closed[1]) {
+    return false;
+  }
+
+  mLink->rx[remote].push_back(LoopbackLink::Pdu());
+  LoopbackLink::Pdu& pdu = mLink->rx[remote].back();
+  pdu.ready = NowMs() + mLatencyMs;
+  pdu.data.assign(aData, aData + aLength);
+  mLink->wake[remote].NotifyOne();
+
+  mSentPdus++;
+  mSentBytes += aLength;
+  return true;
+}
+
+bool LoopbackLlcpSocket::Send(const struct iovec* aIov, size_t aCount)
+{
+  if (!mLink) {
+    return false;
+  }
+
+  size_t miu;
+  {
+    AutoMutex lock(mLink->mutex);
+    miu = mLink->miu[1 - mSide];
+  }
+
+  // Each PDU is gathered, the loopback copies it anyway.
+  std::vector<uint8_t> pdu;
+  for (size_t i = 0; i < aCount; i++) {
+    const uint8_t* base = static_cast<const uint8_t*>(aIov[i].iov_base);
+    for (size_t offset = 0; offset < aIov[i].iov_len; ) {
+      size_t chunk = aIov[i].iov_len - offset;
+      if (chunk > miu - pdu.size()) {
+        chunk = miu - pdu.size();
+      }
+      pdu.insert(pdu.end(), base + offset, base + offset + chunk);
+      offset += chunk;
+      if (pdu.size() == miu) {
+        if (!Send(&pdu[0], pdu.size())) {
+          return false;
+        }
+        pdu.clear();
+      }
+    }
+  }
+
+  return pdu.empty() || Send(&pdu[0], pdu.size());
+}
+
+int LoopbackLlcpSocket::Receive(uint8_t* aBuf, size_t aLength)
+{
+  if (!mLink) {
+    return -1;
+  }
+
+  const int remote = 1 - mSide;
+  AutoMutex lock(mLink->mutex);
+
+  while (true) {
+    std::deque<LoopbackLink::Pdu>& rx = mLink->rx[mSide];
+    if (!rx.empty()) {
+      uint64_t now = NowMs();
+      if (rx.front().ready > now) {
+        mLink->wake[mSide].Wait(mLink->mutex, rx.front().ready - now);
+        continue;
+      }
+
+      // What does not fit is left for the next call, as NFA does.
+      std::vector<uint8_t>& data = rx.front().data;
+      size_t length = data.size() < aLength ? data.size() : aLength;
+      if (length) {
+        memcpy(aBuf, &data[0], length);
+      }
+      mReceivedBytes += length;
+      if (length < data.size()) {
+        data.erase(data.begin(), data.begin() + length);
+        return length;
+      }
+      rx.pop_front();
+      mLink->wake[remote].NotifyOne();
+
+      mReceivedPdus++;
+      return length;
+    }
+
+    // Data sent before a close is still delivered.
+    if (mLink->closed[0] || mLink->closed[1]) {
+      return -1;
+    }
+    mLink->wake[mSide].Wait(mLink->mutex);
+  }
+}
+
+int LoopbackLlcpSocket::GetRemoteMiu() const
+{
+  if (!mLink) {
+    return 0;
+  }
+  AutoMutex lock(mLink->mutex);
+  return mLink->miu[1 - mSide];
+}
+
+int LoopbackLlcpSocket::GetRemoteRw() const
+{
+  if (!mLink) {
+    return 0;
+  }
+  AutoMutex lock(mLink->mutex);
+  return mLink->rw[1 - mSide];
+}
+
+int LoopbackLlcpSocket::GetLocalSap() const
+{
+  return mSap;
+}
+
+int LoopbackLlcpSocket::GetLocalMiu() const
+{
+  return mMiu;
+}
+
+int LoopbackLlcpSocket::GetLocalRw() const
+{
+  return mRw;
+}
+
+/**
+ * LoopbackLlcpServerSocket
+ */
+LoopbackLlcpServerSocket::LoopbackLlcpServerSocket(int aSap,
+                                                   const char* aServiceName,
+                                                   int aMiu,
+                                                   int aRw,
+                                                   uint32_t aLatencyMs)
+ : mSap(aSap)
+ , mServiceName(aServiceName ? aServiceName : "")
+ , mMiu(aMiu)
+ , mRw(aRw)
+ , mLatencyMs(aLatencyMs)
+ , mClosed(false)
+{
+  AutoMutex lock(sServersMutex);
+  sServers.push_back(this);
+}
+
+LoopbackLlcpServerSocket::~LoopbackLlcpServerSocket()
+{
+  Close();
+
+  AutoMutex lock(sServersMutex);
+  std::vector<LoopbackLlcpServerSocket*>::iterator it =
+    std::find(sServers.begin(), sServers.end(), this);
+  if (it != sServers.end()) {
+    sServers.erase(it);
+  }
+}
+
+LoopbackLlcpServerSocket* LoopbackLlcpServerSocket::Find(int aSap,
+                                                         const char* aServiceName)
+{
+  AutoMutex lock(sServersMutex);
+  for (size_t i = 0; i < sServers.size(); i++) {
+    LoopbackLlcpServerSocket* server = sServers[i];
+    if (aServiceName ? server->mServiceName == aServiceName
+                     : server->mSap == aSap) {
+      return server;
+    }
+  }
+  return NULL;
+}
+
+bool LoopbackLlcpServerSocket::Connect(LoopbackLlcpSocket* aClient)
+{
+  AutoMutex lock(mMutex);
+  if (mClosed) {
+    return false;
+  }
+
+  LoopbackLlcpSocket* socket = new LoopbackLlcpSocket(mMiu, mRw, mLatencyMs);
+  socket->mSap = mSap;
+
+  LoopbackLink* link = new LoopbackLink();
+  link->refs = 0;
+  aClient->Attach(link, 0);
+  socket->Attach(link, 1);
+
+  mPending.push_back(socket);
+  mCondVar.NotifyOne();
+  return true;
+}
+
+ILlcpSocket* LoopbackLlcpServerSocket::Accept()
+{
+  AutoMutex lock(mMutex);
+  while (!mClosed && mPending.empty()) {
+    mCondVar.Wait(mMutex);
+  }
+  if (mClosed) {
+    return NULL;
+  }
+
+  LoopbackLlcpSocket* socket = mPending.front();
+  mPending.pop_front();
+  return socket;
+}
+
+bool LoopbackLlcpServerSocket::Close()
+{
+  AutoMutex lock(mMutex);
+  mClosed = true;
+  mCondVar.NotifyOne();
+  while (!mPending.empty()) {
+    delete mPending.front();
+    mPending.pop_front();
+  }
+  return true;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_LoopbackLlcpSocket_h
+#define mozilla_nfcd_LoopbackLlcpSocket_h
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "CondVar.h"
+#include "ILlcpServerSocket.h"
+#include "ILlcpSocket.h"
+#include "Mutex.h"
+
+class LoopbackLlcpServerSocket;
+struct LoopbackLink;
+
+/**
+ * In-process LLCP data link connection, for exercising SNEP without a peer.
+ *
+ * Each side announces an MIU and a receive window. Send() refuses SDUs
+ * larger than the remote MIU and blocks while the remote window is full,
+ * i.e. until the peer has received earlier PDUs. Every PDU becomes
+ * readable a configurable time after it was sent.
+ */
+class LoopbackLlcpSocket : public ILlcpSocket {
+public:
+  /**
+   * @param  aMiu       Local maximum information unit.
+   * @param  aRw        Local receive window.
+   * @param  aLatencyMs Delay before a PDU sent from this side is readable.
+   */
+  LoopbackLlcpSocket(int aMiu, int aRw, uint32_t aLatencyMs);
+  virtual ~LoopbackLlcpSocket();
+
+  bool ConnectToSap(int aSap);
+  bool ConnectToService(const char* aSN);
+  void Close();
+  bool Send(const uint8_t* aData, size_t aLength);
+  bool Send(const struct iovec* aIov, size_t aCount);
+  int Receive(uint8_t* aBuf, size_t aLength);
+  int GetRemoteMiu() const;
+  int GetRemoteRw() const;
+  int GetLocalSap() const;
+  int GetLocalMiu() const;
+  int GetLocalRw() const;
+
+  /**
+   * Number of PDUs and bytes sent and received on this side.
+   */
+  uint32_t GetSentPdus() const { return mSentPdus; }
+  uint64_t GetSentBytes() const { return mSentBytes; }
+  uint32_t GetReceivedPdus() const { return mReceivedPdus; }
+  uint64_t GetReceivedBytes() const { return mReceivedBytes; }
+  void ResetStats();
+
+private:
+  friend class LoopbackLlcpServerSocket;
+
+  bool Connect(LoopbackLlcpServerSocket* aServer);
+  void Attach(LoopbackLink* aLink, int aSide);
+
+  LoopbackLink* mLink;
+  // Index of this side in mLink.
+  int mSide;
+  int mSap;
+  int mMiu;
+  int mRw;
+  uint32_t mLatencyMs;
+
+  uint32_t mSentPdus;
+  uint64_t mSentBytes;
+  uint32_t mReceivedPdus;
+  uint64_t mReceivedBytes;
+};
+
+/**
+ * Listening end of the loopback. Clients find it by SAP or service name.
+ */
+class LoopbackLlcpServerSocket : public ILlcpServerSocket {
+public:
+  /**
+   * @param  aSap         Service access point.
+   * @param  aServiceName Service name, may be NULL.
+   * @param  aMiu         MIU of accepted sockets.
+   * @param  aRw          Receive window of accepted sockets.
+   * @param  aLatencyMs   PDU latency of accepted sockets.
+   */
+  LoopbackLlcpServerSocket(int aSap,
+                           const char* aServiceName,
+                           int aMiu,
+                           int aRw,
+                           uint32_t aLatencyMs);
+  virtual ~LoopbackLlcpServerSocket();
+
+  ILlcpSocket* Accept();
+  bool Close();
+
+private:
+  friend class LoopbackLlcpSocket;
+
+  static LoopbackLlcpServerSocket* Find(int aSap, const char* aServiceName);
+  bool Connect(LoopbackLlcpSocket* aClient);
+
+  int mSap;
+  std::string mServiceName;
+  int mMiu;
+  int mRw;
+  uint32_t mLatencyMs;
+
+  Mutex mMutex;
+  CondVar mCondVar;
+  bool mClosed;
+  std::deque<LoopbackLlcpSocket*> mPending;
+};
+
+#endif // mozilla_nfcd_LoopbackLlcpSocket_h
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tap-to-notification latency benchmark.
+ *
+ * Runs nfcd on top of the simulated controller, with this process playing
+ * Gecko on the IPC socket. For each tag type and NDEF size, a tag is
+ * tapped repeatedly and the time from the NFA_ACTIVATED_EVT callback to
+ * the arrival of NFC_NOTIFICATION_TECH_DISCOVERED is recorded. This covers
+ * the NDEF detection and read done before the notification is sent.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "GeckoClient.h"
+#include "MessageHandler.h"
+#include "NdefMessage.h"
+#include "NdefRecord.h"
+#include "NfcDebug.h"
+#include "NfcGonkMessage.h"
+#include "NfcIpcSocket.h"
+#include "NfcManager.h"
+#include "NfcService.h"
+#include "SimController.h"
+#include "SimScript.h"
+
+bool gNfcDebugFlag;
+
+static const char* DEFAULT_SOCKET_NAME = "nfcd-bench";
+static const char* DEFAULT_TAG_TYPES = "t1t,t2t,t3t,isodep-a,isodep-b,iso15693";
+static const char* DEFAULT_NDEF_SIZES = "0,16,256,1024,4096";
+static const char* BENCH_TAG_NAME = "bench";
+
+// Generous, tag loss is only seen at the next presence check.
+static const int MESSAGE_TIMEOUT_MS = 5000;
+
+struct Options {
+  const char* mSocketName;
+  int mIterations;
+  int mWarmup;
+  int mLatency;
+  std::vector<std::string> mTagTypes;
+  std::vector<uint32_t> mNdefSizes;
+
+  Options()
+    : mSocketName(DEFAULT_SOCKET_NAME)
+    , mIterations(100)
+    , mWarmup(5)
+    , mLatency(0)
+  { }
+
+  int Parse(int aArgc, char* aArgv[])
+  {
+    const char* types = DEFAULT_TAG_TYPES;
+    const char* sizes = DEFAULT_NDEF_SIZES;
+
+    opterr = 0; /* no default error messages from getopt */
+
+    int c;
+    while ((c = getopt(aArgc, aArgv, "a:n:w:l:t:s:vh")) >= 0) {
+      switch (c) {
+        case 'a':
+          mSocketName = optarg;
+          break;
+        case 'n':
+          mIterations = atoi(optarg);
+          break;
+        case 'w':
+          mWarmup = atoi(optarg);
+          break;
+        case 'l':
+          mLatency = atoi(optarg);
+          break;
+        case 't':
+          types = optarg;
+          break;
+        case 's':
+          sizes = optarg;
+          break;
+        case 'v':
+          gNfcDebugFlag = true;
+          break;
+        case 'h':
+          Usage();
+          return 1;
+        default:
+          fprintf(stderr, "Unknown option %c\n", optopt);
+          return -1;
+      }
+    }
+
+    if (mIterations <= 0 || mWarmup < 0 || mLatency < 0) {
+      fprintf(stderr, "Error: bad iteration count or latency\n");
+      return -1;
+    }
+
+    std::vector<std::string> list;
+    Split(types, list);
+    for (size_t i = 0; i < list.size(); i++) {
+      SimTarget tag;
+      if (!SimScript::InitTag(list[i], tag)) {
+        fprintf(stderr, "Error: unknown tag type %s\n", list[i].c_str());
+        return -1;
+      }
+      mTagTypes.push_back(list[i]);
+    }
+
+    Split(sizes, list);
+    for (size_t i = 0; i < list.size(); i++) {
+      mNdefSizes.push_back(strtoul(list[i].c_str(), NULL, 0));
+    }
+
+    if (mTagTypes.empty() || mNdefSizes.empty()) {
+      fprintf(stderr, "Error: no tag type or NDEF size\n");
+      return -1;
+    }
+    return 0;
+  }
+
+private:
+  static void Split(const char* aList, std::vector<std::string>& aItems)
+  {
+    aItems.clear();
+    std::string list(aList);
+    size_t start = 0;
+    while (start <= list.size()) {
+      size_t end = list.find(',', start);
+      if (end == std::string::npos) {
+        end = list.size();
+      }
+      if (end > start) {
+        aItems.push_back(list.substr(start, end - start));
+      }
+      start = end + 1;
+    }
+  }
+
+  static void Usage()
+  {
+    printf("Usage: nfcd-bench [OPTION]\n"
+           "Measures the latency from tag activation to the\n"
+           "TECH_DISCOVERED notification, on the simulated controller\n"
+           "\n"
+           "  -a    IPC socket name (default %s)\n"
+           "  -n    measured taps per case (default 100)\n"
+           "  -w    warm-up taps per case (default 5)\n"
+           "  -l    simulated controller latency in ms (default 0)\n"
+           "  -t    comma separated tag types (default %s)\n"
+           "  -s    comma separated NDEF payload sizes, 0 for an\n"
+           "        empty tag (default %s)\n"
+           "  -v    enable nfcd logs\n"
+           "  -h    displays this help\n",
+           DEFAULT_SOCKET_NAME, DEFAULT_TAG_TYPES, DEFAULT_NDEF_SIZES);
+  }
+};
+
+static void* SocketThreadFunc(void* aArg)
+{
+  NfcIpcSocket::Instance()->Loop(static_cast<const char*>(aArg), false);
+  return NULL;
+}
+
+/**
+ * Start nfcd the way main() in nfcd.cpp does, except that the IPC socket
+ * loop runs on its own thread.
+ */
+static bool StartNfcd(const char* aSocketName)
+{
+  NfcManager* pNfcManager = new NfcManager();
+  NfcService* service = NfcService::Instance();
+  MessageHandler* msgHandler = new MessageHandler(service);
+  service->Initialize(pNfcManager, msgHandler);
+
+  NfcIpcSocket* socket = NfcIpcSocket::Instance();
+  socket->Initialize(msgHandler);
+  socket->SetSocketListener(service);
+  msgHandler->SetOutgoingSocket(socket);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, SocketThreadFunc,
+                     const_cast<char*>(aSocketName)) != 0) {
+    fprintf(stderr, "Error: can't create the socket thread\n");
+    return false;
+  }
+  pthread_detach(thread);
+  return true;
+}
+
+static bool ChangeRFState(GeckoClient& aClient, NfcRFState aState)
+{
+  std::vector<int32_t> fields(1, aState);
+  GeckoClient::Message msg;
+  if (!aClient.SendRequest(NFC_REQUEST_CHANGE_RF_STATE, fields) ||
+      !aClient.WaitResponse(NFC_RESPONSE_CHANGE_RF_STATE, msg, MESSAGE_TIMEOUT_MS)) {
+    fprintf(stderr, "Error: no response to CHANGE_RF_STATE\n");
+    return false;
+  }
+  if (msg.error != NFC_SUCCESS) {
+    fprintf(stderr, "Error: CHANGE_RF_STATE failed with %d\n", msg.error);
+    return false;
+  }
+  return true;
+}
+
+static void MakeTag(const std::string& aType, uint32_t aNdefSize, SimTarget& aTag)
+{
+  aTag.name = BENCH_TAG_NAME;
+  SimScript::InitTag(aType, aTag);
+
+  // NFCID length of the RF technology.
+  size_t uidLength = 7;
+  if (aTag.mode == NFC_DISCOVERY_TYPE_POLL_B) {
+    uidLength = 4;
+  } else if (aTag.mode == NFC_DISCOVERY_TYPE_POLL_F ||
+             aTag.mode == NFC_DISCOVERY_TYPE_POLL_ISO15693) {
+    uidLength = 8;
+  }
+  aTag.uid.clear();
+  for (size_t i = 0; i < uidLength; i++) {
+    aTag.uid.push_back(0x04 + i);
+  }
+
+  aTag.ndef.clear();
+  if (aNdefSize) {
+    static const char type[] = "application/octet-stream";
+    std::vector<uint8_t> mimeType(type, type + sizeof(type) - 1);
+    std::vector<uint8_t> id;
+    std::vector<uint8_t> payload(aNdefSize, 0xA5);
+    NdefMessage ndef;
+    ndef.mRecords.push_back(NdefRecord());
+    ndef.mRecords.back().Adopt(NdefRecord::TNF_MIME_MEDIA, mimeType, id, payload);
+    ndef.ToByteArray(aTag.ndef);
+  }
+  if (aTag.maxNdefSize < aTag.ndef.size()) {
+    aTag.maxNdefSize = aTag.ndef.size();
+  }
+}
+
+/**
+ * Nearest-rank percentile of sorted samples.
+ */
+static uint64_t Percentile(const std::vector<uint64_t>& aSorted, int aPercent)
+{
+  size_t rank = (aSorted.size() * aPercent + 99) / 100;
+  return aSorted[rank ? rank - 1 : 0];
+}
+
+static bool RunCase(GeckoClient& aClient,
+                    const Options& aOptions,
+                    const std::string& aType,
+                    uint32_t aNdefSize)
+{
+  SimController& sim = SimController::GetInstance();
+  SimTarget tag;
+  MakeTag(aType, aNdefSize, tag);
+  sim.AddTarget(tag);
+
+  std::vector<uint64_t> samples;
+  samples.reserve(aOptions.mIterations);
+
+  for (int i = 0; i < aOptions.mWarmup + aOptions.mIterations; i++) {
+    GeckoClient::Message msg;
+    if (!sim.Tap(BENCH_TAG_NAME) ||
+        !aClient.WaitNotification(NFC_NOTIFICATION_TECH_DISCOVERED, msg,
+                                  MESSAGE_TIMEOUT_MS)) {
+      fprintf(stderr, "Error: %s/%u was not discovered\n", aType.c_str(), aNdefSize);
+      return false;
+    }
+
+    // The activation always precedes its notification.
+    uint64_t latency = msg.time - sim.GetActivationTime();
+    if (i >= aOptions.mWarmup) {
+      samples.push_back(latency);
+    }
+
+    sim.Remove();
+    if (!aClient.WaitNotification(NFC_NOTIFICATION_TECH_LOST, msg,
+                                  MESSAGE_TIMEOUT_MS)) {
+      fprintf(stderr, "Error: %s/%u was not lost\n", aType.c_str(), aNdefSize);
+      return false;
+    }
+  }
+
+  std::sort(samples.begin(), samples.end());
+  printf("%-10s %8u %8u %6u %10llu %10llu %10llu %10llu\n",
+         aType.c_str(), aNdefSize, static_cast<uint32_t>(tag.ndef.size()),
+         static_cast<uint32_t>(samples.size()),
+         static_cast<unsigned long long>(samples.front()),
+         static_cast<unsigned long long>(Percentile(samples, 50)),
+         static_cast<unsigned long long>(Percentile(samples, 99)),
+         static_cast<unsigned long long>(samples.back()));
+  fflush(stdout);
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  int res = options.Parse(argc, argv);
+  if (res > 0) {
+    return EXIT_SUCCESS;
+  } else if (res < 0) {
+    return EXIT_FAILURE;
+  }
+
+  SimController::GetInstance().SetLatency(options.mLatency);
+
+  GeckoClient client;
+  if (!client.Listen(options.mSocketName) ||
+      !StartNfcd(options.mSocketName) ||
+      !client.Accept()) {
+    return EXIT_FAILURE;
+  }
+
+  GeckoClient::Message msg;
+  if (!client.WaitNotification(NFC_NOTIFICATION_INITIALIZED, msg, MESSAGE_TIMEOUT_MS)) {
+    fprintf(stderr, "Error: nfcd did not initialize\n");
+    return EXIT_FAILURE;
+  }
+  if (!ChangeRFState(client, NFC_RF_STATE_DISCOVERY)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("%-10s %8s %8s %6s %10s %10s %10s %10s\n",
+         "type", "payload", "ndef", "taps", "min(us)", "p50(us)", "p99(us)", "max(us)");
+  for (size_t i = 0; i < options.mTagTypes.size(); i++) {
+    for (size_t j = 0; j < options.mNdefSizes.size(); j++) {
+      if (!RunCase(client, options, options.mTagTypes[i], options.mNdefSizes[j])) {
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  ChangeRFState(client, NFC_RF_STATE_IDLE);
+  // nfcd has no orderly shutdown, as in nfcd.cpp.
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * SNEP PUT throughput benchmark.
+ *
+ * A SnepClient PUTs NDEF messages of increasing size to a SnepServer over
+ * loopback LLCP sockets, so the SNEP fragmentation and the LLCP window
+ * are exercised without a peer. Goodput and the number of PDUs exchanged
+ * per PUT are reported for each size.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "ISnepCallback.h"
+#include "LoopbackLlcpSocket.h"
+#include "NdefMessage.h"
+#include "NdefRecord.h"
+#include "NfcDebug.h"
+#include "NfcService.h"
+#include "SnepClient.h"
+#include "SnepMessage.h"
+#include "SnepServer.h"
+
+bool gNfcDebugFlag;
+
+/**
+ * snep-bench links the SNEP code alone. Its sockets are handed to the
+ * client and the server directly, so there is no NFC manager to create them.
+ */
+INfcManager* NfcService::GetNfcManager()
+{
+  return NULL;
+}
+
+static const char* DEFAULT_NDEF_SIZES = "1,16,256,4096,65536,1048576";
+
+struct Options {
+  int mMiu;
+  int mRw;
+  int mLatency;
+  int mIterations;
+  std::vector<uint32_t> mNdefSizes;
+
+  Options()
+    : mMiu(SnepServer::DEFAULT_MIU)
+    , mRw(SnepServer::DEFAULT_RW_SIZE)
+    , mLatency(0)
+    , mIterations(10)
+  { }
+
+  int Parse(int aArgc, char* aArgv[])
+  {
+    const char* sizes = DEFAULT_NDEF_SIZES;
+
+    opterr = 0; /* no default error messages from getopt */
+
+    int c;
+    while ((c = getopt(aArgc, aArgv, "m:r:l:n:s:vh")) >= 0) {
+      switch (c) {
+        case 'm':
+          mMiu = atoi(optarg);
+          break;
+        case 'r':
+          mRw = atoi(optarg);
+          break;
+        case 'l':
+          mLatency = atoi(optarg);
+          break;
+        case 'n':
+          mIterations = atoi(optarg);
+          break;
+        case 's':
+          sizes = optarg;
+          break;
+        case 'v':
+          gNfcDebugFlag = true;
+          break;
+        case 'h':
+          Usage();
+          return 1;
+        default:
+          fprintf(stderr, "Unknown option %c\n", optopt);
+          return -1;
+      }
+    }
+
+    // The SNEP header has to fit in the first fragment.
+    if (mMiu < 6 || mRw < 1 || mLatency < 0 || mIterations <= 0) {
+      fprintf(stderr, "Error: bad MIU, RW, latency or iteration count\n");
+      return -1;
+    }
+
+    std::string list(sizes);
+    size_t start = 0;
+    while (start < list.size()) {
+      size_t end = list.find(',', start);
+      if (end == std::string::npos) {
+        end = list.size();
+      }
+      uint32_t size = strtoul(list.substr(start, end - start).c_str(), NULL, 0);
+      if (size) {
+        mNdefSizes.push_back(size);
+      }
+      start = end + 1;
+    }
+
+    if (mNdefSizes.empty()) {
+      fprintf(stderr, "Error: no NDEF size\n");
+      return -1;
+    }
+    return 0;
+  }
+
+private:
+  static void Usage()
+  {
+    printf("Usage: snep-bench [OPTION]\n"
+           "Measures SNEP PUT goodput over loopback LLCP sockets\n"
+           "\n"
+           "  -m    MIU of both sides (default %d)\n"
+           "  -r    receive window of both sides (default %d)\n"
+           "  -l    latency of each PDU in ms (default 0)\n"
+           "  -n    PUTs per size (default 10)\n"
+           "  -s    comma separated NDEF payload sizes (default %s)\n"
+           "  -v    enable nfcd logs\n"
+           "  -h    displays this help\n",
+           SnepServer::DEFAULT_MIU, SnepServer::DEFAULT_RW_SIZE,
+           DEFAULT_NDEF_SIZES);
+  }
+};
+
+/**
+ * Accepts every PUT and remembers what it received.
+ */
+class BenchCallback : public ISnepCallback {
+public:
+  BenchCallback() : mPuts(0), mPayloadBytes(0) {}
+
+  SnepMessage* DoPut(NdefMessage* aMsg)
+  {
+    mPuts++;
+    mPayloadBytes = 0;
+    if (aMsg) {
+      for (size_t i = 0; i < aMsg->mRecords.size(); i++) {
+        mPayloadBytes += aMsg->mRecords[i].mPayload.size();
+      }
+    }
+    return SnepMessage::GetMessage(SnepMessage::RESPONSE_SUCCESS);
+  }
+
+  SnepMessage* DoGet(int aAcceptableLength, NdefMessage* aMsg)
+  {
+    return SnepMessage::GetMessage(SnepMessage::RESPONSE_NOT_IMPLEMENTED);
+  }
+
+  // Written by the server thread before it responds.
+  uint32_t mPuts;
+  uint32_t mPayloadBytes;
+};
+
+static uint64_t NowUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool RunSize(const Options& aOptions, BenchCallback& aCallback, uint32_t aSize)
+{
+  static const char type[] = "application/octet-stream";
+  std::vector<uint8_t> mimeType(type, type + sizeof(type) - 1);
+  std::vector<uint8_t> id;
+  std::vector<uint8_t> payload(aSize, 0xA5);
+  NdefMessage ndef;
+  ndef.mRecords.push_back(NdefRecord());
+  ndef.mRecords.back().Adopt(NdefRecord::TNF_MIME_MEDIA, mimeType, id, payload);
+
+  LoopbackLlcpSocket* socket =
+    new LoopbackLlcpSocket(aOptions.mMiu, aOptions.mRw, aOptions.mLatency);
+  SnepClient client(aOptions.mMiu, aOptions.mRw);
+  if (!client.Connect(socket)) {
+    fprintf(stderr, "Error: can't connect to the SNEP server\n");
+    return false;
+  }
+
+  uint64_t elapsed = 0;
+  uint64_t snepBytes = 0;
+  uint32_t pdusOut = 0;
+  uint32_t pdusIn = 0;
+
+  for (int i = 0; i < aOptions.mIterations; i++) {
+    uint32_t puts = aCallback.mPuts;
+    socket->ResetStats();
+
+    uint64_t start = NowUs();
+    client.Put(ndef);
+    elapsed += NowUs() - start;
+
+    if (aCallback.mPuts != puts + 1 || aCallback.mPayloadBytes != aSize) {
+      fprintf(stderr, "Error: PUT of %u bytes was not received\n", aSize);
+      client.Close();
+      return false;
+    }
+    snepBytes = socket->GetSentBytes();
+    pdusOut += socket->GetSentPdus();
+    pdusIn += socket->GetReceivedPdus();
+  }
+  client.Close();
+  delete socket;
+
+  double seconds = elapsed / 1e6;
+  printf("%8u %8llu %8.1f %8.1f %10.3f %12.1f\n",
+         aSize, static_cast<unsigned long long>(snepBytes),
+         (double)pdusOut / aOptions.mIterations,
+         (double)pdusIn / aOptions.mIterations,
+         seconds * 1000 / aOptions.mIterations,
+         seconds > 0 ? (double)aSize * aOptions.mIterations / 1024 / seconds : 0);
+  fflush(stdout);
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  int res = options.Parse(argc, argv);
+  if (res > 0) {
+    return EXIT_SUCCESS;
+  } else if (res < 0) {
+    return EXIT_FAILURE;
+  }
+
+  BenchCallback callback;
+  SnepServer server(&callback, options.mMiu, options.mRw);
+  server.Start(new LoopbackLlcpServerSocket(SnepServer::DEFAULT_PORT,
+                                            SnepServer::DEFAULT_SERVICE_NAME,
+                                            options.mMiu,
+                                            options.mRw,
+                                            options.mLatency));
+
+  printf("MIU %d, RW %d, PDU latency %d ms, %d PUTs per size\n",
+         options.mMiu, options.mRw, options.mLatency, options.mIterations);
+  printf("%8s %8s %8s %8s %10s %12s\n",
+         "payload", "snep", "pdus-out", "pdus-in", "ms/put", "KiB/s");
+  for (size_t i = 0; i < options.mNdefSizes.size(); i++) {
+    if (!RunSize(options, callback, options.mNdefSizes[i])) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The server threads are not joined, as in nfcd.
+  exit(EXIT_SUCCESS);
+}
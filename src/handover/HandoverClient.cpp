@@ -25,6 +25,7 @@
 #include "HandoverServer.h"
 #include "ILlcpSocket.h"
 #include "NdefMessage.h"
+#include "NdefMessageView.h"
 #include "NfcDebug.h"
 
 HandoverClient::HandoverClient()
@@ -52,7 +53,7 @@ bool HandoverClient::Connect()
 
   INfcManager* pINfcManager = NfcService::GetNfcManager();
 
-  mSocket = pINfcManager->CreateLlcpSocket(0, mMiu, 1, 1024);
+  mSocket = pINfcManager->CreateLlcpSocket(0, mMiu, DEFAULT_RW_SIZE, 1024);
   if (!mSocket) {
     NFCD_ERROR("could not connect to socket");
     mState = HandoverClient::DISCONNECTED;
@@ -89,22 +90,34 @@ NdefMessage* HandoverClient::ProcessHandoverRequest(NdefMessage& aMsg)
 NdefMessage* HandoverClient::Receive()
 {
   std::vector<uint8_t> buffer;
+  // Parsing resumes after the last complete chunk on every fragment.
+  NdefMessageView view;
+  const size_t miu = mSocket->GetLocalMiu();
   while (true) {
-    std::vector<uint8_t> partial;
-    int size = mSocket->Receive(partial);
+    // Receive straight at the end of the buffer. Messages are framed by
+    // parsing the NDEF, so SDU boundaries do not matter.
+    const size_t offset = buffer.size();
+    buffer.resize(offset + miu);
+    int size = mSocket->Receive(&buffer[offset], miu);
     if (size < 0) {
       NFCD_ERROR("connection broken");
       break;
-    } else {
-      buffer.insert(buffer.end(), partial.begin(), partial.end());
     }
+    buffer.resize(offset + size);
 
-    NdefMessage* ndef = new NdefMessage();
-    if (ndef->Init(buffer)) {
+    if (buffer.empty()) {
+      continue;
+    }
+
+    NdefParseStatus status = view.Resume(&buffer[0], buffer.size());
+    if (status == NDEF_PARSE_OK) {
       NFCD_DEBUG("get a complete NDEF message");
+      NdefMessage* ndef = new NdefMessage();
+      ndef->Init(view);
       return ndef;
-    } else {
-      delete ndef;
+    } else if (status == NDEF_PARSE_MALFORMED) {
+      NFCD_ERROR("malformed NDEF message");
+      break;
     }
   }
   return NULL;
@@ -121,10 +134,10 @@ bool HandoverClient::Put(NdefMessage& aMsg)
 
   std::vector<uint8_t> buf;
   aMsg.ToByteArray(buf);
-  mSocket->Send(buf);
+  bool sent = HandoverServer::SendMessage(mSocket, buf);
 
   NFCD_DEBUG("exit");
-  return true;
+  return sent;
 }
 
 void HandoverClient::Close()
@@ -33,7 +33,8 @@ public:
   NdefMessage* ProcessHandoverRequest(NdefMessage& aMsg);
 
 private:
-  static const int DEFAULT_MIU = 128;
+  static const int DEFAULT_MIU = 1980;
+  static const int DEFAULT_RW_SIZE = 4;
 
   static const int DISCONNECTED = 0;
   static const int CONNECTING = 1;
@@ -22,8 +22,11 @@
 #include "NfcManager.h"
 #include "HandoverServer.h"
 #include "IHandoverCallback.h"
+#include "ILlcpSocket.h"
 #include "NdefMessage.h"
+#include "NdefMessageView.h"
 #include "NfcDebug.h"
+#include "WorkerPool.h"
 
 // Registered LLCP Service Names.
 const char* HandoverServer::DEFAULT_SERVICE_NAME = "urn:nfc:sn:handover";
@@ -43,25 +46,43 @@ void* HandoverConnectionThreadFunc(void* aArg)
   ILlcpSocket* socket = pConnectionThread->GetSocket();
   bool connectionBroken = false;
   std::vector<uint8_t> buffer;
+  // Parsing resumes after the last complete chunk on every fragment.
+  NdefMessageView view;
+  const size_t miu = socket->GetLocalMiu();
   while (!connectionBroken) {
-    std::vector<uint8_t> partial;
-    int size = socket->Receive(partial);
+    // Receive straight at the end of the buffer. Messages are framed by
+    // parsing the NDEF, so SDU boundaries do not matter.
+    const size_t offset = buffer.size();
+    buffer.resize(offset + miu);
+    int size = socket->Receive(&buffer[offset], miu);
     if (size < 0) {
       NFCD_ERROR("connection broken");
       connectionBroken = true;
       break;
-    } else {
-      buffer.insert(buffer.end(), partial.begin(), partial.end());
     }
+    buffer.resize(offset + size);
 
     // Check if buffer can be create a NDEF message.
     // If yes. need to notify upper layer.
-    NdefMessage* ndef = new NdefMessage();
-    if(ndef->Init(buffer)) {
+    while (!buffer.empty()) {
+      NdefParseStatus status = view.Resume(&buffer[0], buffer.size());
+      if (status == NDEF_PARSE_NEED_MORE) {
+        NFCD_DEBUG("cannot get a complete NDEF message");
+        break;
+      } else if (status == NDEF_PARSE_MALFORMED) {
+        NFCD_ERROR("malformed NDEF message");
+        connectionBroken = true;
+        break;
+      }
+
       NFCD_DEBUG("get a complete NDEF message");
+      NdefMessage* ndef = new NdefMessage();
+      ndef->Init(view);
       ICallback->OnMessageReceived(ndef);
-    } else {
-      NFCD_DEBUG("cannot get a complete NDEF message");
+
+      // Keep what follows the message for the next one.
+      buffer.erase(buffer.begin(), buffer.begin() + view.GetEnd());
+      view.Reset();
     }
   }
 
@@ -94,9 +115,8 @@ HandoverConnectionThread::~HandoverConnectionThread()
 
 void HandoverConnectionThread::Run()
 {
-  pthread_t tid;
-  if (pthread_create(&tid, NULL, HandoverConnectionThreadFunc, this) != 0) {
-    NFCD_ERROR("connection pthread_create failed");
+  if (!WorkerPool::GetInstance().Post(HandoverConnectionThreadFunc, this)) {
+    NFCD_ERROR("cannot run connection");
     abort();
   }
 }
@@ -106,29 +126,31 @@ bool HandoverConnectionThread::IsServerRunning() const
   return mServer->mServerRunning;
 }
 
+// Argument of an accept loop. The socket is the one it was started with,
+// mServerSocket may already belong to a restarted server.
+struct HandoverAcceptLoop {
+  HandoverServer* server;
+  ILlcpServerSocket* socket;
+};
+
 // Handover server thread is responsible for handling incoming connect request.
+// It runs outside the worker pool, so an accept loop never keeps a connection
+// waiting for a worker.
 void* HandoverServerThreadFunc(void* aArg)
 {
-  HandoverServer* pHandoverServer = reinterpret_cast<HandoverServer*>(aArg);
-  if (!pHandoverServer) {
+  HandoverAcceptLoop* loop = reinterpret_cast<HandoverAcceptLoop*>(aArg);
+  if (!loop) {
     NFCD_ERROR("invalid parameter");
     return NULL;
   }
 
-  ILlcpServerSocket* serverSocket = pHandoverServer->mServerSocket;
-  IHandoverCallback* ICallback = pHandoverServer->mCallback;
+  HandoverServer* pHandoverServer = loop->server;
+  ILlcpServerSocket* serverSocket = loop->socket;
+  delete loop;
 
-  if (!serverSocket) {
-    NFCD_ERROR("no server socket");
-    return NULL;
-  }
-
-  while (pHandoverServer->mServerRunning) {
-    if (!serverSocket) {
-      NFCD_ERROR("server socket shut down");
-      return NULL;
-    }
+  IHandoverCallback* ICallback = pHandoverServer->mCallback;
 
+  do {
     ILlcpSocket* communicationSocket = serverSocket->Accept();
 
     if (communicationSocket != NULL) {
@@ -137,13 +159,12 @@ void* HandoverServerThreadFunc(void* aArg)
       pHandoverServer->SetConnectionThread(pConnectionThread);
       pConnectionThread->Run();
     }
-  }
+  } while (pHandoverServer->IsAccepting(serverSocket));
 
-  if (serverSocket) {
-    serverSocket->Close();
-    delete serverSocket;
-  }
+  // Closed by Stop().
+  delete serverSocket;
 
+  NFCD_DEBUG("server socket shut down");
   return NULL;
 }
 
@@ -154,41 +175,83 @@ HandoverServer::HandoverServer(IHandoverCallback* aCallback)
  , mCallback(aCallback)
  , mServerRunning(false)
  , mConnectionThread(NULL)
+ , mHasAcceptThread(false)
 {
+  pthread_mutex_init(&mMutex, NULL);
 }
 
 HandoverServer::~HandoverServer()
 {
+  Stop();
+  // The accept loop uses the mutex until it exits.
+  JoinAcceptThread();
+  pthread_mutex_destroy(&mMutex);
 }
 
 void HandoverServer::Start()
 {
   NFCD_DEBUG("enter");
 
+  // A restart reaps the previous accept loop first.
+  Stop();
+  JoinAcceptThread();
+
   INfcManager* pINfcManager = NfcService::GetNfcManager();
-  mServerSocket = pINfcManager->CreateLlcpServerSocket(
-    mServiceSap, DEFAULT_SERVICE_NAME, DEFAULT_MIU, 1, 1024);
+  ILlcpServerSocket* serverSocket = pINfcManager->CreateLlcpServerSocket(
+    mServiceSap, DEFAULT_SERVICE_NAME, DEFAULT_MIU, DEFAULT_RW_SIZE, 1024);
 
-  if (!mServerSocket) {
+  if (!serverSocket) {
     NFCD_ERROR("cannot create llcp server socket");
+    return;
   }
 
-  pthread_t tid;
-  if (pthread_create(&tid, NULL, HandoverServerThreadFunc, this) != 0) {
+  pthread_mutex_lock(&mMutex);
+  mServerSocket = serverSocket;
+  // Set before the accept loop starts, it stops as soon as this is false.
+  mServerRunning = true;
+  pthread_mutex_unlock(&mMutex);
+
+  HandoverAcceptLoop* loop = new HandoverAcceptLoop;
+  loop->server = this;
+  loop->socket = serverSocket;
+  if (pthread_create(&mAcceptThread, NULL, HandoverServerThreadFunc, loop) != 0) {
     NFCD_ERROR("pthread_create failed");
     abort();
   }
-  mServerRunning = true;
+  mHasAcceptThread = true;
 
   NFCD_DEBUG("exit");
 }
 
+void HandoverServer::JoinAcceptThread()
+{
+  if (mHasAcceptThread) {
+    pthread_join(mAcceptThread, NULL);
+    mHasAcceptThread = false;
+  }
+}
+
 void HandoverServer::Stop()
 {
+  pthread_mutex_lock(&mMutex);
+  ILlcpServerSocket* serverSocket = mServerSocket;
   mServerSocket = NULL;
   mServerRunning = false;
 
-  // use pthread_join here to make sure all thread is finished ?
+  // Wake up Accept(), the accept loop then exits and deletes the socket.
+  if (serverSocket) {
+    serverSocket->Close();
+  }
+  pthread_mutex_unlock(&mMutex);
+}
+
+bool HandoverServer::IsAccepting(ILlcpServerSocket* aServerSocket)
+{
+  pthread_mutex_lock(&mMutex);
+  // A restarted server has a new socket, the old loop must still exit.
+  bool accepting = mServerRunning && mServerSocket == aServerSocket;
+  pthread_mutex_unlock(&mMutex);
+  return accepting;
 }
 
 bool HandoverServer::Put(NdefMessage& aMsg)
@@ -202,9 +265,26 @@ bool HandoverServer::Put(NdefMessage& aMsg)
 
   std::vector<uint8_t> buf;
   aMsg.ToByteArray(buf);
-  mConnectionThread->GetSocket()->Send(buf);
+  bool sent = SendMessage(mConnectionThread->GetSocket(), buf);
 
   NFCD_DEBUG("exit");
+  return sent;
+}
+
+bool HandoverServer::SendMessage(ILlcpSocket* aSocket, const std::vector<uint8_t>& aData)
+{
+  if (aData.empty()) {
+    return true;
+  }
+
+  // The socket splits the message at the remote MIU.
+  struct iovec iov;
+  iov.iov_base = const_cast<uint8_t*>(&aData[0]);
+  iov.iov_len = aData.size();
+  if (!aSocket->Send(&iov, 1)) {
+    NFCD_ERROR("send failed");
+    return false;
+  }
   return true;
 }
 
@@ -17,7 +17,13 @@
 #ifndef mozilla_nfcd_HandoverPushServer_h
 #define mozilla_nfcd_HandoverPushServer_h
 
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+
 class IHandoverCallback;
+class ILlcpServerSocket;
+class ILlcpSocket;
 class NdefMessage;
 class HandoverConnectionThread;
 
@@ -26,22 +32,51 @@ public:
   HandoverServer(IHandoverCallback* aCallback);
   ~HandoverServer();
 
-  static const int DEFAULT_MIU = 128;
+  static const int DEFAULT_MIU = 1980;
+  static const int DEFAULT_RW_SIZE = 4;
   static const char* DEFAULT_SERVICE_NAME;
   static const int HANDOVER_SAP = 0x14;
 
   void Start();
   void Stop();
+
+  /**
+   * Whether the accept loop of a server socket should go on. Stop() closes
+   * the socket under the same lock, so the loop cannot delete the socket
+   * while it is being closed.
+   *
+   * @param  aServerSocket Socket the accept loop was started with.
+   * @return               False once the server is stopped.
+   */
+  bool IsAccepting(ILlcpServerSocket* aServerSocket);
+
   bool Put(NdefMessage& msg);
   void SetConnectionThread(HandoverConnectionThread* aThread);
 
+  /**
+   * Send a handover message in fragments no larger than the remote MIU.
+   * The receiver reassembles them by parsing the NDEF message.
+   *
+   * @param  aSocket Connected LLCP socket.
+   * @param  aData   Encoded NDEF message.
+   * @return         True if every fragment was sent.
+   */
+  static bool SendMessage(ILlcpSocket* aSocket, const std::vector<uint8_t>& aData);
+
   ILlcpServerSocket* mServerSocket;
   int                mServiceSap;
   IHandoverCallback* mCallback;
   bool               mServerRunning;
 
 private:
+  void JoinAcceptThread();
+
   HandoverConnectionThread* mConnectionThread;
+  // Guards mServerSocket against the accept loop.
+  pthread_mutex_t mMutex;
+  // Accept loop of the last Start(), joined on restart and destruction.
+  pthread_t mAcceptThread;
+  bool mHasAcceptThread;
 };
 
 class HandoverConnectionThread {
@@ -61,15 +61,5 @@ void DeviceHost::NotifySeFieldDeactivated()
 TransactionEvent::TransactionEvent()
  : originType(TransactionEvent::SIM)
  , originIndex(-1)
- , aidLen(0)
- , aid(NULL)
- , payloadLen(0)
- , payload(NULL)
 {
 }
-
-TransactionEvent::~TransactionEvent()
-{
-  delete aid;
-  delete payload;
-}
@@ -18,6 +18,8 @@
 #define mozilla_nfcd_DeviceHost_h
 
 #include <stdio.h>
+#include <stdint.h>
+#include <vector>
 
 class INfcTag;
 class IP2pDevice;
@@ -53,7 +55,8 @@ public:
   void NotifyLlcpLinkDeactivated(IP2pDevice* aDevice);
 
   /**
-   * Notifies HCI TRANSACTION event received.
+   * Notifies HCI TRANSACTION event received. The event is copied, the
+   * caller keeps ownership of aEvent.
    *
    * @param  aEvent Contain transaction aid and payload
    * @return        None.
@@ -89,15 +92,13 @@ public:
   };
 
   TransactionEvent();
-  ~TransactionEvent();
 
   OriginType originType;
   uint32_t originIndex;
 
-  uint32_t aidLen;
-  uint8_t* aid;
-
-  uint32_t payloadLen;
-  uint8_t* payload;
+  // Storage is reused by the owner of the event, so the capacity of the
+  // vectors is kept across events.
+  std::vector<uint8_t> aid;
+  std::vector<uint8_t> payload;
 };
 #endif
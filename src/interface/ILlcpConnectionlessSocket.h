@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_ILlcpConnectionlessSocket_h
+#define mozilla_nfcd_ILlcpConnectionlessSocket_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * LLCP connectionless transport: datagrams carried in UI PDUs, with no
+ * CONNECT/CC or DISC/DM exchange and no acknowledgement.
+ */
+class ILlcpConnectionlessSocket {
+public:
+  virtual ~ILlcpConnectionlessSocket() {};
+
+  /**
+   * Send one datagram to peer. Does not wait for the peer, datagrams
+   * queued before the next LLCP symmetry turn are sent together.
+   *
+   * @param  aSap    Destination service access point on the peer.
+   * @param  aData   Data to send, not retained after the call.
+   * @param  aLength Length of aData, at most the link MIU.
+   * @return         True if queued ok.
+   */
+  virtual bool Send(int aSap, const uint8_t* aData, size_t aLength) = 0;
+
+  /**
+   * Receive one datagram from peer. Blocks until one is available; the
+   * part of a datagram that does not fit in aBuf is discarded.
+   *
+   * @param  aBuf    Buffer to put received data.
+   * @param  aLength Size of aBuf.
+   * @param  aSap    Set to the service access point of the sender.
+   * @return         Number of bytes received, -1 if the socket is closed.
+   */
+  virtual int Receive(uint8_t* aBuf, size_t aLength, int& aSap) = 0;
+
+  /**
+   * Get the largest datagram the peer accepts on the current link.
+   *
+   * @return Remote link MIU, 0 if no link is up.
+   */
+  virtual int GetLinkMiu() const = 0;
+
+  /**
+   * Get local service access point.
+   *
+   * @return Local service access point, -1 if the stack picked it.
+   */
+  virtual int GetLocalSap() const = 0;
+
+  /**
+   * Close socket.
+   *
+   * @return None.
+   */
+  virtual void Close() = 0;
+};
+
+#endif
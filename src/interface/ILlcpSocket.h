@@ -17,6 +17,9 @@
 #ifndef mozilla_nfcd_ILlcpSocket_h
 #define mozilla_nfcd_ILlcpSocket_h
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
 #include <vector>
 
 class ILlcpSocket {
@@ -47,20 +50,36 @@ public:
   virtual void Close() = 0;
 
   /**
-   * Send data to peer.
+   * Send one SDU to peer.
    *
-   * @param  aSendBuf Buffer of data.
-   * @return          True if sent ok.
+   * @param  aData   Data to send, not retained after the call.
+   * @param  aLength Length of aData, at most the remote MIU.
+   * @return         True if sent ok.
    */
-  virtual bool Send(std::vector<uint8_t>& aSendBuf) = 0;
+  virtual bool Send(const uint8_t* aData, size_t aLength) = 0;
 
   /**
-   * Receive data from peer.
+   * Send a payload of any length to peer. The buffers are sent back to
+   * back and split into SDUs of the remote MIU; blocks only while the
+   * remote receive window is full.
    *
-   * @param  aRecvBuf Buffer to put received data.
-   * @return          Number of bytes received.
+   * @param  aIov   Buffers to send, not retained after the call.
+   * @param  aCount Number of buffers in aIov.
+   * @return        True if the whole payload is sent ok.
    */
-  virtual int Receive(std::vector<uint8_t>& aRecvBuf) = 0;
+  virtual bool Send(const struct iovec* aIov, size_t aCount) = 0;
+
+  /**
+   * Receive data from peer. Blocks until some data is available, then
+   * returns as much as fits in aBuf. SDU boundaries are not preserved:
+   * one call may return the end of an SDU and the start of the next one,
+   * or part of an SDU, so callers frame messages themselves.
+   *
+   * @param  aBuf    Buffer to put received data.
+   * @param  aLength Size of aBuf.
+   * @return         Number of bytes received, -1 if the link is closed.
+   */
+  virtual int Receive(uint8_t* aBuf, size_t aLength) = 0;
 
   /**
    * Get peer's maximum information unit.
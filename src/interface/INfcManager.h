@@ -17,8 +17,10 @@
 #ifndef mozilla_nfcd_INfcManager_h
 #define mozilla_nfcd_INfcManager_h
 
+#include "ILlcpConnectionlessSocket.h"
 #include "ILlcpServerSocket.h"
 #include "ILlcpSocket.h"
+#include "LlcpMetrics.h"
 
 class INfcManager {
 public:
@@ -132,6 +134,27 @@ public:
                                                     int aRw,
                                                     int aBufLen) = 0;
 
+  /**
+   * Create a LLCP connectionless socket.
+   *
+   * @param  aSap Local service access point, negative for any. Only used
+   *              together with aSn.
+   * @param  aSn  Local service name, NULL for a socket that only talks to
+   *              services on the peer.
+   * @return      ILlcpConnectionlessSocket interface.
+   */
+  virtual ILlcpConnectionlessSocket* CreateLlcpConnectionlessSocket(int aSap,
+                                                                    const char* aSn) = 0;
+
+  /**
+   * Get the traffic counters of the current LLCP link, or of the last one
+   * if no link is up.
+   *
+   * @param  aMetrics Set to the link counters.
+   * @return          None.
+   */
+  virtual void GetLlcpMetrics(LlcpLinkMetrics& aMetrics) = 0;
+
   /**
    * Get default Llcp connection maxumum information unit.
    *
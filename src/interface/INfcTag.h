@@ -25,6 +25,18 @@
 class NdefMessage;
 class NdefInfo;
 
+/**
+ * Result of a presence check.
+ */
+typedef enum {
+  PRESENCE_CHECK_PRESENT,
+  // The check failed; the tag may be leaving the field or may have been
+  // disturbed, the caller decides after how many misses it is gone.
+  PRESENCE_CHECK_MISSED,
+  // The tag is known to be gone, e.g. it was already deactivated.
+  PRESENCE_CHECK_ABSENT
+} PresenceCheckResult;
+
 class INfcTag {
 public:
   virtual ~INfcTag() {};
@@ -76,9 +88,9 @@ public:
   /**
    * Check if the tag is in the RF field.
    *
-   * @return True if tag is in RF field.
+   * @return Result of the check.
    */
-  virtual bool PresenceCheck() = 0;
+  virtual PresenceCheckResult PresenceCheck() = 0;
 
   /**
    * Make the tag read-only.
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_LlcpMetrics_h
+#define mozilla_nfcd_LlcpMetrics_h
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Counters of LLCP connection-oriented traffic. Times are in milliseconds.
+ */
+struct LlcpMetrics {
+  uint32_t pdusSent;        // I-PDUs accepted by the stack.
+  uint32_t bytesSent;
+  uint32_t pdusReceived;    // I-PDUs read from the stack.
+  uint32_t bytesReceived;
+  uint32_t congestionWaits; // Sends that blocked on a full remote window.
+  uint32_t congestionMs;    // Time spent blocked in those sends.
+  uint32_t receiveWaits;    // Receives that blocked on an empty ring.
+  uint32_t receiveWaitMs;   // Time spent blocked in those receives.
+  uint32_t connects;        // Out-bound connects that got a CC.
+  uint32_t connectMs;       // Total CONNECT to CC round trip.
+  uint32_t maxConnectMs;    // Longest CONNECT to CC round trip.
+
+  LlcpMetrics() { Reset(); }
+
+  void Reset()
+  {
+    pdusSent = bytesSent = pdusReceived = bytesReceived = 0;
+    congestionWaits = congestionMs = receiveWaits = receiveWaitMs = 0;
+    connects = connectMs = maxConnectMs = 0;
+  }
+
+  void Add(const LlcpMetrics& aOther)
+  {
+    pdusSent += aOther.pdusSent;
+    bytesSent += aOther.bytesSent;
+    pdusReceived += aOther.pdusReceived;
+    bytesReceived += aOther.bytesReceived;
+    congestionWaits += aOther.congestionWaits;
+    congestionMs += aOther.congestionMs;
+    receiveWaits += aOther.receiveWaits;
+    receiveWaitMs += aOther.receiveWaitMs;
+    connects += aOther.connects;
+    connectMs += aOther.connectMs;
+    if (aOther.maxConnectMs > maxConnectMs) {
+      maxConnectMs = aOther.maxConnectMs;
+    }
+  }
+};
+
+/**
+ * Counters of one open connection.
+ */
+struct LlcpConnMetrics {
+  unsigned int handle;
+  LlcpMetrics metrics;
+};
+
+/**
+ * Counters of the current LLCP link, or of the last one if no link is up.
+ */
+struct LlcpLinkMetrics {
+  bool isActive;
+  uint32_t durationMs;      // Time since activation, or link lifetime.
+  uint16_t remoteLinkMiu;
+  // All connections of the link, closed ones included.
+  LlcpMetrics total;
+  // Connections still open.
+  std::vector<LlcpConnMetrics> connections;
+};
+
+#endif // mozilla_nfcd_LlcpMetrics_h
@@ -15,6 +15,7 @@
  */
 
 #include "NdefMessage.h"
+#include <stddef.h>
 
 NdefMessage::NdefMessage()
 {
@@ -25,13 +26,7 @@ NdefMessage::NdefMessage(NdefMessage* aNdef)
   if (!aNdef)
     return;
 
-  std::vector<NdefRecord>& record = aNdef->mRecords;
-  for (uint32_t i = 0; i < record.size(); i++) {
-    mRecords.push_back(NdefRecord(record[i].mTnf,
-                                  record[i].mType,
-                                  record[i].mId,
-                                  record[i].mPayload));
-  }
+  mRecords = aNdef->mRecords;
 }
 
 NdefMessage::~NdefMessage()
@@ -49,16 +44,49 @@ bool NdefMessage::Init(std::vector<uint8_t>& aBuf)
   return NdefRecord::Parse(aBuf, false, mRecords);
 }
 
+void NdefMessage::Init(const NdefMessageView& aView)
+{
+  mRecords.clear();
+  aView.ToNdefRecords(mRecords);
+}
+
 /**
  * This method will generate current NDEF message to byte array(vector).
+ * The output is grown once to the encoded length, then filled in place.
  */
 void NdefMessage::ToByteArray(std::vector<uint8_t>& aBuf)
 {
-  int recordSize = mRecords.size();
-  for (int i = 0; i < recordSize; i++) {
+  uint32_t length = GetEncodedLength();
+  if (!length) {
+    return;
+  }
+
+  size_t offset = aBuf.size();
+  aBuf.resize(offset + length);
+  ToBuffer(&aBuf[offset], length);
+}
+
+uint32_t NdefMessage::GetEncodedLength() const
+{
+  uint32_t length = 0;
+  for (size_t i = 0; i < mRecords.size(); i++) {
+    length += mRecords[i].GetEncodedLength();
+  }
+  return length;
+}
+
+bool NdefMessage::ToBuffer(uint8_t* aBuf, uint32_t aLength) const
+{
+  if (aLength < GetEncodedLength()) {
+    return false;
+  }
+
+  uint32_t offset = 0;
+  size_t recordSize = mRecords.size();
+  for (size_t i = 0; i < recordSize; i++) {
     bool mb = (i == 0);  // first record.
     bool me = (i == recordSize - 1);  // last record.
-    mRecords[i].WriteToByteBuffer(aBuf, mb, me);
+    offset += mRecords[i].WriteToBuffer(aBuf + offset, mb, me);
   }
-  return;
+  return true;
 }
@@ -17,6 +17,7 @@
 #ifndef mozilla_nfcd_NdefMessage_h
 #define mozilla_nfcd_NdefMessage_h
 
+#include "NdefMessageView.h"
 #include "NdefRecord.h"
 #include "TagTechnology.h"
 #include <vector>
@@ -44,6 +45,15 @@ public:
    */
   bool Init(std::vector<uint8_t>& aBuf, int aOffset);
 
+  /**
+   * Initialize NDEF message from an already parsed view. Records are
+   * materialized straight from the buffer referenced by the view.
+   *
+   * @param  aView Parsed NDEF message.
+   * @return       None.
+   */
+  void Init(const NdefMessageView& aView);
+
   /**
    * Write current NdefMessage to byte buffer.
    *
@@ -52,6 +62,22 @@ public:
    */
   void ToByteArray(std::vector<uint8_t>& aBuf);
 
+  /**
+   * Length of current NdefMessage once encoded.
+   *
+   * @return Encoded length in bytes.
+   */
+  uint32_t GetEncodedLength() const;
+
+  /**
+   * Write current NdefMessage to a caller-provided buffer.
+   *
+   * @param  aBuf    Output raw buffer.
+   * @param  aLength Size of aBuf, at least GetEncodedLength().
+   * @return         False if aBuf is too small.
+   */
+  bool ToBuffer(uint8_t* aBuf, uint32_t aLength) const;
+
   // Array of NDEF records.
   std::vector<NdefRecord> mRecords;
 };
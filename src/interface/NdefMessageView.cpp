@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NdefMessageView.h"
+#include "NdefRecord.h"
+#include "NfcDebug.h"
+
+static const uint8_t FLAG_MB = 0x80;
+static const uint8_t FLAG_ME = 0x40;
+static const uint8_t FLAG_CF = 0x20;
+static const uint8_t FLAG_SR = 0x10;
+static const uint8_t FLAG_IL = 0x08;
+
+// 10 MB payload limit.
+static const uint32_t MAX_PAYLOAD_SIZE = 10 * (1 << 20);
+
+static inline bool HasBytes(uint32_t aLength, uint32_t aIndex, uint32_t aCount)
+{
+  return aIndex <= aLength && aLength - aIndex >= aCount;
+}
+
+NdefRecordView::NdefRecordView()
+ : mBuf(NULL)
+ , mTnf(NdefRecord::TNF_EMPTY)
+ , mOffset(0)
+ , mEnd(0)
+ , mChunkCount(0)
+ , mTypeOffset(0)
+ , mTypeLength(0)
+ , mIdOffset(0)
+ , mIdLength(0)
+ , mPayloadOffset(0)
+ , mPayloadLength(0)
+{
+}
+
+NdefParseStatus NdefRecordView::ParseHeader(const uint8_t* aBuf,
+                                            uint32_t aLength,
+                                            uint32_t aOffset,
+                                            NdefRecordHeader& aHeader)
+{
+  uint32_t index = aOffset;
+
+  // Flags and type length.
+  if (!HasBytes(aLength, index, 2)) {
+    return NDEF_PARSE_NEED_MORE;
+  }
+  aHeader.flags = aBuf[index++];
+  aHeader.tnf = aHeader.flags & 0x07;
+  aHeader.typeLength = aBuf[index++];
+
+  if (aHeader.flags & FLAG_SR) {
+    if (!HasBytes(aLength, index, 1)) {
+      return NDEF_PARSE_NEED_MORE;
+    }
+    aHeader.payloadLength = aBuf[index++];
+  } else {
+    if (!HasBytes(aLength, index, 4)) {
+      return NDEF_PARSE_NEED_MORE;
+    }
+    aHeader.payloadLength = ((uint32_t)aBuf[index]     << 24) |
+                            ((uint32_t)aBuf[index + 1] << 16) |
+                            ((uint32_t)aBuf[index + 2] <<  8) |
+                            ((uint32_t)aBuf[index + 3]);
+    index += 4;
+  }
+
+  if (aHeader.flags & FLAG_IL) {
+    if (!HasBytes(aLength, index, 1)) {
+      return NDEF_PARSE_NEED_MORE;
+    }
+    aHeader.idLength = aBuf[index++];
+  } else {
+    aHeader.idLength = 0;
+  }
+
+  if (!NdefMessageView::EnsureSanePayloadSize(aHeader.payloadLength)) {
+    return NDEF_PARSE_MALFORMED;
+  }
+
+  aHeader.typeOffset = index;
+  aHeader.idOffset = aHeader.typeOffset + aHeader.typeLength;
+  aHeader.payloadOffset = aHeader.idOffset + aHeader.idLength;
+  aHeader.end = aHeader.payloadOffset + aHeader.payloadLength;
+
+  if (aHeader.end > aLength) {
+    return NDEF_PARSE_NEED_MORE;
+  }
+
+  return NDEF_PARSE_OK;
+}
+
+const uint8_t* NdefRecordView::GetPayload() const
+{
+  return IsChunked() ? NULL : mBuf + mPayloadOffset;
+}
+
+void NdefRecordView::CopyPayload(std::vector<uint8_t>& aPayload) const
+{
+  if (!IsChunked()) {
+    aPayload.assign(mBuf + mPayloadOffset, mBuf + mPayloadOffset + mPayloadLength);
+    return;
+  }
+
+  aPayload.clear();
+  aPayload.reserve(mPayloadLength);
+
+  // Chunks were validated by NdefMessageView::Parse, and the buffer is
+  // known to hold all of them.
+  uint32_t offset = mOffset;
+  for (uint32_t i = 0; i < mChunkCount; i++) {
+    NdefRecordHeader header;
+    NdefRecordView::ParseHeader(mBuf, mEnd, offset, header);
+    aPayload.insert(aPayload.end(),
+                    mBuf + header.payloadOffset,
+                    mBuf + header.payloadOffset + header.payloadLength);
+    offset = header.end;
+  }
+}
+
+void NdefRecordView::ToNdefRecord(NdefRecord& aRecord) const
+{
+  std::vector<uint8_t> type(GetType(), GetType() + mTypeLength);
+  std::vector<uint8_t> id(GetId(), GetId() + mIdLength);
+  std::vector<uint8_t> payload;
+  CopyPayload(payload);
+  aRecord.Adopt(mTnf, type, id, payload);
+}
+
+NdefMessageView::NdefMessageView()
+ : mEnd(0)
+ , mIndex(0)
+ , mInChunk(false)
+ , mStatus(NDEF_PARSE_NEED_MORE)
+{
+}
+
+NdefParseStatus NdefMessageView::Parse(const uint8_t* aBuf,
+                                       uint32_t aLength,
+                                       uint32_t aOffset,
+                                       bool aIgnoreMbMe)
+{
+  Reset(aOffset);
+  return Resume(aBuf, aLength, aIgnoreMbMe);
+}
+
+void NdefMessageView::Reset(uint32_t aOffset)
+{
+  mRecords.clear();
+  mEnd = aOffset;
+  mIndex = aOffset;
+  mInChunk = false;
+  mPending = NdefRecordView();
+  mStatus = NDEF_PARSE_NEED_MORE;
+}
+
+NdefParseStatus NdefMessageView::Resume(const uint8_t* aBuf,
+                                        uint32_t aLength,
+                                        bool aIgnoreMbMe)
+{
+  if (mStatus != NDEF_PARSE_NEED_MORE) {
+    return mStatus;
+  }
+
+  // The buffer may have been reallocated while growing, offsets are still
+  // valid.
+  for (size_t i = 0; i < mRecords.size(); i++) {
+    mRecords[i].mBuf = aBuf;
+  }
+  mPending.mBuf = aBuf;
+
+  while (mStatus == NDEF_PARSE_NEED_MORE) {
+    NdefParseStatus status = ParseChunk(aBuf, aLength, aIgnoreMbMe);
+    if (status == NDEF_PARSE_NEED_MORE) {
+      break;
+    } else if (status == NDEF_PARSE_MALFORMED) {
+      mStatus = NDEF_PARSE_MALFORMED;
+    }
+  }
+
+  return mStatus;
+}
+
+NdefParseStatus NdefMessageView::ParseChunk(const uint8_t* aBuf,
+                                            uint32_t aLength,
+                                            bool aIgnoreMbMe)
+{
+  NdefRecordHeader header;
+  NdefParseStatus status = NdefRecordView::ParseHeader(aBuf, aLength, mIndex, header);
+  if (status != NDEF_PARSE_OK) {
+    return status;
+  }
+
+  bool mb = (header.flags & FLAG_MB) != 0;
+  bool me = (header.flags & FLAG_ME) != 0;
+  bool cf = (header.flags & FLAG_CF) != 0;
+  bool il = (header.flags & FLAG_IL) != 0;
+  uint8_t tnf = header.tnf;
+
+  if (!mb && mRecords.size() == 0 && !mInChunk && !aIgnoreMbMe) {
+    NFCD_ERROR("expected MB flag");
+    return NDEF_PARSE_MALFORMED;
+  } else if (mb && mRecords.size() != 0 && !aIgnoreMbMe) {
+    NFCD_ERROR("unexpected MB flag");
+    return NDEF_PARSE_MALFORMED;
+  } else if (mInChunk && il) {
+    NFCD_ERROR("unexpected IL flag in non-leading chunk");
+    return NDEF_PARSE_MALFORMED;
+  } else if (cf && me) {
+    NFCD_ERROR("unexpected ME flag in non-trailing chunk");
+    return NDEF_PARSE_MALFORMED;
+  } else if (mInChunk && tnf != NdefRecord::TNF_UNCHANGED) {
+    NFCD_ERROR("expected TNF_UNCHANGED in non-leading chunk");
+    return NDEF_PARSE_MALFORMED;
+  } else if (!mInChunk && tnf == NdefRecord::TNF_UNCHANGED) {
+    NFCD_ERROR("unexpected TNF_UNCHANGED in first chunk or unchunked record");
+    return NDEF_PARSE_MALFORMED;
+  }
+
+  if (!tnf && (header.typeLength || header.payloadLength || header.idLength)) {
+    NFCD_ERROR("expected zero-length type, id and payload in empty NDEF message");
+    return NDEF_PARSE_MALFORMED;
+  }
+
+  if (mInChunk && header.typeLength != 0) {
+    NFCD_ERROR("expected zero-length type in non-leading chunk");
+    return NDEF_PARSE_MALFORMED;
+  }
+
+  if (!mInChunk) {
+    mPending.mBuf = aBuf;
+    mPending.mTnf = tnf;
+    mPending.mOffset = mIndex;
+    mPending.mChunkCount = 1;
+    mPending.mTypeOffset = header.typeOffset;
+    mPending.mTypeLength = header.typeLength;
+    mPending.mIdOffset = header.idOffset;
+    mPending.mIdLength = header.idLength;
+    mPending.mPayloadOffset = header.payloadOffset;
+    mPending.mPayloadLength = header.payloadLength;
+  } else {
+    mPending.mChunkCount++;
+    mPending.mPayloadLength += header.payloadLength;
+    if (!EnsureSanePayloadSize(mPending.mPayloadLength)) {
+      return NDEF_PARSE_MALFORMED;
+    }
+  }
+
+  mIndex = header.end;
+  mPending.mEnd = mIndex;
+
+  if (cf) {
+    // More chunks to come.
+    mInChunk = true;
+    return NDEF_PARSE_OK;
+  }
+  mInChunk = false;
+
+  if (!ValidateTnf(mPending.mTnf, mPending.mTypeLength,
+                   mPending.mIdLength, mPending.mPayloadLength)) {
+    return NDEF_PARSE_MALFORMED;
+  }
+
+  mRecords.push_back(mPending);
+  mEnd = mIndex;
+
+  if (me || aIgnoreMbMe) {  // aIgnoreMbMe is for parsing a single NdefRecord.
+    mStatus = NDEF_PARSE_OK;
+  }
+
+  return NDEF_PARSE_OK;
+}
+
+void NdefMessageView::ToNdefRecords(std::vector<NdefRecord>& aRecords) const
+{
+  aRecords.reserve(aRecords.size() + mRecords.size());
+  for (size_t i = 0; i < mRecords.size(); i++) {
+    // Materialize in place to avoid copying the owned vectors again.
+    aRecords.push_back(NdefRecord());
+    mRecords[i].ToNdefRecord(aRecords.back());
+  }
+}
+
+bool NdefMessageView::EnsureSanePayloadSize(uint32_t aSize)
+{
+  if (aSize > MAX_PAYLOAD_SIZE) {
+    NFCD_ERROR("payload above max limit: %u > %u", aSize, MAX_PAYLOAD_SIZE);
+    return false;
+  }
+  return true;
+}
+
+bool NdefMessageView::ValidateTnf(uint8_t aTnf,
+                                  uint32_t aTypeLength,
+                                  uint32_t aIdLength,
+                                  uint32_t aPayloadLength)
+{
+  bool isValid = true;
+  switch (aTnf) {
+    case NdefRecord::TNF_EMPTY:
+      if (aTypeLength != 0 || aIdLength != 0 || aPayloadLength != 0) {
+        NFCD_ERROR("unexpected data in TNF_EMPTY record");
+        isValid = false;
+      }
+      break;
+    case NdefRecord::TNF_WELL_KNOWN:
+    case NdefRecord::TNF_MIME_MEDIA:
+    case NdefRecord::TNF_ABSOLUTE_URI:
+    case NdefRecord::TNF_EXTERNAL_TYPE:
+      break;
+    case NdefRecord::TNF_UNKNOWN:
+    case NdefRecord::TNF_RESERVED:
+      if (aTypeLength != 0) {
+        NFCD_ERROR("unexpected type field in TNF_UNKNOWN or TNF_RESERVEd record");
+        isValid = false;
+      }
+      break;
+    case NdefRecord::TNF_UNCHANGED:
+      NFCD_ERROR("unexpected TNF_UNCHANGED in first chunk or logical record");
+      isValid = false;
+      break;
+    default:
+      NFCD_ERROR("unexpected tnf value");
+      isValid = false;
+      break;
+  }
+  return isValid;
+}
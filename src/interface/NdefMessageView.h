@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_NdefMessageView_h
+#define mozilla_nfcd_NdefMessageView_h
+
+#include <stdint.h>
+#include <vector>
+
+class NdefRecord;
+
+typedef enum {
+  NDEF_PARSE_OK = 0,
+  // The buffer ends in the middle of a record.
+  NDEF_PARSE_NEED_MORE,
+  NDEF_PARSE_MALFORMED
+} NdefParseStatus;
+
+/**
+ * Layout of a single NDEF record (or chunk) header, as offsets into the
+ * buffer it was decoded from.
+ */
+struct NdefRecordHeader {
+  uint8_t flags;
+  uint8_t tnf;
+  uint32_t typeOffset;
+  uint32_t typeLength;
+  uint32_t idOffset;
+  uint32_t idLength;
+  uint32_t payloadOffset;
+  uint32_t payloadLength;
+  // Offset right after the record.
+  uint32_t end;
+};
+
+/**
+ * Non-owning view of a logical NDEF record. Type, id and payload are
+ * referenced by offset into the buffer the record was parsed from, so the
+ * buffer must outlive the view. A chunked record spans several chunks in
+ * the buffer; its payload is only contiguous once copied out.
+ */
+class NdefRecordView {
+public:
+  NdefRecordView();
+
+  /**
+   * Decode the header of the record starting at aOffset.
+   *
+   * @param  aBuf    Raw NDEF data.
+   * @param  aLength Length of aBuf.
+   * @param  aOffset Start of the record.
+   * @param  aHeader Output header.
+   * @return         NDEF_PARSE_NEED_MORE if the record is truncated.
+   */
+  static NdefParseStatus ParseHeader(const uint8_t* aBuf,
+                                     uint32_t aLength,
+                                     uint32_t aOffset,
+                                     NdefRecordHeader& aHeader);
+
+  uint8_t GetTnf() const { return mTnf; }
+  bool IsChunked() const { return mChunkCount > 1; }
+
+  const uint8_t* GetType() const { return mBuf + mTypeOffset; }
+  uint32_t GetTypeLength() const { return mTypeLength; }
+
+  const uint8_t* GetId() const { return mBuf + mIdOffset; }
+  uint32_t GetIdLength() const { return mIdLength; }
+
+  /**
+   * Payload of an unchunked record, NULL for a chunked one.
+   */
+  const uint8_t* GetPayload() const;
+
+  /**
+   * Total payload length, summed over all chunks.
+   */
+  uint32_t GetPayloadLength() const { return mPayloadLength; }
+
+  /**
+   * Copy the payload out of the buffer, joining chunks if needed.
+   *
+   * @param  aPayload Output payload; replaced.
+   * @return          None.
+   */
+  void CopyPayload(std::vector<uint8_t>& aPayload) const;
+
+  /**
+   * Materialize an owning NdefRecord.
+   *
+   * @param  aRecord Output record; type, id and payload are replaced.
+   * @return         None.
+   */
+  void ToNdefRecord(NdefRecord& aRecord) const;
+
+private:
+  friend class NdefMessageView;
+
+  const uint8_t* mBuf;
+  uint8_t mTnf;
+  // Offset of the first chunk header.
+  uint32_t mOffset;
+  // Offset right after the last chunk.
+  uint32_t mEnd;
+  uint32_t mChunkCount;
+  uint32_t mTypeOffset;
+  uint32_t mTypeLength;
+  uint32_t mIdOffset;
+  uint32_t mIdLength;
+  uint32_t mPayloadOffset;
+  uint32_t mPayloadLength;
+};
+
+/**
+ * Non-owning view of an NDEF message. Parsing only validates the message
+ * and records offsets and lengths; nothing is copied until a record is
+ * materialized.
+ *
+ * Parsing is resumable, so a message arriving in fragments (e.g. over LLCP)
+ * can be fed with Resume() each time the buffer grows. Each call only
+ * looks at the bytes following the last complete chunk.
+ */
+class NdefMessageView {
+public:
+  NdefMessageView();
+
+  /**
+   * Parse NDEF records in place.
+   *
+   * @param  aBuf        Raw NDEF data, must outlive the view.
+   * @param  aLength     Length of aBuf.
+   * @param  aOffset     Start position of the message in aBuf.
+   * @param  aIgnoreMbMe Only parse a single record, ignore MB/ME flags.
+   * @return             NDEF_PARSE_OK if a complete message was parsed.
+   */
+  NdefParseStatus Parse(const uint8_t* aBuf,
+                        uint32_t aLength,
+                        uint32_t aOffset = 0,
+                        bool aIgnoreMbMe = false);
+
+  /**
+   * Discard parsed records and restart parsing at aOffset on the next
+   * Resume().
+   *
+   * @param  aOffset Start position of the message in the buffer.
+   * @return         None.
+   */
+  void Reset(uint32_t aOffset = 0);
+
+  /**
+   * Continue parsing where the previous call stopped. The buffer must hold
+   * the same bytes as before, followed by new data; it may have been
+   * reallocated.
+   *
+   * @param  aBuf        Raw NDEF data, must outlive the view.
+   * @param  aLength     Length of aBuf.
+   * @param  aIgnoreMbMe Only parse a single record, ignore MB/ME flags.
+   * @return             NDEF_PARSE_NEED_MORE until the message is complete.
+   *                     Once complete or malformed, the same status is
+   *                     returned until Reset().
+   */
+  NdefParseStatus Resume(const uint8_t* aBuf,
+                         uint32_t aLength,
+                         bool aIgnoreMbMe = false);
+
+  uint32_t GetRecordCount() const { return mRecords.size(); }
+  const NdefRecordView& GetRecord(uint32_t aIndex) const { return mRecords[aIndex]; }
+
+  /**
+   * Offset right after the last parsed record.
+   */
+  uint32_t GetEnd() const { return mEnd; }
+
+  /**
+   * Materialize owning NdefRecords, appended to aRecords.
+   *
+   * @param  aRecords Output records.
+   * @return          None.
+   */
+  void ToNdefRecords(std::vector<NdefRecord>& aRecords) const;
+
+  /**
+   * Validate the fields of a logical record against its TNF.
+   */
+  static bool ValidateTnf(uint8_t aTnf,
+                          uint32_t aTypeLength,
+                          uint32_t aIdLength,
+                          uint32_t aPayloadLength);
+
+  /**
+   * Check a payload length against the maximum supported size.
+   */
+  static bool EnsureSanePayloadSize(uint32_t aSize);
+
+private:
+  NdefParseStatus ParseChunk(const uint8_t* aBuf,
+                             uint32_t aLength,
+                             bool aIgnoreMbMe);
+
+  std::vector<NdefRecordView> mRecords;
+  uint32_t mEnd;
+
+  // Resume state.
+  // Offset of the next record or chunk header.
+  uint32_t mIndex;
+  bool mInChunk;
+  // Record whose chunks are being parsed.
+  NdefRecordView mPending;
+  NdefParseStatus mStatus;
+};
+
+#endif // mozilla_nfcd_NdefMessageView_h
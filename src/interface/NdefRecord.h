@@ -17,6 +17,7 @@
 #ifndef mozilla_nfcd_NdefRecord_h
 #define mozilla_nfcd_NdefRecord_h
 
+#include <stdint.h>
 #include <vector>
 
 class NdefRecord {
@@ -87,6 +88,21 @@ public:
                     std::vector<NdefRecord>& aRecords,
                     int aOffset);
 
+  /**
+   * Take over type, id and payload without copying them. The arguments
+   * are swapped with the current contents of the record.
+   *
+   * @param  aTnf     Type name format.
+   * @param  aType    Payload type, left with the previous type.
+   * @param  aId      Identifier, left with the previous identifier.
+   * @param  aPayload NDEF payload, left with the previous payload.
+   * @return          None.
+   */
+  void Adopt(uint8_t aTnf,
+             std::vector<uint8_t>& aType,
+             std::vector<uint8_t>& aId,
+             std::vector<uint8_t>& aPayload);
+
   /**
    * Write current Ndefrecord to byte buffer. MB,ME bit is specified in parameter.
    *
@@ -99,6 +115,25 @@ public:
                          bool aMb,
                          bool aMe);
 
+  /**
+   * Length of the record once encoded by WriteToBuffer().
+   *
+   * @return Encoded length in bytes.
+   */
+  uint32_t GetEncodedLength() const;
+
+  /**
+   * Encode current NdefRecord into a raw buffer.
+   *
+   * @param  aBuf Output buffer, must hold at least GetEncodedLength() bytes.
+   * @param  aMb  Message begin bit of NDEF record.
+   * @param  aMe  Message end bit of NDEF record.
+   * @return      Number of bytes written.
+   */
+  uint32_t WriteToBuffer(uint8_t* aBuf,
+                         bool aMb,
+                         bool aMe) const;
+
   // MB, ME, CF, SR, IL.
   uint8_t mFlags;
 
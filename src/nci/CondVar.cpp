@@ -19,12 +19,23 @@
  */
 #include "CondVar.h"
 #include <errno.h>
+#include <string.h>
 #include "NfcDebug.h"
 
 CondVar::CondVar()
 {
   memset(&mCondition, 0, sizeof(mCondition));
+#ifdef HAVE_PTHREAD_COND_TIMEDWAIT_MONOTONIC
   int const res = pthread_cond_init(&mCondition, NULL);
+#else
+  // Host builds have no pthread_cond_timedwait_monotonic_np(), let the
+  // standard timed wait use the monotonic clock instead.
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  int const res = pthread_cond_init(&mCondition, &attr);
+  pthread_condattr_destroy(&attr);
+#endif
   if (res) {
     NCI_ERROR("fail init; error=0x%X", res);
   }
@@ -67,7 +78,11 @@ bool CondVar::Wait(Mutex& aMutex, long aMillisec)
   // Declared in /development/ndk/platforms/android-9/include/pthread.h.
   // It uses monotonic clock.
   // The standard pthread_cond_timedwait() uses realtime clock.
+#ifdef HAVE_PTHREAD_COND_TIMEDWAIT_MONOTONIC
   const int waitResult = pthread_cond_timedwait_monotonic_np(&mCondition, aMutex.GetHandle(), &absoluteTime);
+#else
+  const int waitResult = pthread_cond_timedwait(&mCondition, aMutex.GetHandle(), &absoluteTime);
+#endif
   if ((waitResult != 0) && (waitResult != ETIMEDOUT)) {
     NCI_ERROR("fail timed wait; error=0x%X", waitResult);
   }
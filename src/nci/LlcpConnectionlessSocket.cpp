@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LlcpConnectionlessSocket.h"
+
+#include "NfcDebug.h"
+#include "PeerToPeer.h"
+
+// PeerToPeer takes 16-bit lengths.
+#define MAX_DATAGRAM_LENGTH 0xFFFF
+
+LlcpConnectionlessSocket::LlcpConnectionlessSocket(unsigned int aHandle, int aSap)
+  : mHandle(aHandle)
+  , mSap(aSap)
+{
+}
+
+LlcpConnectionlessSocket::~LlcpConnectionlessSocket()
+{
+}
+
+bool LlcpConnectionlessSocket::Send(int aSap, const uint8_t* aData, size_t aLength)
+{
+  if (aSap < 0 || aSap > 0x3F) {
+    NCI_ERROR("invalid sap: %d", aSap);
+    return false;
+  }
+  if (aLength > MAX_DATAGRAM_LENGTH) {
+    NCI_ERROR("datagram too long: %u", static_cast<uint32_t>(aLength));
+    return false;
+  }
+
+  // NFA copies the data into its own buffer before returning.
+  bool stat = PeerToPeer::GetInstance().SendConnectionless(
+    mHandle, aSap, const_cast<uint8_t*>(aData), aLength);
+  if (!stat) {
+    NCI_ERROR("fail send");
+  }
+
+  return stat;
+}
+
+int LlcpConnectionlessSocket::Receive(uint8_t* aBuf, size_t aLength, int& aSap)
+{
+  uint16_t actualLen = 0;
+  uint16_t bufLen = aLength > MAX_DATAGRAM_LENGTH ? MAX_DATAGRAM_LENGTH : aLength;
+  uint8_t sap = 0;
+
+  bool stat = PeerToPeer::GetInstance().ReceiveConnectionless(
+    mHandle, aBuf, bufLen, actualLen, sap);
+  if (!stat) {
+    return -1;
+  }
+
+  aSap = sap;
+  return actualLen;
+}
+
+int LlcpConnectionlessSocket::GetLinkMiu() const
+{
+  return PeerToPeer::GetInstance().GetRemoteLinkMiu();
+}
+
+void LlcpConnectionlessSocket::Close()
+{
+  NCI_DEBUG("enter");
+
+  if (!PeerToPeer::GetInstance().DeregisterConnectionless(mHandle)) {
+    NCI_ERROR("fail deregister connectionless");
+  }
+
+  NCI_DEBUG("exit");
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_LlcpConnectionlessSocket_h
+#define mozilla_nfcd_LlcpConnectionlessSocket_h
+
+#include "ILlcpConnectionlessSocket.h"
+
+/**
+ * LlcpConnectionlessSocket represents a LLCP connectionless endpoint, to be
+ * used for short datagram exchanges with a peer.
+ */
+class LlcpConnectionlessSocket
+  : public ILlcpConnectionlessSocket
+{
+public:
+  LlcpConnectionlessSocket(unsigned int aHandle, int aSap);
+  virtual ~LlcpConnectionlessSocket();
+
+  /**
+   * Send one datagram to peer.
+   *
+   * @param  aSap    Destination service access point.
+   * @param  aData   Buffer of data.
+   * @param  aLength Length of aData.
+   * @return         True if queued ok.
+   */
+  bool Send(int aSap, const uint8_t* aData, size_t aLength);
+
+  /**
+   * Receive one datagram from peer.
+   *
+   * @param  aBuf    Buffer to put received data.
+   * @param  aLength Size of aBuf.
+   * @param  aSap    Set to the service access point of the sender.
+   * @return         Number of bytes received, -1 if closed.
+   */
+  int Receive(uint8_t* aBuf, size_t aLength, int& aSap);
+
+  /**
+   * Get the remote link MIU.
+   *
+   * @return Remote link MIU.
+   */
+  int GetLinkMiu() const;
+
+  /**
+   * Get local service access point.
+   *
+   * @return Local service access point.
+   */
+  int GetLocalSap() const { return mSap; }
+
+  /**
+   * Close socket.
+   *
+   * @return None.
+   */
+  void Close();
+
+private:
+  unsigned int mHandle;
+  int mSap;
+};
+
+#endif  // mozilla_nfcd_LlcpConnectionlessSocket_h
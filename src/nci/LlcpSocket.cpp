@@ -19,6 +19,9 @@
 #include "NfcDebug.h"
 #include "PeerToPeer.h"
 
+// PeerToPeer takes 16-bit lengths.
+#define MAX_SDU_LENGTH 0xFFFF
+
 LlcpSocket::LlcpSocket(unsigned int aHandle, int aSap, int aMiu, int aRw)
   : mHandle(aHandle)
   , mSap(aSap)
@@ -56,14 +59,19 @@ void LlcpSocket::Close()
   LlcpSocket::DoClose();
 }
 
-bool LlcpSocket::Send(std::vector<uint8_t>& aData)
+bool LlcpSocket::Send(const uint8_t* aData, size_t aLength)
+{
+  return LlcpSocket::DoSend(aData, aLength);
+}
+
+bool LlcpSocket::Send(const struct iovec* aIov, size_t aCount)
 {
-  return LlcpSocket::DoSend(aData);
+  return LlcpSocket::DoSend(aIov, aCount);
 }
 
-int LlcpSocket::Receive(std::vector<uint8_t>& aRecvBuf)
+int LlcpSocket::Receive(uint8_t* aBuf, size_t aLength)
 {
-  return LlcpSocket::DoReceive(aRecvBuf);;
+  return LlcpSocket::DoReceive(aBuf, aLength);
 }
 
 int LlcpSocket::GetRemoteMiu() const
@@ -121,45 +129,40 @@ bool LlcpSocket::DoClose()
   return true;  // TODO: stat?
 }
 
-bool LlcpSocket::DoSend(std::vector<uint8_t>& aData)
+bool LlcpSocket::DoSend(const uint8_t* aData, size_t aLength)
 {
-  uint8_t* raw_ptr = new uint8_t[aData.size()];
-
-  for (size_t i = 0; i < aData.size(); i++) {
-    raw_ptr[i] = (uint8_t)aData[i];
+  if (aLength > MAX_SDU_LENGTH) {
+    NCI_ERROR("SDU too long: %u", static_cast<uint32_t>(aLength));
+    return false;
   }
 
-  bool stat = PeerToPeer::GetInstance().Send(mHandle, raw_ptr, aData.size());
+  // NFA copies the data into its own buffer before returning.
+  bool stat = PeerToPeer::GetInstance().Send(mHandle, const_cast<uint8_t*>(aData), aLength);
   if (!stat) {
     NCI_ERROR("fail send");
   }
 
-  delete[] raw_ptr;
+  return stat;
+}
+
+bool LlcpSocket::DoSend(const struct iovec* aIov, size_t aCount)
+{
+  bool stat = PeerToPeer::GetInstance().Send(mHandle, aIov, aCount);
+  if (!stat) {
+    NCI_ERROR("fail send");
+  }
 
   return stat;
 }
 
-int LlcpSocket::DoReceive(std::vector<uint8_t>& aRecvBuf)
+int LlcpSocket::DoReceive(uint8_t* aBuf, size_t aLength)
 {
-  const uint16_t MAX_BUF_SIZE = 4096;
   uint16_t actualLen = 0;
+  uint16_t bufLen = aLength > MAX_SDU_LENGTH ? MAX_SDU_LENGTH : aLength;
 
-  uint8_t* raw_ptr = new uint8_t[MAX_BUF_SIZE];
-  bool stat = PeerToPeer::GetInstance().Receive(mHandle, raw_ptr, MAX_BUF_SIZE, actualLen);
-
-  int retval = 0;
-  if (stat && (actualLen > 0)) {
-    for (uint16_t i = 0; i < actualLen; i++) {
-      aRecvBuf.push_back(raw_ptr[i]);
-    }
-    retval = actualLen;
-  } else {
-    retval = -1;
-  }
-
-  delete[] raw_ptr;
+  bool stat = PeerToPeer::GetInstance().Receive(mHandle, aBuf, bufLen, actualLen);
 
-  return retval;
+  return (stat && (actualLen > 0)) ? actualLen : -1;
 }
 
 int LlcpSocket::DoGetRemoteSocketMIU() const
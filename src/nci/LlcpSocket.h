@@ -58,18 +58,29 @@ public:
   /**
    * Send data to peer.
    *
-   * @param  aSendBuf Buffer of data.
-   * @return          True if sent ok.
+   * @param  aData   Buffer of data.
+   * @param  aLength Length of aData.
+   * @return         True if sent ok.
    */
-  bool Send(std::vector<uint8_t>& aSendBuf);
+  bool Send(const uint8_t* aData, size_t aLength);
+
+  /**
+   * Send a payload of any length to peer, split at the remote MIU.
+   *
+   * @param  aIov   Buffers of data.
+   * @param  aCount Number of buffers in aIov.
+   * @return        True if sent ok.
+   */
+  bool Send(const struct iovec* aIov, size_t aCount);
 
   /**
    * Receive data from peer.
    *
-   * @param  aRecvBuf Buffer to put received data.
-   * @return          Buffer to put received data.
+   * @param  aBuf    Buffer to put received data.
+   * @param  aLength Size of aBuf.
+   * @return         Number of bytes received, -1 on error.
    */
-  int Receive(std::vector<uint8_t>& aRecvBuf);
+  int Receive(uint8_t* aBuf, size_t aLength);
 
   /**
    * Get peer's maximum information unit.
@@ -99,8 +110,9 @@ private:
   bool DoConnectBy(const char* aSn);
   bool DoClose();
 
-  bool DoSend(std::vector<uint8_t>& aData);
-  int DoReceive(std::vector<uint8_t>& aRecvBuf);
+  bool DoSend(const uint8_t* aData, size_t aLength);
+  bool DoSend(const struct iovec* aIov, size_t aCount);
+  int DoReceive(uint8_t* aBuf, size_t aLength);
 
   int DoGetRemoteSocketMIU() const;
   int DoGetRemoteSocketRW() const;
@@ -19,6 +19,7 @@
  */
 #include "Mutex.h"
 #include <errno.h>
+#include <string.h>
 #include "NfcDebug.h"
 
 Mutex::Mutex()
@@ -26,6 +26,7 @@
 #include "PowerSwitch.h"
 #include "NfcTag.h"
 #include "Pn544Interop.h"
+#include "LlcpConnectionlessSocket.h"
 #include "LlcpSocket.h"
 #include "LlcpServiceSocket.h"
 #include "NfcTagManager.h"
@@ -411,6 +412,29 @@ ILlcpServerSocket* NfcManager::CreateLlcpServerSocket(int aSap,
   return static_cast<ILlcpServerSocket*>(pLlcpServiceSocket);
 }
 
+ILlcpConnectionlessSocket* NfcManager::CreateLlcpConnectionlessSocket(int aSap,
+                                                                      const char* aSn)
+{
+  NCI_DEBUG("enter; sap=%d; sn =%s", aSap, aSn ? aSn : "");
+  const uint32_t handle = PeerToPeer::GetInstance().GetNewHandle();
+  int localSap = -1;
+
+  if (!(PeerToPeer::GetInstance().RegisterConnectionless(handle, aSap, aSn, localSap))) {
+    NCI_ERROR("register connectionless fail");
+    return NULL;
+  }
+
+  LlcpConnectionlessSocket* pSocket = new LlcpConnectionlessSocket(handle, localSap);
+
+  NCI_DEBUG("exit");
+  return static_cast<ILlcpConnectionlessSocket*>(pSocket);
+}
+
+void NfcManager::GetLlcpMetrics(LlcpLinkMetrics& aMetrics)
+{
+  PeerToPeer::GetInstance().GetLinkMetrics(aMetrics);
+}
+
 bool NfcManager::EnableSecureElement()
 {
   NCI_DEBUG("enter");
@@ -27,6 +27,7 @@ extern "C"
 
 class P2pDevice;
 class NfcTagManager;
+class ILlcpConnectionlessSocket;
 class ILlcpServerSocket;
 class ILlcpSocket;
 
@@ -151,6 +152,24 @@ public:
                                             int aRw,
                                             int aBufLen);
 
+  /**
+   * Create a LLCP connectionless socket.
+   *
+   * @param  aSap Local service access point, negative for any.
+   * @param  aSn  Local service name, may be NULL.
+   * @return      ILlcpConnectionlessSocket interface.
+   */
+  ILlcpConnectionlessSocket* CreateLlcpConnectionlessSocket(int aSap,
+                                                            const char* aSn);
+
+  /**
+   * Get the traffic counters of the current or last LLCP link.
+   *
+   * @param  aMetrics Set to the link counters.
+   * @return          None.
+   */
+  void GetLlcpMetrics(LlcpLinkMetrics& aMetrics);
+
   /**
    * Get default Llcp connection maxumum information unit
    *
@@ -56,7 +56,11 @@ static tNFA_STATUS     sCheckNdefStatus = 0;      // Whether tag already contain
 static bool            sCheckNdefCapable = false; // Whether tag has NDEF capability.
 static tNFA_HANDLE     sNdefTypeHandlerHandle = NFA_HANDLE_INVALID;
 static tNFA_INTF_TYPE  sCurrentRfInterface = NFA_INTERFACE_ISO_DEP;
-static uint8_t*        sTransceiveData = NULL;
+// Large enough for an ISO-DEP extended length APDU, header + Lc + 65535
+// data bytes + Le.
+static const uint32_t  MAX_TRANSCEIVE_LEN = 4 + 3 + 65535 + 2;
+static uint8_t         sTransceiveCommand[MAX_TRANSCEIVE_LEN];
+static uint8_t         sTransceiveData[MAX_TRANSCEIVE_LEN];
 static uint32_t        sTransceiveDataLen = 0;
 static bool            sWaitingForTransceive = false;
 static bool            sTransceiveRfTimeout = false;
@@ -114,10 +118,17 @@ static void NdefHandlerCallback(tNFA_NDEF_EVT aEvent, tNFA_NDEF_EVT_DATA* aEvent
 NfcTagManager::NfcTagManager()
 {
   pthread_mutex_init(&mMutex, NULL);
+
+  // Presence checks run several times per second, so the semaphore is
+  // created once instead of on every check.
+  if (sem_init(&sPresenceCheckSem, 0, 0) == -1) {
+    NCI_ERROR("presence check semaphore creation failed (errno=0x%08x)", errno);
+  }
 }
 
 NfcTagManager::~NfcTagManager()
 {
+  sem_destroy(&sPresenceCheckSem);
 }
 
 NdefInfo* NfcTagManager::DoReadNdefInfo()
@@ -356,14 +367,11 @@ void NfcTagManager::DoTransceiveComplete(uint8_t* aBuf,
   }
 
   sTransceiveDataLen = 0;
-  if (aBufLen) {
-    sTransceiveData = new uint8_t[aBufLen];
-    if (!sTransceiveData) {
-      NCI_ERROR("memory allocation error");
-    } else {
-      sTransceiveDataLen = aBufLen;
-      memcpy(sTransceiveData, aBuf, aBufLen);
-    }
+  if (aBufLen > MAX_TRANSCEIVE_LEN) {
+    NCI_ERROR("response too long; len=%u", aBufLen);
+  } else if (aBufLen) {
+    sTransceiveDataLen = aBufLen;
+    memcpy(sTransceiveData, aBuf, aBufLen);
   }
 
   {
@@ -384,29 +392,35 @@ bool NfcTagManager::DoTransceive(const std::vector<uint8_t>& aCommand,
     return false;
   }
 
+  uint32_t size = aCommand.size();
+  if (size > MAX_TRANSCEIVE_LEN) {
+    NCI_ERROR("command too long; len=%u", size);
+    return false;
+  }
+
   do {
     {
       SyncEventGuard g(sTransceiveEvent);
       sTransceiveRfTimeout = false;
       sWaitingForTransceive = true;
-      delete sTransceiveData;
+      sTransceiveDataLen = 0;
 
-      uint32_t size = aCommand.size();
-      uint8_t* cmd = new uint8_t[size];
-      std::copy(aCommand.begin(), aCommand.end(), cmd);
+      // The stack may modify the frame, so send a copy in the reused
+      // command buffer.
+      if (size) {
+        memcpy(sTransceiveCommand, &aCommand[0], size);
+      }
 
       tNFA_STATUS status = NFA_STATUS_FAILED;
       if (IsMifareTech(tag.mTechLibNfcTypes[0])) {
 #ifdef NFCC_PN547
-        status = EXTNS_MfcTransceive(cmd, size);
+        status = EXTNS_MfcTransceive(sTransceiveCommand, size);
 #endif
       } else {
-        status = NFA_SendRawFrame(cmd, size,
+        status = NFA_SendRawFrame(sTransceiveCommand, size,
                    NFA_DM_DEFAULT_PRESENCE_CHECK_START_DELAY);
       }
 
-      delete cmd;
-
       if (status != NFA_STATUS_OK) {
         NCI_ERROR("fail send; error=%d", status);
         break;
@@ -432,22 +446,18 @@ bool NfcTagManager::DoTransceive(const std::vector<uint8_t>& aCommand,
     }
 
     if (!isNack) {
+      uint8_t* data = sTransceiveData;
       if (IsMifareTech(tag.mTechLibNfcTypes[0])) {
 #ifdef NFCC_PN547
-        uint8_t** sTransData = &sTransceiveData;
         if (NFCSTATUS_FAILED ==
-            EXTNS_CheckMfcResponse(sTransData, &sTransceiveDataLen)) {
+            EXTNS_CheckMfcResponse(&data, &sTransceiveDataLen)) {
           NCI_ERROR("fail get response");
         }
 #endif
       }
-      for (size_t i = 0; i < sTransceiveDataLen; i++) {
-        aOutResponse.push_back(sTransceiveData[i]);
-      }
+      aOutResponse.insert(aOutResponse.end(), data, data + sTransceiveDataLen);
     }
 
-    delete sTransceiveData;
-    sTransceiveData = NULL;
     sTransceiveDataLen = 0;
   } while (0);
 
@@ -921,10 +931,10 @@ TheEnd:
   return retCode;
 }
 
-bool NfcTagManager::DoPresenceCheck()
+PresenceCheckResult NfcTagManager::DoPresenceCheck()
 {
   NCI_DEBUG("enter");
-  bool isPresent = false;
+  PresenceCheckResult result = PRESENCE_CHECK_MISSED;
   NfcTag& tag = NfcTag::GetInstance();
 
   // Special case for Kovio. The deactivation would have already occurred
@@ -940,23 +950,21 @@ bool NfcTagManager::DoPresenceCheck()
     DoAbortWaits();
     tag.Abort();
 
-    return false;
+    return PRESENCE_CHECK_ABSENT;
   }
 
   if (IsNfcActive() == false) {
     NCI_DEBUG("NFC is no longer active.");
-    return false;
+    return PRESENCE_CHECK_ABSENT;
   }
 
   if (tag.GetActivationState() != NfcTag::Active) {
     NCI_DEBUG("tag already deactivated");
-    return false;
+    return PRESENCE_CHECK_ABSENT;
   }
 
-  if (sem_init(&sPresenceCheckSem, 0, 0) == -1) {
-    NCI_ERROR("semaphore creation failed (errno=0x%08x)", errno);
-    return false;
-  }
+  // Drop wake-ups left over from DoAbortWaits() while nobody was waiting.
+  while (sem_trywait(&sPresenceCheckSem) == 0);
 
   tNFA_STATUS status = NFA_STATUS_OK;
 #ifdef NFA_DM_PRESENCE_CHECK_OPTION
@@ -968,19 +976,16 @@ bool NfcTagManager::DoPresenceCheck()
   if (status == NFA_STATUS_OK) {
     if (sem_wait(&sPresenceCheckSem)) {
       NCI_ERROR("failed to wait (errno=0x%08x)", errno);
-    } else {
-      isPresent = (sCountTagAway > 3) ? false : true;
+    } else if (sCountTagAway == 0) {
+      result = PRESENCE_CHECK_PRESENT;
     }
   }
 
-  if (sem_destroy(&sPresenceCheckSem)) {
-    NCI_ERROR("Failed to destroy check NDEF semaphore (errno=0x%08x)", errno);
-  }
-
-  if (isPresent == false)
-    NCI_DEBUG("tag absent ????");
+  // The caller counts consecutive misses and decides when the tag is gone.
+  if (result != PRESENCE_CHECK_PRESENT)
+    NCI_DEBUG("presence check missed; sCountTagAway=%d", sCountTagAway);
 
-  return isPresent;
+  return result;
 }
 
 int NfcTagManager::ReSelect(tNFA_INTF_TYPE aRfInterface)
@@ -1318,9 +1323,9 @@ bool NfcTagManager::Reconnect()
   return NFCSTATUS_SUCCESS == status;
 }
 
-bool NfcTagManager::PresenceCheck()
+PresenceCheckResult NfcTagManager::PresenceCheck()
 {
-  bool result;
+  PresenceCheckResult result;
   pthread_mutex_lock(&mMutex);
   result = DoPresenceCheck();
   pthread_mutex_unlock(&mMutex);
@@ -42,7 +42,7 @@ public:
   NdefMessage* ReadNdef();
   NdefInfo* ReadNdefInfo();
   bool WriteNdef(NdefMessage& aNdef);
-  bool PresenceCheck();
+  PresenceCheckResult PresenceCheck();
   bool MakeReadOnly();
   bool FormatNdef();
   bool Transceive(const std::vector<uint8_t>& aCommand,
@@ -204,9 +204,9 @@ public:
   /**
    * Check if the tag is in the RF field.
    *
-   * @return None.
+   * @return Result of the check.
    */
-  static bool DoPresenceCheck();
+  static PresenceCheckResult DoPresenceCheck();
 
   /**
    * Deactivate the RF field.
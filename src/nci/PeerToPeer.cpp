@@ -19,6 +19,8 @@
  */
 #include "PeerToPeer.h"
 
+#include <time.h>
+
 #include "NfcDebug.h"
 #include "NfcManager.h"
 #include "NfcNciUtil.h"
@@ -42,6 +44,13 @@ using namespace android;
 PeerToPeer PeerToPeer::sP2p;
 const std::string P2pServer::sSnepServiceName("urn:nfc:sn:snep");
 
+static uint64_t NowMs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
 PeerToPeer::PeerToPeer()
  : mRemoteWKS(0)
  , mIsP2pListening(false)
@@ -50,10 +59,12 @@ PeerToPeer::PeerToPeer()
                     | NFA_TECHNOLOGY_MASK_A_ACTIVE
                     | NFA_TECHNOLOGY_MASK_F_ACTIVE)
  , mNextHandle(1)
+ , mIsLinkActive(false)
+ , mRemoteLinkMiu(0)
+ , mLinkActivatedMs(0)
+ , mLinkDeactivatedMs(0)
  , mNfcManager(NULL)
 {
-  memset(mServers, 0, sizeof(mServers));
-  memset(mClients, 0, sizeof(mClients));
 }
 
 PeerToPeer::~PeerToPeer()
@@ -77,36 +88,22 @@ void PeerToPeer::Initialize(NfcManager* aNfcManager)
 
 sp<P2pServer> PeerToPeer::FindServerLocked(tNFA_HANDLE aNfaP2pServerHandle)
 {
-  for (int i = 0; i < sMax; i++) {
-    if ((mServers[i] != NULL)
-      && (mServers[i]->mNfaP2pServerHandle == aNfaP2pServerHandle) ) {
-      return mServers[i];
-    }
-  }
-
-  // If here, not found.
-  return NULL;
+  NfaServerMap::const_iterator it = mNfaServers.find(aNfaP2pServerHandle);
+  return it != mNfaServers.end() ? it->second : NULL;
 }
 
 sp<P2pServer> PeerToPeer::FindServerLocked(unsigned int aHandle)
 {
-  for (int i = 0; i < sMax; i++) {
-    if (( mServers[i] != NULL)
-      && (mServers[i]->mHandle == aHandle) ) {
-      return mServers[i];
-    }
-  }
-
-  // If here, not found.
-  return NULL;
+  ServerMap::const_iterator it = mServers.find(aHandle);
+  return it != mServers.end() ? it->second : NULL;
 }
 
 sp<P2pServer> PeerToPeer::FindServerLocked(const char* aServiceName)
 {
-  for (int i = 0; i < sMax; i++) {
-    if ((mServers[i] != NULL) &&
-        (mServers[i]->mServiceName.compare(aServiceName) == 0) )
-      return mServers[i];
+  // Only used when registering, there are few servers.
+  for (ServerMap::const_iterator it = mServers.begin(); it != mServers.end(); ++it) {
+    if (it->second->mServiceName.compare(aServiceName) == 0)
+      return it->second;
   }
 
   // If here, not found.
@@ -126,25 +123,17 @@ bool PeerToPeer::RegisterServer(unsigned int aHandle,
               aServiceName, pSrv->mNfaP2pServerHandle);
 
     // Update handle.
+    mServers.erase(pSrv->mHandle);
     pSrv->mHandle = aHandle;
+    mServers[aHandle] = pSrv;
     mMutex.Unlock();
     return true;
   }
 
-  for (int i = 0; i < sMax; i++) {
-    if (mServers[i] == NULL) {
-      pSrv = mServers[i] = new P2pServer(aHandle, aServiceName);
-      NCI_DEBUG("added new p2p server  index: %d  handle: %u  name: %s", i, aHandle, aServiceName);
-      break;
-    }
-  }
+  pSrv = mServers[aHandle] = new P2pServer(aHandle, aServiceName);
+  NCI_DEBUG("added new p2p server  handle: %u  name: %s", aHandle, aServiceName);
   mMutex.Unlock();
 
-  if (pSrv == NULL) {
-    NCI_ERROR("service name=%s  no free entry", aServiceName);
-    return false;
-  }
-
   if (pSrv->RegisterWithStack()) {
     NCI_DEBUG("got new p2p server h=0x%X", pSrv->mNfaP2pServerHandle);
     return true;
@@ -159,15 +148,21 @@ void PeerToPeer::RemoveServer(unsigned int aHandle)
 {
   AutoMutex mutex(mMutex);
 
-  for (int i = 0; i < sMax; i++) {
-    if ((mServers[i] != NULL) && (mServers[i]->mHandle == aHandle) ) {
-      NCI_DEBUG("server handle: %u;  nfa_handle: 0x%04x; name: %s; index=%d",
-                aHandle, mServers[i]->mNfaP2pServerHandle, mServers[i]->mServiceName.c_str(), i);
-      mServers[i] = NULL;
-      return;
-    }
+  ServerMap::iterator it = mServers.find(aHandle);
+  if (it == mServers.end()) {
+    NCI_ERROR("unknown server handle: %u", aHandle);
+    return;
+  }
+
+  sp<P2pServer> pSrv = it->second;
+  NCI_DEBUG("server handle: %u;  nfa_handle: 0x%04x; name: %s",
+            aHandle, pSrv->mNfaP2pServerHandle, pSrv->mServiceName.c_str());
+  mServers.erase(it);
+
+  NfaServerMap::iterator nfaIt = mNfaServers.find(pSrv->mNfaP2pServerHandle);
+  if (nfaIt != mNfaServers.end() && nfaIt->second == pSrv) {
+    mNfaServers.erase(nfaIt);
   }
-  NCI_ERROR("unknown server handle: %u", aHandle);
 }
 
 void PeerToPeer::LlcpActivatedHandler(tNFA_LLCP_ACTIVATED& aActivated)
@@ -195,6 +190,21 @@ void PeerToPeer::LlcpActivatedHandler(tNFA_LLCP_ACTIVATED& aActivated)
 
   pIP2pDevice->GetHandle() = 0x1234;
 
+  // SAPs resolved on a previous link may now belong to other services.
+  mRemoteWKS = aActivated.remote_wks;
+  {
+    AutoMutex mutex(mMutex);
+    mRemoteLinkMiu = aActivated.remote_link_miu;
+    mRemoteSaps.clear();
+    if (mRemoteWKS & (1 << LLCP_SAP_SNEP)) {
+      mRemoteSaps[P2pServer::sSnepServiceName] = LLCP_SAP_SNEP;
+    }
+
+    mIsLinkActive = true;
+    mLinkActivatedMs = NowMs();
+    mLinkMetrics.Reset();
+  }
+
   mNfcManager->NotifyLlcpLinkActivated(pIP2pDevice);
 
   NCI_DEBUG("exit");
@@ -212,6 +222,17 @@ void PeerToPeer::LlcpDeactivatedHandler(tNFA_LLCP_DEACTIVATED& /*deactivated*/)
     return;
   }
 
+  mRemoteWKS = 0;
+  {
+    AutoMutex mutex(mMutex);
+    mRemoteSaps.clear();
+    mIsLinkActive = false;
+    mLinkDeactivatedMs = NowMs();
+  }
+
+  // Connections still open are counted as they are now.
+  DumpLinkMetrics();
+
   mNfcManager->NotifyLlcpLinkDeactivated(pIP2pDevice);
 
   NfcTagManager::DoRegisterNdefTypeHandler();
@@ -245,7 +266,14 @@ bool PeerToPeer::Accept(unsigned int aServerHandle,
   }
   mMutex.Unlock();
 
-  return pSrv->Accept(aServerHandle, aConnHandle, aMaxInfoUnit, aRecvWindow);
+  sp<NfaConn> connection = pSrv->AllocateConnection(aConnHandle);
+  AddConn(connection);
+
+  if (!pSrv->Accept(connection, aMaxInfoUnit, aRecvWindow)) {
+    RemoveConn(aConnHandle);
+    return false;
+  }
+  return true;
 }
 
 bool PeerToPeer::DeregisterServer(unsigned int aHandle)
@@ -283,37 +311,28 @@ bool PeerToPeer::CreateClient(unsigned int aHandle,
                               uint16_t aMiu,
                               uint8_t aRw)
 {
-  int i = 0;
   NCI_DEBUG("enter: h: %u  miu: %u  rw: %u", aHandle, aMiu, aRw);
 
+  sp<P2pClient> client = new P2pClient();
+  client->mClientConn->mHandle = aHandle;
+  client->mClientConn->mMaxInfoUnit = aMiu;
+  // The RW field of the CONNECT PDU is 4 bits wide.
+  client->mClientConn->mRecvWindow = aRw > LLCP_MAX_RW ? LLCP_MAX_RW : aRw;
+
   mMutex.Lock();
-  sp<P2pClient> client = NULL;
-  for (i = 0; i < sMax; i++) {
-    if (mClients[i] == NULL) {
-      mClients[i] = client = new P2pClient();
-
-      mClients[i]->mClientConn->mHandle = aHandle;
-      mClients[i]->mClientConn->mMaxInfoUnit = aMiu;
-      mClients[i]->mClientConn->mRecvWindow = aRw;
-      break;
-    }
-  }
+  mClients[aHandle] = client;
+  mConnections[aHandle] = client->mClientConn;
   mMutex.Unlock();
 
-  if (client == NULL) {
-    NCI_ERROR("fail");
-    return false;
-  }
-
   NCI_DEBUG("pClient: 0x%p  assigned for client handle: %u", client.get(), aHandle);
 
   {
-    SyncEventGuard guard(mClients[i]->mRegisteringEvent);
+    SyncEventGuard guard(client->mRegisteringEvent);
     NFA_P2pRegisterClient(NFA_P2P_DLINK_TYPE, NfaClientCallback);
-    mClients[i]->mRegisteringEvent.Wait(); // Wait for NFA_P2P_REG_CLIENT_EVT.
+    client->mRegisteringEvent.Wait(); // Wait for NFA_P2P_REG_CLIENT_EVT.
   }
 
-  if (mClients[i]->mNfaP2pClientHandle != NFA_HANDLE_INVALID) {
+  if (client->mNfaP2pClientHandle != NFA_HANDLE_INVALID) {
     NCI_DEBUG("exit; new client handle: %u   NFA Handle: 0x%04x",
               aHandle, client->mClientConn->mNfaConnHandle);
     return true;
@@ -325,39 +344,104 @@ bool PeerToPeer::CreateClient(unsigned int aHandle,
   }
 }
 
+void PeerToPeer::AddConn(const sp<NfaConn>& aConn)
+{
+  AutoMutex mutex(mMutex);
+  mConnections[aConn->mHandle] = aConn;
+}
+
 void PeerToPeer::RemoveConn(unsigned int aHandle)
 {
   AutoMutex mutex(mMutex);
-  // If the connection is a for a client, delete the client itself.
-  for (int i = 0; i < sMax; i++) {
-    if ((mClients[i] != NULL) && (mClients[i]->mClientConn->mHandle == aHandle)) {
-      if (mClients[i]->mNfaP2pClientHandle != NFA_HANDLE_INVALID) {
-        NFA_P2pDeregister(mClients[i]->mNfaP2pClientHandle);
-      }
 
-      mClients[i] = NULL;
-      NCI_DEBUG("deleted client handle: %u  index: %u", aHandle, i);
-      return;
+  ConnMap::iterator connIt = mConnections.find(aHandle);
+  const bool found = connIt != mConnections.end();
+  if (found) {
+    LlcpMetrics metrics;
+    connIt->second->GetMetrics(metrics);
+    mLinkMetrics.Add(metrics);
+    NCI_DEBUG("handle: %u  sent: %u pdus %u bytes  received: %u pdus %u bytes  "
+              "congested: %u waits %ums  receive: %u waits %ums  connect: %ums",
+              aHandle, metrics.pdusSent, metrics.bytesSent,
+              metrics.pdusReceived, metrics.bytesReceived,
+              metrics.congestionWaits, metrics.congestionMs,
+              metrics.receiveWaits, metrics.receiveWaitMs, metrics.connectMs);
+
+    NfaConnMap::iterator nfaIt = mNfaConnections.find(connIt->second->mNfaConnHandle);
+    if (nfaIt != mNfaConnections.end() && nfaIt->second == connIt->second) {
+      mNfaConnections.erase(nfaIt);
+    }
+    mConnections.erase(connIt);
+  }
+
+  // If the connection is a for a client, delete the client itself.
+  ClientMap::iterator it = mClients.find(aHandle);
+  if (it != mClients.end()) {
+    sp<P2pClient> client = it->second;
+    if (client->mNfaP2pClientHandle != NFA_HANDLE_INVALID) {
+      NFA_P2pDeregister(client->mNfaP2pClientHandle);
+      mNfaClients.erase(client->mNfaP2pClientHandle);
     }
+
+    mClients.erase(it);
+    NCI_DEBUG("deleted client handle: %u", aHandle);
+    return;
   }
 
   // If the connection is for a server, just delete the connection.
-  for (int i = 0; i < sMax; i++) {
-    if (mServers[i] != NULL) {
-      if (mServers[i]->RemoveServerConnection(aHandle)) {
-        return;
-      }
+  for (ServerMap::const_iterator srvIt = mServers.begin(); srvIt != mServers.end(); ++srvIt) {
+    if (srvIt->second->RemoveServerConnection(aHandle)) {
+      return;
     }
   }
 
-  NCI_ERROR("could not find handle: %u", aHandle);
+  // The server may already be gone, e.g. when deregistered during accept().
+  if (!found) {
+    NCI_ERROR("could not find handle: %u", aHandle);
+  }
+}
+
+void PeerToPeer::SetNfaConnHandle(const sp<NfaConn>& aConn, tNFA_HANDLE aNfaConnHandle)
+{
+  AutoMutex mutex(mMutex);
+  aConn->mNfaConnHandle = aNfaConnHandle;
+  mNfaConnections[aNfaConnHandle] = aConn;
+}
+
+void PeerToPeer::ClearNfaConnHandle(const sp<NfaConn>& aConn)
+{
+  AutoMutex mutex(mMutex);
+  NfaConnMap::iterator it = mNfaConnections.find(aConn->mNfaConnHandle);
+  if (it != mNfaConnections.end() && it->second == aConn) {
+    mNfaConnections.erase(it);
+  }
+  aConn->mNfaConnHandle = NFA_HANDLE_INVALID;
 }
 
 bool PeerToPeer::ConnectConnOriented(unsigned int aHandle,
                                      const char* aServiceName)
 {
   NCI_DEBUG("enter; h: %u  service name=%s", aHandle, aServiceName);
-  bool stat = CreateDataLinkConn(aHandle, aServiceName, 0);
+  bool stat = false;
+  uint8_t sap = 0;
+  if (FindRemoteSap(aServiceName, sap)) {
+    // The peer already told us where the service is on this link.
+    NCI_DEBUG("h: %u  cached sap: 0x%X", aHandle, sap);
+    stat = CreateDataLinkConn(aHandle, NULL, sap, false);
+    if (!stat && CanRetryConnect(aHandle)) {
+      // The SAP is stale, resolve the service name again with the same client.
+      NCI_DEBUG("h: %u  cached sap failed, connect by name", aHandle);
+      {
+        AutoMutex mutex(mMutex);
+        mRemoteSaps.erase(aServiceName);
+      }
+      stat = CreateDataLinkConn(aHandle, aServiceName, 0, true);
+    } else if (!stat) {
+      RemoveConn(aHandle);
+    }
+  } else {
+    stat = CreateDataLinkConn(aHandle, aServiceName, 0, true);
+  }
   NCI_DEBUG("exit; h: %u  stat: %u", aHandle, stat);
   return stat;
 }
@@ -366,14 +450,15 @@ bool PeerToPeer::ConnectConnOriented(unsigned int aHandle,
                                      uint8_t aDestinationSap)
 {
   NCI_DEBUG("enter; h: %u  dest sap: 0x%X", aHandle, aDestinationSap);
-  bool stat = CreateDataLinkConn(aHandle, NULL, aDestinationSap);
+  bool stat = CreateDataLinkConn(aHandle, NULL, aDestinationSap, true);
   NCI_DEBUG("exit; h: %u  stat: %u", aHandle, stat);
   return stat;
 }
 
 bool PeerToPeer::CreateDataLinkConn(unsigned int aHandle,
                                     const char* aServiceName,
-                                    uint8_t aDestinationSap)
+                                    uint8_t aDestinationSap,
+                                    bool aRemoveOnFailure)
 {
   NCI_DEBUG("enter");
   tNFA_STATUS nfaStat = NFA_STATUS_FAILED;
@@ -384,11 +469,14 @@ bool PeerToPeer::CreateDataLinkConn(unsigned int aHandle,
     return false;
   }
 
+  const uint64_t connectStart = NowMs();
   {
     SyncEventGuard guard(pClient->mConnectingEvent);
     pClient->mIsConnecting = true;
+    pClient->mConnectCancelled = false;
 
     if (aServiceName) {
+      pClient->mServiceName = aServiceName;
       nfaStat = NFA_P2pConnectByName(pClient->mNfaP2pClientHandle,
                   const_cast<char*>(aServiceName), pClient->mClientConn->mMaxInfoUnit,
                   pClient->mClientConn->mRecvWindow);
@@ -403,51 +491,93 @@ bool PeerToPeer::CreateDataLinkConn(unsigned int aHandle,
     }
   }
 
-  if (nfaStat == NFA_STATUS_OK) {
-    if (pClient->mClientConn->mNfaConnHandle == NFA_HANDLE_INVALID) {
-      RemoveConn(aHandle);
-      nfaStat = NFA_STATUS_FAILED;
-    } else {
+  if (nfaStat == NFA_STATUS_OK &&
+      pClient->mClientConn->mNfaConnHandle == NFA_HANDLE_INVALID) {
+    nfaStat = NFA_STATUS_FAILED;
+  }
+
+  if (nfaStat != NFA_STATUS_OK) {
+    {
+      SyncEventGuard guard(pClient->mConnectingEvent);
       pClient->mIsConnecting = false;
     }
-  } else {
-    RemoveConn(aHandle);
+    if (aRemoveOnFailure) {
+      RemoveConn(aHandle);
+    }
     NCI_ERROR("fail; error=0x%X", nfaStat);
+  } else {
+    pClient->mIsConnecting = false;
+
+    // CONNECT to CC round trip.
+    const uint32_t connectMs = NowMs() - connectStart;
+    NfaConn* conn = pClient->mClientConn.get();
+    SyncEventGuard guard(conn->mCongEvent);
+    conn->mMetrics.connects++;
+    conn->mMetrics.connectMs += connectMs;
+    if (connectMs > conn->mMetrics.maxConnectMs) {
+      conn->mMetrics.maxConnectMs = connectMs;
+    }
   }
 
   NCI_DEBUG("exit");
   return nfaStat == NFA_STATUS_OK;
 }
 
-sp<P2pClient> PeerToPeer::FindClient(tNFA_HANDLE aNfaConnHandle)
+bool PeerToPeer::CanRetryConnect(unsigned int aHandle)
+{
+  sp<P2pClient> pClient = FindClient(aHandle);
+  if (pClient == NULL) {
+    return false;
+  }
+  {
+    SyncEventGuard guard(pClient->mConnectingEvent);
+    if (pClient->mConnectCancelled) {
+      NCI_DEBUG("h: %u  connect cancelled", aHandle);
+      return false;
+    }
+  }
+  AutoMutex mutex(mMutex);
+  return mIsLinkActive;
+}
+
+bool PeerToPeer::FindRemoteSap(const char* aServiceName, uint8_t& aSap)
 {
   AutoMutex mutex(mMutex);
-  for (int i = 0; i < sMax; i++) {
-    if ((mClients[i] != NULL) &&
-        (mClients[i]->mNfaP2pClientHandle == aNfaConnHandle))
-      return mClients[i];
+  std::map<std::string, uint8_t>::const_iterator it = mRemoteSaps.find(aServiceName);
+  if (it == mRemoteSaps.end()) {
+    return false;
   }
-  return NULL;
+  aSap = it->second;
+  return true;
+}
+
+void PeerToPeer::SetRemoteSap(const std::string& aServiceName, uint8_t aSap)
+{
+  AutoMutex mutex(mMutex);
+  mRemoteSaps[aServiceName] = aSap;
+}
+
+sp<P2pClient> PeerToPeer::FindClient(tNFA_HANDLE aNfaConnHandle)
+{
+  AutoMutex mutex(mMutex);
+  NfaClientMap::const_iterator it = mNfaClients.find(aNfaConnHandle);
+  return it != mNfaClients.end() ? it->second : NULL;
 }
 
 sp<P2pClient> PeerToPeer::FindClient(unsigned int aHandle)
 {
   AutoMutex mutex(mMutex);
-  for (int i = 0; i < sMax; i++) {
-    if ((mClients[i] != NULL) &&
-        (mClients[i]->mClientConn->mHandle == aHandle))
-      return mClients[i];
-  }
-  return NULL;
+  ClientMap::const_iterator it = mClients.find(aHandle);
+  return it != mClients.end() ? it->second : NULL;
 }
 
-sp<P2pClient> PeerToPeer::FindClientCon(tNFA_HANDLE aNfaConnHandle)
+sp<P2pClient> PeerToPeer::FindRegisteringClient()
 {
   AutoMutex mutex(mMutex);
-  for (int i = 0; i < sMax; i++) {
-    if ((mClients[i] != NULL) &&
-        (mClients[i]->mClientConn->mNfaConnHandle == aNfaConnHandle))
-      return mClients[i];
+  // Only used once per client, while NFA_P2pRegisterClient() is pending.
+  for (ClientMap::const_iterator it = mClients.begin(); it != mClients.end(); ++it) {
+    if (it->second->mNfaP2pClientHandle == NFA_HANDLE_INVALID)
+      return it->second;
   }
   return NULL;
 }
@@ -455,58 +585,35 @@ sp<P2pClient> PeerToPeer::FindClientCon(tNFA_HANDLE aNfaConnHandle)
 sp<NfaConn> PeerToPeer::FindConnection(tNFA_HANDLE aNfaConnHandle)
 {
   AutoMutex mutex(mMutex);
-  // First, look through all the client control blocks.
-  for (int i = 0; i < sMax; i++) {
-    if ((mClients[i] != NULL)
-      &&(mClients[i]->mClientConn->mNfaConnHandle == aNfaConnHandle)) {
-      return mClients[i]->mClientConn;
-    }
-  }
-
-  // Not found yet. Look through all the server control blocks.
-  for (int i = 0; i < sMax; i++) {
-    if (mServers[i] != NULL) {
-      sp<NfaConn> conn = mServers[i]->FindServerConnection(aNfaConnHandle);
-      if (conn != NULL) {
-        return conn;
-      }
-    }
-  }
-
-  // Not found...
-  return NULL;
+  NfaConnMap::const_iterator it = mNfaConnections.find(aNfaConnHandle);
+  return it != mNfaConnections.end() ? it->second : NULL;
 }
 
 sp<NfaConn> PeerToPeer::FindConnection(unsigned int aHandle)
 {
   AutoMutex mutex(mMutex);
-  // First, look through all the client control blocks.
-  for (int i = 0; i < sMax; i++) {
-    if ((mClients[i] != NULL)
-      && (mClients[i]->mClientConn->mHandle == aHandle)) {
-      return mClients[i]->mClientConn;
-    }
-  }
+  ConnMap::const_iterator it = mConnections.find(aHandle);
+  return it != mConnections.end() ? it->second : NULL;
+}
 
-  // Not found yet. Look through all the server control blocks.
-  for (int i = 0; i < sMax; i++) {
-    if (mServers[i] != NULL) {
-      sp<NfaConn> conn = mServers[i]->FindServerConnection(aHandle);
-      if (conn != NULL) {
-        return conn;
-      }
-    }
+bool PeerToPeer::Send(unsigned int aHandle,
+                      uint8_t* aBuffer,
+                      uint16_t aBufferLen)
+{
+  sp<NfaConn> pConn = NULL;
+
+  if ((pConn = FindConnection(aHandle)) == NULL) {
+    NCI_ERROR("can't find connection handle: %u", aHandle);
+    return false;
   }
 
-  // Not found...
-  return NULL;
+  return SendPdu(pConn, aBuffer, aBufferLen);
 }
 
 bool PeerToPeer::Send(unsigned int aHandle,
-                      uint8_t* aBuffer,
-                      uint16_t aBufferLen)
+                      const struct iovec* aIov,
+                      size_t aCount)
 {
-  tNFA_STATUS nfaStat = NFA_STATUS_FAILED;
   sp<NfaConn> pConn = NULL;
 
   if ((pConn = FindConnection(aHandle)) == NULL) {
@@ -514,26 +621,89 @@ bool PeerToPeer::Send(unsigned int aHandle,
     return false;
   }
 
+  const size_t miu = pConn->mRemoteMaxInfoUnit ? pConn->mRemoteMaxInfoUnit : LLCP_DEFAULT_MIU;
+  // Only used for PDUs that span two or more buffers.
+  std::vector<uint8_t> pdu;
+  size_t i = 0;
+  size_t offset = 0;
+
+  while (i < aCount) {
+    uint8_t* data = static_cast<uint8_t*>(aIov[i].iov_base) + offset;
+    size_t length = aIov[i].iov_len - offset;
+    if (length == 0) {
+      i++;
+      offset = 0;
+      continue;
+    }
+
+    if (length >= miu || i + 1 == aCount) {
+      // The PDU lies within this buffer, NFA copies it from there.
+      length = length < miu ? length : miu;
+      if (!SendPdu(pConn, data, length)) {
+        return false;
+      }
+      offset += length;
+      continue;
+    }
+
+    pdu.clear();
+    while (i < aCount && pdu.size() < miu) {
+      const uint8_t* base = static_cast<const uint8_t*>(aIov[i].iov_base);
+      size_t chunk = aIov[i].iov_len - offset;
+      if (chunk > miu - pdu.size()) {
+        chunk = miu - pdu.size();
+      }
+      pdu.insert(pdu.end(), base + offset, base + offset + chunk);
+      offset += chunk;
+      if (offset == aIov[i].iov_len) {
+        i++;
+        offset = 0;
+      }
+    }
+    if (!SendPdu(pConn, &pdu[0], pdu.size())) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool PeerToPeer::SendPdu(const sp<NfaConn>& aConn,
+                         uint8_t* aBuffer,
+                         uint16_t aBufferLen)
+{
+  tNFA_STATUS nfaStat = NFA_STATUS_FAILED;
+
+  // NFA keeps up to the remote receive window of I-PDUs unacknowledged and
+  // only reports congestion once that window is full, so consecutive
+  // PDUs are pipelined.
   while (true) {
-    SyncEventGuard guard(pConn->mCongEvent);
-    nfaStat = NFA_P2pSendData(pConn->mNfaConnHandle, aBufferLen, aBuffer);
+    SyncEventGuard guard(aConn->mCongEvent);
+    nfaStat = NFA_P2pSendData(aConn->mNfaConnHandle, aBufferLen, aBuffer);
     if (nfaStat == NFA_STATUS_CONGESTED) {
-      pConn->mCongEvent.Wait(); // Wait for NFA_P2P_CONGEST_EVT.
+      const uint64_t waitStart = NowMs();
+      aConn->mCongEvent.Wait(); // Wait for NFA_P2P_CONGEST_EVT.
+      aConn->mMetrics.congestionWaits++;
+      aConn->mMetrics.congestionMs += NowMs() - waitStart;
     } else {
+      if (nfaStat == NFA_STATUS_OK) {
+        aConn->mMetrics.pdusSent++;
+        aConn->mMetrics.bytesSent += aBufferLen;
+      }
       break;
     }
 
-    if (pConn->mNfaConnHandle == NFA_HANDLE_INVALID) { // Peer already disconnected.
+    if (aConn->mNfaConnHandle == NFA_HANDLE_INVALID) { // Peer already disconnected.
       NCI_DEBUG("peer disconnected");
       return false;
     }
   }
 
   if (nfaStat == NFA_STATUS_OK) {
-    NCI_DEBUG("exit OK; handle: %u  NFA Handle: 0x%04x", aHandle, pConn->mNfaConnHandle);
+    NCI_DEBUG("exit OK; handle: %u  NFA Handle: 0x%04x", aConn->mHandle, aConn->mNfaConnHandle);
   } else {
     NCI_ERROR("Data not sent; handle: %u  NFA Handle: 0x%04x  error: 0x%04x",
-              aHandle, pConn->mNfaConnHandle, nfaStat);
+              aConn->mHandle, aConn->mNfaConnHandle, nfaStat);
   }
 
   return nfaStat == NFA_STATUS_OK;
@@ -546,9 +716,6 @@ bool PeerToPeer::Receive(unsigned int aHandle,
 {
   NCI_DEBUG("enter; handle: %u  bufferLen: %u", aHandle, aBufferLen);
   sp<NfaConn> pConn = NULL;
-  tNFA_STATUS stat = NFA_STATUS_FAILED;
-  long unsigned int actualDataLen = 0;
-  BOOLEAN isMoreData = TRUE;
   bool retVal = false;
 
   if ((pConn = FindConnection(aHandle)) == NULL) {
@@ -559,21 +726,35 @@ bool PeerToPeer::Receive(unsigned int aHandle,
   NCI_DEBUG("handle: %u  nfaHandle: 0x%04X  buf len=%u",
             pConn->mHandle, pConn->mNfaConnHandle, aBufferLen);
 
-  while (pConn->mNfaConnHandle != NFA_HANDLE_INVALID) {
-    // NFA_P2pReadData() is synchronous.
-    stat = NFA_P2pReadData(
-      pConn->mNfaConnHandle, aBufferLen, &actualDataLen, aBuffer, &isMoreData);
-    if ((stat == NFA_STATUS_OK) && (actualDataLen > 0)) { // Received some data.
-      aActualLen = (uint16_t)actualDataLen;
-      retVal = true;
-      break;
-    }
-    NCI_DEBUG("waiting for data...");
-    {
-      SyncEventGuard guard(pConn->mReadEvent);
+  {
+    // NFA_P2P_DATA_EVT fills the ring, so data is usually there already.
+    SyncEventGuard guard(pConn->mReadEvent);
+    bool waited = false;
+    uint64_t waitStart = 0;
+    while (true) {
+      if (pConn->mRecvLength > 0) { // Received some data.
+        aActualLen = pConn->DrainRecvRing(aBuffer, aBufferLen);
+        // Take what the stack kept while the ring was full.
+        pConn->FillRecvRing();
+        retVal = true;
+        break;
+      }
+      if (pConn->mNfaConnHandle == NFA_HANDLE_INVALID) {
+        break;
+      }
+      NCI_DEBUG("waiting for data...");
+      if (!waited) {
+        waited = true;
+        waitStart = NowMs();
+      }
       pConn->mReadEvent.Wait();
     }
-  } // while.
+
+    if (waited) {
+      pConn->mMetrics.receiveWaits++;
+      pConn->mMetrics.receiveWaitMs += NowMs() - waitStart;
+    }
+  }
 
   NCI_DEBUG("exit; nfa h: 0x%X  ok: %u  actual len: %u",
             pConn->mNfaConnHandle, retVal, aActualLen);
@@ -596,6 +777,7 @@ bool PeerToPeer::DisconnectConnOriented(unsigned int aHandle)
   // If this is a client, he may not be connected yet, so unblock him just in case.
   if (((pClient = FindClient(aHandle)) != NULL) && (pClient->mIsConnecting) ) {
     SyncEventGuard guard(pClient->mConnectingEvent);
+    pClient->mConnectCancelled = true;
     pClient->mConnectingEvent.NotifyOne();
     return true;
   }
@@ -653,6 +835,231 @@ uint8_t PeerToPeer::GetRemoteRecvWindow(unsigned int aHandle)
   return pConn->mRemoteRecvWindow;
 }
 
+uint16_t PeerToPeer::GetRemoteLinkMiu()
+{
+  AutoMutex mutex(mMutex);
+  return mIsLinkActive ? mRemoteLinkMiu : 0;
+}
+
+void PeerToPeer::GetLinkMetrics(LlcpLinkMetrics& aMetrics)
+{
+  AutoMutex mutex(mMutex);
+
+  aMetrics.isActive = mIsLinkActive;
+  aMetrics.remoteLinkMiu = mRemoteLinkMiu;
+  if (!mLinkActivatedMs) {
+    aMetrics.durationMs = 0;
+  } else {
+    aMetrics.durationMs = (mIsLinkActive ? NowMs() : mLinkDeactivatedMs) - mLinkActivatedMs;
+  }
+
+  aMetrics.total = mLinkMetrics;
+  aMetrics.connections.clear();
+  for (ConnMap::const_iterator it = mConnections.begin(); it != mConnections.end(); ++it) {
+    LlcpConnMetrics conn;
+    conn.handle = it->first;
+    it->second->GetMetrics(conn.metrics);
+    aMetrics.total.Add(conn.metrics);
+    aMetrics.connections.push_back(conn);
+  }
+}
+
+void PeerToPeer::DumpLinkMetrics()
+{
+  LlcpLinkMetrics link;
+  GetLinkMetrics(link);
+
+  const LlcpMetrics& total = link.total;
+  NCI_DEBUG("link: %ums  miu: %u  open connections: %u",
+            link.durationMs, link.remoteLinkMiu,
+            static_cast<uint32_t>(link.connections.size()));
+  NCI_DEBUG("sent: %u pdus %u bytes  received: %u pdus %u bytes",
+            total.pdusSent, total.bytesSent, total.pdusReceived, total.bytesReceived);
+  NCI_DEBUG("congested: %u waits %ums  receive: %u waits %ums  "
+            "connect: %u avg %ums max %ums",
+            total.congestionWaits, total.congestionMs,
+            total.receiveWaits, total.receiveWaitMs, total.connects,
+            total.connects ? total.connectMs / total.connects : 0, total.maxConnectMs);
+}
+
+bool PeerToPeer::RegisterConnectionless(unsigned int aHandle,
+                                        int aSap,
+                                        const char* aServiceName,
+                                        int& aLocalSap)
+{
+  NCI_DEBUG("enter; handle: %u  sap: %d  service name: %s",
+            aHandle, aSap, aServiceName ? aServiceName : "");
+  tNFA_STATUS nfaStat = NFA_STATUS_FAILED;
+
+  sp<P2pConnectionless> endpoint = new P2pConnectionless(aHandle, aServiceName);
+  mMutex.Lock();
+  mConnectionless[aHandle] = endpoint;
+  mMutex.Unlock();
+
+  {
+    SyncEventGuard guard(endpoint->mRegisteringEvent);
+    if (aServiceName) {
+      uint8_t serverSap = aSap < 0 ? NFA_P2P_ANY_SAP : aSap;
+      nfaStat = NFA_P2pRegisterServer(serverSap,
+                                      NFA_P2P_LLINK_TYPE,
+                                      const_cast<char*>(aServiceName),
+                                      NfaConnectionlessCallback);
+    } else {
+      nfaStat = NFA_P2pRegisterClient(NFA_P2P_LLINK_TYPE, NfaConnectionlessCallback);
+    }
+
+    if (nfaStat == NFA_STATUS_OK) {
+      // Wait for NFA_P2P_REG_SERVER_EVT or NFA_P2P_REG_CLIENT_EVT.
+      endpoint->mRegisteringEvent.Wait();
+    }
+  }
+
+  if (nfaStat != NFA_STATUS_OK || endpoint->mNfaHandle == NFA_HANDLE_INVALID) {
+    NCI_ERROR("fail register connectionless; error=0x%X", nfaStat);
+    AutoMutex mutex(mMutex);
+    mConnectionless.erase(aHandle);
+    return false;
+  }
+
+  aLocalSap = endpoint->mLocalSap;
+  NCI_DEBUG("exit; handle: %u  NFA Handle: 0x%04x  sap: %d",
+            aHandle, endpoint->mNfaHandle, aLocalSap);
+  return true;
+}
+
+bool PeerToPeer::DeregisterConnectionless(unsigned int aHandle)
+{
+  NCI_DEBUG("enter; handle: %u", aHandle);
+  sp<P2pConnectionless> endpoint = NULL;
+
+  {
+    AutoMutex mutex(mMutex);
+    ConnectionlessMap::iterator it = mConnectionless.find(aHandle);
+    if (it == mConnectionless.end()) {
+      NCI_ERROR("unknown connectionless handle: %u", aHandle);
+      return false;
+    }
+    endpoint = it->second;
+    mConnectionless.erase(it);
+    mNfaConnectionless.erase(endpoint->mNfaHandle);
+  }
+
+  {
+    SyncEventGuard guard1(endpoint->mReadEvent);
+    endpoint->mClosed = true;
+    endpoint->mReadEvent.NotifyOne(); // Unblock receive().
+  }
+  {
+    SyncEventGuard guard2(endpoint->mCongEvent);
+    endpoint->mCongEvent.NotifyOne(); // Unblock send() if congested.
+  }
+
+  tNFA_STATUS nfaStat = NFA_P2pDeregister(endpoint->mNfaHandle);
+  if (nfaStat != NFA_STATUS_OK) {
+    NCI_ERROR("deregister error=0x%X", nfaStat);
+  }
+
+  NCI_DEBUG("exit");
+  return nfaStat == NFA_STATUS_OK;
+}
+
+bool PeerToPeer::SendConnectionless(unsigned int aHandle,
+                                    uint8_t aDestinationSap,
+                                    uint8_t* aBuffer,
+                                    uint16_t aBufferLen)
+{
+  tNFA_STATUS nfaStat = NFA_STATUS_FAILED;
+  sp<P2pConnectionless> endpoint = NULL;
+
+  if ((endpoint = FindConnectionless(aHandle)) == NULL) {
+    NCI_ERROR("can't find connectionless handle: %u", aHandle);
+    return false;
+  }
+
+  // UI PDUs are not acknowledged. NFA queues them and sends all that are
+  // pending in one aggregated frame on the next symmetry turn, so only
+  // wait when the link itself is congested.
+  while (true) {
+    SyncEventGuard guard(endpoint->mCongEvent);
+    nfaStat = NFA_P2pSendUI(endpoint->mNfaHandle, aDestinationSap, aBufferLen, aBuffer);
+    if (nfaStat != NFA_STATUS_CONGESTED || endpoint->mClosed) {
+      break;
+    }
+    endpoint->mCongEvent.Wait(); // Wait for NFA_P2P_CONGEST_EVT.
+  }
+
+  if (nfaStat != NFA_STATUS_OK) {
+    NCI_ERROR("UI not sent; handle: %u  NFA Handle: 0x%04x  error: 0x%04x",
+              aHandle, endpoint->mNfaHandle, nfaStat);
+  }
+
+  return nfaStat == NFA_STATUS_OK;
+}
+
+bool PeerToPeer::ReceiveConnectionless(unsigned int aHandle,
+                                       uint8_t* aBuffer,
+                                       uint16_t aBufferLen,
+                                       uint16_t& aActualLen,
+                                       uint8_t& aRemoteSap)
+{
+  NCI_DEBUG("enter; handle: %u  bufferLen: %u", aHandle, aBufferLen);
+  sp<P2pConnectionless> endpoint = NULL;
+  bool retVal = false;
+
+  if ((endpoint = FindConnectionless(aHandle)) == NULL) {
+    NCI_ERROR("can't find connectionless handle: %u", aHandle);
+    return false;
+  }
+
+  SyncEventGuard guard(endpoint->mReadEvent);
+  while (!endpoint->mClosed) {
+    long unsigned int actualDataLen = 0;
+    BOOLEAN isMoreData = FALSE;
+
+    // NFA_P2pReadUI() returns one UI PDU per call.
+    tNFA_STATUS stat = NFA_P2pReadUI(endpoint->mNfaHandle, aBufferLen, &aRemoteSap,
+                                     &actualDataLen, aBuffer, &isMoreData);
+    if ((stat == NFA_STATUS_OK) && (actualDataLen > 0)) {
+      aActualLen = (uint16_t)actualDataLen;
+      retVal = true;
+      break;
+    }
+    NCI_DEBUG("waiting for data...");
+    endpoint->mReadEvent.Wait();
+  }
+
+  NCI_DEBUG("exit; handle: %u  ok: %u  actual len: %u  remote sap: 0x%X",
+            aHandle, retVal, aActualLen, aRemoteSap);
+  return retVal;
+}
+
+sp<P2pConnectionless> PeerToPeer::FindConnectionless(tNFA_HANDLE aNfaHandle)
+{
+  AutoMutex mutex(mMutex);
+  NfaConnectionlessMap::const_iterator it = mNfaConnectionless.find(aNfaHandle);
+  return it != mNfaConnectionless.end() ? it->second : NULL;
+}
+
+sp<P2pConnectionless> PeerToPeer::FindConnectionless(unsigned int aHandle)
+{
+  AutoMutex mutex(mMutex);
+  ConnectionlessMap::const_iterator it = mConnectionless.find(aHandle);
+  return it != mConnectionless.end() ? it->second : NULL;
+}
+
+sp<P2pConnectionless> PeerToPeer::FindRegisteringConnectionless(const char* aServiceName)
+{
+  AutoMutex mutex(mMutex);
+  // Only used once per endpoint, while its registration is pending.
+  for (ConnectionlessMap::const_iterator it = mConnectionless.begin();
+       it != mConnectionless.end(); ++it) {
+    if (it->second->mNfaHandle == NFA_HANDLE_INVALID &&
+        it->second->mServiceName.compare(aServiceName) == 0)
+      return it->second;
+  }
+  return NULL;
+}
+
 void PeerToPeer::SetP2pListenMask(tNFA_TECHNOLOGY_MASK aP2pListenMask)
 {
   mP2pListenTechMask = aP2pListenMask;
@@ -699,36 +1106,56 @@ void PeerToPeer::HandleNfcOnOff(bool aIsOn)
   AutoMutex mutex(mMutex);
   if (aIsOn) {
     // Start with no clients or servers.
-    memset(mServers, 0, sizeof(mServers));
-    memset(mClients, 0, sizeof(mClients));
+    mServers.clear();
+    mNfaServers.clear();
+    mClients.clear();
+    mNfaClients.clear();
+    mConnections.clear();
+    mNfaConnections.clear();
+    mConnectionless.clear();
+    mNfaConnectionless.clear();
   } else {
     // Disconnect through all the clients.
-    for (int i = 0; i < sMax; i++) {
-      if (mClients[i] != NULL) {
-        if (mClients[i]->mClientConn->mNfaConnHandle == NFA_HANDLE_INVALID) {
-          SyncEventGuard guard(mClients[i]->mConnectingEvent);
-          mClients[i]->mConnectingEvent.NotifyOne();
-        } else {
-          mClients[i]->mClientConn->mNfaConnHandle = NFA_HANDLE_INVALID;
-          {
-            SyncEventGuard guard1(mClients[i]->mClientConn->mCongEvent);
-            mClients[i]->mClientConn->mCongEvent.NotifyOne(); // Unblock send().
-          }
-          {
-            SyncEventGuard guard2(mClients[i]->mClientConn->mReadEvent);
-            mClients[i]->mClientConn->mReadEvent.NotifyOne(); // Unblock receive().
-          }
+    for (ClientMap::const_iterator it = mClients.begin(); it != mClients.end(); ++it) {
+      sp<P2pClient> client = it->second;
+      if (client->mClientConn->mNfaConnHandle == NFA_HANDLE_INVALID) {
+        SyncEventGuard guard(client->mConnectingEvent);
+        client->mConnectingEvent.NotifyOne();
+      } else {
+        client->mClientConn->mNfaConnHandle = NFA_HANDLE_INVALID;
+        {
+          SyncEventGuard guard1(client->mClientConn->mCongEvent);
+          client->mClientConn->mCongEvent.NotifyOne(); // Unblock send().
+        }
+        {
+          SyncEventGuard guard2(client->mClientConn->mReadEvent);
+          client->mClientConn->mReadEvent.NotifyOne(); // Unblock receive().
         }
       }
     } // Loop.
 
     // Now look through all the server control blocks.
-    for (int i = 0; i < sMax; i++) {
-      if (mServers[i] != NULL) {
-        mServers[i]->UnblockAll();
-      }
+    for (ServerMap::const_iterator it = mServers.begin(); it != mServers.end(); ++it) {
+      it->second->UnblockAll();
     } // Loop.
 
+    // None of the NFA connection handles is valid anymore.
+    mNfaConnections.clear();
+
+    // Unblock connectionless readers and writers.
+    for (ConnectionlessMap::const_iterator it = mConnectionless.begin();
+         it != mConnectionless.end(); ++it) {
+      sp<P2pConnectionless> endpoint = it->second;
+      {
+        SyncEventGuard guard1(endpoint->mReadEvent);
+        endpoint->mClosed = true;
+        endpoint->mReadEvent.NotifyOne(); // Unblock receive().
+      }
+      {
+        SyncEventGuard guard2(endpoint->mCongEvent);
+        endpoint->mCongEvent.NotifyOne(); // Unblock send().
+      }
+    } // Loop.
   }
   NCI_DEBUG("exit");
 }
@@ -750,6 +1177,9 @@ void PeerToPeer::NfaServerCallback(tNFA_P2P_EVT aP2pEvent,
 
       sP2p.mMutex.Lock();
       pSrv = sP2p.FindServerLocked(aEventData->reg_server.service_name);
+      if (pSrv != NULL) {
+        sP2p.mNfaServers[aEventData->reg_server.server_handle] = pSrv;
+      }
       sP2p.mMutex.Unlock();
       if (pSrv == NULL) {
         NCI_ERROR("NFA_P2P_REG_SERVER_EVT for unknown service: %s",
@@ -783,11 +1213,11 @@ void PeerToPeer::NfaServerCallback(tNFA_P2P_EVT aP2pEvent,
       NCI_DEBUG("NFA_P2P_CONN_REQ_EVT; server h=%u", pSrv->mHandle);
 
       // Look for a connection block that is waiting (handle invalid).
-      if ((pConn = pSrv->FindServerConnection((tNFA_HANDLE)NFA_HANDLE_INVALID)) == NULL) {
+      if ((pConn = pSrv->FindWaitingConnection()) == NULL) {
         NCI_ERROR("NFA_P2P_CONN_REQ_EVT; server not listening");
       } else {
+        sP2p.SetNfaConnHandle(pConn, aEventData->conn_req.conn_handle);
         SyncEventGuard guard(pSrv->mConnRequestEvent);
-        pConn->mNfaConnHandle = aEventData->conn_req.conn_handle;
         pConn->mRemoteMaxInfoUnit = aEventData->conn_req.remote_miu;
         pConn->mRemoteRecvWindow = aEventData->conn_req.remote_rw;
         NCI_DEBUG("NFA_P2P_CONN_REQ_EVT; server h=%u; conn h=%u; notify conn req",
@@ -810,7 +1240,7 @@ void PeerToPeer::NfaServerCallback(tNFA_P2P_EVT aP2pEvent,
                   aEventData->disc.handle);
       } else {
         sP2p.mDisconnectMutex.Lock();
-        pConn->mNfaConnHandle = NFA_HANDLE_INVALID;
+        sP2p.ClearNfaConnHandle(pConn);
         {
           NCI_DEBUG("NFA_P2P_DISC_EVT; try guard disconn event");
           SyncEventGuard guard3(pConn->mDisconnectingEvent);
@@ -842,6 +1272,7 @@ void PeerToPeer::NfaServerCallback(tNFA_P2P_EVT aP2pEvent,
                   aEventData->data.handle,
                   aEventData->data.remote_sap);
         SyncEventGuard guard(pConn->mReadEvent);
+        pConn->FillRecvRing();
         pConn->mReadEvent.NotifyOne();
       }
       break;
@@ -877,12 +1308,16 @@ void PeerToPeer::NfaClientCallback(tNFA_P2P_EVT aP2pEvent,
   switch (aP2pEvent) {
     case NFA_P2P_REG_CLIENT_EVT:
       // Look for a client that is trying to register.
-      if ((pClient = sP2p.FindClient((tNFA_HANDLE)NFA_HANDLE_INVALID)) == NULL) {
+      if ((pClient = sP2p.FindRegisteringClient()) == NULL) {
         NCI_ERROR("NFA_P2P_REG_CLIENT_EVT: can't find waiting client");
       } else {
         NCI_DEBUG("NFA_P2P_REG_CLIENT_EVT; Conn Handle: 0x%04x, pClient: 0x%p",
                   aEventData->reg_client.client_handle, pClient.get());
 
+        sP2p.mMutex.Lock();
+        sP2p.mNfaClients[aEventData->reg_client.client_handle] = pClient;
+        sP2p.mMutex.Unlock();
+
         SyncEventGuard guard(pClient->mRegisteringEvent);
         pClient->mNfaP2pClientHandle = aEventData->reg_client.client_handle;
         pClient->mRegisteringEvent.NotifyOne();
@@ -901,8 +1336,13 @@ void PeerToPeer::NfaClientCallback(tNFA_P2P_EVT aP2pEvent,
                   aEventData->connected.remote_sap,
                   pClient.get());
 
+        // Later connects to the same service on this link skip the lookup.
+        if (!pClient->mServiceName.empty()) {
+          sP2p.SetRemoteSap(pClient->mServiceName, aEventData->connected.remote_sap);
+        }
+
+        sP2p.SetNfaConnHandle(pClient->mClientConn, aEventData->connected.conn_handle);
         SyncEventGuard guard(pClient->mConnectingEvent);
-        pClient->mClientConn->mNfaConnHandle = aEventData->connected.conn_handle;
         pClient->mClientConn->mRemoteMaxInfoUnit = aEventData->connected.remote_miu;
         pClient->mClientConn->mRemoteRecvWindow = aEventData->connected.remote_rw;
         pClient->mConnectingEvent.NotifyOne(); // Unblock createDataLinkConn().
@@ -924,7 +1364,7 @@ void PeerToPeer::NfaClientCallback(tNFA_P2P_EVT aP2pEvent,
         pClient->mConnectingEvent.NotifyOne();
       } else {
         sP2p.mDisconnectMutex.Lock();
-        pConn->mNfaConnHandle = NFA_HANDLE_INVALID;
+        sP2p.ClearNfaConnHandle(pConn);
         {
           NCI_DEBUG("NFA_P2P_DISC_EVT; try guard disconn event");
           SyncEventGuard guard3(pConn->mDisconnectingEvent);
@@ -956,6 +1396,7 @@ void PeerToPeer::NfaClientCallback(tNFA_P2P_EVT aP2pEvent,
         NCI_DEBUG("NFA_P2P_DATA_EVT; h=0x%X; remote sap=0x%X",
                   aEventData->data.handle, aEventData->data.remote_sap);
         SyncEventGuard guard(pConn->mReadEvent);
+        pConn->FillRecvRing();
         pConn->mReadEvent.NotifyOne();
       }
       break;
@@ -977,6 +1418,76 @@ void PeerToPeer::NfaClientCallback(tNFA_P2P_EVT aP2pEvent,
   }
 }
 
+void PeerToPeer::NfaConnectionlessCallback(tNFA_P2P_EVT aP2pEvent,
+                                           tNFA_P2P_EVT_DATA* aEventData)
+{
+  sp<P2pConnectionless> endpoint = NULL;
+
+  NCI_DEBUG("enter; event=%u", aP2pEvent);
+
+  switch (aP2pEvent) {
+    case NFA_P2P_REG_SERVER_EVT:
+    case NFA_P2P_REG_CLIENT_EVT: {
+      const bool isServer = aP2pEvent == NFA_P2P_REG_SERVER_EVT;
+      const tNFA_HANDLE nfaHandle = isServer ? aEventData->reg_server.server_handle
+                                             : aEventData->reg_client.client_handle;
+
+      // Look for the endpoint that is trying to register.
+      endpoint = sP2p.FindRegisteringConnectionless(
+        isServer ? aEventData->reg_server.service_name : "");
+      if (endpoint == NULL) {
+        NCI_ERROR("registration event: can't find waiting endpoint: 0x%04x", nfaHandle);
+        break;
+      }
+      NCI_DEBUG("registered connectionless handle: %u  NFA Handle: 0x%04x",
+                endpoint->mHandle, nfaHandle);
+
+      sP2p.mMutex.Lock();
+      sP2p.mNfaConnectionless[nfaHandle] = endpoint;
+      sP2p.mMutex.Unlock();
+
+      SyncEventGuard guard(endpoint->mRegisteringEvent);
+      endpoint->mNfaHandle = nfaHandle;
+      if (isServer) {
+        endpoint->mLocalSap = aEventData->reg_server.server_sap;
+      }
+      endpoint->mRegisteringEvent.NotifyOne();
+      break;
+    }
+
+    case NFA_P2P_ACTIVATED_EVT:
+    case NFA_P2P_DEACTIVATED_EVT:
+      NCI_DEBUG("link event=%u; handle: 0x%04x", aP2pEvent, aEventData->activated.handle);
+      break;
+
+    case NFA_P2P_DATA_EVT:
+      if ((endpoint = sP2p.FindConnectionless(aEventData->data.handle)) == NULL) {
+        NCI_ERROR("NFA_P2P_DATA_EVT: can't find endpoint for NFA handle: 0x%04x",
+                  aEventData->data.handle);
+      } else {
+        NCI_DEBUG("NFA_P2P_DATA_EVT; h=0x%X; remote sap=0x%X",
+                  aEventData->data.handle, aEventData->data.remote_sap);
+        SyncEventGuard guard(endpoint->mReadEvent);
+        endpoint->mReadEvent.NotifyOne();
+      }
+      break;
+
+    case NFA_P2P_CONGEST_EVT:
+      if ((endpoint = sP2p.FindConnectionless(aEventData->congest.handle)) == NULL) {
+        NCI_ERROR("NFA_P2P_CONGEST_EVT: can't find endpoint for NFA handle: 0x%04x",
+                  aEventData->congest.handle);
+      } else if (aEventData->congest.is_congested == FALSE) {
+        SyncEventGuard guard(endpoint->mCongEvent);
+        endpoint->mCongEvent.NotifyOne();
+      }
+      break;
+
+    default:
+      NCI_ERROR("unknown event 0x%X ????", aP2pEvent);
+      break;
+  }
+}
+
 void PeerToPeer::ConnectionEventHandler(uint8_t aEvent,
                                         tNFA_CONN_EVT_DATA* /*eventData*/)
 {
@@ -1005,8 +1516,6 @@ P2pServer::P2pServer(unsigned int aHandle,
  , mHandle(aHandle)
 {
   mServiceName.assign(aServiceName);
-
-  memset(mServerConn, 0, sizeof(mServerConn));
 }
 
 bool P2pServer::RegisterWithStack()
@@ -1060,38 +1569,35 @@ bool P2pServer::RegisterWithStack()
   return (mNfaP2pServerHandle != NFA_HANDLE_INVALID);
 }
 
-bool P2pServer::Accept(unsigned int aServerHandle,
-                       unsigned int aConnHandle,
+bool P2pServer::Accept(const sp<NfaConn>& aConnection,
                        int aMaxInfoUnit,
                        int aRecvWindow)
 {
   tNFA_STATUS nfaStat = NFA_STATUS_OK;
 
-  sp<NfaConn> connection = AllocateConnection(aConnHandle);
-  if (connection == NULL) {
-    NCI_ERROR("failed to allocate new server connection");
-    return false;
-  }
-
   {
     // Wait for NFA_P2P_CONN_REQ_EVT or NFA_NDEF_DATA_EVT when remote device requests connection.
     SyncEventGuard guard(mConnRequestEvent);
     NCI_DEBUG("serverHandle: %u; connHandle: %u; wait for incoming connection",
-              aServerHandle, aConnHandle);
+              mHandle, aConnection->mHandle);
     mConnRequestEvent.Wait();
     NCI_DEBUG("serverHandle: %u; connHandle: %u; nfa conn h: 0x%X; got incoming connection",
-              aServerHandle, aConnHandle, connection->mNfaConnHandle);
+              mHandle, aConnection->mHandle, aConnection->mNfaConnHandle);
   }
 
-  if (connection->mNfaConnHandle == NFA_HANDLE_INVALID) {
-    RemoveServerConnection(aConnHandle);
+  if (aConnection->mNfaConnHandle == NFA_HANDLE_INVALID) {
     NCI_DEBUG("no handle assigned");
     return false;
   }
 
   NCI_DEBUG("serverHandle: %u; connHandle: %u; nfa conn h: 0x%X; try accept",
-            aServerHandle, aConnHandle, connection->mNfaConnHandle);
-  nfaStat = NFA_P2pAcceptConn(connection->mNfaConnHandle, aMaxInfoUnit, aRecvWindow);
+            mHandle, aConnection->mHandle, aConnection->mNfaConnHandle);
+  if (aRecvWindow > LLCP_MAX_RW) {
+    aRecvWindow = LLCP_MAX_RW;
+  }
+  aConnection->mMaxInfoUnit = aMaxInfoUnit;
+  aConnection->mRecvWindow = aRecvWindow;
+  nfaStat = NFA_P2pAcceptConn(aConnection->mNfaConnHandle, aMaxInfoUnit, aRecvWindow);
 
   if (nfaStat != NFA_STATUS_OK) {
     NCI_ERROR("fail to accept remote; error=0x%X", nfaStat);
@@ -1099,24 +1605,23 @@ bool P2pServer::Accept(unsigned int aServerHandle,
   }
 
   NCI_DEBUG("exit; serverHandle: %u; connHandle: %u; nfa conn h: 0x%X",
-            aServerHandle, aConnHandle, connection->mNfaConnHandle);
+            mHandle, aConnection->mHandle, aConnection->mNfaConnHandle);
   return true;
 }
 
 void P2pServer::UnblockAll()
 {
   AutoMutex mutex(mMutex);
-  for (int i = 0; i < MAX_NFA_CONNS_PER_SERVER; i++) {
-    if (mServerConn[i] != NULL) {
-      mServerConn[i]->mNfaConnHandle = NFA_HANDLE_INVALID;
-      {
-        SyncEventGuard guard1(mServerConn[i]->mCongEvent);
-        mServerConn[i]->mCongEvent.NotifyOne(); // Unblock write (if congested).
-      }
-      {
-        SyncEventGuard guard2(mServerConn[i]->mReadEvent);
-        mServerConn[i]->mReadEvent.NotifyOne(); // Unblock receive().
-      }
+  for (ConnMap::const_iterator it = mServerConn.begin(); it != mServerConn.end(); ++it) {
+    sp<NfaConn> conn = it->second;
+    conn->mNfaConnHandle = NFA_HANDLE_INVALID;
+    {
+      SyncEventGuard guard1(conn->mCongEvent);
+      conn->mCongEvent.NotifyOne(); // Unblock write (if congested).
+    }
+    {
+      SyncEventGuard guard2(conn->mReadEvent);
+      conn->mReadEvent.NotifyOne(); // Unblock receive().
     }
   }
 }
@@ -1124,62 +1629,34 @@ void P2pServer::UnblockAll()
 sp<NfaConn> P2pServer::AllocateConnection(unsigned int aHandle)
 {
   AutoMutex mutex(mMutex);
-  // First, find a free connection block to handle the connection.
-  for (int i = 0; i < MAX_NFA_CONNS_PER_SERVER; i++) {
-    if (mServerConn[i] == NULL) {
-      mServerConn[i] = new NfaConn;
-      mServerConn[i]->mHandle = aHandle;
-      return mServerConn[i];
-    }
-  }
-
-  return NULL;
+  sp<NfaConn> conn = new NfaConn;
+  conn->mHandle = aHandle;
+  mServerConn[aHandle] = conn;
+  return conn;
 }
 
-sp<NfaConn> P2pServer::FindServerConnection(tNFA_HANDLE aNfaConnHandle)
+sp<NfaConn> P2pServer::FindWaitingConnection()
 {
   AutoMutex mutex(mMutex);
-  for (int i = 0; i < MAX_NFA_CONNS_PER_SERVER; i++) {
-    if ((mServerConn[i] != NULL) &&
-        (mServerConn[i]->mNfaConnHandle == aNfaConnHandle) )
-      return mServerConn[i];
+  for (ConnMap::const_iterator it = mServerConn.begin(); it != mServerConn.end(); ++it) {
+    if (it->second->mNfaConnHandle == NFA_HANDLE_INVALID)
+      return it->second;
   }
 
   // If here, not found.
   return NULL;
 }
 
-sp<NfaConn> P2pServer::FindServerConnection(unsigned int aHandle)
-{
-  AutoMutex mutex(mMutex);
-  for (int i = 0; i < MAX_NFA_CONNS_PER_SERVER; i++) {
-    if ((mServerConn[i] != NULL) && (mServerConn[i]->mHandle == aHandle))
-      return (mServerConn[i]);
-  }
-
-  // If here, not found.
-  return (NULL);
-}
-
 bool P2pServer::RemoveServerConnection(unsigned int aHandle)
 {
-  int i = 0;
-
   AutoMutex mutex(mMutex);
-  for (i = 0; i < MAX_NFA_CONNS_PER_SERVER; i++) {
-    if ((mServerConn[i] != NULL) && (mServerConn[i]->mHandle == aHandle) ) {
-      mServerConn[i] = NULL;
-      return true;
-    }
-  }
-
-  // If here, not found.
-  return false;
+  return mServerConn.erase(aHandle) > 0;
 }
 
 P2pClient::P2pClient()
  : mNfaP2pClientHandle(NFA_HANDLE_INVALID)
  , mIsConnecting(false)
+ , mConnectCancelled(false)
 {
   mClientConn = new NfaConn();
 }
@@ -1195,5 +1672,79 @@ NfaConn::NfaConn()
  , mRecvWindow(0)
  , mRemoteMaxInfoUnit(0)
  , mRemoteRecvWindow(0)
+ , mRecvHead(0)
+ , mRecvLength(0)
+{
+}
+
+void NfaConn::FillRecvRing()
+{
+  if (mRecvRing.empty()) {
+    // Room for one receive window, what is left waits in the stack and
+    // keeps the peer flow controlled.
+    const size_t miu = mMaxInfoUnit ? mMaxInfoUnit : LLCP_DEFAULT_MIU;
+    mRecvRing.resize(miu * (mRecvWindow ? mRecvWindow : 1));
+  }
+
+  const size_t capacity = mRecvRing.size();
+  BOOLEAN isMoreData = TRUE;
+  while (isMoreData && mRecvLength < capacity &&
+         mNfaConnHandle != NFA_HANDLE_INVALID) {
+    // Read into the free space up to the end of the ring.
+    const size_t tail = (mRecvHead + mRecvLength) % capacity;
+    const size_t space = tail < mRecvHead ? mRecvHead - tail : capacity - tail;
+    long unsigned int actualDataLen = 0;
+
+    // NFA_P2pReadData() is synchronous and returns at most one I-PDU.
+    tNFA_STATUS stat = NFA_P2pReadData(
+      mNfaConnHandle, space, &actualDataLen, &mRecvRing[tail], &isMoreData);
+    if (stat != NFA_STATUS_OK || actualDataLen == 0) {
+      break;
+    }
+    mRecvLength += actualDataLen;
+    mMetrics.pdusReceived++;
+    mMetrics.bytesReceived += actualDataLen;
+  }
+}
+
+void NfaConn::GetMetrics(LlcpMetrics& aMetrics)
+{
+  SyncEventGuard guard1(mCongEvent);
+  SyncEventGuard guard2(mReadEvent);
+  aMetrics = mMetrics;
+}
+
+uint16_t NfaConn::DrainRecvRing(uint8_t* aBuffer, uint16_t aLength)
+{
+  const size_t capacity = mRecvRing.size();
+  size_t length = aLength < mRecvLength ? aLength : mRecvLength;
+  size_t copied = 0;
+
+  // At most two copies, the second one after the ring wraps around.
+  while (copied < length) {
+    size_t chunk = capacity - mRecvHead;
+    if (chunk > length - copied) {
+      chunk = length - copied;
+    }
+    memcpy(aBuffer + copied, &mRecvRing[mRecvHead], chunk);
+    copied += chunk;
+    mRecvHead = (mRecvHead + chunk) % capacity;
+  }
+  mRecvLength -= copied;
+  if (mRecvLength == 0) {
+    mRecvHead = 0;
+  }
+
+  return static_cast<uint16_t>(copied);
+}
+
+P2pConnectionless::P2pConnectionless(unsigned int aHandle,
+                                     const char* aServiceName)
+ : mNfaHandle(NFA_HANDLE_INVALID)
+ , mHandle(aHandle)
+ , mLocalSap(-1)
+ , mClosed(false)
 {
+  if (aServiceName)
+    mServiceName.assign(aServiceName);
 }
@@ -16,10 +16,14 @@
 
 #pragma once
 
+#include <sys/uio.h>
 #include <utils/RefBase.h>
 #include <utils/StrongPointer.h>
+#include <map>
 #include <string>
+#include <vector>
 
+#include "LlcpMetrics.h"
 #include "SyncEvent.h"
 
 extern "C"
@@ -30,10 +34,9 @@ extern "C"
 class NfcManager;
 class P2pServer;
 class P2pClient;
+class P2pConnectionless;
 class NfaConn;
 
-#define MAX_NFA_CONNS_PER_SERVER    5
-
 /**
  * Communicate with a peer using NFC-DEP, LLCP, SNEP.
  */
@@ -162,6 +165,19 @@ public:
             uint8_t* aBuffer,
             uint16_t aBufferLen);
 
+  /**
+   * Send a payload of any length to peer. It is split into PDUs of the
+   * remote MIU, which the stack pipelines up to the remote receive window.
+   *
+   * @param  aHandle Handle of connection.
+   * @param  aIov    Buffers sent back to back.
+   * @param  aCount  Number of buffers in aIov.
+   * @return         True if ok.
+   */
+  bool Send(unsigned int aHandle,
+            const struct iovec* aIov,
+            size_t aCount);
+
   /**
    * Receive data from peer.
    *
@@ -200,6 +216,75 @@ public:
    */
   uint8_t GetRemoteRecvWindow(unsigned int aHandle);
 
+  /**
+   * Register a connectionless endpoint with the stack.
+   *
+   * @param  aHandle      Handle of the endpoint.
+   * @param  aSap         Local SAP of a named endpoint, negative for any.
+   * @param  aServiceName Local service name, NULL to let the stack pick
+   *                      the SAP.
+   * @param  aLocalSap    Set to the local SAP if the stack reports it.
+   * @return              True if ok.
+   */
+  bool RegisterConnectionless(unsigned int aHandle,
+                              int aSap,
+                              const char* aServiceName,
+                              int& aLocalSap);
+
+  /**
+   * Deregister a connectionless endpoint and unblock its readers.
+   *
+   * @param  aHandle Handle of the endpoint.
+   * @return         True if ok.
+   */
+  bool DeregisterConnectionless(unsigned int aHandle);
+
+  /**
+   * Queue a UI PDU for peer.
+   *
+   * @param  aHandle         Handle of the endpoint.
+   * @param  aDestinationSap Peer's service access point.
+   * @param  aBuffer         Buffer of data.
+   * @param  aBufferLen      Length of data.
+   * @return                 True if ok.
+   */
+  bool SendConnectionless(unsigned int aHandle,
+                          uint8_t aDestinationSap,
+                          uint8_t* aBuffer,
+                          uint16_t aBufferLen);
+
+  /**
+   * Receive a UI PDU from peer.
+   *
+   * @param  aHandle    Handle of the endpoint.
+   * @param  aBuffer    Buffer to store data.
+   * @param  aBufferLen Max length of buffer.
+   * @param  aActualLen Actual length received.
+   * @param  aRemoteSap Peer's service access point.
+   * @return            True if ok.
+   */
+  bool ReceiveConnectionless(unsigned int aHandle,
+                             uint8_t* aBuffer,
+                             uint16_t aBufferLen,
+                             uint16_t& aActualLen,
+                             uint8_t& aRemoteSap);
+
+  /**
+   * Get peer's link MIU.
+   *
+   * @return Peer's link MIU, 0 if no link is up.
+   */
+  uint16_t GetRemoteLinkMiu();
+
+  /**
+   * Get the traffic counters of the current LLCP link, or of the last one
+   * if no link is up.
+   *
+   * @param  aMetrics Link counters and counters of every open connection.
+   * @return          None.
+   */
+  void GetLinkMetrics(LlcpLinkMetrics& aMetrics);
+
   /**
    * Sets the p2p listen technology mask.
    *
@@ -251,8 +336,26 @@ public:
   static void NfaClientCallback(tNFA_P2P_EVT aP2pEvent,
                                 tNFA_P2P_EVT_DATA* aEventData);
 
+  /**
+   * Receive connectionless LLCP events from the stack.
+   *
+   * @param  aP2pEvent  Event code.
+   * @param  aEventData Event data.
+   * @return            None.
+   */
+  static void NfaConnectionlessCallback(tNFA_P2P_EVT aP2pEvent,
+                                        tNFA_P2P_EVT_DATA* aEventData);
+
 private:
-  static const int sMax = 10;
+  typedef std::map<unsigned int, android::sp<P2pServer> > ServerMap;
+  typedef std::map<tNFA_HANDLE, android::sp<P2pServer> > NfaServerMap;
+  typedef std::map<unsigned int, android::sp<P2pClient> > ClientMap;
+  typedef std::map<tNFA_HANDLE, android::sp<P2pClient> > NfaClientMap;
+  typedef std::map<unsigned int, android::sp<NfaConn> > ConnMap;
+  typedef std::map<tNFA_HANDLE, android::sp<NfaConn> > NfaConnMap;
+  typedef std::map<unsigned int, android::sp<P2pConnectionless> > ConnectionlessMap;
+  typedef std::map<tNFA_HANDLE, android::sp<P2pConnectionless> > NfaConnectionlessMap;
+
   static PeerToPeer sP2p;
 
   // Variables below only accessed from a single thread.
@@ -267,8 +370,22 @@ private:
   // A note on locking order: mMutex in PeerToPeer is *ALWAYS*.
   // locked before any locks / guards in P2pServer / P2pClient.
   Mutex                    mMutex;
-  android::sp<P2pServer>   mServers[sMax];
-  android::sp<P2pClient>   mClients[sMax];
+  ServerMap                mServers;           // Servers by handle.
+  NfaServerMap             mNfaServers;        // Servers by NFA server handle.
+  ClientMap                mClients;           // Clients by connection handle.
+  NfaClientMap             mNfaClients;        // Clients by NFA client handle.
+  ConnMap                  mConnections;       // Client and server connections by handle.
+  NfaConnMap               mNfaConnections;    // Connections by NFA connection handle.
+  ConnectionlessMap        mConnectionless;    // Connectionless endpoints by handle.
+  NfaConnectionlessMap     mNfaConnectionless; // Connectionless endpoints by NFA handle.
+  // Remote SAPs by service name, only valid for the current LLCP link.
+  std::map<std::string, uint8_t> mRemoteSaps;
+  // State and counters of the current or last LLCP link.
+  bool                     mIsLinkActive;
+  uint16_t                 mRemoteLinkMiu;     // Kept after deactivation.
+  uint64_t                 mLinkActivatedMs;
+  uint64_t                 mLinkDeactivatedMs;
+  LlcpMetrics              mLinkMetrics;       // Connections closed on the link.
 
   // Synchronization variables.
   // Completion event for NFA_SetP2pListenTech().
@@ -292,16 +409,32 @@ private:
   android::sp<P2pServer> FindServerLocked(const char* aServiceName);
 
   void RemoveServer(unsigned int aHandle);
+  void AddConn(const android::sp<NfaConn>& aConn);
   void RemoveConn(unsigned int aHandle);
+  void SetNfaConnHandle(const android::sp<NfaConn>& aConn, tNFA_HANDLE aNfaConnHandle);
+  void ClearNfaConnHandle(const android::sp<NfaConn>& aConn);
+  void DumpLinkMetrics();
+  bool SendPdu(const android::sp<NfaConn>& aConn,
+               uint8_t* aBuffer,
+               uint16_t aBufferLen);
+  // The client is deleted on failure unless the caller retries with it.
   bool CreateDataLinkConn(unsigned int aHandle,
                           const char* aServiceName,
-                          uint8_t aDestinationSap);
+                          uint8_t aDestinationSap,
+                          bool aRemoveOnFailure);
+  // False if the link went down or the connect was cancelled meanwhile.
+  bool CanRetryConnect(unsigned int aHandle);
+  bool FindRemoteSap(const char* aServiceName, uint8_t& aSap);
+  void SetRemoteSap(const std::string& aServiceName, uint8_t aSap);
 
   android::sp<P2pClient> FindClient(tNFA_HANDLE aNfaConnHandle);
   android::sp<P2pClient> FindClient(unsigned int aHandle);
-  android::sp<P2pClient> FindClientCon(tNFA_HANDLE aNfaConnHandle);
+  android::sp<P2pClient> FindRegisteringClient();
   android::sp<NfaConn>   FindConnection(tNFA_HANDLE aNfaConnHandle);
   android::sp<NfaConn>   FindConnection(unsigned int aHandle);
+  android::sp<P2pConnectionless> FindConnectionless(tNFA_HANDLE aNfaHandle);
+  android::sp<P2pConnectionless> FindConnectionless(unsigned int aHandle);
+  android::sp<P2pConnectionless> FindRegisteringConnectionless(const char* aServiceName);
 };
 
 class NfaConn
@@ -318,7 +451,41 @@ public:
   SyncEvent           mCongEvent;          // Event for congestion.
   SyncEvent           mDisconnectingEvent; // Event for disconnecting.
 
+  // Data read from the stack but not yet received, protected by mReadEvent.
+  std::vector<uint8_t> mRecvRing;
+  size_t              mRecvHead;
+  size_t              mRecvLength;
+
+  // Traffic counters. Send side and connect are protected by mCongEvent,
+  // receive side by mReadEvent.
+  LlcpMetrics         mMetrics;
+
   NfaConn();
+
+  /**
+   * Take a consistent copy of the traffic counters.
+   *
+   * @param  aMetrics Set to the counters.
+   * @return          None.
+   */
+  void GetMetrics(LlcpMetrics& aMetrics);
+
+  /**
+   * Move the data the stack holds for this connection into the receive
+   * ring, until the ring is full. Call with mReadEvent held.
+   *
+   * @return None.
+   */
+  void FillRecvRing();
+
+  /**
+   * Copy data out of the receive ring. Call with mReadEvent held.
+   *
+   * @param  aBuffer Buffer to store data.
+   * @param  aLength Max length of buffer.
+   * @return         Number of bytes copied.
+   */
+  uint16_t DrainRecvRing(uint8_t* aBuffer, uint16_t aLength);
 };
 
 class P2pServer
@@ -337,23 +504,22 @@ public:
             const char* aServiceName);
 
   bool RegisterWithStack();
-  bool Accept(unsigned int aServerHandle,
-              unsigned int aConnHandle,
+  bool Accept(const android::sp<NfaConn>& aConnection,
               int aMaxInfoUnit,
               int aRecvWindow);
   void UnblockAll();
 
-  android::sp<NfaConn> FindServerConnection(tNFA_HANDLE aNfaConnHandle);
-  android::sp<NfaConn> FindServerConnection(unsigned int aHandle);
+  android::sp<NfaConn> AllocateConnection(unsigned int aHandle);
+  android::sp<NfaConn> FindWaitingConnection();
 
   bool RemoveServerConnection(unsigned int aHandle);
 
 private:
+  typedef std::map<unsigned int, android::sp<NfaConn> > ConnMap;
+
   Mutex           mMutex;
   // mServerConn is protected by mMutex.
-  android::sp<NfaConn> mServerConn[MAX_NFA_CONNS_PER_SERVER];
-
-  android::sp<NfaConn> AllocateConnection(unsigned int aHandle);
+  ConnMap         mServerConn;
 };
 
 class P2pClient
@@ -362,9 +528,11 @@ class P2pClient
 public:
   tNFA_HANDLE           mNfaP2pClientHandle;    // NFA p2p handle of client.
   bool                  mIsConnecting;          // Set true while connecting.
+  bool                  mConnectCancelled;      // Disconnected while connecting.
   android::sp<NfaConn>  mClientConn;
   SyncEvent             mRegisteringEvent;      // For client registration.
   SyncEvent             mConnectingEvent;       // For NFA_P2pConnectByName or Sap().
+  std::string           mServiceName;           // Name passed to NFA_P2pConnectByName().
   SyncEvent             mSnepEvent;             // To wait for SNEP completion.
 
   P2pClient();
@@ -372,3 +540,20 @@ public:
 
   void Unblock();
 };
+
+class P2pConnectionless
+  : public android::RefBase
+{
+public:
+  tNFA_HANDLE           mNfaHandle;             // NFA p2p handle of the endpoint.
+  unsigned int          mHandle;                // Handle of the endpoint.
+  int                   mLocalSap;              // Local SAP, -1 if unknown.
+  std::string           mServiceName;           // Empty for a client endpoint.
+  bool                  mClosed;                // Set once deregistered.
+  SyncEvent             mRegisteringEvent;      // For NFA_P2pRegisterServer or Client().
+  SyncEvent             mReadEvent;             // Event for reading.
+  SyncEvent             mCongEvent;             // Event for congestion.
+
+  P2pConnectionless(unsigned int aHandle,
+                    const char* aServiceName);
+};
@@ -362,22 +362,15 @@ void SecureElement::NotifyTransactionEvent(const uint8_t* aAid,
     return;
   }
 
-  TransactionEvent* pTransaction = new TransactionEvent();
-
   // TODO: For now, we dodn't have a solution to get aid origin from nfcd.
   //       So use SIM1 as dfault value.
-  pTransaction->originType = TransactionEvent::SIM;
-  pTransaction->originIndex = 1;
-
-  pTransaction->aidLen = aAidLen;
-  pTransaction->aid = new uint8_t[aAidLen];
-  memcpy(pTransaction->aid, aAid, aAidLen);
+  mTransaction.originType = TransactionEvent::SIM;
+  mTransaction.originIndex = 1;
 
-  pTransaction->payloadLen = aPayloadLen;
-  pTransaction->payload = new uint8_t[aPayloadLen];
-  memcpy(pTransaction->payload, aPayload, aPayloadLen);
+  mTransaction.aid.assign(aAid, aAid + aAidLen);
+  mTransaction.payload.assign(aPayload, aPayload + aPayloadLen);
 
-  mNfcManager->NotifyTransactionEvent(pTransaction);
+  mNfcManager->NotifyTransactionEvent(&mTransaction);
 }
 
 void SecureElement::NotifyListenModeState(bool aIsActivated)
@@ -20,6 +20,7 @@
 #include <string>
 #include "SyncEvent.h"
 #include "RouteDataSet.h"
+#include "DeviceHost.h"
 
 extern "C"
 {
@@ -215,6 +216,7 @@ private:
   SyncEvent mUiccListenEvent;
   SyncEvent mAidAddRemoveEvent;
   RouteDataSet mRouteDataSet; //routing data
+  TransactionEvent mTransaction;  // reused for every HCI transaction event
   Mutex mMutex;  // protects fields below
   bool mRfFieldIsOn;  // last known RF field state
   struct timespec mLastRfFieldToggle;  // last time RF field went off
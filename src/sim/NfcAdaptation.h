@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_sim_NfcAdaptation_h
+#define mozilla_nfcd_sim_NfcAdaptation_h
+
+/**
+ * Replaces the libnfc-nci adaptation layer in simulator builds. src/sim is
+ * searched before the libnfc-nci include directories, so NfcManager picks
+ * up this declaration. Instead of starting GKI and the HAL, Initialize()
+ * starts the simulated controller.
+ */
+
+extern "C"
+{
+  #include "nfc_hal_api.h"
+}
+
+class NfcAdaptation
+{
+public:
+  ~NfcAdaptation();
+
+  static NfcAdaptation& GetInstance();
+
+  /**
+   * Start the simulated controller and run the script named by
+   * NFCD_SIM_SCRIPT, if any.
+   *
+   * @return None.
+   */
+  void Initialize();
+
+  /**
+   * Stop the simulated controller.
+   *
+   * @return None.
+   */
+  void Finalize();
+
+  /**
+   * HAL entry points, unused by the simulated NFA layer.
+   */
+  tHAL_NFC_ENTRY* GetHalEntryFuncs();
+
+private:
+  NfcAdaptation();
+
+  static NfcAdaptation* sInstance;
+  tHAL_NFC_ENTRY mHalEntryFuncs;
+};
+
+#endif // mozilla_nfcd_sim_NfcAdaptation_h
@@ -0,0 +1,1410 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SimController.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "NfcDebug.h"
+#include "SnepMessage.h"
+#include "SnepServer.h"
+
+extern "C"
+{
+  #include "rw_api.h"
+}
+
+// Values of NFA_P2P_DISC_REASON_*.
+static const uint8_t DISC_REASON_REMOTE_INITIATE = 0x00;
+static const uint8_t DISC_REASON_LOCAL_INITIATE = 0x01;
+static const uint8_t DISC_REASON_NO_SERVICE = 0x02;
+static const uint8_t DISC_REASON_LLCP_DEACTIVATED = 0x05;
+
+// SAP used by the peer for the connections it initiates.
+static const uint8_t PEER_CLIENT_SAP = 0x20;
+// First SAP given to servers registered without one.
+static const uint8_t FIRST_DYNAMIC_SAP = 0x10;
+// LLCP default MIU, used until a connection is accepted.
+static const uint16_t LLCP_DEFAULT_MIU = 128;
+
+static const uint32_t DEFAULT_LATENCY_MS = 1;
+static const uint32_t DEFAULT_MAX_NDEF_SIZE = 1024;
+
+SimTarget::SimTarget()
+ : kind(SIM_TARGET_TAG)
+ , protocol(NFA_PROTOCOL_T2T)
+ , mode(NFC_DISCOVERY_TYPE_POLL_A)
+ , maxNdefSize(DEFAULT_MAX_NDEF_SIZE)
+ , readOnly(false)
+ , linkMiu(2175)
+ , miu(SnepServer::DEFAULT_MIU)
+ , rw(SnepServer::DEFAULT_RW_SIZE)
+{
+}
+
+SimController& SimController::GetInstance()
+{
+  static SimController sInstance;
+  return sInstance;
+}
+
+SimController::SimController()
+ : mRunning(false)
+ , mLatency(DEFAULT_LATENCY_MS)
+ , mDmCallback(NULL)
+ , mConnCallback(NULL)
+ , mNdefCallback(NULL)
+ , mEeCallback(NULL)
+ , mHciCallback(NULL)
+ , mEnabled(false)
+ , mPollMask(0)
+ , mListenMask(0)
+ , mDiscovering(false)
+ , mField(-1)
+ , mActivationPending(false)
+ , mActive(false)
+ , mSleeping(false)
+ , mLlcpActive(false)
+ , mActivationTime(0)
+ , mLinkMiu(LLCP_DEFAULT_MIU)
+ , mNextP2pHandle(0)
+{
+}
+
+void SimController::Start()
+{
+  AutoMutex lock(mMutex);
+  if (mRunning) {
+    return;
+  }
+
+  mRunning = true;
+  if (pthread_create(&mThread, NULL, EventThread, this) != 0) {
+    NCI_ERROR("fail to create event thread");
+    mRunning = false;
+  }
+}
+
+void SimController::Stop()
+{
+  {
+    AutoMutex lock(mMutex);
+    if (!mRunning) {
+      return;
+    }
+    mRunning = false;
+    mEvents.clear();
+    mCondVar.NotifyOne();
+  }
+  pthread_join(mThread, NULL);
+}
+
+void SimController::SetLatency(uint32_t aMillisec)
+{
+  AutoMutex lock(mMutex);
+  mLatency = aMillisec;
+}
+
+uint64_t SimController::GetActivationTime()
+{
+  AutoMutex lock(mMutex);
+  return mActivationTime;
+}
+
+uint64_t SimController::Now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void* SimController::EventThread(void* aArg)
+{
+  static_cast<SimController*>(aArg)->RunEvents();
+  return NULL;
+}
+
+void SimController::RunEvents()
+{
+  mMutex.Lock();
+  while (mRunning) {
+    if (mEvents.empty()) {
+      mCondVar.Wait(mMutex);
+      continue;
+    }
+
+    uint64_t now = Now();
+    if (mEvents.front().when > now) {
+      mCondVar.Wait(mMutex, mEvents.front().when - now);
+      continue;
+    }
+
+    Event event = mEvents.front();
+    mEvents.pop_front();
+
+    // Callbacks call back into the NFA layer.
+    mMutex.Unlock();
+    Deliver(event);
+    mMutex.Lock();
+  }
+  mMutex.Unlock();
+}
+
+void SimController::Deliver(Event& aEvent)
+{
+  uint8_t* payload = aEvent.payload.empty() ? NULL : &aEvent.payload[0];
+
+  switch (aEvent.type) {
+    case CALLBACK_DM:
+      if (aEvent.callback.dm) {
+        aEvent.callback.dm(aEvent.event, &aEvent.data.dm);
+      }
+      break;
+    case CALLBACK_CONN:
+      if (aEvent.event == NFA_DATA_EVT) {
+        aEvent.data.conn.data.p_data = payload;
+      } else if (aEvent.event == NFA_ACTIVATED_EVT) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        AutoMutex lock(mMutex);
+        mActivationTime = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+      }
+      if (aEvent.callback.conn) {
+        aEvent.callback.conn(aEvent.event, &aEvent.data.conn);
+      }
+      break;
+    case CALLBACK_NDEF:
+      if (aEvent.event == NFA_NDEF_DATA_EVT) {
+        aEvent.data.ndef.ndef_data.p_data = payload;
+      }
+      if (aEvent.callback.ndef) {
+        aEvent.callback.ndef(aEvent.event, &aEvent.data.ndef);
+      }
+      break;
+    case CALLBACK_P2P:
+      if (aEvent.event == NFA_P2P_DATA_EVT &&
+          aEvent.data.p2p.data.link_type == NFA_P2P_LLINK_TYPE) {
+        // The UI PDU becomes readable when it is signaled.
+        AutoMutex lock(mMutex);
+        P2pRegistration* reg = FindRegistration(aEvent.data.p2p.data.handle);
+        if (!reg) {
+          break;
+        }
+        reg->ui.push_back(UiPdu());
+        reg->ui.back().remoteSap = aEvent.data.p2p.data.remote_sap;
+        reg->ui.back().data.swap(aEvent.payload);
+      } else if (aEvent.event == NFA_P2P_DATA_EVT) {
+        // The SDU becomes readable when it is signaled.
+        AutoMutex lock(mMutex);
+        P2pConnection* conn = FindConnection(aEvent.data.p2p.data.handle);
+        if (!conn) {
+          break;
+        }
+        conn->rx.push_back(std::vector<uint8_t>());
+        conn->rx.back().swap(aEvent.payload);
+      }
+      if (aEvent.callback.p2p) {
+        aEvent.callback.p2p(aEvent.event, &aEvent.data.p2p);
+      }
+      break;
+    case CALLBACK_EE:
+      if (aEvent.callback.ee) {
+        aEvent.callback.ee(aEvent.event, &aEvent.data.ee);
+      }
+      break;
+    case CALLBACK_HCI:
+      if (aEvent.callback.hci) {
+        aEvent.callback.hci(aEvent.event, &aEvent.data.hci);
+      }
+      break;
+  }
+}
+
+SimController::Event& SimController::NewEvent(CallbackType aType, uint8_t aEvent)
+{
+  // Keep events in order even if the latency was lowered meanwhile.
+  uint64_t when = Now() + mLatency;
+  if (!mEvents.empty() && mEvents.back().when > when) {
+    when = mEvents.back().when;
+  }
+
+  mEvents.push_back(Event());
+  Event& event = mEvents.back();
+  event.when = when;
+  event.type = aType;
+  memset(&event.callback, 0, sizeof(event.callback));
+  event.event = aEvent;
+  memset(&event.data, 0, sizeof(event.data));
+
+  mCondVar.NotifyOne();
+  return event;
+}
+
+void SimController::PostConnStatus(uint8_t aEvent, tNFA_STATUS aStatus)
+{
+  Event& event = NewEvent(CALLBACK_CONN, aEvent);
+  event.callback.conn = mConnCallback;
+  event.data.conn.status = aStatus;
+}
+
+/**
+ * Targets.
+ */
+
+void SimController::AddTarget(const SimTarget& aTarget)
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = FindTarget(aTarget.name);
+  if (target) {
+    *target = aTarget;
+  } else {
+    mTargets.push_back(aTarget);
+  }
+}
+
+bool SimController::SetReadOnly(const std::string& aName)
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = FindTarget(aName);
+  if (!target || target->kind != SIM_TARGET_TAG) {
+    NCI_ERROR("no tag named %s", aName.c_str());
+    return false;
+  }
+  target->readOnly = true;
+  return true;
+}
+
+bool SimController::SetResponse(const std::string& aName,
+                                const std::vector<uint8_t>& aCommand,
+                                const std::vector<uint8_t>& aResponse)
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = FindTarget(aName);
+  if (!target || target->kind != SIM_TARGET_TAG) {
+    NCI_ERROR("no tag named %s", aName.c_str());
+    return false;
+  }
+  target->responses[aCommand] = aResponse;
+  return true;
+}
+
+bool SimController::AddService(const std::string& aName,
+                               const std::string& aService,
+                               const SimService& aDef)
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = FindTarget(aName);
+  if (!target || target->kind != SIM_TARGET_PEER) {
+    NCI_ERROR("no peer named %s", aName.c_str());
+    return false;
+  }
+  target->services[aService] = aDef;
+  return true;
+}
+
+SimTarget* SimController::FindTarget(const std::string& aName)
+{
+  for (size_t i = 0; i < mTargets.size(); i++) {
+    if (mTargets[i].name == aName) {
+      return &mTargets[i];
+    }
+  }
+  return NULL;
+}
+
+SimTarget* SimController::GetFieldTarget()
+{
+  return mField < 0 ? NULL : &mTargets[mField];
+}
+
+bool SimController::CanActivate(const SimTarget& aTarget) const
+{
+  tNFA_TECHNOLOGY_MASK tech = 0;
+  switch (aTarget.mode) {
+    case NFC_DISCOVERY_TYPE_POLL_A:         tech = NFA_TECHNOLOGY_MASK_A; break;
+    case NFC_DISCOVERY_TYPE_POLL_B:         tech = NFA_TECHNOLOGY_MASK_B; break;
+    case NFC_DISCOVERY_TYPE_POLL_F:         tech = NFA_TECHNOLOGY_MASK_F; break;
+    case NFC_DISCOVERY_TYPE_POLL_ISO15693:  tech = NFA_TECHNOLOGY_MASK_ISO15693; break;
+    default: break;
+  }
+
+  if (aTarget.kind == SIM_TARGET_PEER) {
+    return (mPollMask | mListenMask) & tech;
+  }
+  return mPollMask & tech;
+}
+
+bool SimController::Tap(const std::string& aName)
+{
+  AutoMutex lock(mMutex);
+
+  int index = -1;
+  for (size_t i = 0; i < mTargets.size(); i++) {
+    if (mTargets[i].name == aName) {
+      index = i;
+      break;
+    }
+  }
+  if (index < 0) {
+    NCI_ERROR("no target named %s", aName.c_str());
+    return false;
+  }
+  if (mField >= 0) {
+    NCI_ERROR("%s is already in the field", mTargets[mField].name.c_str());
+    return false;
+  }
+
+  NCI_DEBUG("tap %s", aName.c_str());
+  mField = index;
+  mActivationPending = true;
+  if (mDiscovering && CanActivate(mTargets[mField])) {
+    ActivateLocked();
+  }
+  return true;
+}
+
+void SimController::Remove()
+{
+  AutoMutex lock(mMutex);
+
+  SimTarget* target = GetFieldTarget();
+  if (!target) {
+    return;
+  }
+
+  NCI_DEBUG("remove %s", target->name.c_str());
+  bool isPeer = target->kind == SIM_TARGET_PEER;
+  mField = -1;
+  mActivationPending = false;
+
+  // A tag is noticed gone by the next presence check, the link to a peer
+  // breaks right away.
+  if (isPeer && (mActive || mSleeping)) {
+    DeactivateLinkLocked(mDiscovering ? NFA_DEACTIVATE_TYPE_DISCOVERY
+                                      : NFA_DEACTIVATE_TYPE_IDLE);
+  }
+}
+
+void SimController::FillActivation(const SimTarget& aTarget, tNFA_ACTIVATED& aActivated)
+{
+  tNFC_ACTIVATE_DEVT& ntf = aActivated.activate_ntf;
+  tNFC_RF_TECH_PARAMS& tech = ntf.rf_tech_param;
+
+  ntf.rf_disc_id = 1;
+  ntf.protocol = aTarget.protocol;
+  tech.mode = aTarget.mode;
+
+  switch (aTarget.protocol) {
+    case NFA_PROTOCOL_ISO_DEP: ntf.intf_param.type = NFC_INTERFACE_ISO_DEP; break;
+    case NFA_PROTOCOL_NFC_DEP: ntf.intf_param.type = NFC_INTERFACE_NFC_DEP; break;
+    default:                   ntf.intf_param.type = NFC_INTERFACE_FRAME;   break;
+  }
+
+  const std::vector<uint8_t>& uid = aTarget.uid;
+  switch (aTarget.mode) {
+    case NFC_DISCOVERY_TYPE_POLL_A: {
+      size_t len = uid.size() < sizeof(tech.param.pa.nfcid1) ?
+                   uid.size() : sizeof(tech.param.pa.nfcid1);
+      memcpy(tech.param.pa.nfcid1, &uid[0], len);
+      tech.param.pa.nfcid1_len = len;
+
+      // SENS_RES and SEL_RES of common tags.
+      switch (aTarget.protocol) {
+        case NFA_PROTOCOL_T1T:
+          tech.param.pa.sens_res[0] = 0x0C;
+          break;
+        case NFA_PROTOCOL_T2T:
+          tech.param.pa.sens_res[0] = 0x44;
+          break;
+        case NFA_PROTOCOL_MIFARE:
+          tech.param.pa.sens_res[0] = 0x04;
+          tech.param.pa.sel_rsp = 0x08;
+          break;
+        case NFA_PROTOCOL_ISO_DEP:
+          tech.param.pa.sens_res[0] = 0x04;
+          tech.param.pa.sel_rsp = 0x20;
+          break;
+        case NFA_PROTOCOL_NFC_DEP:
+          tech.param.pa.sel_rsp = 0x40;
+          break;
+      }
+      break;
+    }
+    case NFC_DISCOVERY_TYPE_POLL_B:
+      for (size_t i = 0; i < uid.size() && i < NFC_NFCID0_MAX_LEN; i++) {
+        tech.param.pb.nfcid0[i] = uid[i];
+        tech.param.pb.sensb_res[i + 1] = uid[i];
+      }
+      tech.param.pb.sensb_res[0] = 0x50;
+      tech.param.pb.sensb_res_len = 12;
+      break;
+    case NFC_DISCOVERY_TYPE_POLL_F:
+      for (size_t i = 0; i < uid.size() && i < NFC_NFCID2_LEN; i++) {
+        tech.param.pf.nfcid2[i] = uid[i];
+        tech.param.pf.sensf_res[i] = uid[i];
+      }
+      tech.param.pf.sensf_res_len = 16;
+      break;
+    case NFC_DISCOVERY_TYPE_POLL_ISO15693:
+      // The stack keeps the UID least significant byte first.
+      for (size_t i = 0; i < uid.size() && i < I93_UID_BYTE_LEN; i++) {
+        aActivated.params.i93.uid[I93_UID_BYTE_LEN - i - 1] = uid[i];
+      }
+      break;
+  }
+}
+
+void SimController::ActivateLocked()
+{
+  SimTarget* target = GetFieldTarget();
+
+  mActivationPending = false;
+  mActive = true;
+  mSleeping = false;
+
+  Event& event = NewEvent(CALLBACK_CONN, NFA_ACTIVATED_EVT);
+  event.callback.conn = mConnCallback;
+  FillActivation(*target, event.data.conn.activated);
+
+  if (target->kind != SIM_TARGET_PEER) {
+    return;
+  }
+
+  // Bring the LLCP link up.
+  mLlcpActive = true;
+
+  uint16_t wks = 0x0003; // Link management and SDP.
+  std::map<std::string, SimService>::const_iterator it;
+  for (it = target->services.begin(); it != target->services.end(); ++it) {
+    if (it->second.sap < 16) {
+      wks |= 1 << it->second.sap;
+    }
+  }
+
+  Event& llcp = NewEvent(CALLBACK_CONN, NFA_LLCP_ACTIVATED_EVT);
+  llcp.callback.conn = mConnCallback;
+  llcp.data.conn.llcp_activated.is_initiator = TRUE;
+  llcp.data.conn.llcp_activated.remote_wks = wks;
+  llcp.data.conn.llcp_activated.remote_lsc = 3;
+  llcp.data.conn.llcp_activated.remote_link_miu = target->linkMiu;
+  llcp.data.conn.llcp_activated.local_link_miu = mLinkMiu;
+
+  for (size_t i = 0; i < mRegistrations.size(); i++) {
+    Event& p2p = NewEvent(CALLBACK_P2P, NFA_P2P_ACTIVATED_EVT);
+    p2p.callback.p2p = mRegistrations[i].callback;
+    p2p.data.p2p.activated.handle = mRegistrations[i].handle;
+    p2p.data.p2p.activated.local_link_miu = mLinkMiu;
+    p2p.data.p2p.activated.remote_link_miu = target->linkMiu;
+  }
+}
+
+void SimController::DeactivateLinkLocked(tNFA_DEACTIVATE_TYPE aType)
+{
+  if (mLlcpActive) {
+    mLlcpActive = false;
+
+    for (size_t i = 0; i < mConnections.size(); i++) {
+      PostP2pDisconnect(mConnections[i], DISC_REASON_LLCP_DEACTIVATED);
+    }
+    mConnections.clear();
+
+    for (size_t i = 0; i < mRegistrations.size(); i++) {
+      mRegistrations[i].ui.clear();
+      Event& p2p = NewEvent(CALLBACK_P2P, NFA_P2P_DEACTIVATED_EVT);
+      p2p.callback.p2p = mRegistrations[i].callback;
+      p2p.data.p2p.deactivated.handle = mRegistrations[i].handle;
+    }
+
+    Event& llcp = NewEvent(CALLBACK_CONN, NFA_LLCP_DEACTIVATED_EVT);
+    llcp.callback.conn = mConnCallback;
+  }
+
+  mActive = false;
+  mSleeping = aType == NFA_DEACTIVATE_TYPE_SLEEP;
+
+  Event& event = NewEvent(CALLBACK_CONN, NFA_DEACTIVATED_EVT);
+  event.callback.conn = mConnCallback;
+  event.data.conn.deactivated.type = aType;
+}
+
+/**
+ * Device management and RF discovery.
+ */
+
+tNFA_STATUS SimController::Enable(tNFA_DM_CBACK* aDmCallback,
+                                  tNFA_CONN_CBACK* aConnCallback)
+{
+  AutoMutex lock(mMutex);
+  mDmCallback = aDmCallback;
+  mConnCallback = aConnCallback;
+  mEnabled = true;
+
+  Event& event = NewEvent(CALLBACK_DM, NFA_DM_ENABLE_EVT);
+  event.callback.dm = mDmCallback;
+  event.data.dm.status = NFA_STATUS_OK;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::Disable(bool aGraceful)
+{
+  AutoMutex lock(mMutex);
+  if (mActive || mSleeping) {
+    DeactivateLinkLocked(NFA_DEACTIVATE_TYPE_IDLE);
+  }
+  mEnabled = false;
+  mDiscovering = false;
+  mPollMask = 0;
+  mListenMask = 0;
+  mRegistrations.clear();
+
+  Event& event = NewEvent(CALLBACK_DM, NFA_DM_DISABLE_EVT);
+  event.callback.dm = mDmCallback;
+  event.data.dm.status = NFA_STATUS_OK;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::SetConfig(tNFA_PMID aParamId, uint8_t aLength, uint8_t* aData)
+{
+  AutoMutex lock(mMutex);
+  Event& event = NewEvent(CALLBACK_DM, NFA_DM_SET_CONFIG_EVT);
+  event.callback.dm = mDmCallback;
+  event.data.dm.status = NFA_STATUS_OK;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::PowerOffSleepMode(bool aStart)
+{
+  AutoMutex lock(mMutex);
+  Event& event = NewEvent(CALLBACK_DM, NFA_DM_PWR_MODE_CHANGE_EVT);
+  event.callback.dm = mDmCallback;
+  event.data.dm.power_mode.status = NFA_STATUS_OK;
+  event.data.dm.power_mode.power_mode =
+    aStart ? NFA_DM_PWR_MODE_OFF_SLEEP : NFA_DM_PWR_MODE_FULL;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::EnablePolling(tNFA_TECHNOLOGY_MASK aPollMask)
+{
+  AutoMutex lock(mMutex);
+  mPollMask = aPollMask;
+  PostConnStatus(NFA_POLL_ENABLED_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::DisablePolling()
+{
+  AutoMutex lock(mMutex);
+  mPollMask = 0;
+  PostConnStatus(NFA_POLL_DISABLED_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::SetP2pListenTech(tNFA_TECHNOLOGY_MASK aTechMask)
+{
+  AutoMutex lock(mMutex);
+  mListenMask = aTechMask;
+  PostConnStatus(NFA_SET_P2P_LISTEN_TECH_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::StartRfDiscovery()
+{
+  AutoMutex lock(mMutex);
+  if (!mEnabled) {
+    return NFA_STATUS_FAILED;
+  }
+
+  mDiscovering = true;
+  PostConnStatus(NFA_RF_DISCOVERY_STARTED_EVT, NFA_STATUS_OK);
+
+  SimTarget* target = GetFieldTarget();
+  if (target && mActivationPending && CanActivate(*target)) {
+    ActivateLocked();
+  }
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::StopRfDiscovery()
+{
+  AutoMutex lock(mMutex);
+  if (mActive || mSleeping) {
+    DeactivateLinkLocked(NFA_DEACTIVATE_TYPE_IDLE);
+    // Found again when discovery restarts.
+    mActivationPending = mField >= 0;
+  }
+
+  mDiscovering = false;
+  PostConnStatus(NFA_RF_DISCOVERY_STOPPED_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::Select(uint8_t aRfDiscId,
+                                  tNFA_NFC_PROTOCOL aProtocol,
+                                  tNFA_INTF_TYPE aRfInterface)
+{
+  AutoMutex lock(mMutex);
+  if (!mSleeping) {
+    return NFA_STATUS_FAILED;
+  }
+
+  SimTarget* target = GetFieldTarget();
+  if (!target) {
+    PostConnStatus(NFA_SELECT_CPLT_EVT, NFA_STATUS_FAILED);
+    DeactivateLinkLocked(NFA_DEACTIVATE_TYPE_DISCOVERY);
+    return NFA_STATUS_OK;
+  }
+
+  PostConnStatus(NFA_SELECT_CPLT_EVT, NFA_STATUS_OK);
+
+  mSleeping = false;
+  mActive = true;
+  Event& event = NewEvent(CALLBACK_CONN, NFA_ACTIVATED_EVT);
+  event.callback.conn = mConnCallback;
+  FillActivation(*target, event.data.conn.activated);
+  event.data.conn.activated.activate_ntf.protocol = aProtocol;
+  event.data.conn.activated.activate_ntf.intf_param.type = aRfInterface;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::Deactivate(bool aSleepMode)
+{
+  AutoMutex lock(mMutex);
+  if (!mActive && !mSleeping) {
+    return NFA_STATUS_FAILED;
+  }
+
+  // A tag left in the field is not activated again until the next tap.
+  if (aSleepMode) {
+    DeactivateLinkLocked(NFA_DEACTIVATE_TYPE_SLEEP);
+  } else {
+    DeactivateLinkLocked(mDiscovering ? NFA_DEACTIVATE_TYPE_DISCOVERY
+                                      : NFA_DEACTIVATE_TYPE_IDLE);
+  }
+  return NFA_STATUS_OK;
+}
+
+/**
+ * Reader/writer.
+ */
+
+tNFA_STATUS SimController::SendRawFrame(uint8_t* aData, uint16_t aLength)
+{
+  AutoMutex lock(mMutex);
+  if (!mActive) {
+    return NFA_STATUS_FAILED;
+  }
+
+  SimTarget* target = GetFieldTarget();
+  if (!target || target->kind != SIM_TARGET_TAG) {
+    // Tag gone, the frame times out.
+    PostConnStatus(NFA_RW_INTF_ERROR_EVT, NFA_STATUS_FAILED);
+    return NFA_STATUS_OK;
+  }
+
+  std::vector<uint8_t> command(aData, aData + aLength);
+  std::map<std::vector<uint8_t>, std::vector<uint8_t> >::const_iterator it =
+    target->responses.find(command);
+
+  Event& event = NewEvent(CALLBACK_CONN, NFA_DATA_EVT);
+  event.callback.conn = mConnCallback;
+  event.payload = it != target->responses.end() ? it->second
+                                                : target->defaultResponse;
+  event.data.conn.data.len = event.payload.size();
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::RegisterNdefTypeHandler(tNFA_NDEF_CBACK* aCallback)
+{
+  AutoMutex lock(mMutex);
+  mNdefCallback = aCallback;
+
+  Event& event = NewEvent(CALLBACK_NDEF, NFA_NDEF_REGISTER_EVT);
+  event.callback.ndef = mNdefCallback;
+  event.data.ndef.ndef_reg.status = NFA_STATUS_OK;
+  event.data.ndef.ndef_reg.ndef_type_handle = NFA_HANDLE_GROUP_NDEF_HANDLER;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::RwDetectNdef()
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = GetFieldTarget();
+  if (!mActive || !target || target->kind != SIM_TARGET_TAG) {
+    return NFA_STATUS_FAILED;
+  }
+
+  Event& event = NewEvent(CALLBACK_CONN, NFA_NDEF_DETECT_EVT);
+  event.callback.conn = mConnCallback;
+  tNFA_NDEF_DETECT& detect = event.data.conn.ndef_detect;
+  detect.protocol = target->protocol;
+  if (!target->maxNdefSize) {
+    detect.status = NFA_STATUS_FAILED;
+    detect.flags = RW_NDEF_FL_FORMATABLE;
+    return NFA_STATUS_OK;
+  }
+
+  detect.status = NFA_STATUS_OK;
+  detect.max_size = target->maxNdefSize;
+  detect.cur_size = target->ndef.size();
+  detect.flags = RW_NDEF_FL_SUPPORTED | RW_NDEF_FL_FORMATED;
+  if (target->readOnly) {
+    detect.flags |= RW_NDEF_FL_READ_ONLY;
+  }
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::RwReadNdef()
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = GetFieldTarget();
+  if (!mActive || !target || target->kind != SIM_TARGET_TAG) {
+    return NFA_STATUS_FAILED;
+  }
+
+  if (target->ndef.empty()) {
+    PostConnStatus(NFA_READ_CPLT_EVT, NFA_STATUS_FAILED);
+    return NFA_STATUS_OK;
+  }
+
+  Event& event = NewEvent(CALLBACK_NDEF, NFA_NDEF_DATA_EVT);
+  event.callback.ndef = mNdefCallback;
+  event.payload = target->ndef;
+  event.data.ndef.ndef_data.len = event.payload.size();
+
+  PostConnStatus(NFA_READ_CPLT_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::RwWriteNdef(uint8_t* aData, uint32_t aLength)
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = GetFieldTarget();
+  if (!mActive || !target || target->kind != SIM_TARGET_TAG) {
+    return NFA_STATUS_FAILED;
+  }
+
+  if (target->readOnly || aLength > target->maxNdefSize) {
+    PostConnStatus(NFA_WRITE_CPLT_EVT, NFA_STATUS_FAILED);
+    return NFA_STATUS_OK;
+  }
+
+  target->ndef.assign(aData, aData + aLength);
+  PostConnStatus(NFA_WRITE_CPLT_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::RwPresenceCheck()
+{
+  AutoMutex lock(mMutex);
+  if (!mActive) {
+    return NFA_STATUS_FAILED;
+  }
+
+  PostConnStatus(NFA_PRESENCE_CHECK_EVT,
+                 GetFieldTarget() ? NFA_STATUS_OK : NFA_STATUS_FAILED);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::RwFormatTag()
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = GetFieldTarget();
+  if (!mActive || !target || target->kind != SIM_TARGET_TAG) {
+    return NFA_STATUS_FAILED;
+  }
+
+  if (target->readOnly) {
+    PostConnStatus(NFA_FORMAT_CPLT_EVT, NFA_STATUS_FAILED);
+    return NFA_STATUS_OK;
+  }
+
+  target->ndef.clear();
+  if (!target->maxNdefSize) {
+    target->maxNdefSize = DEFAULT_MAX_NDEF_SIZE;
+  }
+  PostConnStatus(NFA_FORMAT_CPLT_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::RwSetTagReadOnly()
+{
+  AutoMutex lock(mMutex);
+  SimTarget* target = GetFieldTarget();
+  if (!mActive || !target || target->kind != SIM_TARGET_TAG) {
+    return NFA_STATUS_FAILED;
+  }
+
+  target->readOnly = true;
+  PostConnStatus(NFA_SET_TAG_RO_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+/**
+ * LLCP.
+ */
+
+SimController::P2pRegistration* SimController::FindRegistration(tNFA_HANDLE aHandle)
+{
+  for (size_t i = 0; i < mRegistrations.size(); i++) {
+    if (mRegistrations[i].handle == aHandle) {
+      return &mRegistrations[i];
+    }
+  }
+  return NULL;
+}
+
+SimController::P2pConnection* SimController::FindConnection(tNFA_HANDLE aHandle)
+{
+  for (size_t i = 0; i < mConnections.size(); i++) {
+    if (mConnections[i].handle == aHandle) {
+      return &mConnections[i];
+    }
+  }
+  return NULL;
+}
+
+tNFA_HANDLE SimController::NewP2pHandle()
+{
+  tNFA_HANDLE handle;
+  do {
+    if (++mNextP2pHandle == 0) {
+      mNextP2pHandle = 1;
+    }
+    handle = NFA_HANDLE_GROUP_P2P | mNextP2pHandle;
+  } while (FindRegistration(handle) || FindConnection(handle));
+  return handle;
+}
+
+void SimController::PostP2pData(P2pConnection& aConn, const uint8_t* aData, uint32_t aLength)
+{
+  Event& event = NewEvent(CALLBACK_P2P, NFA_P2P_DATA_EVT);
+  event.callback.p2p = aConn.callback;
+  event.data.p2p.data.handle = aConn.handle;
+  event.data.p2p.data.remote_sap = aConn.remoteSap;
+  event.data.p2p.data.link_type = NFA_P2P_DLINK_TYPE;
+  event.payload.assign(aData, aData + aLength);
+}
+
+void SimController::PostP2pDisconnect(P2pConnection& aConn, uint8_t aReason)
+{
+  Event& event = NewEvent(CALLBACK_P2P, NFA_P2P_DISC_EVT);
+  event.callback.p2p = aConn.callback;
+  event.data.p2p.disc.handle = aConn.handle;
+  event.data.p2p.disc.reason = aReason;
+}
+
+void SimController::PostP2pUi(P2pRegistration& aReg,
+                              uint8_t aRemoteSap,
+                              const uint8_t* aData,
+                              uint32_t aLength)
+{
+  Event& event = NewEvent(CALLBACK_P2P, NFA_P2P_DATA_EVT);
+  event.callback.p2p = aReg.callback;
+  event.data.p2p.data.handle = aReg.handle;
+  event.data.p2p.data.remote_sap = aRemoteSap;
+  event.data.p2p.data.link_type = NFA_P2P_LLINK_TYPE;
+  event.payload.assign(aData, aData + aLength);
+}
+
+void SimController::PushPendingLocked(P2pConnection& aConn, bool aAll)
+{
+  do {
+    uint32_t remaining = aConn.tx.size() - aConn.txOffset;
+    if (!remaining) {
+      break;
+    }
+    uint32_t length = remaining < aConn.miu ? remaining : aConn.miu;
+    PostP2pData(aConn, &aConn.tx[aConn.txOffset], length);
+    aConn.txOffset += length;
+  } while (aAll);
+}
+
+void SimController::PeerReceiveLocked(P2pConnection& aConn,
+                                      const uint8_t* aData,
+                                      uint32_t aLength)
+{
+  bool isSnep = aConn.serviceName == SnepServer::DEFAULT_SERVICE_NAME;
+
+  if (aConn.fromPeer) {
+    // nfcd answered a push: send the rest after a SNEP continue, otherwise
+    // the exchange is over.
+    if (isSnep && aLength >= 2 && aData[1] == SnepMessage::RESPONSE_CONTINUE) {
+      PushPendingLocked(aConn, true);
+      return;
+    }
+    tNFA_HANDLE handle = aConn.handle;
+    PostP2pDisconnect(aConn, DISC_REASON_REMOTE_INITIATE);
+    for (size_t i = 0; i < mConnections.size(); i++) {
+      if (mConnections[i].handle == handle) {
+        mConnections.erase(mConnections.begin() + i);
+        break;
+      }
+    }
+    return;
+  }
+
+  if (!isSnep) {
+    SimTarget* peer = GetFieldTarget();
+    std::map<std::string, SimService>::const_iterator it =
+      peer->services.find(aConn.serviceName);
+    if (it != peer->services.end() && !it->second.reply.empty()) {
+      aConn.tx = it->second.reply;
+      aConn.txOffset = 0;
+      PushPendingLocked(aConn, true);
+    }
+    return;
+  }
+
+  uint8_t response[SnepMessage::HEADER_LENGTH] = {SnepMessage::VERSION, 0, 0, 0, 0, 0};
+  bool first = aConn.snepReceived == 0;
+  if (first) {
+    if (aLength < (uint32_t)SnepMessage::HEADER_LENGTH) {
+      response[1] = SnepMessage::RESPONSE_BAD_REQUEST;
+      PostP2pData(aConn, response, sizeof(response));
+      return;
+    }
+    if (aData[1] != SnepMessage::REQUEST_PUT) {
+      response[1] = SnepMessage::RESPONSE_NOT_IMPLEMENTED;
+      PostP2pData(aConn, response, sizeof(response));
+      return;
+    }
+    aConn.snepLength = SnepMessage::HEADER_LENGTH +
+                       (((uint32_t)aData[2] << 24) |
+                        ((uint32_t)aData[3] << 16) |
+                        ((uint32_t)aData[4] <<  8) |
+                        ((uint32_t)aData[5]));
+  }
+
+  aConn.snepReceived += aLength;
+  if (aConn.snepReceived < aConn.snepLength) {
+    if (first) {
+      response[1] = SnepMessage::RESPONSE_CONTINUE;
+      PostP2pData(aConn, response, sizeof(response));
+    }
+    return;
+  }
+
+  aConn.snepReceived = 0;
+  aConn.snepLength = 0;
+  response[1] = SnepMessage::RESPONSE_SUCCESS;
+  PostP2pData(aConn, response, sizeof(response));
+}
+
+tNFA_STATUS SimController::P2pSetLlcpConfig(uint16_t aLinkMiu)
+{
+  AutoMutex lock(mMutex);
+  mLinkMiu = aLinkMiu;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::P2pRegisterServer(uint8_t aServerSap,
+                                             tNFA_P2P_LINK_TYPE aLinkType,
+                                             const char* aServiceName,
+                                             tNFA_P2P_CBACK* aCallback)
+{
+  AutoMutex lock(mMutex);
+
+  P2pRegistration reg;
+  reg.handle = NewP2pHandle();
+  reg.sap = aServerSap != NFA_P2P_ANY_SAP ? aServerSap
+                                          : FIRST_DYNAMIC_SAP + mRegistrations.size();
+  reg.serviceName = aServiceName ? aServiceName : "";
+  reg.callback = aCallback;
+  reg.linkType = aLinkType;
+  mRegistrations.push_back(reg);
+
+  Event& event = NewEvent(CALLBACK_P2P, NFA_P2P_REG_SERVER_EVT);
+  event.callback.p2p = aCallback;
+  event.data.p2p.reg_server.server_handle = reg.handle;
+  event.data.p2p.reg_server.server_sap = reg.sap;
+  strncpy(event.data.p2p.reg_server.service_name, reg.serviceName.c_str(),
+          sizeof(event.data.p2p.reg_server.service_name) - 1);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::P2pRegisterClient(tNFA_P2P_LINK_TYPE aLinkType,
+                                             tNFA_P2P_CBACK* aCallback)
+{
+  AutoMutex lock(mMutex);
+
+  P2pRegistration reg;
+  reg.handle = NewP2pHandle();
+  reg.sap = 0;
+  reg.callback = aCallback;
+  reg.linkType = aLinkType;
+  mRegistrations.push_back(reg);
+
+  Event& event = NewEvent(CALLBACK_P2P, NFA_P2P_REG_CLIENT_EVT);
+  event.callback.p2p = aCallback;
+  event.data.p2p.reg_client.client_handle = reg.handle;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::P2pDeregister(tNFA_HANDLE aHandle)
+{
+  AutoMutex lock(mMutex);
+  for (size_t i = 0; i < mRegistrations.size(); i++) {
+    if (mRegistrations[i].handle == aHandle) {
+      mRegistrations.erase(mRegistrations.begin() + i);
+      return NFA_STATUS_OK;
+    }
+  }
+  return NFA_STATUS_BAD_HANDLE;
+}
+
+tNFA_STATUS SimController::P2pAcceptConn(tNFA_HANDLE aHandle, uint16_t aMiu, uint8_t aRw)
+{
+  AutoMutex lock(mMutex);
+  P2pConnection* conn = FindConnection(aHandle);
+  if (!conn || !conn->fromPeer || conn->accepted) {
+    return NFA_STATUS_BAD_HANDLE;
+  }
+
+  conn->accepted = true;
+  conn->miu = aMiu ? aMiu : LLCP_DEFAULT_MIU;
+
+  // A SNEP client waits for continue after the first fragment.
+  PushPendingLocked(*conn, conn->serviceName != SnepServer::DEFAULT_SERVICE_NAME);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::P2pConnect(tNFA_HANDLE aClientHandle,
+                                      const char* aServiceName,
+                                      uint8_t aDsap,
+                                      uint16_t aMiu,
+                                      uint8_t aRw)
+{
+  AutoMutex lock(mMutex);
+  P2pRegistration* reg = FindRegistration(aClientHandle);
+  if (!reg || !(reg->linkType & NFA_P2P_DLINK_TYPE)) {
+    return NFA_STATUS_BAD_HANDLE;
+  }
+
+  SimTarget* peer = GetFieldTarget();
+  std::map<std::string, SimService>::const_iterator it;
+  if (mLlcpActive && peer) {
+    for (it = peer->services.begin(); it != peer->services.end(); ++it) {
+      if (aServiceName ? it->first == aServiceName : it->second.sap == aDsap) {
+        break;
+      }
+    }
+  }
+
+  if (!mLlcpActive || !peer || it == peer->services.end()) {
+    Event& event = NewEvent(CALLBACK_P2P, NFA_P2P_DISC_EVT);
+    event.callback.p2p = reg->callback;
+    event.data.p2p.disc.handle = aClientHandle;
+    event.data.p2p.disc.reason = DISC_REASON_NO_SERVICE;
+    return NFA_STATUS_OK;
+  }
+
+  P2pConnection conn;
+  conn.handle = NewP2pHandle();
+  conn.callback = reg->callback;
+  conn.remoteSap = it->second.sap;
+  conn.serviceName = it->first;
+  conn.fromPeer = false;
+  conn.accepted = true;
+  conn.miu = aMiu ? aMiu : LLCP_DEFAULT_MIU;
+  conn.rxOffset = 0;
+  conn.txOffset = 0;
+  conn.snepLength = 0;
+  conn.snepReceived = 0;
+  mConnections.push_back(conn);
+
+  Event& event = NewEvent(CALLBACK_P2P, NFA_P2P_CONNECTED_EVT);
+  event.callback.p2p = conn.callback;
+  event.data.p2p.connected.client_handle = aClientHandle;
+  event.data.p2p.connected.conn_handle = conn.handle;
+  event.data.p2p.connected.remote_sap = conn.remoteSap;
+  event.data.p2p.connected.remote_miu = peer->miu;
+  event.data.p2p.connected.remote_rw = peer->rw;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::P2pDisconnect(tNFA_HANDLE aHandle)
+{
+  AutoMutex lock(mMutex);
+  for (size_t i = 0; i < mConnections.size(); i++) {
+    if (mConnections[i].handle == aHandle) {
+      PostP2pDisconnect(mConnections[i], DISC_REASON_LOCAL_INITIATE);
+      mConnections.erase(mConnections.begin() + i);
+      return NFA_STATUS_OK;
+    }
+  }
+  return NFA_STATUS_BAD_HANDLE;
+}
+
+tNFA_STATUS SimController::P2pSendData(tNFA_HANDLE aHandle, uint16_t aLength, uint8_t* aData)
+{
+  AutoMutex lock(mMutex);
+  P2pConnection* conn = FindConnection(aHandle);
+  if (!conn) {
+    return NFA_STATUS_BAD_HANDLE;
+  }
+  if (!mLlcpActive || !conn->accepted) {
+    return NFA_STATUS_FAILED;
+  }
+
+  PeerReceiveLocked(*conn, aData, aLength);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::P2pReadData(tNFA_HANDLE aHandle,
+                                       uint32_t aMaxLength,
+                                       UINT32* aLength,
+                                       uint8_t* aData,
+                                       BOOLEAN* aMore)
+{
+  AutoMutex lock(mMutex);
+  *aLength = 0;
+  *aMore = FALSE;
+
+  P2pConnection* conn = FindConnection(aHandle);
+  if (!conn) {
+    return NFA_STATUS_BAD_HANDLE;
+  }
+
+  // One SDU per read; an SDU larger than the buffer is read in parts.
+  if (!conn->rx.empty()) {
+    const std::vector<uint8_t>& sdu = conn->rx.front();
+    uint32_t available = sdu.size() - conn->rxOffset;
+    uint32_t length = available < aMaxLength ? available : aMaxLength;
+    memcpy(aData, &sdu[conn->rxOffset], length);
+    *aLength = length;
+
+    conn->rxOffset += length;
+    if (conn->rxOffset == sdu.size()) {
+      conn->rx.pop_front();
+      conn->rxOffset = 0;
+    }
+  }
+
+  *aMore = conn->rx.empty() ? FALSE : TRUE;
+  return NFA_STATUS_OK;
+}
+
+bool SimController::Push(const std::string& aService, const std::vector<uint8_t>& aData)
+{
+  AutoMutex lock(mMutex);
+  SimTarget* peer = GetFieldTarget();
+  if (!mLlcpActive || !peer) {
+    NCI_ERROR("no LLCP link");
+    return false;
+  }
+
+  P2pRegistration* reg = NULL;
+  for (size_t i = 0; i < mRegistrations.size(); i++) {
+    if (mRegistrations[i].serviceName == aService &&
+        (mRegistrations[i].linkType & NFA_P2P_DLINK_TYPE)) {
+      reg = &mRegistrations[i];
+      break;
+    }
+  }
+  if (!reg) {
+    NCI_ERROR("no server for %s", aService.c_str());
+    return false;
+  }
+
+  P2pConnection conn;
+  conn.handle = NewP2pHandle();
+  conn.callback = reg->callback;
+  conn.remoteSap = PEER_CLIENT_SAP;
+  conn.serviceName = aService;
+  conn.fromPeer = true;
+  conn.accepted = false;
+  conn.miu = LLCP_DEFAULT_MIU;
+  conn.rxOffset = 0;
+  conn.tx = aData;
+  conn.txOffset = 0;
+  conn.snepLength = 0;
+  conn.snepReceived = 0;
+  mConnections.push_back(conn);
+
+  Event& event = NewEvent(CALLBACK_P2P, NFA_P2P_CONN_REQ_EVT);
+  event.callback.p2p = reg->callback;
+  event.data.p2p.conn_req.server_handle = reg->handle;
+  event.data.p2p.conn_req.conn_handle = conn.handle;
+  event.data.p2p.conn_req.remote_sap = conn.remoteSap;
+  event.data.p2p.conn_req.remote_miu = peer->miu;
+  event.data.p2p.conn_req.remote_rw = peer->rw;
+  return true;
+}
+
+tNFA_STATUS SimController::P2pSendUi(tNFA_HANDLE aHandle,
+                                     uint8_t aDsap,
+                                     uint16_t aLength,
+                                     uint8_t* aData)
+{
+  AutoMutex lock(mMutex);
+  P2pRegistration* reg = FindRegistration(aHandle);
+  if (!reg || !(reg->linkType & NFA_P2P_LLINK_TYPE)) {
+    return NFA_STATUS_BAD_HANDLE;
+  }
+
+  SimTarget* peer = GetFieldTarget();
+  if (!mLlcpActive || !peer) {
+    return NFA_STATUS_FAILED;
+  }
+  if (aLength > peer->linkMiu) {
+    return NFA_STATUS_BAD_LENGTH;
+  }
+
+  // UI PDUs are not acknowledged. A peer service answers with its reply,
+  // if any, UI PDUs to unknown SAPs are dropped.
+  std::map<std::string, SimService>::const_iterator it;
+  for (it = peer->services.begin(); it != peer->services.end(); ++it) {
+    if (it->second.sap == aDsap) {
+      break;
+    }
+  }
+  if (it != peer->services.end() && !it->second.reply.empty()) {
+    const std::vector<uint8_t>& reply = it->second.reply;
+    PostP2pUi(*reg, aDsap, &reply[0], reply.size());
+  }
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::P2pReadUi(tNFA_HANDLE aHandle,
+                                     uint32_t aMaxLength,
+                                     uint8_t* aRemoteSap,
+                                     UINT32* aLength,
+                                     uint8_t* aData,
+                                     BOOLEAN* aMore)
+{
+  AutoMutex lock(mMutex);
+  *aLength = 0;
+  *aMore = FALSE;
+
+  P2pRegistration* reg = FindRegistration(aHandle);
+  if (!reg) {
+    return NFA_STATUS_BAD_HANDLE;
+  }
+
+  // One UI PDU per read; what does not fit in the buffer is dropped.
+  if (!reg->ui.empty()) {
+    const UiPdu& pdu = reg->ui.front();
+    uint32_t length = pdu.data.size() < aMaxLength ? pdu.data.size() : aMaxLength;
+    if (length) {
+      memcpy(aData, &pdu.data[0], length);
+    }
+    *aLength = length;
+    *aRemoteSap = pdu.remoteSap;
+    reg->ui.pop_front();
+  }
+
+  *aMore = reg->ui.empty() ? FALSE : TRUE;
+  return NFA_STATUS_OK;
+}
+
+bool SimController::PushUi(const std::string& aService, const std::vector<uint8_t>& aData)
+{
+  AutoMutex lock(mMutex);
+  SimTarget* peer = GetFieldTarget();
+  if (!mLlcpActive || !peer) {
+    NCI_ERROR("no LLCP link");
+    return false;
+  }
+
+  for (size_t i = 0; i < mRegistrations.size(); i++) {
+    P2pRegistration& reg = mRegistrations[i];
+    if (reg.serviceName == aService && (reg.linkType & NFA_P2P_LLINK_TYPE)) {
+      PostP2pUi(reg, PEER_CLIENT_SAP, aData.empty() ? NULL : &aData[0], aData.size());
+      return true;
+    }
+  }
+
+  NCI_ERROR("no connectionless service %s", aService.c_str());
+  return false;
+}
+
+/**
+ * Secure elements. The simulated controller has none, but nfcd still
+ * registers and configures routing.
+ */
+
+tNFA_STATUS SimController::EeRegister(tNFA_EE_CBACK* aCallback)
+{
+  AutoMutex lock(mMutex);
+  mEeCallback = aCallback;
+
+  Event& event = NewEvent(CALLBACK_EE, NFA_EE_REGISTER_EVT);
+  event.callback.ee = mEeCallback;
+  event.data.ee.ee_register = NFA_STATUS_OK;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::EeDeregister(tNFA_EE_CBACK* aCallback)
+{
+  AutoMutex lock(mMutex);
+  Event& event = NewEvent(CALLBACK_EE, NFA_EE_DEREGISTER_EVT);
+  event.callback.ee = aCallback;
+  mEeCallback = NULL;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::EeModeSet(tNFA_HANDLE aEeHandle, tNFA_EE_MD aMode)
+{
+  AutoMutex lock(mMutex);
+  Event& event = NewEvent(CALLBACK_EE, NFA_EE_MODE_SET_EVT);
+  event.callback.ee = mEeCallback;
+  event.data.ee.mode_set.status = NFA_STATUS_FAILED;
+  event.data.ee.mode_set.ee_handle = aEeHandle;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::EeRoutingChanged(tNFA_EE_EVT aEvent)
+{
+  AutoMutex lock(mMutex);
+  Event& event = NewEvent(CALLBACK_EE, aEvent);
+  event.callback.ee = mEeCallback;
+  event.data.ee.status = NFA_STATUS_OK;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::EeUpdateNow()
+{
+  return EeRoutingChanged(NFA_EE_UPDATED_EVT);
+}
+
+tNFA_STATUS SimController::CeConfigureUiccListenTech()
+{
+  AutoMutex lock(mMutex);
+  PostConnStatus(NFA_CE_UICC_LISTEN_CONFIGURED_EVT, NFA_STATUS_OK);
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::HciRegister(tNFA_HCI_CBACK* aCallback)
+{
+  AutoMutex lock(mMutex);
+  mHciCallback = aCallback;
+
+  Event& event = NewEvent(CALLBACK_HCI, NFA_HCI_REGISTER_EVT);
+  event.callback.hci = mHciCallback;
+  event.data.hci.hci_register.status = NFA_STATUS_OK;
+  event.data.hci.hci_register.hci_handle = NFA_HANDLE_GROUP_HCI;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS SimController::HciDeregister()
+{
+  AutoMutex lock(mMutex);
+  Event& event = NewEvent(CALLBACK_HCI, NFA_HCI_DEREGISTER_EVT);
+  event.callback.hci = mHciCallback;
+  mHciCallback = NULL;
+  return NFA_STATUS_OK;
+}
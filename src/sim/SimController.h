@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_SimController_h
+#define mozilla_nfcd_SimController_h
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Mutex.h"
+#include "CondVar.h"
+
+extern "C"
+{
+  #include "nfa_api.h"
+  #include "nfa_p2p_api.h"
+  #include "nfa_ee_api.h"
+  #include "nfa_hci_api.h"
+}
+
+typedef enum {
+  SIM_TARGET_TAG = 0,
+  SIM_TARGET_PEER
+} SimTargetKind;
+
+/**
+ * LLCP service offered by a simulated peer. A peer answers every SDU
+ * received on the service with the reply, if any. The SNEP service is
+ * built in: PUT requests are reassembled and acknowledged.
+ */
+struct SimService {
+  uint8_t sap;
+  std::vector<uint8_t> reply;
+
+  SimService() : sap(0) {}
+};
+
+/**
+ * A virtual tag or P2P peer which can be brought into the RF field.
+ */
+struct SimTarget {
+  std::string name;
+  SimTargetKind kind;
+  tNFC_PROTOCOL protocol;
+  tNFC_DISCOVERY_TYPE mode;
+  std::vector<uint8_t> uid;
+
+  // Tag.
+  std::vector<uint8_t> ndef;
+  uint32_t maxNdefSize;
+  bool readOnly;
+  // Raw frame responses, keyed by command.
+  std::map<std::vector<uint8_t>, std::vector<uint8_t> > responses;
+  std::vector<uint8_t> defaultResponse;
+
+  // Peer.
+  uint16_t linkMiu;
+  uint16_t miu;
+  uint8_t rw;
+  std::map<std::string, SimService> services;
+
+  SimTarget();
+};
+
+/**
+ * Software stand-in for the NFC controller and the libnfc-nci NFA layer.
+ *
+ * The NFA entry points in SimNfa.cpp forward here. Each request is answered
+ * with the events the real stack would send, which are delivered from a
+ * dedicated thread after a configurable latency, so callers see the same
+ * threading as with a controller attached.
+ *
+ * Tags and peers are added by name and brought into the field with Tap().
+ * A tag is activated once RF discovery is running and polling covers its
+ * technology. Removing a tag only makes the next presence check or
+ * transceive fail, as with a real controller; removing a peer tears the
+ * LLCP link down.
+ */
+class SimController {
+public:
+  static SimController& GetInstance();
+
+  /**
+   * Start the callback thread.
+   *
+   * @return None.
+   */
+  void Start();
+
+  /**
+   * Stop the callback thread. Pending events are dropped.
+   *
+   * @return None.
+   */
+  void Stop();
+
+  /**
+   * Set the delay between a request and its callback events.
+   *
+   * @param  aMillisec Latency in milliseconds.
+   * @return           None.
+   */
+  void SetLatency(uint32_t aMillisec);
+
+  /**
+   * Add a tag or peer, replacing the one with the same name.
+   *
+   * @param  aTarget Target definition.
+   * @return         None.
+   */
+  void AddTarget(const SimTarget& aTarget);
+
+  /**
+   * Make a tag read-only.
+   *
+   * @param  aName Tag name.
+   * @return       False if the tag does not exist.
+   */
+  bool SetReadOnly(const std::string& aName);
+
+  /**
+   * Configure the response of a tag to a raw frame.
+   *
+   * @param  aName     Tag name.
+   * @param  aCommand  Raw frame sent by nfcd.
+   * @param  aResponse Response returned to nfcd.
+   * @return           False if the tag does not exist.
+   */
+  bool SetResponse(const std::string& aName,
+                   const std::vector<uint8_t>& aCommand,
+                   const std::vector<uint8_t>& aResponse);
+
+  /**
+   * Offer a service on a peer.
+   *
+   * @param  aName    Peer name.
+   * @param  aService Service name, e.g. urn:nfc:sn:snep.
+   * @param  aDef     Service definition.
+   * @return          False if the peer does not exist.
+   */
+  bool AddService(const std::string& aName,
+                  const std::string& aService,
+                  const SimService& aDef);
+
+  /**
+   * Bring a target into the field. Fails if another one is there.
+   *
+   * @param  aName Target name.
+   * @return       True if the target entered the field.
+   */
+  bool Tap(const std::string& aName);
+
+  /**
+   * Take the target out of the field.
+   *
+   * @return None.
+   */
+  void Remove();
+
+  /**
+   * Make the peer in the field connect to an nfcd server and send data.
+   * The peer disconnects once the server replies.
+   *
+   * @param  aService Name of the nfcd service.
+   * @param  aData    Data to send, split by the negotiated MIU.
+   * @return          False if no peer is linked or the service is unknown.
+   */
+  bool Push(const std::string& aService, const std::vector<uint8_t>& aData);
+
+  /**
+   * Make the peer in the field send a UI PDU to an nfcd connectionless
+   * service.
+   *
+   * @param  aService Name of the nfcd service.
+   * @param  aData    Information field of the UI PDU.
+   * @return          False if no peer is linked or the service is unknown.
+   */
+  bool PushUi(const std::string& aService, const std::vector<uint8_t>& aData);
+
+  /**
+   * Time the last NFA_ACTIVATED_EVT was handed to nfcd.
+   *
+   * @return Monotonic time in microseconds, 0 if nothing was activated yet.
+   */
+  uint64_t GetActivationTime();
+
+  // NFA layer, see SimNfa.cpp.
+  tNFA_STATUS Enable(tNFA_DM_CBACK* aDmCallback, tNFA_CONN_CBACK* aConnCallback);
+  tNFA_STATUS Disable(bool aGraceful);
+  tNFA_STATUS SetConfig(tNFA_PMID aParamId, uint8_t aLength, uint8_t* aData);
+  tNFA_STATUS PowerOffSleepMode(bool aStart);
+  tNFA_STATUS EnablePolling(tNFA_TECHNOLOGY_MASK aPollMask);
+  tNFA_STATUS DisablePolling();
+  tNFA_STATUS SetP2pListenTech(tNFA_TECHNOLOGY_MASK aTechMask);
+  tNFA_STATUS StartRfDiscovery();
+  tNFA_STATUS StopRfDiscovery();
+  tNFA_STATUS Select(uint8_t aRfDiscId, tNFA_NFC_PROTOCOL aProtocol,
+                     tNFA_INTF_TYPE aRfInterface);
+  tNFA_STATUS Deactivate(bool aSleepMode);
+  tNFA_STATUS SendRawFrame(uint8_t* aData, uint16_t aLength);
+
+  tNFA_STATUS RegisterNdefTypeHandler(tNFA_NDEF_CBACK* aCallback);
+  tNFA_STATUS RwDetectNdef();
+  tNFA_STATUS RwReadNdef();
+  tNFA_STATUS RwWriteNdef(uint8_t* aData, uint32_t aLength);
+  tNFA_STATUS RwPresenceCheck();
+  tNFA_STATUS RwFormatTag();
+  tNFA_STATUS RwSetTagReadOnly();
+
+  tNFA_STATUS P2pSetLlcpConfig(uint16_t aLinkMiu);
+  tNFA_STATUS P2pRegisterServer(uint8_t aServerSap,
+                                tNFA_P2P_LINK_TYPE aLinkType,
+                                const char* aServiceName,
+                                tNFA_P2P_CBACK* aCallback);
+  tNFA_STATUS P2pRegisterClient(tNFA_P2P_LINK_TYPE aLinkType,
+                                tNFA_P2P_CBACK* aCallback);
+  tNFA_STATUS P2pDeregister(tNFA_HANDLE aHandle);
+  tNFA_STATUS P2pAcceptConn(tNFA_HANDLE aHandle, uint16_t aMiu, uint8_t aRw);
+  tNFA_STATUS P2pConnect(tNFA_HANDLE aClientHandle, const char* aServiceName,
+                         uint8_t aDsap, uint16_t aMiu, uint8_t aRw);
+  tNFA_STATUS P2pDisconnect(tNFA_HANDLE aHandle);
+  tNFA_STATUS P2pSendData(tNFA_HANDLE aHandle, uint16_t aLength, uint8_t* aData);
+  tNFA_STATUS P2pReadData(tNFA_HANDLE aHandle, uint32_t aMaxLength,
+                          UINT32* aLength, uint8_t* aData, BOOLEAN* aMore);
+  tNFA_STATUS P2pSendUi(tNFA_HANDLE aHandle, uint8_t aDsap,
+                        uint16_t aLength, uint8_t* aData);
+  tNFA_STATUS P2pReadUi(tNFA_HANDLE aHandle, uint32_t aMaxLength,
+                        uint8_t* aRemoteSap, UINT32* aLength,
+                        uint8_t* aData, BOOLEAN* aMore);
+
+  tNFA_STATUS EeRegister(tNFA_EE_CBACK* aCallback);
+  tNFA_STATUS EeDeregister(tNFA_EE_CBACK* aCallback);
+  tNFA_STATUS EeModeSet(tNFA_HANDLE aEeHandle, tNFA_EE_MD aMode);
+  tNFA_STATUS EeRoutingChanged(tNFA_EE_EVT aEvent);
+  tNFA_STATUS EeUpdateNow();
+  tNFA_STATUS CeConfigureUiccListenTech();
+  tNFA_STATUS HciRegister(tNFA_HCI_CBACK* aCallback);
+  tNFA_STATUS HciDeregister();
+
+private:
+  typedef enum {
+    CALLBACK_DM = 0,
+    CALLBACK_CONN,
+    CALLBACK_NDEF,
+    CALLBACK_P2P,
+    CALLBACK_EE,
+    CALLBACK_HCI
+  } CallbackType;
+
+  struct Event {
+    // Monotonic delivery time in milliseconds.
+    uint64_t when;
+    CallbackType type;
+    union {
+      tNFA_DM_CBACK* dm;
+      tNFA_CONN_CBACK* conn;
+      tNFA_NDEF_CBACK* ndef;
+      tNFA_P2P_CBACK* p2p;
+      tNFA_EE_CBACK* ee;
+      tNFA_HCI_CBACK* hci;
+    } callback;
+    uint8_t event;
+    union {
+      tNFA_DM_CBACK_DATA dm;
+      tNFA_CONN_EVT_DATA conn;
+      tNFA_NDEF_EVT_DATA ndef;
+      tNFA_P2P_EVT_DATA p2p;
+      tNFA_EE_CBACK_DATA ee;
+      tNFA_HCI_EVT_DATA hci;
+    } data;
+    // Referenced by the data pointer of NFA_DATA_EVT and NFA_NDEF_DATA_EVT.
+    std::vector<uint8_t> payload;
+  };
+
+  struct UiPdu {
+    uint8_t remoteSap;
+    std::vector<uint8_t> data;
+  };
+
+  struct P2pRegistration {
+    tNFA_HANDLE handle;
+    uint8_t sap;
+    std::string serviceName;
+    tNFA_P2P_CBACK* callback;
+    // NFA_P2P_LLINK_TYPE and/or NFA_P2P_DLINK_TYPE.
+    tNFA_P2P_LINK_TYPE linkType;
+    // UI PDUs waiting for NFA_P2pReadUI().
+    std::deque<UiPdu> ui;
+  };
+
+  struct P2pConnection {
+    tNFA_HANDLE handle;
+    tNFA_P2P_CBACK* callback;
+    uint8_t remoteSap;
+    std::string serviceName;
+    // Connection requested by the peer, to an nfcd server.
+    bool fromPeer;
+    bool accepted;
+    // Largest SDU nfcd accepts on this connection.
+    uint16_t miu;
+
+    // SDUs waiting for NFA_P2pReadData().
+    std::deque<std::vector<uint8_t> > rx;
+    uint32_t rxOffset;
+
+    // Peer side: data still to push, SNEP request being reassembled.
+    std::vector<uint8_t> tx;
+    uint32_t txOffset;
+    uint32_t snepLength;
+    uint32_t snepReceived;
+  };
+
+  SimController();
+
+  static void* EventThread(void* aArg);
+  void RunEvents();
+  void Deliver(Event& aEvent);
+  static uint64_t Now();
+
+  Event& NewEvent(CallbackType aType, uint8_t aEvent);
+  void PostConnStatus(uint8_t aEvent, tNFA_STATUS aStatus);
+
+  SimTarget* FindTarget(const std::string& aName);
+  SimTarget* GetFieldTarget();
+  bool CanActivate(const SimTarget& aTarget) const;
+  void ActivateLocked();
+  void DeactivateLinkLocked(tNFA_DEACTIVATE_TYPE aType);
+  void FillActivation(const SimTarget& aTarget, tNFA_ACTIVATED& aActivated);
+
+  P2pRegistration* FindRegistration(tNFA_HANDLE aHandle);
+  P2pConnection* FindConnection(tNFA_HANDLE aHandle);
+  tNFA_HANDLE NewP2pHandle();
+  void PostP2pData(P2pConnection& aConn, const uint8_t* aData, uint32_t aLength);
+  void PostP2pDisconnect(P2pConnection& aConn, uint8_t aReason);
+  void PostP2pUi(P2pRegistration& aReg, uint8_t aRemoteSap,
+                 const uint8_t* aData, uint32_t aLength);
+  void PushPendingLocked(P2pConnection& aConn, bool aAll);
+  void PeerReceiveLocked(P2pConnection& aConn, const uint8_t* aData, uint32_t aLength);
+
+  Mutex mMutex;
+  CondVar mCondVar;
+  pthread_t mThread;
+  bool mRunning;
+  uint32_t mLatency;
+  std::deque<Event> mEvents;
+
+  tNFA_DM_CBACK* mDmCallback;
+  tNFA_CONN_CBACK* mConnCallback;
+  tNFA_NDEF_CBACK* mNdefCallback;
+  tNFA_EE_CBACK* mEeCallback;
+  tNFA_HCI_CBACK* mHciCallback;
+
+  // RF state.
+  bool mEnabled;
+  tNFA_TECHNOLOGY_MASK mPollMask;
+  tNFA_TECHNOLOGY_MASK mListenMask;
+  bool mDiscovering;
+  // Target in the field, -1 if none.
+  int mField;
+  // The target in the field waits for discovery to be activated.
+  bool mActivationPending;
+  bool mActive;
+  bool mSleeping;
+  bool mLlcpActive;
+  uint64_t mActivationTime;
+
+  std::vector<SimTarget> mTargets;
+
+  // LLCP state.
+  uint16_t mLinkMiu;
+  uint8_t mNextP2pHandle;
+  std::vector<P2pRegistration> mRegistrations;
+  std::vector<P2pConnection> mConnections;
+};
+
+#endif // mozilla_nfcd_SimController_h
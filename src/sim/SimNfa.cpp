@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * The libnfc-nci entry points used by src/nci, implemented on top of
+ * SimController. Built instead of linking libnfc-nci when
+ * NFCD_SIMULATOR := true.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "NfcAdaptation.h"
+#include "NfcDebug.h"
+#include "OverrideLog.h"
+#include "SimController.h"
+#include "SimScript.h"
+#include "config.h"
+
+extern "C"
+{
+  #include "nfa_api.h"
+  #include "nfa_p2p_api.h"
+  #include "nfa_ee_api.h"
+  #include "nfa_hci_api.h"
+  #include "nfa_ce_api.h"
+  #include "rw_api.h"
+  #include "ce_api.h"
+  #include "llcp_api.h"
+}
+
+// Script run once the controller is up.
+#define SIM_SCRIPT_ENV "NFCD_SIM_SCRIPT"
+// Callback latency in milliseconds.
+#define SIM_LATENCY_ENV "NFCD_SIM_LATENCY"
+
+static SimController& sSim = SimController::GetInstance();
+
+/**
+ * Adaptation.
+ */
+
+NfcAdaptation* NfcAdaptation::sInstance = NULL;
+
+NfcAdaptation::NfcAdaptation()
+{
+  memset(&mHalEntryFuncs, 0, sizeof(mHalEntryFuncs));
+}
+
+NfcAdaptation::~NfcAdaptation()
+{
+}
+
+NfcAdaptation& NfcAdaptation::GetInstance()
+{
+  if (!sInstance) {
+    sInstance = new NfcAdaptation();
+  }
+  return *sInstance;
+}
+
+void NfcAdaptation::Initialize()
+{
+  const char* latency = getenv(SIM_LATENCY_ENV);
+  if (latency) {
+    sSim.SetLatency(atoi(latency));
+  }
+  sSim.Start();
+
+  const char* path = getenv(SIM_SCRIPT_ENV);
+  if (path) {
+    static SimScript sScript(sSim);
+    if (sScript.Load(path)) {
+      sScript.Start();
+    }
+  }
+}
+
+void NfcAdaptation::Finalize()
+{
+  sSim.Stop();
+}
+
+tHAL_NFC_ENTRY* NfcAdaptation::GetHalEntryFuncs()
+{
+  return &mHalEntryFuncs;
+}
+
+/**
+ * Configuration and tracing. Every config value is left at its default.
+ */
+
+unsigned char appl_trace_level = 0;
+
+unsigned char initializeGlobalAppLogLevel()
+{
+  return appl_trace_level;
+}
+
+int GetStrValue(const char* name, char* p_value, unsigned long len)
+{
+  return 0;
+}
+
+int GetNumValue(const char* name, void* p_value, unsigned long len)
+{
+  return 0;
+}
+
+UINT8 NFA_SetTraceLevel(UINT8 new_level) { return new_level; }
+UINT8 NFA_P2pSetTraceLevel(UINT8 new_level) { return new_level; }
+UINT8 NFC_SetTraceLevel(UINT8 new_level) { return new_level; }
+UINT8 RW_SetTraceLevel(UINT8 new_level) { return new_level; }
+UINT8 CE_SetTraceLevel(UINT8 new_level) { return new_level; }
+UINT8 LLCP_SetTraceLevel(UINT8 new_level) { return new_level; }
+
+/**
+ * Device management.
+ */
+
+void NFA_Init(tHAL_NFC_ENTRY* p_hal_entry_tbl)
+{
+}
+
+tNFA_STATUS NFA_Enable(tNFA_DM_CBACK* p_dm_cback, tNFA_CONN_CBACK* p_conn_cback)
+{
+  return sSim.Enable(p_dm_cback, p_conn_cback);
+}
+
+tNFA_STATUS NFA_Disable(BOOLEAN graceful)
+{
+  return sSim.Disable(graceful);
+}
+
+tNFA_STATUS NFA_SetConfig(tNFA_PMID param_id, UINT8 length, UINT8* p_data)
+{
+  return sSim.SetConfig(param_id, length, p_data);
+}
+
+tNFA_STATUS NFA_PowerOffSleepMode(BOOLEAN start_stop)
+{
+  return sSim.PowerOffSleepMode(start_stop);
+}
+
+/**
+ * RF discovery.
+ */
+
+tNFA_STATUS NFA_EnablePolling(tNFA_TECHNOLOGY_MASK poll_mask)
+{
+  return sSim.EnablePolling(poll_mask);
+}
+
+tNFA_STATUS NFA_DisablePolling(void)
+{
+  return sSim.DisablePolling();
+}
+
+tNFA_STATUS NFA_SetP2pListenTech(tNFA_TECHNOLOGY_MASK tech_mask)
+{
+  return sSim.SetP2pListenTech(tech_mask);
+}
+
+tNFA_STATUS NFA_StartRfDiscovery(void)
+{
+  return sSim.StartRfDiscovery();
+}
+
+tNFA_STATUS NFA_StopRfDiscovery(void)
+{
+  return sSim.StopRfDiscovery();
+}
+
+tNFA_STATUS NFA_SetRfDiscoveryDuration(UINT16 discovery_period_ms)
+{
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS NFA_Select(UINT8 rf_disc_id,
+                       tNFA_NFC_PROTOCOL protocol,
+                       tNFA_INTF_TYPE rf_interface)
+{
+  return sSim.Select(rf_disc_id, protocol, rf_interface);
+}
+
+tNFA_STATUS NFA_Deactivate(BOOLEAN sleep_mode)
+{
+  return sSim.Deactivate(sleep_mode);
+}
+
+tNFA_STATUS NFA_SendRawFrame(UINT8* p_raw_data,
+                             UINT16 data_len,
+                             UINT16 presence_check_start_delay)
+{
+  return sSim.SendRawFrame(p_raw_data, data_len);
+}
+
+/**
+ * Reader/writer.
+ */
+
+tNFA_STATUS NFA_RegisterNDefTypeHandler(BOOLEAN handle_whole_message,
+                                        tNFA_TNF tnf,
+                                        UINT8* p_type_name,
+                                        UINT8 type_name_len,
+                                        tNFA_NDEF_CBACK* p_ndef_cback)
+{
+  // nfcd registers a single default handler for whole messages.
+  return sSim.RegisterNdefTypeHandler(p_ndef_cback);
+}
+
+tNFA_STATUS NFA_DeregisterNDefTypeHandler(tNFA_HANDLE ndef_type_handle)
+{
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS NFA_RwDetectNDef(void)
+{
+  return sSim.RwDetectNdef();
+}
+
+tNFA_STATUS NFA_RwReadNDef(void)
+{
+  return sSim.RwReadNdef();
+}
+
+tNFA_STATUS NFA_RwWriteNDef(UINT8* p_data, UINT32 len)
+{
+  return sSim.RwWriteNdef(p_data, len);
+}
+
+#ifdef NFA_DM_PRESENCE_CHECK_OPTION
+tNFA_STATUS NFA_RwPresenceCheck(tNFA_RW_PRES_CHK_OPTION option)
+#else
+tNFA_STATUS NFA_RwPresenceCheck(void)
+#endif
+{
+  return sSim.RwPresenceCheck();
+}
+
+tNFA_STATUS NFA_RwFormatTag(void)
+{
+  return sSim.RwFormatTag();
+}
+
+tNFA_STATUS NFA_RwSetTagReadOnly(BOOLEAN b_hard_lock)
+{
+  return sSim.RwSetTagReadOnly();
+}
+
+/**
+ * LLCP.
+ */
+
+tNFA_STATUS NFA_P2pSetLLCPConfig(UINT16 link_miu,
+                                 UINT8 opt,
+                                 UINT8 wt,
+                                 UINT16 link_timeout,
+                                 UINT16 inact_timeout_init,
+                                 UINT16 inact_timeout_target,
+                                 UINT16 symm_delay,
+                                 UINT16 data_link_timeout,
+                                 UINT16 delay_first_pdu_timeout)
+{
+  return sSim.P2pSetLlcpConfig(link_miu);
+}
+
+tNFA_STATUS NFA_P2pRegisterServer(UINT8 server_sap,
+                                  tNFA_P2P_LINK_TYPE link_type,
+                                  char* p_service_name,
+                                  tNFA_P2P_CBACK* p_cback)
+{
+  return sSim.P2pRegisterServer(server_sap, link_type, p_service_name, p_cback);
+}
+
+tNFA_STATUS NFA_P2pRegisterClient(tNFA_P2P_LINK_TYPE link_type,
+                                  tNFA_P2P_CBACK* p_cback)
+{
+  return sSim.P2pRegisterClient(link_type, p_cback);
+}
+
+tNFA_STATUS NFA_P2pDeregister(tNFA_HANDLE handle)
+{
+  return sSim.P2pDeregister(handle);
+}
+
+tNFA_STATUS NFA_P2pAcceptConn(tNFA_HANDLE handle, UINT16 miu, UINT8 rw)
+{
+  return sSim.P2pAcceptConn(handle, miu, rw);
+}
+
+tNFA_STATUS NFA_P2pConnectByName(tNFA_HANDLE client_handle,
+                                 char* p_service_name,
+                                 UINT16 miu,
+                                 UINT8 rw)
+{
+  return sSim.P2pConnect(client_handle, p_service_name, 0, miu, rw);
+}
+
+tNFA_STATUS NFA_P2pConnectBySap(tNFA_HANDLE client_handle,
+                                UINT8 dsap,
+                                UINT16 miu,
+                                UINT8 rw)
+{
+  return sSim.P2pConnect(client_handle, NULL, dsap, miu, rw);
+}
+
+tNFA_STATUS NFA_P2pDisconnect(tNFA_HANDLE handle, BOOLEAN flush)
+{
+  return sSim.P2pDisconnect(handle);
+}
+
+tNFA_STATUS NFA_P2pSendData(tNFA_HANDLE handle, UINT16 length, UINT8* p_data)
+{
+  return sSim.P2pSendData(handle, length, p_data);
+}
+
+tNFA_STATUS NFA_P2pReadData(tNFA_HANDLE handle,
+                            UINT32 max_data_len,
+                            UINT32* p_data_len,
+                            UINT8* p_data,
+                            BOOLEAN* p_more)
+{
+  return sSim.P2pReadData(handle, max_data_len, p_data_len, p_data, p_more);
+}
+
+tNFA_STATUS NFA_P2pSendUI(tNFA_HANDLE handle, UINT8 dsap, UINT16 length, UINT8* p_data)
+{
+  return sSim.P2pSendUi(handle, dsap, length, p_data);
+}
+
+tNFA_STATUS NFA_P2pReadUI(tNFA_HANDLE handle,
+                          UINT32 max_data_len,
+                          UINT8* p_remote_sap,
+                          UINT32* p_data_len,
+                          UINT8* p_data,
+                          BOOLEAN* p_more)
+{
+  return sSim.P2pReadUi(handle, max_data_len, p_remote_sap, p_data_len, p_data, p_more);
+}
+
+/**
+ * Secure elements and card emulation.
+ */
+
+tNFA_STATUS NFA_EeGetInfo(UINT8* p_num_nfcee, tNFA_EE_INFO* p_info)
+{
+  *p_num_nfcee = 0;
+  return NFA_STATUS_OK;
+}
+
+tNFA_STATUS NFA_EeRegister(tNFA_EE_CBACK* p_cback)
+{
+  return sSim.EeRegister(p_cback);
+}
+
+tNFA_STATUS NFA_EeDeregister(tNFA_EE_CBACK* p_cback)
+{
+  return sSim.EeDeregister(p_cback);
+}
+
+tNFA_STATUS NFA_EeModeSet(tNFA_HANDLE ee_handle, tNFA_EE_MD mode)
+{
+  return sSim.EeModeSet(ee_handle, mode);
+}
+
+tNFA_STATUS NFA_EeSetDefaultTechRouting(tNFA_HANDLE ee_handle,
+                                        tNFA_TECHNOLOGY_MASK technologies_switch_on,
+                                        tNFA_TECHNOLOGY_MASK technologies_switch_off,
+                                        tNFA_TECHNOLOGY_MASK technologies_battery_off)
+{
+  return sSim.EeRoutingChanged(NFA_EE_SET_TECH_CFG_EVT);
+}
+
+tNFA_STATUS NFA_EeSetDefaultProtoRouting(tNFA_HANDLE ee_handle,
+                                         tNFA_PROTOCOL_MASK protocols_switch_on,
+                                         tNFA_PROTOCOL_MASK protocols_switch_off,
+                                         tNFA_PROTOCOL_MASK protocols_battery_off)
+{
+  return sSim.EeRoutingChanged(NFA_EE_SET_PROTO_CFG_EVT);
+}
+
+tNFA_STATUS NFA_EeUpdateNow(void)
+{
+  return sSim.EeUpdateNow();
+}
+
+tNFA_STATUS NFA_CeConfigureUiccListenTech(tNFA_HANDLE ee_handle,
+                                          tNFA_TECHNOLOGY_MASK tech_mask)
+{
+  return sSim.CeConfigureUiccListenTech();
+}
+
+tNFA_STATUS NFA_HciRegister(char* p_app_name,
+                            tNFA_HCI_CBACK* p_cback,
+                            BOOLEAN b_send_conn_evts)
+{
+  return sSim.HciRegister(p_cback);
+}
+
+tNFA_STATUS NFA_HciDeregister(char* p_app_name)
+{
+  return sSim.HciDeregister();
+}
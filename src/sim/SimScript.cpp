@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SimScript.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "NfcDebug.h"
+#include "SimController.h"
+#include "SnepServer.h"
+
+struct TagType {
+  const char* name;
+  tNFC_PROTOCOL protocol;
+  tNFC_DISCOVERY_TYPE mode;
+};
+
+static const TagType sTagTypes[] = {
+  {"t1t",      NFA_PROTOCOL_T1T,      NFC_DISCOVERY_TYPE_POLL_A},
+  {"t2t",      NFA_PROTOCOL_T2T,      NFC_DISCOVERY_TYPE_POLL_A},
+  {"t3t",      NFA_PROTOCOL_T3T,      NFC_DISCOVERY_TYPE_POLL_F},
+  {"isodep-a", NFA_PROTOCOL_ISO_DEP,  NFC_DISCOVERY_TYPE_POLL_A},
+  {"isodep-b", NFA_PROTOCOL_ISO_DEP,  NFC_DISCOVERY_TYPE_POLL_B},
+  {"mifare",   NFA_PROTOCOL_MIFARE,   NFC_DISCOVERY_TYPE_POLL_A},
+  {"iso15693", NFA_PROTOCOL_ISO15693, NFC_DISCOVERY_TYPE_POLL_ISO15693},
+};
+
+static const TagType* FindTagType(const std::string& aName)
+{
+  for (size_t i = 0; i < sizeof(sTagTypes) / sizeof(sTagTypes[0]); i++) {
+    if (aName == sTagTypes[i].name) {
+      return &sTagTypes[i];
+    }
+  }
+  return NULL;
+}
+
+static bool ParseNumber(const std::string& aString, uint32_t& aValue)
+{
+  char* end = NULL;
+  unsigned long value = strtoul(aString.c_str(), &end, 0);
+  if (aString.empty() || *end) {
+    return false;
+  }
+  aValue = value;
+  return true;
+}
+
+SimScript::SimScript(SimController& aController)
+ : mController(aController)
+{
+}
+
+bool SimScript::ParseHex(const std::string& aHex, std::vector<uint8_t>& aBytes)
+{
+  aBytes.clear();
+  if (aHex == "-") {
+    return true;
+  }
+  if (aHex.size() % 2) {
+    return false;
+  }
+
+  aBytes.reserve(aHex.size() / 2);
+  for (size_t i = 0; i < aHex.size(); i += 2) {
+    if (!isxdigit(aHex[i]) || !isxdigit(aHex[i + 1])) {
+      return false;
+    }
+    char byte[3] = {aHex[i], aHex[i + 1], 0};
+    aBytes.push_back(strtoul(byte, NULL, 16));
+  }
+  return true;
+}
+
+bool SimScript::InitTag(const std::string& aType, SimTarget& aTag)
+{
+  const TagType* type = FindTagType(aType);
+  if (!type) {
+    return false;
+  }
+
+  aTag.kind = SIM_TARGET_TAG;
+  aTag.protocol = type->protocol;
+  aTag.mode = type->mode;
+  aTag.defaultResponse.clear();
+  if (aTag.protocol == NFA_PROTOCOL_ISO_DEP) {
+    // Instruction not supported.
+    aTag.defaultResponse.push_back(0x6D);
+    aTag.defaultResponse.push_back(0x00);
+  }
+  return true;
+}
+
+bool SimScript::Load(const char* aPath)
+{
+  FILE* file = fopen(aPath, "r");
+  if (!file) {
+    NCI_ERROR("can't open %s", aPath);
+    return false;
+  }
+
+  mCommands.clear();
+  bool ok = true;
+  int depth = 0;
+  char line[4096];
+  for (int lineNumber = 1; fgets(line, sizeof(line), file); lineNumber++) {
+    Command command;
+    command.line = lineNumber;
+    for (char* token = strtok(line, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+      command.args.push_back(token);
+    }
+    if (command.args.empty() || command.args[0][0] == '#') {
+      continue;
+    }
+
+    if (!Check(command)) {
+      NCI_ERROR("%s:%d: bad command", aPath, lineNumber);
+      ok = false;
+      continue;
+    }
+
+    if (command.args[0] == "loop") {
+      depth++;
+    } else if (command.args[0] == "end" && --depth < 0) {
+      NCI_ERROR("%s:%d: end without loop", aPath, lineNumber);
+      ok = false;
+    }
+    mCommands.push_back(command);
+  }
+  fclose(file);
+
+  if (depth > 0) {
+    NCI_ERROR("%s: loop without end", aPath);
+    ok = false;
+  }
+  return ok;
+}
+
+bool SimScript::Check(const Command& aCommand)
+{
+  const std::vector<std::string>& args = aCommand.args;
+  const std::string& name = args[0];
+  size_t count = args.size() - 1;
+  uint32_t number;
+  std::vector<uint8_t> bytes;
+
+  if (name == "latency" || name == "wait" || name == "loop") {
+    return count == 1 && ParseNumber(args[1], number);
+  } else if (name == "tag") {
+    return count >= 3 && count <= 5 &&
+           FindTagType(args[2]) &&
+           ParseHex(args[3], bytes) &&
+           (count < 4 || ParseHex(args[4], bytes)) &&
+           (count < 5 || ParseNumber(args[5], number));
+  } else if (name == "readonly" || name == "tap") {
+    return count == 1;
+  } else if (name == "response") {
+    return count == 3 && ParseHex(args[2], bytes) && ParseHex(args[3], bytes);
+  } else if (name == "peer") {
+    return count >= 1 && count <= 3 &&
+           (count < 2 || ParseNumber(args[2], number)) &&
+           (count < 3 || ParseNumber(args[3], number));
+  } else if (name == "service") {
+    return (count == 3 || count == 4) &&
+           ParseNumber(args[3], number) &&
+           (count < 4 || ParseHex(args[4], bytes));
+  } else if (name == "push" || name == "push-ui") {
+    return count == 2 && ParseHex(args[2], bytes);
+  } else if (name == "remove" || name == "end") {
+    return count == 0;
+  }
+  return false;
+}
+
+bool SimScript::Execute(const Command& aCommand)
+{
+  const std::vector<std::string>& args = aCommand.args;
+  const std::string& name = args[0];
+  uint32_t number = 0;
+
+  if (name == "latency") {
+    ParseNumber(args[1], number);
+    mController.SetLatency(number);
+  } else if (name == "wait") {
+    ParseNumber(args[1], number);
+    usleep(number * 1000);
+  } else if (name == "tag") {
+    SimTarget tag;
+    tag.name = args[1];
+    InitTag(args[2], tag);
+    ParseHex(args[3], tag.uid);
+    if (args.size() > 4) {
+      ParseHex(args[4], tag.ndef);
+    }
+    if (args.size() > 5) {
+      ParseNumber(args[5], tag.maxNdefSize);
+    } else if (tag.maxNdefSize < tag.ndef.size()) {
+      tag.maxNdefSize = tag.ndef.size();
+    }
+    mController.AddTarget(tag);
+  } else if (name == "readonly") {
+    return mController.SetReadOnly(args[1]);
+  } else if (name == "response") {
+    std::vector<uint8_t> command, response;
+    ParseHex(args[2], command);
+    ParseHex(args[3], response);
+    return mController.SetResponse(args[1], command, response);
+  } else if (name == "peer") {
+    SimTarget peer;
+    peer.name = args[1];
+    peer.kind = SIM_TARGET_PEER;
+    peer.protocol = NFA_PROTOCOL_NFC_DEP;
+    peer.mode = NFC_DISCOVERY_TYPE_POLL_A;
+    if (args.size() > 2) {
+      ParseNumber(args[2], number);
+      peer.miu = number;
+    }
+    if (args.size() > 3) {
+      ParseNumber(args[3], number);
+      peer.rw = number;
+    }
+    SimService snep;
+    snep.sap = SnepServer::DEFAULT_PORT;
+    peer.services[SnepServer::DEFAULT_SERVICE_NAME] = snep;
+    mController.AddTarget(peer);
+  } else if (name == "service") {
+    SimService service;
+    ParseNumber(args[3], number);
+    service.sap = number;
+    if (args.size() > 4) {
+      ParseHex(args[4], service.reply);
+    }
+    return mController.AddService(args[1], args[2], service);
+  } else if (name == "tap") {
+    return mController.Tap(args[1]);
+  } else if (name == "remove") {
+    mController.Remove();
+  } else if (name == "push") {
+    std::vector<uint8_t> data;
+    ParseHex(args[2], data);
+    return mController.Push(args[1], data);
+  } else if (name == "push-ui") {
+    std::vector<uint8_t> data;
+    ParseHex(args[2], data);
+    return mController.PushUi(args[1], data);
+  }
+  return true;
+}
+
+bool SimScript::Run()
+{
+  // Start of the body and remaining iterations of the enclosing loops.
+  std::vector<size_t> loopStart;
+  std::vector<uint32_t> loopCount;
+
+  size_t pc = 0;
+  while (pc < mCommands.size()) {
+    const Command& command = mCommands[pc];
+    const std::string& name = command.args[0];
+
+    if (name == "loop") {
+      uint32_t count = 0;
+      ParseNumber(command.args[1], count);
+      loopStart.push_back(pc + 1);
+      loopCount.push_back(count);
+      pc++;
+    } else if (name == "end") {
+      // A count of 0 loops forever.
+      if (loopCount.back() == 0 || --loopCount.back() > 0) {
+        pc = loopStart.back();
+      } else {
+        loopStart.pop_back();
+        loopCount.pop_back();
+        pc++;
+      }
+    } else {
+      if (!Execute(command)) {
+        NCI_ERROR("line %d: %s failed", command.line, name.c_str());
+        return false;
+      }
+      pc++;
+    }
+  }
+  return true;
+}
+
+void* SimScript::ScriptThread(void* aArg)
+{
+  static_cast<SimScript*>(aArg)->Run();
+  return NULL;
+}
+
+void SimScript::Start()
+{
+  if (pthread_create(&mThread, NULL, ScriptThread, this) != 0) {
+    NCI_ERROR("fail to create script thread");
+    return;
+  }
+  pthread_detach(mThread);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014  Mozilla Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mozilla_nfcd_SimScript_h
+#define mozilla_nfcd_SimScript_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class SimController;
+struct SimTarget;
+
+/**
+ * Drives the simulated controller from a text file, one command per line.
+ * Blank lines and lines starting with '#' are ignored. Byte strings are
+ * written in hex, '-' standing for none.
+ *
+ *   latency <ms>                           Callback latency.
+ *   tag <name> <type> <uid> [<ndef> [<max-size>]]
+ *                                          Define a tag. Types are t1t, t2t,
+ *                                          t3t, isodep-a, isodep-b, mifare
+ *                                          and iso15693.
+ *   readonly <name>                        Make a tag read-only.
+ *   response <name> <command> <response>  Answer a raw frame.
+ *   peer <name> [<miu> [<rw>]]             Define a P2P peer offering SNEP.
+ *   service <peer> <service-name> <sap> [<reply>]
+ *                                          Offer another service on a peer.
+ *   tap <name>                             Bring a tag or peer in the field.
+ *   remove                                 Take it out of the field.
+ *   push <service-name> <data>             Make the peer send data to an
+ *                                          nfcd server.
+ *   push-ui <service-name> <data>          Make the peer send a UI PDU to
+ *                                          an nfcd connectionless service.
+ *   wait <ms>                              Sleep.
+ *   loop <count> ... end                   Repeat, forever if count is 0.
+ */
+class SimScript {
+public:
+  SimScript(SimController& aController);
+
+  /**
+   * Read and check a script.
+   *
+   * @param  aPath Script file.
+   * @return       False if the file can't be read or has errors.
+   */
+  bool Load(const char* aPath);
+
+  /**
+   * Run the script on its own thread.
+   *
+   * @return None.
+   */
+  void Start();
+
+  /**
+   * Run the script on the calling thread.
+   *
+   * @return False if a command failed.
+   */
+  bool Run();
+
+  /**
+   * Parse a hex byte string.
+   *
+   * @param  aHex   Hex digits, or "-" for none.
+   * @param  aBytes Output bytes.
+   * @return        False if aHex is not valid.
+   */
+  static bool ParseHex(const std::string& aHex, std::vector<uint8_t>& aBytes);
+
+  /**
+   * Set the protocol, RF technology and default response of a tag.
+   *
+   * @param  aType Tag type, as in the tag command.
+   * @param  aTag  Tag to set up.
+   * @return       False if aType is unknown.
+   */
+  static bool InitTag(const std::string& aType, SimTarget& aTag);
+
+private:
+  struct Command {
+    int line;
+    std::vector<std::string> args;
+  };
+
+  static void* ScriptThread(void* aArg);
+  bool Check(const Command& aCommand);
+  bool Execute(const Command& aCommand);
+
+  SimController& mController;
+  std::vector<Command> mCommands;
+  pthread_t mThread;
+};
+
+#endif // mozilla_nfcd_SimScript_h
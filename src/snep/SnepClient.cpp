@@ -21,7 +21,7 @@
 #include <stdlib.h>
 
 #include "NfcService.h"
-#include "NfcManager.h"
+#include "INfcManager.h"
 #include "SnepServer.h"
 #include "NfcDebug.h"
 
@@ -40,6 +40,7 @@ SnepClient::SnepClient()
 SnepClient::SnepClient(const char* aServiceName)
  : mMessenger(NULL)
 {
+  mState = SnepClient::DISCONNECTED;
   mServiceName = aServiceName;
   mPort = -1;
   mAcceptableLength = SnepClient::DEFAULT_ACCEPTABLE_LENGTH;
@@ -52,6 +53,7 @@ SnepClient::SnepClient(int aMiu,
                        int aRwSize)
  : mMessenger(NULL)
 {
+  mState = SnepClient::DISCONNECTED;
   mServiceName = SnepServer::DEFAULT_SERVICE_NAME;
   mPort = SnepServer::DEFAULT_PORT;
   mAcceptableLength = SnepClient::DEFAULT_ACCEPTABLE_LENGTH;
@@ -64,6 +66,7 @@ SnepClient::SnepClient(const char* aServiceName,
                        int aFragmentLength)
  : mMessenger(NULL)
 {
+  mState = SnepClient::DISCONNECTED;
   mServiceName = aServiceName;
   mPort = -1;
   mAcceptableLength = SnepClient::DEFAULT_ACCEPTABLE_LENGTH;
@@ -77,6 +80,7 @@ SnepClient::SnepClient(const char* aServiceName,
                        int aFragmentLength)
  : mMessenger(NULL)
 {
+  mState = SnepClient::DISCONNECTED;
   mServiceName = aServiceName;
   mPort = -1;
   mAcceptableLength = aAcceptableLength;
@@ -95,31 +99,41 @@ SnepClient::~SnepClient()
  * The client requests that the server accept the NDEF message
  * transmitted with the request.
  */
-void SnepClient::Put(NdefMessage& aMsg)
+bool SnepClient::Put(NdefMessage& aMsg)
 {
   if (!mMessenger) {
     NFCD_ERROR("no messenger");
-    return;
+    return false;
   }
 
   if (mState != SnepClient::CONNECTED) {
     NFCD_ERROR("socket is not connected");
-    return;
+    return false;
   }
 
   SnepMessage* snepRequest = SnepMessage::GetPutRequest(aMsg);
-  if (snepRequest) {
-    // Send request.
-    mMessenger->SendMessage(*snepRequest);
-  } else {
+  if (!snepRequest) {
     NFCD_ERROR("get put request fail");
+    return false;
+  }
+
+  // Send request.
+  bool sent = mMessenger->SendMessage(*snepRequest);
+  delete snepRequest;
+  if (!sent) {
+    NFCD_ERROR("put request not sent");
+    return false;
   }
 
   // Get response.
   SnepMessage* snepResponse = mMessenger->GetMessage();
-
-  delete snepRequest;
+  bool success = snepResponse &&
+                 snepResponse->GetField() == SnepMessage::RESPONSE_SUCCESS;
+  if (snepResponse && !success) {
+    NFCD_ERROR("put rejected (%d)", snepResponse->GetField());
+  }
   delete snepResponse;
+  return success;
 }
 
 /**
@@ -140,11 +154,11 @@ SnepMessage* SnepClient::Get(NdefMessage& aMsg)
   }
 
   SnepMessage* snepRequest = SnepMessage::GetGetRequest(mAcceptableLength, aMsg);
-  mMessenger->SendMessage(*snepRequest);
+  bool sent = snepRequest && mMessenger->SendMessage(*snepRequest);
 
   delete snepRequest;
 
-  return mMessenger->GetMessage();
+  return sent ? mMessenger->GetMessage() : NULL;
 }
 
 bool SnepClient::Connect()
@@ -153,7 +167,6 @@ bool SnepClient::Connect()
     NFCD_ERROR("snep already connected");
     return false;
   }
-  mState = SnepClient::CONNECTING;
 
   INfcManager* pINfcManager = NfcService::GetNfcManager();
 
@@ -164,11 +177,21 @@ bool SnepClient::Connect()
   ILlcpSocket* socket = pINfcManager->CreateLlcpSocket(0, mMiu, mRwSize, 1024);
   if (!socket) {
     NFCD_ERROR("could not connect to socket");
-    mState = SnepClient::DISCONNECTED;
     return false;
   }
 
-  bool ret = false;
+  return Connect(socket);
+}
+
+bool SnepClient::Connect(ILlcpSocket* aSocket)
+{
+  if (mState != SnepClient::DISCONNECTED) {
+    NFCD_ERROR("snep already connected");
+    return false;
+  }
+  mState = SnepClient::CONNECTING;
+
+  ILlcpSocket* socket = aSocket;
   if (mPort == -1) {
     if (!socket->ConnectToService(mServiceName)) {
       NFCD_ERROR("could not connect to service (%s)", mServiceName);
@@ -185,8 +208,8 @@ bool SnepClient::Connect()
     }
   }
 
-  const int miu = socket->GetRemoteMiu();
-  const int fragmentLength = (mFragmentLength == -1) ?  miu : miu < mFragmentLength ? miu : mFragmentLength;
+  // Fragments are as large as the MIU the server announced.
+  const uint32_t fragmentLength = SnepMessenger::GetFragmentLength(socket, mFragmentLength);
 
   // Remove old messenger.
   if (mMessenger) {
@@ -17,6 +17,7 @@
 #ifndef mozilla_nfcd_SnepClient_h
 #define mozilla_nfcd_SnepClient_h
 
+class ILlcpSocket;
 class NdefMessage;
 class SnepMessage;
 class SnepMessenger;
@@ -34,15 +35,24 @@ public:
              int aFragmentLength);
   ~SnepClient();
 
-  void Put(NdefMessage& aMsg);
+  bool Put(NdefMessage& aMsg);
   SnepMessage* Get(NdefMessage& aMsg);
   bool Connect();
+
+  /**
+   * Connect over a socket created by the caller, instead of one created by
+   * the NFC manager.
+   *
+   * @param  aSocket Unconnected socket, owned by the client from now on.
+   * @return         True if connected.
+   */
+  bool Connect(ILlcpSocket* aSocket);
   void Close();
 
 private:
   static const int DEFAULT_ACCEPTABLE_LENGTH = 100*1024;
-  static const int DEFAULT_MIU = 128;
-  static const int DEFAULT_RWSIZE = 1;
+  static const int DEFAULT_MIU = 1980;
+  static const int DEFAULT_RWSIZE = 4;
 
   static const int DISCONNECTED = 0;
   static const int CONNECTING = 1;
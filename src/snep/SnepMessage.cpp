@@ -21,15 +21,19 @@
 
 SnepMessage::SnepMessage()
  : mNdefMessage(NULL)
+ , mOwnsNdefMessage(false)
 {
 }
 
 SnepMessage::~SnepMessage()
 {
-  delete mNdefMessage;
+  if (mOwnsNdefMessage) {
+    delete mNdefMessage;
+  }
 }
 
 SnepMessage::SnepMessage(std::vector<uint8_t>& aBuf)
+ : mOwnsNdefMessage(true)
 {
   int ndefOffset = 0;
   int ndefLength = 0;
@@ -72,12 +76,13 @@ SnepMessage::SnepMessage(uint8_t aVersion,
                          int aLength,
                          int aAcceptableLength,
                          NdefMessage* aNdefMessage)
+ : mNdefMessage(aNdefMessage)
+ , mOwnsNdefMessage(false)
 {
   mVersion = aVersion;
   mField = aField;
   mLength = aLength;
   mAcceptableLength = aAcceptableLength;
-  mNdefMessage = new NdefMessage(aNdefMessage);
 }
 
 bool SnepMessage::IsValidFormat(std::vector<uint8_t>& aBuf)
@@ -100,22 +105,18 @@ bool SnepMessage::IsValidFormat(std::vector<uint8_t>& aBuf)
 SnepMessage* SnepMessage::GetGetRequest(int aAcceptableLength,
                                         NdefMessage& aNdef)
 {
-  std::vector<uint8_t> buf;
-  aNdef.ToByteArray(buf);
   return new SnepMessage(SnepMessage::VERSION,
                          SnepMessage::REQUEST_GET,
-                         4 + buf.size(),
+                         4 + aNdef.GetEncodedLength(),
                          aAcceptableLength,
                          &aNdef);
 }
 
 SnepMessage* SnepMessage::GetPutRequest(NdefMessage& aNdef)
 {
-  std::vector<uint8_t> buf;
-  aNdef.ToByteArray(buf);
   return new SnepMessage(SnepMessage::VERSION,
                          SnepMessage::REQUEST_PUT,
-                         buf.size(),
+                         aNdef.GetEncodedLength(),
                          0,
                          &aNdef);
 }
@@ -130,9 +131,8 @@ SnepMessage* SnepMessage::GetSuccessResponse(NdefMessage* aNdef)
   if (!aNdef) {
     return new SnepMessage(SnepMessage::VERSION, SnepMessage::RESPONSE_SUCCESS, 0, 0, NULL);
   } else {
-    std::vector<uint8_t> buf;
-    aNdef->ToByteArray(buf);
-    return new SnepMessage(SnepMessage::VERSION, SnepMessage::RESPONSE_SUCCESS, buf.size(), 0, aNdef);
+    return new SnepMessage(SnepMessage::VERSION, SnepMessage::RESPONSE_SUCCESS,
+                           aNdef->GetEncodedLength(), 0, aNdef);
   }
 }
 
@@ -152,33 +152,36 @@ SnepMessage* SnepMessage::FromByteArray(uint8_t* aBuf,
   return FromByteArray(buf);
 }
 
+/**
+ * The message is appended to aBuf. The buffer is grown once to the full
+ * length, the header is written first and the NDEF message is encoded in
+ * place after it.
+ */
 void SnepMessage::ToByteArray(std::vector<uint8_t>& aBuf)
 {
-  if (mNdefMessage) {
-    mNdefMessage->ToByteArray(aBuf);
+  const bool isGet = mField == SnepMessage::REQUEST_GET;
+  const uint32_t ndefLength = mNdefMessage ? mNdefMessage->GetEncodedLength() : 0;
+  const uint32_t headerLength = SnepMessage::HEADER_LENGTH + (isGet ? 4 : 0);
+  const uint32_t len = ndefLength + (isGet ? 4 : 0);
+
+  aBuf.reserve(aBuf.size() + headerLength + ndefLength);
+
+  aBuf.push_back(mVersion);
+  aBuf.push_back(mField);
+  aBuf.push_back((len >> 24) & 0xFF);
+  aBuf.push_back((len >> 16) & 0xFF);
+  aBuf.push_back((len >>  8) & 0xFF);
+  aBuf.push_back( len & 0xFF);
+  if (isGet) {
+    aBuf.push_back((mAcceptableLength >> 24) & 0xFF);
+    aBuf.push_back((mAcceptableLength >> 16) & 0xFF);
+    aBuf.push_back((mAcceptableLength >>  8) & 0xFF);
+    aBuf.push_back( mAcceptableLength & 0xFF);
   }
 
-  std::vector<uint8_t> snepHeader;
-
-  snepHeader.push_back(mVersion);
-  snepHeader.push_back(mField);
-  if (mField == SnepMessage::REQUEST_GET) {
-    uint32_t len = aBuf.size() + 4;
-    snepHeader.push_back((len >> 24) & 0xFF);
-    snepHeader.push_back((len >> 16) & 0xFF);
-    snepHeader.push_back((len >>  8) & 0xFF);
-    snepHeader.push_back( len & 0xFF);
-    snepHeader.push_back((mAcceptableLength >> 24) & 0xFF);
-    snepHeader.push_back((mAcceptableLength >> 16) & 0xFF);
-    snepHeader.push_back((mAcceptableLength >>  8) & 0xFF);
-    snepHeader.push_back( mAcceptableLength & 0xFF);
-  } else {
-    uint32_t len = aBuf.size();
-    snepHeader.push_back((len >> 24) & 0xFF);
-    snepHeader.push_back((len >> 16) & 0xFF);
-    snepHeader.push_back((len >>  8) & 0xFF);
-    snepHeader.push_back( len & 0xFF);
+  if (ndefLength) {
+    size_t offset = aBuf.size();
+    aBuf.resize(offset + ndefLength);
+    mNdefMessage->ToBuffer(&aBuf[offset], ndefLength);
   }
-
-  aBuf.insert(aBuf.begin(), snepHeader.begin(), snepHeader.end());
 }
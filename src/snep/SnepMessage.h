@@ -17,12 +17,17 @@
 #ifndef mozilla_nfcd_SnepMessage_h
 #define mozilla_nfcd_SnepMessage_h
 
+#include <stdint.h>
 #include <vector>
 
 class NdefMessage;
 
 class SnepMessage{
 public:
+  /**
+   * Build a message to send. aNdefMessage is referenced, not copied, and
+   * must outlive the message.
+   */
   SnepMessage(uint8_t aVersion,
               uint8_t aField,
               int aLength,
@@ -72,6 +77,8 @@ private:
   static const int HEADER_LENGTH = 6;
 
   NdefMessage* mNdefMessage;
+  // False if mNdefMessage belongs to the caller.
+  bool mOwnsNdefMessage;
   uint8_t mVersion;
   uint8_t mField;
   uint32_t mLength;
@@ -40,7 +40,17 @@ SnepMessenger::~SnepMessenger()
   Close();
 }
 
-void SnepMessenger::SendMessage(SnepMessage& aMsg)
+uint32_t SnepMessenger::GetFragmentLength(ILlcpSocket* aSocket, int aFragmentLength)
+{
+  int miu = aSocket->GetRemoteMiu();
+  if (miu <= 0) {
+    NFCD_ERROR("unknown remote MIU, use %d", LLCP_DEFAULT_MIU);
+    miu = LLCP_DEFAULT_MIU;
+  }
+  return (aFragmentLength == -1 || miu < aFragmentLength) ? miu : aFragmentLength;
+}
+
+bool SnepMessenger::SendMessage(SnepMessage& aMsg)
 {
   NFCD_DEBUG("enter");
 
@@ -53,56 +63,73 @@ void SnepMessenger::SendMessage(SnepMessage& aMsg)
 
   std::vector<uint8_t> buf;
   aMsg.ToByteArray(buf);
-  uint32_t length = -1;
 
-  if (buf.size() <  mFragmentLength) {
-    length = buf.size();
-    mSocket->Send(buf);
-  } else {
-    length = mFragmentLength;
-    std::vector<uint8_t> tmpBuf;
-    for (uint32_t i = 0; i < mFragmentLength; i++) {
-      tmpBuf.push_back(buf[i]);
-    }
-    mSocket->Send(tmpBuf);
+  // Fragments are sent straight from the serialized message.
+  uint32_t length = buf.size() < mFragmentLength ? buf.size() : mFragmentLength;
+  if (!mSocket->Send(&buf[0], length)) {
+    NFCD_ERROR("send failed");
+    return false;
   }
 
   if (length == buf.size()) {
     NFCD_DEBUG("exit");
-    return;
+    return true;
   }
 
   // Fragmented SNEP message handling.
   // Look for Continue or Reject from peer.
   uint32_t offset = length;
-  std::vector<uint8_t> responseBytes;
-  mSocket->Receive(responseBytes);
+  std::vector<uint8_t> responseBytes(HEADER_LENGTH);
+  int size = ReceiveHeader(&responseBytes[0], responseBytes.size());
+  if (size < 0) {
+    NFCD_ERROR("connection broken");
+    return false;
+  }
+  responseBytes.resize(size);
 
   SnepMessage* snepResponse = SnepMessage::FromByteArray(responseBytes);
   if (!snepResponse) {
     NFCD_ERROR("invalid SNEP message");
-    return;
+    return false;
   }
 
   if (snepResponse->GetField() != remoteContinue) {
     NFCD_ERROR("invalid response from server (%d)", snepResponse->GetField());
     delete snepResponse;
-    return;
+    return false;
+  }
+  delete snepResponse;
+
+  /**
+   * Send remaining fragments without waiting for the peer in between.
+   * Send() only blocks once the remote receive window is full, so up to
+   * RW fragments are in flight and the transfer is not round-trip bound.
+   */
+  if (mFragmentLength >= static_cast<uint32_t>(mSocket->GetRemoteMiu())) {
+    // Fragments as large as the MIU, let the socket split the rest.
+    struct iovec iov;
+    iov.iov_base = &buf[offset];
+    iov.iov_len = buf.size() - offset;
+    if (!mSocket->Send(&iov, 1)) {
+      NFCD_ERROR("send failed after offset %u", offset);
+      return false;
+    }
+
+    NFCD_DEBUG("exit");
+    return true;
   }
 
-  // Send remaining fragments.
   while (offset < buf.size()) {
-    std::vector<uint8_t> tmpBuf;
     length = buf.size() - offset < mFragmentLength ? buf.size() - offset : mFragmentLength;
-    // TODO : Need check here
-    for (uint32_t i = offset; i < offset + length; i++) {
-      tmpBuf.push_back(buf[i]);
+    if (!mSocket->Send(&buf[offset], length)) {
+      NFCD_ERROR("send failed at offset %u", offset);
+      return false;
     }
-    mSocket->Send(tmpBuf);
     offset += length;
   }
 
   NFCD_DEBUG("exit");
+  return true;
 }
 
 /**
@@ -112,8 +139,9 @@ SnepMessage* SnepMessenger::GetMessage()
 {
   NFCD_DEBUG("enter");
 
-  std::vector<uint8_t> partial;
-  std::vector<uint8_t> buffer;
+  // Large enough for any fragment the peer may send.
+  int miu = mSocket->GetLocalMiu();
+  std::vector<uint8_t> buffer(miu > HEADER_LENGTH ? miu : HEADER_LENGTH);
 
   uint8_t fieldContinue = 0;
   uint8_t fieldReject = 0;
@@ -144,24 +172,21 @@ SnepMessage* SnepMessenger::GetMessage()
     fieldReject = SnepMessage::RESPONSE_REJECT;
   }
 
-  uint32_t readSize = 0;
-  int size = mSocket->Receive(partial);
-  if (size < 0 || size < HEADER_LENGTH) {
-    if (!SocketSend(fieldReject)) {
-      NFCD_ERROR("snep message send fail");
-      return NULL;
-    }
-  } else {
-    readSize = size - HEADER_LENGTH;
-    buffer.insert(buffer.end(), partial.begin(), partial.end());
+  // SDU boundaries are not relied upon: the peer sends nothing past the
+  // first fragment before CONTINUE, so whatever is read here belongs to
+  // it, and the remaining bytes are read with the other fragments.
+  int size = ReceiveHeader(&buffer[0], buffer.size());
+  if (size < 0) {
+    NFCD_ERROR("connection broken");
+    return NULL;
   }
 
-  const uint8_t requestVersion = partial[0];
-  const uint8_t requestField = partial[1];
-  const uint32_t requestSize = ((uint32_t)partial[2] << 24) |
-                               ((uint32_t)partial[3] << 16) |
-                               ((uint32_t)partial[4] <<  8) |
-                               ((uint32_t)partial[5]);
+  const uint8_t requestVersion = buffer[0];
+  const uint8_t requestField = buffer[1];
+  const uint32_t requestSize = ((uint32_t)buffer[2] << 24) |
+                               ((uint32_t)buffer[3] << 16) |
+                               ((uint32_t)buffer[4] <<  8) |
+                               ((uint32_t)buffer[5]);
 
   if (((requestVersion & 0xF0) >> 4) != SnepMessage::VERSION_MAJOR) {
     // Invalid protocol version; treat message as complete.
@@ -170,33 +195,31 @@ SnepMessage* SnepMessenger::GetMessage()
     return new SnepMessage(requestVersion, requestField, 0, 0, NULL);
   }
 
-  bool doneReading = false;
+  uint32_t readSize = size - HEADER_LENGTH;
   if (requestSize > readSize) {
+    if (requestSize > MAX_MESSAGE_LENGTH) {
+      NFCD_ERROR("message of %u bytes is too long", requestSize);
+      SocketSend(fieldReject);
+      return NULL;
+    }
     if (!SocketSend(fieldContinue)) {
       NFCD_ERROR("snep message send fail");
       return NULL;
     }
-  } else {
-    doneReading = true;
   }
 
   // Fragmented SNEP message handling.
-  // Remaining fragments.
-  while (!doneReading) {
-    partial.clear();
-    size = mSocket->Receive(partial);
+  // The announced length is bounded above, so size the buffer once and
+  // receive the remaining fragments in place.
+  buffer.resize(HEADER_LENGTH + requestSize);
+  while (readSize < requestSize) {
+    size = mSocket->Receive(&buffer[HEADER_LENGTH + readSize],
+                            requestSize - readSize);
     if (size < 0) {
-      if (!SocketSend(fieldReject)) {
-        NFCD_ERROR("snep message send fail");
-        return NULL;
-      }
-    } else {
-      readSize += size;
-      buffer.insert(buffer.end(), partial.begin(), partial.end());
-      if (readSize == requestSize) {
-        doneReading = true;
-      }
+      NFCD_ERROR("connection broken");
+      return NULL;
     }
+    readSize += size;
   }
 
   SnepMessage* snep = SnepMessage::FromByteArray(buffer);
@@ -216,13 +239,30 @@ void SnepMessenger::Close()
   }
 }
 
+/**
+ * Receive at least a SNEP header. Receive() does not preserve SDU
+ * boundaries, so the header is not assumed to arrive in one piece.
+ */
+int SnepMessenger::ReceiveHeader(uint8_t* aBuf, uint32_t aLength)
+{
+  int readSize = 0;
+  while (readSize < HEADER_LENGTH) {
+    int size = mSocket->Receive(aBuf + readSize, aLength - readSize);
+    if (size < 0) {
+      return -1;
+    }
+    readSize += size;
+  }
+  return readSize;
+}
+
 bool SnepMessenger::SocketSend(uint8_t aField)
 {
   bool status = false;
   std::vector<uint8_t> data;
   SnepMessage* msg = SnepMessage::GetMessage(aField);
   msg->ToByteArray(data);
-  status = mSocket->Send(data);
+  status = mSocket->Send(&data[0], data.size());
   delete msg;
   return status;
 }
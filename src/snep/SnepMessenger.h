@@ -32,15 +32,30 @@ public:
   uint32_t mFragmentLength;
   bool mIsClient;
 
-  void SendMessage(SnepMessage& aMsg);
+  bool SendMessage(SnepMessage& aMsg);
   SnepMessage* GetMessage();
   void Close();
   static SnepMessage* GetPutRequest(NdefMessage& aNdef);
 
+  /**
+   * Fragment length to use on a connected socket.
+   *
+   * @param  aSocket         Connected LLCP socket.
+   * @param  aFragmentLength Preferred fragment length, -1 for no preference.
+   * @return                 The remote MIU, bounded by aFragmentLength.
+   */
+  static uint32_t GetFragmentLength(ILlcpSocket* aSocket, int aFragmentLength);
+
 private:
   static const int HEADER_LENGTH = 6;
+  // Largest message accepted, longer ones are rejected. Matches the
+  // payload limit of the NDEF parser.
+  static const uint32_t MAX_MESSAGE_LENGTH = 10 * (1 << 20);
+  // MIU of a peer that did not announce one, from the LLCP specification.
+  static const int LLCP_DEFAULT_MIU = 128;
 
   bool SocketSend(uint8_t aField);
+  int ReceiveHeader(uint8_t* aBuf, uint32_t aLength);
 };
 
 #endif
@@ -19,10 +19,11 @@
 #include <stdlib.h>
 
 #include "NfcService.h"
-#include "NfcManager.h"
+#include "INfcManager.h"
 #include "SnepServer.h"
 #include "ISnepCallback.h"
 #include "NfcDebug.h"
+#include "WorkerPool.h"
 
 // Well-known LLCP SAP Values defined by NFC forum.
 const char* SnepServer::DEFAULT_SERVICE_NAME = "urn:nfc:sn:snep";
@@ -77,9 +78,8 @@ SnepConnectionThread::~SnepConnectionThread()
 
 void SnepConnectionThread::Run()
 {
-  pthread_t tid;
-  if (pthread_create(&tid, NULL, SnepConnectionThreadFunc, this) != 0) {
-    NFCD_ERROR("pthread_create fail");
+  if (!WorkerPool::GetInstance().Post(SnepConnectionThreadFunc, this)) {
+    NFCD_ERROR("cannot run connection");
     abort();
   }
 }
@@ -89,49 +89,51 @@ bool SnepConnectionThread::IsServerRunning() const
   return mServer->mServerRunning;
 }
 
+// Argument of an accept loop. The socket is the one it was started with,
+// mServerSocket may already belong to a restarted server.
+struct SnepAcceptLoop {
+  SnepServer* server;
+  ILlcpServerSocket* socket;
+};
+
 /**
- * Server thread, used to listen for incoming connection request.
+ * Server thread, used to listen for incoming connection request. It runs
+ * outside the worker pool, so an accept loop never keeps a connection
+ * waiting for a worker.
  */
 void* SnepServerThreadFunc(void* aArg)
 {
-  SnepServer* pSnepServer = reinterpret_cast<SnepServer*>(aArg);
-  if (!pSnepServer) {
+  SnepAcceptLoop* loop = reinterpret_cast<SnepAcceptLoop*>(aArg);
+  if (!loop) {
     NFCD_ERROR("invalid parameter");
     return NULL;
   }
 
-  ILlcpServerSocket* serverSocket = pSnepServer->mServerSocket;
+  SnepServer* pSnepServer = loop->server;
+  ILlcpServerSocket* serverSocket = loop->socket;
+  delete loop;
+
   ISnepCallback* ICallback = pSnepServer->mCallback;
   const int fragmentLength = pSnepServer->mFragmentLength;
 
-  if (!serverSocket) {
-    NFCD_ERROR("no server socket");
-    return NULL;
-  }
-
-  while (pSnepServer->mServerRunning) {
-    if (!serverSocket) {
-      NFCD_DEBUG("server socket shut down");
-      return NULL;
-    }
-
+  do {
     ILlcpSocket* communicationSocket = serverSocket->Accept();
 
     if (communicationSocket) {
-      const int miu = communicationSocket->GetRemoteMiu();
-      const int length = (fragmentLength == -1) ? miu : miu < fragmentLength ? miu : fragmentLength;
+      // Fragments are as large as the MIU the client announced.
+      const uint32_t length =
+        SnepMessenger::GetFragmentLength(communicationSocket, fragmentLength);
 
       SnepConnectionThread* pConnectionThread =
           new SnepConnectionThread(pSnepServer, communicationSocket, length, ICallback);
       pConnectionThread->Run();
     }
-  }
+  } while (pSnepServer->IsAccepting(serverSocket));
 
-  if (serverSocket) {
-    serverSocket->Close();
-    delete serverSocket;
-  }
+  // Closed by Stop().
+  delete serverSocket;
 
+  NFCD_DEBUG("server socket shut down");
   return NULL;
 }
 
@@ -144,7 +146,9 @@ SnepServer::SnepServer(ISnepCallback* aICallback)
  , mFragmentLength(-1)
  , mMiu(DEFAULT_MIU)
  , mRwSize(DEFAULT_RW_SIZE)
+ , mHasAcceptThread(false)
 {
+  pthread_mutex_init(&mMutex, NULL);
 }
 
 SnepServer::SnepServer(const char* aServiceName,
@@ -158,7 +162,9 @@ SnepServer::SnepServer(const char* aServiceName,
  , mFragmentLength(-1)
  , mMiu(DEFAULT_MIU)
  , mRwSize(DEFAULT_RW_SIZE)
+ , mHasAcceptThread(false)
 {
+  pthread_mutex_init(&mMutex, NULL);
 }
 
 SnepServer::SnepServer(ISnepCallback* aICallback,
@@ -172,7 +178,9 @@ SnepServer::SnepServer(ISnepCallback* aICallback,
  , mFragmentLength(-1)
  , mMiu(aMiu)
  , mRwSize(aRwSize)
+ , mHasAcceptThread(false)
 {
+  pthread_mutex_init(&mMutex, NULL);
 }
 
 SnepServer::SnepServer(const char* aServiceName,
@@ -187,12 +195,17 @@ SnepServer::SnepServer(const char* aServiceName,
  , mFragmentLength(aFragmentLength)
  , mMiu(DEFAULT_MIU)
  , mRwSize(DEFAULT_RW_SIZE)
+ , mHasAcceptThread(false)
 {
+  pthread_mutex_init(&mMutex, NULL);
 }
 
 SnepServer::~SnepServer()
 {
   Stop();
+  // The accept loop uses the mutex until it exits.
+  JoinAcceptThread();
+  pthread_mutex_destroy(&mMutex);
 }
 
 void SnepServer::Start()
@@ -200,30 +213,70 @@ void SnepServer::Start()
   NFCD_DEBUG("enter");
 
   INfcManager* pINfcManager = NfcService::GetNfcManager();
-  mServerSocket = pINfcManager->CreateLlcpServerSocket(mServiceSap, mServiceName, mMiu, mRwSize, 1024);
+  ILlcpServerSocket* serverSocket =
+    pINfcManager->CreateLlcpServerSocket(mServiceSap, mServiceName, mMiu, mRwSize, 1024);
 
-  if (!mServerSocket) {
+  if (!serverSocket) {
     NFCD_ERROR("cannot create llcp server socket");
     abort();
   }
 
-  pthread_t tid;
-  if (pthread_create(&tid, NULL, SnepServerThreadFunc, this) != 0)
-  {
+  Start(serverSocket);
+
+  NFCD_DEBUG("exit");
+}
+
+void SnepServer::Start(ILlcpServerSocket* aServerSocket)
+{
+  // A restart reaps the previous accept loop first.
+  Stop();
+  JoinAcceptThread();
+
+  pthread_mutex_lock(&mMutex);
+  mServerSocket = aServerSocket;
+  // Set before the accept loop starts, it stops as soon as this is false.
+  mServerRunning = true;
+  pthread_mutex_unlock(&mMutex);
+
+  SnepAcceptLoop* loop = new SnepAcceptLoop;
+  loop->server = this;
+  loop->socket = aServerSocket;
+  if (pthread_create(&mAcceptThread, NULL, SnepServerThreadFunc, loop) != 0) {
     NFCD_ERROR("pthread_create failed");
     abort();
   }
-  mServerRunning = true;
+  mHasAcceptThread = true;
+}
 
-  NFCD_DEBUG("exit");
+void SnepServer::JoinAcceptThread()
+{
+  if (mHasAcceptThread) {
+    pthread_join(mAcceptThread, NULL);
+    mHasAcceptThread = false;
+  }
 }
 
 void SnepServer::Stop()
 {
+  pthread_mutex_lock(&mMutex);
+  ILlcpServerSocket* serverSocket = mServerSocket;
   mServerSocket = NULL;
   mServerRunning = false;
 
-  // Use pthread_join here to make sure all thread is finished ?
+  // Wake up Accept(), the accept loop then exits and deletes the socket.
+  if (serverSocket) {
+    serverSocket->Close();
+  }
+  pthread_mutex_unlock(&mMutex);
+}
+
+bool SnepServer::IsAccepting(ILlcpServerSocket* aServerSocket)
+{
+  pthread_mutex_lock(&mMutex);
+  // A restarted server has a new socket, the old loop must still exit.
+  bool accepting = mServerRunning && mServerSocket == aServerSocket;
+  pthread_mutex_unlock(&mMutex);
+  return accepting;
 }
 
 bool SnepServer::HandleRequest(SnepMessenger* aMessenger,
@@ -273,14 +326,15 @@ bool SnepServer::HandleRequest(SnepMessenger* aMessenger,
     response = SnepMessage::GetMessage(SnepMessage::RESPONSE_BAD_REQUEST);
   }
 
-  delete request;
-  if (response) {
-    aMessenger->SendMessage(*response);
-    delete response;
-  } else {
+  if (!response) {
     NFCD_ERROR("no response message is generated");
+    delete request;
     return false;
   }
 
-  return true;
+  // The response may reference the request's NDEF, so send it first.
+  bool sent = aMessenger->SendMessage(*response);
+  delete response;
+  delete request;
+  return sent;
 }
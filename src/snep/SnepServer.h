@@ -17,6 +17,7 @@
 #ifndef mozilla_nfcd_SnepServer_h
 #define mozilla_nfcd_SnepServer_h
 
+#include <pthread.h>
 #include "SnepMessenger.h"
 
 class ILlcpServerSocket;
@@ -37,14 +38,35 @@ public:
              ISnepCallback* aCallback);
   ~SnepServer();
 
-  static const int DEFAULT_MIU = 248;
-  static const int DEFAULT_RW_SIZE = 1;
+  // Same as the link MIU, so peers can send fragments of up to 1980 bytes.
+  static const int DEFAULT_MIU = 1980;
+  // Receive window, lets the peer keep several fragments in flight.
+  static const int DEFAULT_RW_SIZE = 4;
   static const int DEFAULT_PORT = 4;
   static const char* DEFAULT_SERVICE_NAME;
 
   void Start();
+
+  /**
+   * Start serving connections accepted on a server socket created by the
+   * caller, instead of one created by the NFC manager.
+   *
+   * @param  aServerSocket Server socket, owned by the server from now on.
+   * @return               None.
+   */
+  void Start(ILlcpServerSocket* aServerSocket);
   void Stop();
 
+  /**
+   * Whether the accept loop of a server socket should go on. Stop() closes
+   * the socket under the same lock, so the loop cannot delete the socket
+   * while it is being closed.
+   *
+   * @param  aServerSocket Socket the accept loop was started with.
+   * @return               False once the server is stopped.
+   */
+  bool IsAccepting(ILlcpServerSocket* aServerSocket);
+
   static bool HandleRequest(SnepMessenger* aMessenger,
                             ISnepCallback* aCallback);
 
@@ -56,6 +78,15 @@ public:
   int                mFragmentLength;
   int                mMiu;
   int                mRwSize;
+
+private:
+  void JoinAcceptThread();
+
+  // Guards mServerSocket against the accept loop.
+  pthread_mutex_t    mMutex;
+  // Accept loop of the last Start(), joined on restart and destruction.
+  pthread_t          mAcceptThread;
+  bool               mHasAcceptThread;
 };
 
 class SnepConnectionThread {